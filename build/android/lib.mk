@@ -14,8 +14,11 @@ LOCAL_SRC_FILES := \
 			$(SRC_DIR)/IOStream.c \
 			$(SRC_DIR)/Prefs.c \
 			$(SRC_DIR)/PrefsBackend.c \
+			$(SRC_DIR)/PrefsIndex.c \
+			$(SRC_DIR)/PrefsArena.c \
 			$(SRC_DIR)/Utils.c \
 			$(SRC_DIR)/FileStream.c \
+			$(SRC_DIR)/MemoryStream.c \
 			$(SRC_DIR)/LogPriv.c \
 			$(SRC_DIR)/Timer.c \
 			$(SRC_DIR)/ErrorPriv.c \
@@ -9,6 +9,7 @@ LOCAL_C_INCLUDES += \
 LOCAL_SRC_FILES := \
 			$(SRC_DIR)/Tests.c \
 			$(SRC_DIR)/TestArray.c \
+			$(SRC_DIR)/TestMemoryStream.c \
 			$(SRC_DIR)/TestBuffer.c \
 			$(SRC_DIR)/TestCBuffer.c \
 			$(SRC_DIR)/TestConcurrency.c \
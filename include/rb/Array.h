@@ -31,6 +31,26 @@ typedef void* Rb_ArrayHandle;
  */
 Rb_ArrayHandle Rb_Array_new();
 
+/**
+ * Creates new array in concurrent append mode. Rb_Array_append is lock-free on such an array: each writer reserves
+ * its range with an atomic add and copies into fixed chunks which never move. The chunks are copied into one
+ * contiguous buffer by Rb_Array_consolidate (or implicitly by any other call except Rb_Array_size), after which the
+ * array behaves like a regular one.
+ *
+ * @param[in] chunkSize Size of the first chunk in bytes, each following chunk is twice as large.
+ * @return Array handle on success, NULL otherwise.
+ */
+Rb_ArrayHandle Rb_Array_newConcurrent(uint32_t chunkSize);
+
+/**
+ * Creates new array taking ownership of an existing buffer. The write position is set to the end of the data.
+ *
+ * @param[in] data Buffer allocated with malloc (or RB_MALLOC), freed by the array.
+ * @param[in] size Buffer size.
+ * @return Array handle on success, NULL otherwise.
+ */
+Rb_ArrayHandle Rb_Array_adopt(void* data, uint32_t size);
+
 /**
  * Frees existing array.
  *
@@ -40,15 +60,17 @@ Rb_ArrayHandle Rb_Array_new();
 int32_t Rb_Array_free(Rb_ArrayHandle* handle);
 
 /**
- * Acquires a pointer to the arrays data.
+ * Acquires a pointer to the arrays data. The pointer is invalidated by writes which grow the array.
  *
  * @param[in] handle Valid array handle.
- * @return Pointer to the arrays data on success, NULL otherwise.
+ * @return Pointer to the arrays data on success (may be NULL if the array was detached and is still empty),
+ *         NULL otherwise.
  */
 uint8_t* Rb_Array_data(Rb_ArrayHandle handle);
 
 /**
- * Acquires array data size.
+ * Acquires array data size (the highest write position reached, or the space reserved by appends if the array is
+ * in concurrent append mode).
  *
  * @param[in] handle Valid array handle.
  * @return Array data size on success, negative value otherwise.
@@ -64,7 +86,8 @@ uint32_t Rb_Array_size(Rb_ArrayHandle handle);
 int32_t Rb_Array_tell(Rb_ArrayHandle handle);
 
 /**
- * Seeks to a new write position.
+ * Seeks to a new write position. The position may be past the end of the data, in which case the gap is zero
+ * filled by the next write.
  *
  * @param[in] handle Valid array handle.
  * @param[in] pos Write position in bytes.
@@ -77,10 +100,91 @@ int32_t Rb_Array_seek(Rb_ArrayHandle handle, uint32_t pos);
  * @param[in] handle Valid array handle.
  * @param[in] ptr Data pointer.
  * @param[in] size Data size.
- * @return RB_OK on success, negative value otherwijse.
+ * @return Number of bytes written on success, negative value otherwise.
  */
 int32_t Rb_Array_write(Rb_ArrayHandle handle, const void* ptr, uint32_t size);
 
+/**
+ * Appends data to the end of the array, independently of the write position. Can be called from multiple threads,
+ * without locking if the array is in concurrent append mode. A failed concurrent append doesn't affect the others, its
+ * range is left zero filled (or isn't reserved at all if the array would exceed its maximum size).
+ *
+ * @param[in] handle Valid array handle.
+ * @param[in] ptr Data pointer.
+ * @param[in] size Data size.
+ * @return Offset at which the data was stored on success, negative value otherwise.
+ */
+int32_t Rb_Array_append(Rb_ArrayHandle handle, const void* ptr, uint32_t size);
+
+/**
+ * Copies the data appended to a concurrent array into one contiguous buffer and switches the array to regular mode.
+ * Waits for appends which already reserved their range; no new appends may start until the call returns
+ * (e.g. call it after joining the writer threads). Does nothing for regular arrays.
+ *
+ * @param[in] handle Valid array handle.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Array_consolidate(Rb_ArrayHandle handle);
+
+/**
+ * Copies data from the given offset, independently of the write position.
+ *
+ * @param[in] handle Valid array handle.
+ * @param[in] offset Offset in bytes.
+ * @param[out] data Destination buffer.
+ * @param[in] size Number of bytes to copy.
+ * @return Number of bytes copied (less than size if the end of the data was reached), negative value on error.
+ */
+int32_t Rb_Array_read(Rb_ArrayHandle handle, uint32_t offset, void* data, uint32_t size);
+
+/**
+ * Acquires a pointer to a range of the data, without copying it. The pointer is invalidated by writes which grow the
+ * array.
+ *
+ * @param[in] handle Valid array handle.
+ * @param[in] offset Offset of the range in bytes.
+ * @param[in] size Size of the range in bytes, the range has to be within the data.
+ * @param[out] data Pointer to the range.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Array_slice(Rb_ArrayHandle handle, uint32_t offset, uint32_t size, const uint8_t** data);
+
+/**
+ * Transfers the ownership of the buffer to the caller and resets the array to empty.
+ *
+ * @param[in] handle Valid array handle.
+ * @param[out] data Array buffer, should be freed by the caller (with free or RB_FREE).
+ * @param[out] size Size of the data in the buffer.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Array_detach(Rb_ArrayHandle handle, uint8_t** data, uint32_t* size);
+
+/**
+ * Acquires the number of bytes the array can hold before its buffer is reallocated.
+ *
+ * @param[in] handle Valid array handle.
+ * @return Array capacity on success, negative value otherwise.
+ */
+uint32_t Rb_Array_capacity(Rb_ArrayHandle handle);
+
+/**
+ * Makes sure the array can hold at least the given number of bytes without reallocating. Pointers acquired with
+ * Rb_Array_data are invalidated if the buffer is reallocated.
+ *
+ * @param[in] handle Valid array handle.
+ * @param[in] capacity Capacity in bytes.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Array_reserve(Rb_ArrayHandle handle, uint32_t capacity);
+
+/**
+ * Releases the unused capacity of the array. Pointers acquired with Rb_Array_data are invalidated.
+ *
+ * @param[in] handle Valid array handle.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Array_shrinkToFit(Rb_ArrayHandle handle);
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,6 +21,10 @@ typedef enum {
     eRB_IO_MODE_READ,
     eRB_IO_MODE_WRITE,
     eRB_IO_MODE_READ_WRITE,
+    /**
+     * Write only, every write goes to the end of the stream (existing data is kept).
+     */
+    eRB_IO_MODE_APPEND,
 } Rb_IOMode;
 
 typedef void* Rb_IOStreamHandle;
@@ -31,7 +35,12 @@ typedef int32_t (*Rb_IOTellFnc)(Rb_IOStreamHandle handle);
 typedef int32_t (*Rb_IOSeekFnc)(Rb_IOStreamHandle handle, uint32_t position);
 typedef int32_t (*Rb_IOOpenFnc)(const char* uri, Rb_IOMode mode, Rb_IOStreamHandle* handle);
 typedef int32_t (*Rb_IOCloseFnc)(Rb_IOStreamHandle* handle);
+typedef int32_t (*Rb_IOFlushFnc)(Rb_IOStreamHandle handle);
 
+/**
+ * Stream functions. Streams implemented outside the library have to zero-initialize it (e.g. with memset), so optional
+ * fields added in later versions are NULL.
+ */
 typedef struct {
     Rb_IOReadFnc read;
     Rb_IOWriteFnc write;
@@ -39,6 +48,10 @@ typedef struct {
     Rb_IOCloseFnc close;
     Rb_IOTellFnc tell;
     Rb_IOSeekFnc seek;
+    /**
+     * Pushes buffered writes to the underlying storage. Optional, NULL if the stream doesn't buffer. Added in 1.3.0.
+     */
+    Rb_IOFlushFnc flush;
 } Rb_IOApi;
 
 typedef struct {
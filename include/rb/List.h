@@ -9,6 +9,15 @@
 
 #include <stdint.h>
 
+/*******************************************************/
+/*              Defines                                */
+/*******************************************************/
+
+/**
+ * Minimum number of elements for which Rb_List_sortParallel uses more than one thread.
+ */
+#define RB_LIST_PARALLEL_SORT_THRESHOLD ( 65536 )
+
 /*******************************************************/
 /*              Typedefs                               */
 /*******************************************************/
@@ -22,10 +31,94 @@ typedef enum {
     eRB_SORT_DESCEND
 } Rb_SortMode;
 
+typedef enum {
+    /**
+     * Doubly linked list of nodes. Insertion and removal don't move other elements, but indexed access is O(n).
+     */
+    eRB_LIST_TYPE_LINKED,
+
+    /**
+     * Contiguous array which stores the elements inline. Indexed access is O(1) and iteration is cache friendly,
+     * insertion and removal move the elements which follow.
+     */
+    eRB_LIST_TYPE_ARRAY
+} Rb_ListType;
+
 typedef void* Rb_ListHandle;
 
 typedef int32_t (*Rb_List_compareFnc)(Rb_ListHandle handle, void* elem1, void* elem2);
 
+typedef enum {
+    /**
+     * All operations are serialized by a single mutex.
+     */
+    eRB_LIST_LOCKING_MUTEX,
+
+    /**
+     * Operations which only read the list (get, getSize, indexOf, findIf and cursors) take a shared lock and run
+     * concurrently, operations modifying it (including forEach, which allows in-place modification) take an exclusive
+     * one. Suited for read-mostly lists accessed by many threads.
+     */
+    eRB_LIST_LOCKING_READ_WRITE
+} Rb_ListLocking;
+
+typedef struct {
+    /**
+     * Storage used by the list.
+     */
+    Rb_ListType type;
+
+    /**
+     * Synchronization used by the list.
+     */
+    Rb_ListLocking locking;
+
+    /**
+     * If set the list is kept sorted by this comparator (see Rb_List_sort): Rb_List_add inserts elements at their
+     * position, and Rb_List_search and Rb_List_lowerBound become available, while Rb_List_insert, Rb_List_swap and
+     * Rb_List_sort are rejected. Requires eRB_LIST_TYPE_ARRAY.
+     */
+    Rb_List_compareFnc compareFnc;
+
+    /**
+     * Number of elements to reserve space for (used only by eRB_LIST_TYPE_ARRAY lists, may be zero).
+     */
+    uint32_t capacity;
+} Rb_ListConfig;
+
+
+/**
+ * Callback invoked by Rb_List_forEach for each element.
+ *
+ * @param[in] handle List handle.
+ * @param[in] index Element index.
+ * @param[in] element Pointer to the element stored in the list (may be modified in place, valid only during the call).
+ * @param[in] arg User argument passed to Rb_List_forEach.
+ * @return RB_OK to continue the iteration, any other value stops it.
+ */
+typedef int32_t (*Rb_List_forEachFnc)(Rb_ListHandle handle, int32_t index, void* element, void* arg);
+
+/**
+ * Predicate used by Rb_List_findIf.
+ *
+ * @param[in] handle List handle.
+ * @param[in] element Pointer to the element stored in the list (valid only during the call).
+ * @param[in] arg User argument passed to Rb_List_findIf.
+ * @return RB_TRUE if the element matches, RB_FALSE otherwise.
+ */
+typedef int32_t (*Rb_List_predicateFnc)(Rb_ListHandle handle, const void* element, void* arg);
+
+/**
+ * List cursor, holds a position in the list so advancing to the next element is O(1). Any modification of the
+ * list invalidates the cursor. Fields are private and should be initialized with Rb_List_begin.
+ */
+typedef struct {
+    Rb_ListHandle handle;
+    void* node;
+    int32_t index;
+    uint32_t modCount;
+} Rb_ListCursor;
+
 /*******************************************************/
 /*              Functions Declarations                 */
 /*******************************************************/
@@ -38,6 +131,23 @@ typedef int32_t (*Rb_List_compareFnc)(Rb_ListHandle handle, void* elem1, void* e
  */
 Rb_ListHandle Rb_List_new(uint32_t elementSize);
 
+/**
+ * Creates new list with a specific configuration.
+ *
+ * @param[in] elementSize Size of the individual list element.
+ * @param[in] config List configuration (see Rb_List_getDefaultConfig).
+ * @return Valid list handle if successful, NULL otherwise.
+ */
+Rb_ListHandle Rb_List_newWithConfig(uint32_t elementSize, const Rb_ListConfig* config);
+
+/**
+ * Acquires the default list configuration (as used by Rb_List_new).
+ *
+ * @param[out] config Configuration to be filled.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_List_getDefaultConfig(Rb_ListConfig* config);
+
 /**
  * Frees existing list.
  *
@@ -47,7 +157,7 @@ Rb_ListHandle Rb_List_new(uint32_t elementSize);
 int32_t Rb_List_free(Rb_ListHandle* handle);
 
 /**
- * Adds a new element to the end of the list.
+ * Adds a new element to the end of the list, or after the last element not greater than it if the list is sorted.
  *
  * @param[in] handle Valid list handle.
  * @param[in] element Pointer to a list element.
@@ -94,6 +204,78 @@ int32_t Rb_List_indexOf(Rb_ListHandle handle, void* element);
  */
 int32_t Rb_List_insert(Rb_ListHandle handle, int32_t index, const void* element);
 
+/**
+ * Creates new list holding a copy of the given elements.
+ *
+ * @param[in] elementSize Size of the individual list element.
+ * @param[in] config List configuration, or NULL to use the default one.
+ * @param[in] elements Contiguous array of elements.
+ * @param[in] count Number of elements in the array.
+ * @return Valid list handle if successful, NULL otherwise.
+ */
+Rb_ListHandle Rb_List_fromArray(uint32_t elementSize, const Rb_ListConfig* config, const void* elements, uint32_t count);
+
+/**
+ * Makes room for a number of elements, so adding elements up to that size doesn't allocate (and can't fail).
+ *
+ * @param[in] handle Valid list handle.
+ * @param[in] capacity Number of elements.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_List_reserve(Rb_ListHandle handle, uint32_t capacity);
+
+/**
+ * Adds multiple elements to the end of the list (to their positions if the list is sorted).
+ *
+ * @param[in] handle Valid list handle.
+ * @param[in] elements Contiguous array of elements.
+ * @param[in] count Number of elements in the array.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_List_addAll(Rb_ListHandle handle, const void* elements, uint32_t count);
+
+/**
+ * Inserts multiple elements starting at the given index.
+ *
+ * @param[in] handle Valid list handle.
+ * @param[in] index Index at which the first element will be inserted.
+ * @param[in] elements Contiguous array of elements.
+ * @param[in] count Number of elements in the array.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_List_insertAll(Rb_ListHandle handle, int32_t index, const void* elements, uint32_t count);
+
+/**
+ * Removes a range of elements from the list.
+ *
+ * @param[in] handle Valid list handle.
+ * @param[in] index Index of the first element to remove.
+ * @param[in] count Number of elements to remove.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_List_removeRange(Rb_ListHandle handle, int32_t index, uint32_t count);
+
+/**
+ * Copies a range of elements into a contiguous array.
+ *
+ * @param[in] handle Valid list handle.
+ * @param[in] index Index of the first element to copy.
+ * @param[in] count Number of elements to copy.
+ * @param[out] elements Array large enough to hold count elements.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_List_getRange(Rb_ListHandle handle, int32_t index, uint32_t count, void* elements);
+
+/**
+ * Copies all the elements into a newly allocated contiguous array.
+ *
+ * @param[in] handle Valid list handle.
+ * @param[out] elements Allocated array (NULL if the list is empty), should be freed by the caller.
+ * @param[out] count Number of elements in the array.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_List_toArray(Rb_ListHandle handle, void** elements, uint32_t* count);
+
 /**
  * Gets the number of elements in the list.
  *
@@ -111,7 +293,8 @@ int32_t Rb_List_getSize(Rb_ListHandle handle);
 int32_t Rb_List_clear(Rb_ListHandle handle);
 
 /**
- * Sorts the list elements.
+ * Sorts the list elements. The sort is stable (elements which compare equal keep their relative order)
+ * and runs in O(n log n) time.
  *
  * @param[in] handle Valid list handle.
  * @param[in] compareFnc Function used to compare two elements of the list. The function should
@@ -122,6 +305,79 @@ int32_t Rb_List_clear(Rb_ListHandle handle);
  */
 int32_t Rb_List_sort(Rb_ListHandle handle, Rb_List_compareFnc compareFnc, Rb_SortMode mode);
 
+/**
+ * Sorts the list elements using multiple threads. Lists smaller than RB_LIST_PARALLEL_SORT_THRESHOLD are sorted
+ * on the calling thread. The result is the same as the one of Rb_List_sort.
+ *
+ * @param[in] handle Valid list handle.
+ * @param[in] compareFnc Function used to compare two elements of the list (see Rb_List_sort). It is called
+ *            concurrently from multiple threads, so it has to be reentrant.
+ * @param[in] mode Sorting mode. Determines the order in which the elements will be sorted
+ * @param[in] numThreads Maximum number of threads to use, or 0 to use one thread per online processor.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_List_sortParallel(Rb_ListHandle handle, Rb_List_compareFnc compareFnc, Rb_SortMode mode, uint32_t numThreads);
+
+/**
+ * Searches a sorted list in O(log n) time.
+ *
+ * @param[in] handle Valid handle of a sorted list.
+ * @param[in] element Element to search for.
+ * @return Index of the first element comparing equal to the given one if found, negative value otherwise.
+ */
+int32_t Rb_List_search(Rb_ListHandle handle, const void* element);
+
+/**
+ * Finds the position of the first element of a sorted list which is not less than the given one.
+ *
+ * @param[in] handle Valid handle of a sorted list.
+ * @param[in] element Element to compare with.
+ * @return Index of the element (equal to the list size if all elements are less), negative value otherwise.
+ */
+int32_t Rb_List_lowerBound(Rb_ListHandle handle, const void* element);
+
+/**
+ * Positions the cursor at the first element of the list.
+ *
+ * @param[in] handle Valid list handle.
+ * @param[out] cursor Cursor to be initialized.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_List_begin(Rb_ListHandle handle, Rb_ListCursor* cursor);
+
+/**
+ * Copies the element at the cursor position and advances the cursor.
+ *
+ * @param[in,out] cursor Cursor initialized with Rb_List_begin.
+ * @param[out] element Pointer to a element memory.
+ * @return RB_TRUE if an element was copied, RB_FALSE if the end of the list was reached, negative value
+ *         otherwise (e.g. if the list was modified after the cursor was initialized).
+ */
+int32_t Rb_List_next(Rb_ListCursor* cursor, void* element);
+
+/**
+ * Invokes a callback for each element of the list, in order. The list is locked only once for the whole iteration,
+ * so the callback must not modify the list through the list API.
+ *
+ * @param[in] handle Valid list handle.
+ * @param[in] fnc Callback to invoke.
+ * @param[in] arg User argument passed to the callback.
+ * @return RB_OK if all the elements were visited, value returned by the callback if it stopped the iteration,
+ *         negative value otherwise.
+ */
+int32_t Rb_List_forEach(Rb_ListHandle handle, Rb_List_forEachFnc fnc, void* arg);
+
+/**
+ * Finds the first element matching a predicate. The list is locked only once for the whole search.
+ *
+ * @param[in] handle Valid list handle.
+ * @param[in] predicate Predicate the element has to satisfy.
+ * @param[in] arg User argument passed to the predicate.
+ * @param[out] element Pointer to a element memory where the found element is copied (may be NULL).
+ * @return Index of the element if found, negative value otherwise.
+ */
+int32_t Rb_List_findIf(Rb_ListHandle handle, Rb_List_predicateFnc predicate, void* arg, void* element);
+
 /**
  * Swaps the values of two elements in the list.
  *
@@ -0,0 +1,69 @@
+#ifndef RB_MEMORYSTREAM_H_
+#define RB_MEMORYSTREAM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************/
+/*              Includes                               */
+/*******************************************************/
+
+#include <rb/IOStream.h>
+#include <rb/Array.h>
+
+/*******************************************************/
+/*              Functions Declarations                 */
+/*******************************************************/
+
+/**
+ * Acquires the memory stream API. Streams created with its open function write into a new growable buffer, which is
+ * released when the stream is closed (the uri is ignored and may be NULL).
+ *
+ * @param[out] api API to be filled.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_MemoryStream_getApi(Rb_IOApi* api);
+
+/**
+ * Opens a memory stream over an existing array. The stream starts at the beginning of the array, the array is not
+ * freed when the stream is closed.
+ *
+ * @param[in] array Valid array handle.
+ * @param[in] mode Stream mode.
+ * @param[out] handle Stream handle, to be used with the API acquired by Rb_MemoryStream_getApi.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_MemoryStream_openArray(Rb_ArrayHandle array, Rb_IOMode mode, Rb_IOStreamHandle* handle);
+
+/**
+ * Opens a read only memory stream over a caller owned buffer, without copying it. The buffer must outlive the stream.
+ *
+ * @param[in] data Buffer data.
+ * @param[in] size Buffer size.
+ * @param[out] handle Stream handle, to be used with the API acquired by Rb_MemoryStream_getApi.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_MemoryStream_openBuffer(const void* data, uint32_t size, Rb_IOStreamHandle* handle);
+
+/**
+ * Acquires a pointer to the stream data, without copying it. The pointer is invalidated by subsequent writes.
+ *
+ * @param[in] handle Valid memory stream handle.
+ * @return Pointer to the stream data on success, NULL otherwise.
+ */
+const uint8_t* Rb_MemoryStream_data(Rb_IOStreamHandle handle);
+
+/**
+ * Acquires the stream data size.
+ *
+ * @param[in] handle Valid memory stream handle.
+ * @return Stream data size on success, negative value otherwise.
+ */
+int32_t Rb_MemoryStream_size(Rb_IOStreamHandle handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
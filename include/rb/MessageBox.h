@@ -8,6 +8,7 @@
 #include "rb/Common.h"
 
 #include <stdint.h>
+#include <time.h>
 
 /********************************************************/
 /*                 Typedefs                             */
@@ -78,7 +79,29 @@ int32_t Rb_MessageBox_write(Rb_MessageBoxHandle handle, const void* message);
 int32_t Rb_MessageBox_writeTimed(Rb_MessageBoxHandle handle, const void* message, int32_t timeoutMs);
 
 /**
- * Acquires the total number of available messages
+ * Writes a single message which becomes visible to readers only once the given time is reached.
+ * Scheduled messages are kept in an internal deadline queue serviced by the readers, so no additional threads are
+ * involved. They do not count against the message box capacity until they are delivered.
+ *
+ * @param[in] handle Valid message box handle
+ * @param[in] message Message memory
+ * @param[in] time Absolute delivery time (CLOCK_REALTIME, see Rb_Utils_getOffsetTime)
+ * @return Negative value on failure, RB_OK on success
+ */
+int32_t Rb_MessageBox_writeAt(Rb_MessageBoxHandle handle, const void* message, const struct timespec* time);
+
+/**
+ * Writes a single message which becomes visible to readers after the given delay.
+ *
+ * @param[in] handle Valid message box handle
+ * @param[in] message Message memory
+ * @param[in] delayMs Delay in milliseconds after which the message is delivered.
+ * @return Negative value on failure, RB_OK on success
+ */
+int32_t Rb_MessageBox_writeAfter(Rb_MessageBoxHandle handle, const void* message, uint32_t delayMs);
+
+/**
+ * Acquires the total number of available messages (scheduled messages are counted once their delivery time is reached)
  *
  * @param[in] handle Valid message box handle
  * @return Negative value on failure, number of available messages otherwise
@@ -119,7 +142,7 @@ int32_t Rb_MessageBox_enable(Rb_MessageBoxHandle handle);
 int32_t Rb_MessageBox_resize(Rb_MessageBoxHandle handle, uint32_t capacity);
 
 /**
- * Clears the message box.
+ * Clears the message box, including any scheduled messages which were not delivered yet.
  *
  * @param[in] handle Valid message box handle
  * @return Negative value on failure, RB_OK otherwise
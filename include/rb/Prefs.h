@@ -20,15 +20,121 @@ extern "C" {
 
 typedef void* Rb_PrefsHandle;
 
+/**
+ * Key resolved with Rb_Prefs_resolveKey.
+ */
+typedef void* Rb_PrefsKeyHandle;
+
+/**
+ * Transaction started with Rb_Prefs_beginTransaction.
+ */
+typedef void* Rb_PrefsTransactionHandle;
+
+/**
+ * Called once a background save (see Rb_Prefs_saveAsync) is written, with its result.
+ */
+typedef void (*Rb_PrefsSaveCallbackFnc)(Rb_PrefsHandle handle, int32_t rc, void* userData);
+
+/**
+ * Called by Rb_Prefs_forEachPrefix for each matching key (valid only during the call). Returns RB_OK to continue the
+ * iteration, any other value stops it.
+ */
+typedef int32_t (*Rb_PrefsKeyFnc)(Rb_PrefsHandle handle, const char* key, void* userData);
+
 typedef int32_t (*Rb_PrefsBackendSaveFnc)(Rb_PrefsHandle handle, const Rb_IOStream* stream);
 
 typedef int32_t (*Rb_PrefsBackendLoadFnc)(Rb_PrefsHandle handle, const Rb_IOStream* stream);
 
+/**
+ * Appends a journal record with the current state of the key (its value, or its removal if the key is not present).
+ */
+typedef int32_t (*Rb_PrefsBackendAppendFnc)(Rb_PrefsHandle handle, const Rb_IOStream* stream, const char* key);
+
+/**
+ * Applies all the journal records read from the stream on top of the current entries.
+ */
+typedef int32_t (*Rb_PrefsBackendReplayFnc)(Rb_PrefsHandle handle, const Rb_IOStream* stream);
+
+/**
+ * Custom preferences backend. Has to be zero-initialized (e.g. with memset) before its functions are set, so optional
+ * fields added in later versions are NULL.
+ */
 typedef struct {
     Rb_PrefsBackendSaveFnc save;
     Rb_PrefsBackendLoadFnc load;
+    /**
+     * Journal hooks, optional (journal mode is not available without them). Added in 1.3.0.
+     */
+    Rb_PrefsBackendAppendFnc append;
+    Rb_PrefsBackendReplayFnc replay;
 } Rb_PrefsBackend;
 
+/**
+ * On-disk format written by the default backend. Loading detects the format on its own.
+ */
+typedef enum {
+    /**
+     * Entries written one after another, have to be parsed in full to be used.
+     */
+    eRB_PREFS_FORMAT_STREAM,
+
+    /**
+     * Entries table sorted by key followed by the data, can be used directly from memory (see Rb_Prefs_mapFile).
+     */
+    eRB_PREFS_FORMAT_INDEXED,
+
+    /**
+     * Smallest files: prefix compressed key table, varint encoded integers and lengths, CRC-32C checked on load.
+     */
+    eRB_PREFS_FORMAT_COMPACT
+} Rb_PrefsFormat;
+
+/**
+ * Thread safety of the preferences.
+ */
+typedef enum {
+    /**
+     * No synchronization, the preferences have to be used by one thread at a time.
+     */
+    eRB_PREFS_CONCURRENCY_NONE,
+
+    /**
+     * Writers are serialized by a mutex and publish an immutable snapshot of the entries when they're done, readers
+     * take no lock and always see a complete snapshot. Suited for preferences read by many threads and updated
+     * occasionally (each update copies all the entries, group them with Rb_Prefs_beginUpdate). Views
+     * (Rb_Prefs_getStringView, Rb_Prefs_getBlobView, Rb_Prefs_getKey and their *ByKey variants) and mapping are
+     * not available, values have to be copied.
+     */
+    eRB_PREFS_CONCURRENCY_SNAPSHOT
+} Rb_PrefsConcurrency;
+
+typedef struct {
+    /**
+     * Preferences backend (zero-initialized, see Rb_PrefsBackend), NULL for the default one.
+     */
+    const Rb_PrefsBackend* backend;
+
+    /**
+     * Synchronization used by the preferences.
+     */
+    Rb_PrefsConcurrency concurrency;
+
+    /**
+     * Blobs of at least this size are left in the file by Rb_Prefs_loadFile, only their position is kept and they're
+     * read from the file on access (0 loads everything into memory). Applies to files in eRB_PREFS_FORMAT_STREAM
+     * format, the file is kept open while its blobs are referenced. Not available in concurrent mode.
+     */
+    uint32_t lazyBlobSize;
+
+    /**
+     * If set, keys and values are allocated from chunks of this size instead of one by one (0 by default). Clearing,
+     * loading and freeing the preferences then only free the chunks, while the memory of removed or replaced values is
+     * kept until then, so it suits large preferences which are mostly loaded and read. Loading a file reserves the
+     * file size up front. Not available in concurrent mode.
+     */
+    uint32_t arenaChunkSize;
+} Rb_PrefsConfig;
+
 /*******************************************************/
 /*              Functions Declarations                 */
 /*******************************************************/
@@ -36,11 +142,44 @@ typedef struct {
 /**
  * Creates new preferences.
  *
- * @param[in] backend Preferences backend.
+ * @param[in] backend Preferences backend (zero-initialized, see Rb_PrefsBackend), NULL for the default one.
  * @return Valid preferences handle on success, NULL otherwise.
  */
 Rb_PrefsHandle Rb_Prefs_new(const Rb_PrefsBackend* backend);
 
+/**
+ * Creates new preferences with a specific configuration.
+ *
+ * @param[in] config Preferences configuration (see Rb_Prefs_getDefaultConfig).
+ * @return Valid preferences handle on success, NULL otherwise.
+ */
+Rb_PrefsHandle Rb_Prefs_newWithConfig(const Rb_PrefsConfig* config);
+
+/**
+ * Acquires the default preferences configuration (as used by Rb_Prefs_new).
+ *
+ * @param[out] config Configuration to be filled.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_getDefaultConfig(Rb_PrefsConfig* config);
+
+/**
+ * Starts a group of updates. In concurrent mode other writers are blocked until the matching Rb_Prefs_endUpdate,
+ * and readers see all the changes at once when it's called. Calls may be nested.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_beginUpdate(Rb_PrefsHandle handle);
+
+/**
+ * Ends a group of updates started by Rb_Prefs_beginUpdate, publishing the changes if it's the outermost one.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_endUpdate(Rb_PrefsHandle handle);
+
 /**
  * Frees created preferences.
  *
@@ -151,6 +290,83 @@ int32_t Rb_Prefs_getString(Rb_PrefsHandle handle, const char* key, char** value)
  */
 int32_t Rb_Prefs_getBlob(Rb_PrefsHandle handle, const char* key, void** data, uint32_t* size);
 
+/**
+ * Gets previously saved string value without copying it. The string is owned by the preferences, and stays valid
+ * until the entry is removed or the preferences are cleared, loaded or freed, i.e. as long as the generation
+ * (see Rb_Prefs_getGeneration) doesn't change.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Value key.
+ * @param[out] value Pointer to the string.
+ * @param[out] length Pointer to an integer where the string length (without the terminator) will be stored, may be NULL.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_getStringView(Rb_PrefsHandle handle, const char* key, const char** value, uint32_t* length);
+
+/**
+ * Gets previously saved binary data value without copying it. The data is owned by the preferences, and stays valid
+ * until the entry is removed or the preferences are cleared, loaded or freed, i.e. as long as the generation
+ * (see Rb_Prefs_getGeneration) doesn't change.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Value key.
+ * @param[out] data Pointer to the data.
+ * @param[out] size Pointer to an integer where the data size will be stored.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_getBlobView(Rb_PrefsHandle handle, const char* key, const void** data, uint32_t* size);
+
+/**
+ * Copies previously saved string value (including the terminator) into a caller provided buffer, without allocating.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Value key.
+ * @param[out] buffer Destination buffer.
+ * @param[in] bufferSize Destination buffer size, has to be larger than the string length.
+ * @return String length (without the terminator) on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_copyString(Rb_PrefsHandle handle, const char* key, char* buffer, uint32_t bufferSize);
+
+/**
+ * Copies previously saved binary data value into a caller provided buffer, without allocating.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Value key.
+ * @param[out] buffer Destination buffer.
+ * @param[in] bufferSize Destination buffer size, has to be at least the data size.
+ * @return Data size on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_copyBlob(Rb_PrefsHandle handle, const char* key, void* buffer, uint32_t bufferSize);
+
+/**
+ * Opens a stream over a binary data value, for ranged reads (seek and read) or for writing it in parts.
+ *
+ * A reading stream reads the value as it was when the stream was opened. Values in memory are not copied, the stream
+ * has to be closed before they're modified or removed (same as Rb_Prefs_getBlobView), values left in a file (see
+ * Rb_PrefsConfig::lazyBlobSize) are read from it and stay readable. Not available in concurrent mode.
+ *
+ * A writing stream starts empty, and replaces the value (or adds it) when it's closed.
+ *
+ * The stream doesn't support open, and has to be closed before the preferences are freed.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Value key.
+ * @param[in] mode eRB_IO_MODE_READ or eRB_IO_MODE_WRITE.
+ * @param[out] stream Stream to be filled.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_openBlobStream(Rb_PrefsHandle handle, const char* key, Rb_IOMode mode, Rb_IOStream* stream);
+
+/**
+ * Gets the modification counter, which changes every time an entry is added or removed, or the preferences are
+ * cleared, loaded or mapped. Views obtained at a given generation stay valid while it doesn't change.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[out] generation Current generation.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_getGeneration(Rb_PrefsHandle handle, uint32_t* generation);
+
 /**
  * Clears all saved values from the prefrences.
  *
@@ -205,6 +421,31 @@ int32_t Rb_Prefs_contains(Rb_PrefsHandle handle, const char* key);
  */
 int32_t Rb_Prefs_remove(Rb_PrefsHandle handle, const char* key);
 
+/**
+ * Visits the keys starting with given prefix in ascending (strcmp) order, e.g. prefix "net.tcp." visits the subtree
+ * of dotted keys under "net.tcp". The first prefix query sorts all the keys (O(n log n)) and they're kept sorted
+ * afterwards, so later queries cost O(log n) plus the number of matching keys. Keeping them sorted makes each put and
+ * remove which adds or removes a key O(n) from then on, as the sorted array of entry pointers is shifted. The callback
+ * must not modify the preferences.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] prefix Key prefix (empty string visits all the keys).
+ * @param[in] fnc Callback invoked for each matching key.
+ * @param[in] userData User data passed to the callback.
+ * @return RB_OK if all the keys were visited, value returned by the callback if it stopped the iteration, negative
+ *      value otherwise.
+ */
+int32_t Rb_Prefs_forEachPrefix(Rb_PrefsHandle handle, const char* prefix, Rb_PrefsKeyFnc fnc, void* userData);
+
+/**
+ * Removes all the entries whose keys start with given prefix, as a single modification.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] prefix Key prefix.
+ * @return Number of removed entries on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_removePrefix(Rb_PrefsHandle handle, const char* prefix);
+
 /**
  * Loads entries from given stream. Clears all existing entries.
  *
@@ -241,6 +482,291 @@ int32_t Rb_Prefs_loadFile(Rb_PrefsHandle handle, const char* filePath);
  */
 int32_t Rb_Prefs_saveFile(Rb_PrefsHandle handle, const char* filePath);
 
+/**
+ * Saves entries to given file location on a background thread. The entries are serialized into memory before the call
+ * returns, the file is then written to a temporary location and renamed over the destination, so it's always either
+ * the old or the new version. Requests for the same file made while a save is pending are merged into it (only the
+ * newest entries are written), and a request for another file waits until the pending one is taken over by the thread.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] filePath Destination file path.
+ * @param[in] fnc Optional callback, called from the background thread once the file is written. It must not free the
+ *      preferences, and Rb_Prefs_waitSave fails if it's called from it.
+ * @param[in] userData Callback user data.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_saveAsync(Rb_PrefsHandle handle, const char* filePath, Rb_PrefsSaveCallbackFnc fnc, void* userData);
+
+/**
+ * Waits until all the requested background saves are written and their callbacks called. Fails if called from a save
+ * callback, as the saves are written by the thread running it.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @return Result of the last background save (RB_OK if there was none), negative value if waiting failed.
+ */
+int32_t Rb_Prefs_waitSave(Rb_PrefsHandle handle);
+
+/**
+ * Enables the journal mode. Loads the snapshot from the given file, replays the journal next to it
+ * (filePath + ".journal") on top of it, and from then on appends every put and remove to the journal instead of
+ * rewriting the snapshot. Once the journal grows past the threshold, a new snapshot is written (to a temporary file
+ * renamed over the old one) and the journal starts over. Clears all existing entries.
+ *
+ * Loading or mapping other data closes the journal.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] filePath Snapshot file path (doesn't have to exist).
+ * @param[in] compactThreshold Journal size in bytes which triggers compaction.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_openJournal(Rb_PrefsHandle handle, const char* filePath, uint32_t compactThreshold);
+
+/**
+ * Writes a new snapshot and resets the journal, regardless of the journal size.
+ *
+ * @param[in] handle Valid preferences handle with an open journal.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_compact(Rb_PrefsHandle handle);
+
+/**
+ * Disables the journal mode. The snapshot and journal files are kept as they are, and are loaded by the next
+ * Rb_Prefs_openJournal call.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_closeJournal(Rb_PrefsHandle handle);
+
+/**
+ * Selects the format used when saving with the default backend (eRB_PREFS_FORMAT_STREAM by default).
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] format Output format.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_setFormat(Rb_PrefsHandle handle, Rb_PrefsFormat format);
+
+/**
+ * Maps a file saved in eRB_PREFS_FORMAT_INDEXED format into memory, and serves all lookups directly from the
+ * mapping, without parsing or copying the entries. Clears all existing entries. The preferences are read-only
+ * until they're cleared or loaded again (put and remove calls fail), and processes mapping the same file share
+ * its page cache.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] filePath Path to the file.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_mapFile(Rb_PrefsHandle handle, const char* filePath);
+
+/**
+ * Resolves a key into a handle, which can be used with the *ByKey functions to skip hashing and comparing the key on
+ * every access. The entry found is cached in the handle, and looked up again only after entries are added or
+ * removed. The key doesn't have to exist yet.
+ *
+ * @param[in] handle Valid preferences handle, the key handle can only be used with it.
+ * @param[in] key Value key (copied).
+ * @return Key handle on success, NULL otherwise. Has to be released with Rb_Prefs_releaseKey.
+ */
+Rb_PrefsKeyHandle Rb_Prefs_resolveKey(Rb_PrefsHandle handle, const char* key);
+
+/**
+ * Releases a key handle. May be called after the preferences it was resolved with are freed.
+ *
+ * @param[in] key Pointer to a valid key handle.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_releaseKey(Rb_PrefsKeyHandle* key);
+
+/**
+ * Same as Rb_Prefs_getInt32, with a resolved key.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Key handle resolved with the same preferences.
+ * @param[out] value Pointer to an integer where the result will be stored.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_getInt32ByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, int32_t* value);
+
+/**
+ * Same as Rb_Prefs_getInt64, with a resolved key.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Key handle resolved with the same preferences.
+ * @param[out] value Pointer to an integer where the result will be stored.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_getInt64ByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, int64_t* value);
+
+/**
+ * Same as Rb_Prefs_getFloat, with a resolved key.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Key handle resolved with the same preferences.
+ * @param[out] value Pointer to a float where the result will be stored.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_getFloatByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, float* value);
+
+/**
+ * Same as Rb_Prefs_getStringView, with a resolved key.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Key handle resolved with the same preferences.
+ * @param[out] value Pointer to the string.
+ * @param[out] length Pointer to an integer where the string length will be stored, may be NULL.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_getStringViewByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, const char** value, uint32_t* length);
+
+/**
+ * Same as Rb_Prefs_getBlobView, with a resolved key.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Key handle resolved with the same preferences.
+ * @param[out] data Pointer to the data.
+ * @param[out] size Pointer to an integer where the data size will be stored.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_getBlobViewByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, const void** data, uint32_t* size);
+
+/**
+ * Same as Rb_Prefs_putInt32, with a resolved key.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Key handle resolved with the same preferences.
+ * @param[in] value Value.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_putInt32ByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, int32_t value);
+
+/**
+ * Same as Rb_Prefs_putInt64, with a resolved key.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Key handle resolved with the same preferences.
+ * @param[in] value Value.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_putInt64ByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, int64_t value);
+
+/**
+ * Same as Rb_Prefs_putFloat, with a resolved key.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Key handle resolved with the same preferences.
+ * @param[in] value Value.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_putFloatByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, float value);
+
+/**
+ * Same as Rb_Prefs_putString, with a resolved key.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Key handle resolved with the same preferences.
+ * @param[in] value Value (copied).
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_putStringByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, const char* value);
+
+/**
+ * Same as Rb_Prefs_putBlob, with a resolved key.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @param[in] key Key handle resolved with the same preferences.
+ * @param[in] data Data (copied).
+ * @param[in] size Data size.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_Prefs_putBlobByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, const void* data, uint32_t size);
+
+/**
+ * Starts a transaction. Puts and removals are staged in it without touching the preferences, and applied together by
+ * Rb_PrefsTransaction_commit: in concurrent mode readers see all of them or none, the index is grown once and the
+ * journal is flushed once. Unlike Rb_Prefs_put*, staged puts replace existing values.
+ *
+ * @param[in] handle Valid preferences handle.
+ * @return Transaction handle on success, NULL otherwise. Has to be committed or aborted before the preferences are freed.
+ */
+Rb_PrefsTransactionHandle Rb_Prefs_beginTransaction(Rb_PrefsHandle handle);
+
+/**
+ * Stages an integer value.
+ *
+ * @param[in] handle Valid transaction handle.
+ * @param[in] key Value key.
+ * @param[in] value Value.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_PrefsTransaction_putInt32(Rb_PrefsTransactionHandle handle, const char* key, int32_t value);
+
+/**
+ * Stages a 64-bit integer value.
+ *
+ * @param[in] handle Valid transaction handle.
+ * @param[in] key Value key.
+ * @param[in] value Value.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_PrefsTransaction_putInt64(Rb_PrefsTransactionHandle handle, const char* key, int64_t value);
+
+/**
+ * Stages a float value.
+ *
+ * @param[in] handle Valid transaction handle.
+ * @param[in] key Value key.
+ * @param[in] value Value.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_PrefsTransaction_putFloat(Rb_PrefsTransactionHandle handle, const char* key, float value);
+
+/**
+ * Stages a string value.
+ *
+ * @param[in] handle Valid transaction handle.
+ * @param[in] key Value key.
+ * @param[in] value Value (copied).
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_PrefsTransaction_putString(Rb_PrefsTransactionHandle handle, const char* key, const char* value);
+
+/**
+ * Stages a binary data value.
+ *
+ * @param[in] handle Valid transaction handle.
+ * @param[in] key Value key.
+ * @param[in] data Data (copied).
+ * @param[in] size Data size.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_PrefsTransaction_putBlob(Rb_PrefsTransactionHandle handle, const char* key, const void* data, uint32_t size);
+
+/**
+ * Stages the removal of a value (missing keys are ignored).
+ *
+ * @param[in] handle Valid transaction handle.
+ * @param[in] key Value key.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_PrefsTransaction_remove(Rb_PrefsTransactionHandle handle, const char* key);
+
+/**
+ * Applies the staged changes in the order they were staged, and frees the transaction.
+ *
+ * @param[in,out] handle Pointer to a valid transaction handle, set to NULL.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_PrefsTransaction_commit(Rb_PrefsTransactionHandle* handle);
+
+/**
+ * Drops the staged changes, and frees the transaction.
+ *
+ * @param[in,out] handle Pointer to a valid transaction handle, set to NULL.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_PrefsTransaction_abort(Rb_PrefsTransactionHandle* handle);
+
 #ifdef __cplusplus
 }
 #endif
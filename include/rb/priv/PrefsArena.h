@@ -0,0 +1,84 @@
+#ifndef RB_PREFS_ARENA_H_
+#define RB_PREFS_ARENA_H_
+
+/*******************************************************/
+/*              Includes                               */
+/*******************************************************/
+
+#include <stdint.h>
+
+/*******************************************************/
+/*              Typedefs                               */
+/*******************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Chunk header, the chunk data follows it.
+ */
+typedef struct PrefsArenaChunk {
+    struct PrefsArenaChunk* next;
+    uint32_t size;
+    uint32_t used;
+} PrefsArenaChunk;
+
+/**
+ * Bump allocator handing out memory from large chunks. Allocations can't be freed one by one, all of them are freed
+ * at once by PrefsArena_clear.
+ */
+typedef struct {
+    /**
+     * Chunks, the one allocated from first.
+     */
+    PrefsArenaChunk* chunks;
+    /**
+     * Size of new chunks, 0 if the arena isn't used.
+     */
+    uint32_t chunkSize;
+} PrefsArena;
+
+/*******************************************************/
+/*              Functions Declarations                 */
+/*******************************************************/
+
+/**
+ * Initializes an empty arena (no chunk is allocated until needed).
+ *
+ * @param[in] arena Arena to initialize.
+ * @param[in] chunkSize Size of new chunks.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t PrefsArena_init(PrefsArena* arena, uint32_t chunkSize);
+
+/**
+ * Frees all the chunks, and with them everything allocated from the arena. The arena can be used again afterwards.
+ *
+ * @param[in] arena Initialized arena.
+ */
+void PrefsArena_clear(PrefsArena* arena);
+
+/**
+ * Makes sure the next allocations of given total size fit into the current chunk.
+ *
+ * @param[in] arena Initialized arena.
+ * @param[in] size Number of bytes.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t PrefsArena_reserve(PrefsArena* arena, uint32_t size);
+
+/**
+ * Allocates memory (8 bytes aligned, not zeroed).
+ *
+ * @param[in] arena Initialized arena.
+ * @param[in] size Number of bytes.
+ * @return Allocated memory on success, NULL otherwise.
+ */
+void* PrefsArena_alloc(PrefsArena* arena, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,6 +6,7 @@
 /*******************************************************/
 
 #include "rb/Prefs.h"
+#include "rb/priv/PrefsPriv.h"
 
 #include <stdint.h>
 
@@ -26,6 +27,58 @@ int32_t Rb_PrefsBackendSave(Rb_PrefsHandle handle, const Rb_IOStream* stream);
 
 int32_t Rb_PrefsBackendLoad(Rb_PrefsHandle handle, const Rb_IOStream* stream);
 
+int32_t Rb_PrefsBackendAppend(Rb_PrefsHandle handle, const Rb_IOStream* stream, const char* key);
+
+int32_t Rb_PrefsBackendReplay(Rb_PrefsHandle handle, const Rb_IOStream* stream);
+
+/**
+ * Validates the header of a mapped file in eRB_PREFS_FORMAT_INDEXED format.
+ *
+ * @param[in,out] mapping Mapping with data and size set, number of entries is set on success.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_PrefsBackendCheckMapping(PrefsMapping* mapping);
+
+/**
+ * Finds an entry in a mapped file. Entry key and string/blob values point into the mapping.
+ *
+ * @param[in] mapping Valid mapping.
+ * @param[in] key Entry key.
+ * @param[out] entry Found entry.
+ * @return RB_OK if found, negative value otherwise.
+ */
+int32_t Rb_PrefsBackendMappedFind(const PrefsMapping* mapping, const char* key, PrefEntry* entry);
+
+/**
+ * Gets an entry of a mapped file by its index (in the order the entries were saved in).
+ *
+ * @param[in] mapping Valid mapping.
+ * @param[in] index Entry index.
+ * @param[out] entry Entry pointing into the mapping.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_PrefsBackendMappedGet(const PrefsMapping* mapping, int32_t index, PrefEntry* entry);
+
+/**
+ * Gets an entry of a mapped file by its position in the sorted table (in ascending key order).
+ *
+ * @param[in] mapping Valid mapping.
+ * @param[in] position Position in the sorted table.
+ * @param[out] entry Entry pointing into the mapping.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_PrefsBackendMappedGetSorted(const PrefsMapping* mapping, int32_t position, PrefEntry* entry);
+
+/**
+ * Finds the position of the first entry in the sorted table whose key is not less than the given one.
+ *
+ * @param[in] mapping Valid mapping.
+ * @param[in] key Key to compare with.
+ * @param[out] position Position in the sorted table (equal to the number of entries if all keys are less).
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t Rb_PrefsBackendMappedLowerBound(const PrefsMapping* mapping, const char* key, int32_t* position);
+
 #ifdef __cplusplus
 }
 #endif
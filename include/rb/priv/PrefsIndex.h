@@ -0,0 +1,138 @@
+#ifndef RB_PREFS_INDEX_H_
+#define RB_PREFS_INDEX_H_
+
+/*******************************************************/
+/*              Includes                               */
+/*******************************************************/
+
+#include <stdint.h>
+
+/*******************************************************/
+/*              Typedefs                               */
+/*******************************************************/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct PrefEntry;
+
+typedef struct {
+    /**
+     * Hash of the entry key, compared before the key itself.
+     */
+    uint32_t hash;
+
+    /**
+     * Indexed entry, NULL if the slot is empty.
+     */
+    struct PrefEntry* entry;
+} PrefsIndexSlot;
+
+/**
+ * Open addressing (linear probing) hash table mapping keys to preference entries. It doesn't own the entries, the
+ * entry list does, and it has to be kept in sync with it.
+ */
+typedef struct {
+    PrefsIndexSlot* slots;
+    uint32_t capacity;
+    uint32_t size;
+} PrefsIndex;
+
+/*******************************************************/
+/*              Functions Declarations                 */
+/*******************************************************/
+
+/**
+ * Initializes an empty index.
+ *
+ * @param[in] index Index to initialize.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t PrefsIndex_init(PrefsIndex* index);
+
+/**
+ * Releases the index memory (not the indexed entries).
+ *
+ * @param[in] index Initialized index.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t PrefsIndex_destroy(PrefsIndex* index);
+
+/**
+ * Makes room for a number of entries, so they can be inserted without growing the index again.
+ *
+ * @param[in] index Initialized index.
+ * @param[in] size Number of entries.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t PrefsIndex_reserve(PrefsIndex* index, uint32_t size);
+
+/**
+ * Removes all the entries from the index.
+ *
+ * @param[in] index Initialized index.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t PrefsIndex_clear(PrefsIndex* index);
+
+/**
+ * Finds an entry by its key.
+ *
+ * @param[in] index Initialized index.
+ * @param[in] key Entry key.
+ * @return Entry if found, NULL otherwise.
+ */
+struct PrefEntry* PrefsIndex_find(const PrefsIndex* index, const char* key);
+
+/**
+ * Finds an entry by its key, with the key hash calculated beforehand.
+ *
+ * @param[in] index Initialized index.
+ * @param[in] key Entry key.
+ * @param[in] hash Key hash (see PrefsIndex_hash).
+ * @return Entry if found, NULL otherwise.
+ */
+struct PrefEntry* PrefsIndex_findHashed(const PrefsIndex* index, const char* key, uint32_t hash);
+
+/**
+ * Adds an entry to the index. The key must not be indexed already.
+ *
+ * @param[in] index Initialized index.
+ * @param[in] entry Entry to add.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t PrefsIndex_insert(PrefsIndex* index, struct PrefEntry* entry);
+
+/**
+ * Adds an entry to the index, with the key hash calculated beforehand. The key must not be indexed already.
+ *
+ * @param[in] index Initialized index.
+ * @param[in] entry Entry to add.
+ * @param[in] hash Key hash (see PrefsIndex_hash).
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t PrefsIndex_insertHashed(PrefsIndex* index, struct PrefEntry* entry, uint32_t hash);
+
+/**
+ * Removes an entry from the index.
+ *
+ * @param[in] index Initialized index.
+ * @param[in] key Entry key.
+ * @return Removed entry if found, NULL otherwise.
+ */
+struct PrefEntry* PrefsIndex_remove(PrefsIndex* index, const char* key);
+
+/**
+ * Calculates the hash of a key (32-bit FNV-1a).
+ *
+ * @param[in] key Entry key.
+ * @return Key hash.
+ */
+uint32_t PrefsIndex_hash(const char* key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
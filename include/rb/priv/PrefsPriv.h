@@ -6,6 +6,12 @@
 /*******************************************************/
 
 #include "rb/Prefs.h"
+#include "rb/List.h"
+#include "rb/Array.h"
+#include "rb/priv/PrefsIndex.h"
+#include "rb/priv/PrefsArena.h"
+
+#include <pthread.h>
 
 /*******************************************************/
 /*              Defines                                */
@@ -20,6 +26,14 @@
 extern "C" {
 #endif
 
+/**
+ * File blob values are left in (see Rb_PrefsConfig::lazyBlobSize), shared by the values referencing it.
+ */
+typedef struct PrefsBlobFile {
+    int fd;
+    int32_t refs;
+} PrefsBlobFile;
+
 typedef struct {
     Rb_VariantType type;
 
@@ -32,21 +46,262 @@ typedef struct {
         struct {
             void* data;
             uint32_t size;
+            /**
+             * Set if the data is left in a file (data is NULL then), read from offset on access.
+             */
+            PrefsBlobFile* file;
+            uint32_t offset;
         } blobVal;
     } val;
 } Variant;
 
-typedef struct {
+typedef struct PrefEntry {
     char* key;
     Variant value;
 } PrefEntry;
 
+/**
+ * Read-only file mapping the entries are served from (see Rb_Prefs_mapFile).
+ */
+typedef struct {
+    const uint8_t* data;
+    uint32_t size;
+    int32_t numEntries;
+} PrefsMapping;
+
+/**
+ * Journal mode state (see Rb_Prefs_openJournal).
+ */
+typedef struct {
+    char* filePath;
+    char* journalPath;
+    /**
+     * Open journal, handle is NULL if the journal mode is disabled (or while it's damaged).
+     */
+    Rb_IOStream stream;
+    /**
+     * Length of the complete records, the journal is cut back to it if a record is torn.
+     */
+    uint32_t size;
+    uint32_t compactThreshold;
+    /**
+     * Set if a torn record couldn't be cut off, nothing is appended until it is.
+     */
+    int32_t damaged;
+} PrefsJournal;
+
+/**
+ * Immutable copy of all the entries, read without locking in concurrent mode.
+ */
+typedef struct {
+    /**
+     * Entries in insertion order, their keys and values are stored in the same allocation.
+     */
+    PrefEntry* entries;
+    uint32_t numEntries;
+    PrefsIndex index;
+    /**
+     * Generation the snapshot was taken at.
+     */
+    uint32_t generation;
+} PrefsSnapshot;
+
+typedef struct {
+    Rb_PrefsSaveCallbackFnc fnc;
+    void* userData;
+} PrefsSaveCallback;
+
+/**
+ * Background save state (see Rb_Prefs_saveAsync), guarded by its own mutex. The thread is started by the first save.
+ */
+typedef struct {
+    pthread_t thread;
+    int32_t running;
+    pthread_mutex_t mutex;
+    pthread_cond_t cv;
+    /**
+     * Serialized entries waiting for the thread, NULL if no save is pending.
+     */
+    Rb_ArrayHandle pending;
+    char* filePath;
+    /**
+     * Callbacks of all the requests merged into the pending save.
+     */
+    PrefsSaveCallback* callbacks;
+    uint32_t numCallbacks;
+    uint32_t callbackCapacity;
+    /**
+     * Set while the thread writes a file.
+     */
+    int32_t busy;
+    int32_t stop;
+    int32_t result;
+} PrefsSaver;
+
 typedef struct {
     uint32_t magic;
+    /**
+     * Entries in insertion order (defines Rb_Prefs_getKey indices).
+     */
     Rb_ListHandle entries;
+    /**
+     * Key lookup index over the same entries, kept in sync with the list.
+     */
+    PrefsIndex index;
+    /**
+     * Entries sorted by key for prefix queries, built by the first one and kept in sync with the list afterwards (NULL
+     * until then, or after the entries are cleared).
+     */
+    Rb_ListHandle ordered;
+    /**
+     * Valid if the preferences are mapped from a file, the entry list and index are empty in that case.
+     */
+    PrefsMapping mapping;
+    /**
+     * Incremented on every modification, borrowed views are valid while it doesn't change.
+     */
+    uint32_t generation;
+    Rb_PrefsFormat format;
+    PrefsJournal journal;
     Rb_PrefsBackend backend;
+
+    Rb_PrefsConcurrency concurrency;
+    /**
+     * Serializes writers in concurrent mode (recursive, see Rb_Prefs_beginUpdate).
+     */
+    pthread_mutex_t mutex;
+    uint32_t updateDepth;
+    /**
+     * Published state readers use in concurrent mode. Readers register in readers[readEpoch] while they use it, a
+     * replaced snapshot is freed once both counters have drained.
+     */
+    PrefsSnapshot* snapshot;
+    int32_t readEpoch;
+    int32_t readers[2];
+
+    PrefsSaver saver;
+
+    uint32_t lazyBlobSize;
+    /**
+     * File being loaded by Rb_Prefs_loadFile, which blobs may be left in.
+     */
+    PrefsBlobFile* blobSource;
+
+    /**
+     * Storage of the entries, their keys and values (unused if the chunk size is 0).
+     */
+    PrefsArena arena;
+    /**
+     * Size reserved in the arena when it's cleared by Rb_Prefs_loadFile.
+     */
+    uint32_t arenaReserve;
 } PrefsContext;
 
+/**
+ * Resolved key (see Rb_Prefs_resolveKey).
+ */
+typedef struct {
+    uint32_t magic;
+    char* key;
+    uint32_t hash;
+    /**
+     * Preferences the key was resolved with.
+     */
+    PrefsContext* prefs;
+    /**
+     * Entry found by the last lookup (NULL if the key didn't exist), valid while the preferences generation matches.
+     */
+    PrefEntry* entry;
+    uint32_t generation;
+    /**
+     * Storage of the entry if the preferences are mapped.
+     */
+    PrefEntry mapped;
+} PrefsKeyContext;
+
+typedef struct {
+    /**
+     * Staged entry (owned by the transaction until it's committed), only the key is used by removals.
+     */
+    PrefEntry* entry;
+    int32_t remove;
+} PrefsTransactionOp;
+
+/**
+ * Staged changes (see Rb_Prefs_beginTransaction).
+ */
+typedef struct {
+    uint32_t magic;
+    PrefsContext* prefs;
+    PrefsTransactionOp* ops;
+    uint32_t numOps;
+    uint32_t capacity;
+} PrefsTransactionContext;
+
+/**
+ * Stream over a blob value (see Rb_Prefs_openBlobStream).
+ */
+typedef struct {
+    uint32_t magic;
+    Rb_IOMode mode;
+    PrefsContext* prefs;
+    /**
+     * Value being read, its data is borrowed from the entry (the file is referenced).
+     */
+    Variant value;
+    uint32_t position;
+    /**
+     * Key and data of the value being written, stored when the stream is closed.
+     */
+    char* key;
+    Rb_ArrayHandle data;
+} PrefsBlobStream;
+
+/*******************************************************/
+/*              Functions Declarations                 */
+/*******************************************************/
+
+/**
+ * Acquires the preferences context from a handle.
+ *
+ * @param[in] handle Preferences handle.
+ * @return Valid context if the handle is valid, NULL otherwise.
+ */
+PrefsContext* PrefsPriv_getContext(Rb_PrefsHandle handle);
+
+/**
+ * Copies a value and adds it under the key.
+ *
+ * @param[in] prefs Preferences context.
+ * @param[in] key Value key.
+ * @param[in] var Value, string and blob data is copied.
+ * @param[in] replace If set, the value of an existing key is replaced in place (the key keeps its position).
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t PrefsPriv_put(PrefsContext* prefs, const char* key, const Variant* var, int32_t replace);
+
+/**
+ * Adds a blob value left in the file being loaded (see PrefsContext::blobSource).
+ *
+ * @param[in] prefs Preferences context.
+ * @param[in] key Value key.
+ * @param[in] offset Blob position in the file.
+ * @param[in] size Blob size.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t PrefsPriv_putLazyBlob(PrefsContext* prefs, const char* key, uint32_t offset, uint32_t size);
+
+/**
+ * Reads a range of a blob value, from memory or from the file it's left in.
+ *
+ * @param[in] var Blob value.
+ * @param[in] position Range start.
+ * @param[out] data Destination buffer.
+ * @param[in] size Range size.
+ * @return RB_OK on success, negative value otherwise.
+ */
+int32_t PrefsPriv_readBlob(const Variant* var, uint32_t position, void* data, uint32_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,7 +9,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
 
 /*******************************************************/
 /*              Defines                                */
@@ -21,15 +24,41 @@
 
 #define LOCK_RELEASE do{ pthread_mutex_unlock(&array->mutex); }while(0)
 
+/**
+ * Acquires the lock, consolidating a concurrent array first.
+ */
+#define LOCK_ACQUIRE_CONSOLIDATED(errorValue) do{ LOCK_ACQUIRE; if(ArrayPriv_consolidate(array) != RB_OK){ \
+        LOCK_RELEASE; RB_ERR("Error consolidating array"); return errorValue; } }while(0)
+
+#define ARRAY_MIN_CAPACITY ( 64 )
+
+/**
+ * Chunk k of a concurrent array holds chunkSize << k bytes, so this many chunks cover any size.
+ */
+#define ARRAY_MAX_CHUNKS ( 32 )
+
 /*******************************************************/
 /*              Typedefs                               */
 /*******************************************************/
 
 typedef struct {
     uint32_t magic;
-    FILE* stream;
-    char* buffer;
-    size_t len;
+    uint8_t* buffer;
+    /**
+     * Number of bytes written (highest write position reached).
+     */
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t position;
+    /**
+     * Concurrent append mode. Appends reserve their range with an atomic add on the reserved offset and copy into
+     * chunks which never move, the chunks are copied into the buffer when the array is consolidated.
+     */
+    bool concurrent;
+    uint32_t chunkSize;
+    uint8_t* chunks[ARRAY_MAX_CHUNKS];
+    uint64_t reserved;
+    uint64_t committed;
     pthread_mutex_t mutex;
 } ArrayContext;
 
@@ -38,9 +67,12 @@ typedef struct {
 /*******************************************************/
 
 static ArrayContext* ArrayPriv_getContext(Rb_ArrayHandle handle);
-
-// Gets rid of the implicit declaration warning
-extern FILE *open_memstream(char **bufp, size_t *sizep);
+static int32_t ArrayPriv_setCapacity(ArrayContext* array, uint32_t capacity);
+static int32_t ArrayPriv_grow(ArrayContext* array, uint32_t size);
+static int32_t ArrayPriv_consolidate(ArrayContext* array);
+static uint32_t ArrayPriv_getChunk(ArrayContext* array, uint64_t offset, uint64_t* chunkStart);
+static uint64_t ArrayPriv_getChunkSize(ArrayContext* array, uint32_t chunk);
+static int32_t ArrayPriv_appendConcurrent(ArrayContext* array, const void* ptr, uint32_t size);
 
 /*******************************************************/
 /*              Functions Definitions                  */
@@ -51,10 +83,8 @@ Rb_ArrayHandle Rb_Array_new() {
 
     array->magic = ARRAY_MAGIC;
 
-    array->stream = open_memstream(&array->buffer, &array->len);
-
-    if(array->stream == NULL) {
-        RB_ERR("open_memstream failed");
+    if(ArrayPriv_setCapacity(array, ARRAY_MIN_CAPACITY) != RB_OK) {
+        RB_ERR("Error allocating buffer");
         RB_FREE(&array);
         return NULL;
     }
@@ -64,14 +94,58 @@ Rb_ArrayHandle Rb_Array_new() {
     return (Rb_ArrayHandle)array;
 }
 
+Rb_ArrayHandle Rb_Array_newConcurrent(uint32_t chunkSize) {
+    if(chunkSize == 0 || chunkSize > (uint32_t)INT32_MAX) {
+        RB_ERR("Invalid chunk size");
+        return NULL;
+    }
+
+    ArrayContext* array = (ArrayContext*)RB_CALLOC(sizeof(ArrayContext));
+
+    array->magic = ARRAY_MAGIC;
+    array->concurrent = true;
+    array->chunkSize = chunkSize;
+
+    pthread_mutex_init(&array->mutex, NULL);
+
+    return (Rb_ArrayHandle)array;
+}
+
+Rb_ArrayHandle Rb_Array_adopt(void* data, uint32_t size) {
+    if(data == NULL || size == 0 || size > (uint32_t)INT32_MAX) {
+        RB_ERR("Invalid buffer");
+        return NULL;
+    }
+
+    ArrayContext* array = (ArrayContext*)RB_CALLOC(sizeof(ArrayContext));
+
+    array->magic = ARRAY_MAGIC;
+    array->buffer = (uint8_t*)data;
+    array->size = size;
+    array->capacity = size;
+    array->position = size;
+
+    pthread_mutex_init(&array->mutex, NULL);
+
+    return (Rb_ArrayHandle)array;
+}
+
 int32_t Rb_Array_free(Rb_ArrayHandle* handle) {
     ArrayContext* array = ArrayPriv_getContext(*handle);
     if(array == NULL) {
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    fclose(array->stream);
-    RB_FREE(&array->buffer);
+    if(array->buffer) {
+        RB_FREE(&array->buffer);
+    }
+
+    uint32_t i;
+    for(i=0; i<ARRAY_MAX_CHUNKS; i++) {
+        if(array->chunks[i]) {
+            RB_FREE(&array->chunks[i]);
+        }
+    }
 
     pthread_mutex_destroy(&array->mutex);
 
@@ -88,11 +162,9 @@ uint8_t* Rb_Array_data(Rb_ArrayHandle handle) {
         return NULL;
     }
 
-    LOCK_ACQUIRE;
-
-    fflush(array->stream);
+    LOCK_ACQUIRE_CONSOLIDATED(NULL);
 
-    uint8_t* res = (uint8_t*)array->buffer;
+    uint8_t* res = array->buffer;
 
     LOCK_RELEASE;
 
@@ -105,11 +177,16 @@ uint32_t Rb_Array_size(Rb_ArrayHandle handle) {
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    LOCK_ACQUIRE;
+    // Concurrent arrays report the space reserved so far, without waiting for the appends
+    if(__atomic_load_n(&array->concurrent, __ATOMIC_ACQUIRE)) {
+        uint64_t reserved = __atomic_load_n(&array->reserved, __ATOMIC_RELAXED);
+
+        return reserved > (uint64_t)INT32_MAX ? (uint32_t)INT32_MAX : (uint32_t)reserved;
+    }
 
-    fflush(array->stream);
+    LOCK_ACQUIRE;
 
-    uint32_t res = array->len;
+    uint32_t res = array->size;
 
     LOCK_RELEASE;
 
@@ -122,9 +199,9 @@ int32_t Rb_Array_tell(Rb_ArrayHandle handle) {
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    LOCK_ACQUIRE;
+    LOCK_ACQUIRE_CONSOLIDATED(RB_ERROR);
 
-    int32_t res = ftell(array->stream);
+    int32_t res = array->position;
 
     LOCK_RELEASE;
 
@@ -137,13 +214,18 @@ int32_t Rb_Array_seek(Rb_ArrayHandle handle, uint32_t pos) {
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    LOCK_ACQUIRE;
+    if(pos > INT32_MAX) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid position");
+    }
+
+    LOCK_ACQUIRE_CONSOLIDATED(RB_ERROR);
 
-    int32_t res = fseek(array->stream, pos, SEEK_SET);
+    // Seeking past the end is allowed, the gap is zero filled by the next write
+    array->position = pos;
 
     LOCK_RELEASE;
 
-    return res;
+    return RB_OK;
 }
 
 int32_t Rb_Array_write(Rb_ArrayHandle handle, const void* ptr, uint32_t size) {
@@ -152,15 +234,376 @@ int32_t Rb_Array_write(Rb_ArrayHandle handle, const void* ptr, uint32_t size) {
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
+    if(size > (uint32_t)INT32_MAX) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid size");
+    }
+
+    LOCK_ACQUIRE_CONSOLIDATED(RB_ERROR);
+
+    if(size > (uint32_t)INT32_MAX - array->position || ArrayPriv_grow(array, array->position + size) != RB_OK) {
+        LOCK_RELEASE;
+        RB_ERRC(RB_ERROR, "Error growing buffer");
+    }
+
+    if(array->position > array->size) {
+        memset(array->buffer + array->size, 0x00, array->position - array->size);
+    }
+
+    memcpy(array->buffer + array->position, ptr, size);
+
+    array->position += size;
+
+    if(array->position > array->size) {
+        array->size = array->position;
+    }
+
+    LOCK_RELEASE;
+
+    return (int32_t)size;
+}
+
+int32_t Rb_Array_read(Rb_ArrayHandle handle, uint32_t offset, void* data, uint32_t size) {
+    ArrayContext* array = ArrayPriv_getContext(handle);
+    if(array == NULL || (data == NULL && size)) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(size > (uint32_t)INT32_MAX) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid size");
+    }
+
+    LOCK_ACQUIRE_CONSOLIDATED(RB_ERROR);
+
+    // Reads past the end of the data are short
+    if(offset >= array->size) {
+        size = 0;
+    }
+    else if(size > array->size - offset) {
+        size = array->size - offset;
+    }
+
+    if(size) {
+        memcpy(data, array->buffer + offset, size);
+    }
+
+    LOCK_RELEASE;
+
+    return (int32_t)size;
+}
+
+int32_t Rb_Array_slice(Rb_ArrayHandle handle, uint32_t offset, uint32_t size, const uint8_t** data) {
+    ArrayContext* array = ArrayPriv_getContext(handle);
+    if(array == NULL || data == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE_CONSOLIDATED(RB_ERROR);
+
+    if(offset > array->size || size > array->size - offset) {
+        LOCK_RELEASE;
+        RB_ERRC(RB_INVALID_ARG, "Slice out of bounds");
+    }
+
+    *data = array->buffer + offset;
+
+    LOCK_RELEASE;
+
+    return RB_OK;
+}
+
+int32_t Rb_Array_detach(Rb_ArrayHandle handle, uint8_t** data, uint32_t* size) {
+    ArrayContext* array = ArrayPriv_getContext(handle);
+    if(array == NULL || data == NULL || size == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE_CONSOLIDATED(RB_ERROR);
+
+    *data = array->buffer;
+    *size = array->size;
+
+    // The array starts over empty, a new buffer is allocated by the next write
+    array->buffer = NULL;
+    array->size = 0;
+    array->capacity = 0;
+    array->position = 0;
+
+    LOCK_RELEASE;
+
+    return RB_OK;
+}
+
+int32_t Rb_Array_append(Rb_ArrayHandle handle, const void* ptr, uint32_t size) {
+    ArrayContext* array = ArrayPriv_getContext(handle);
+    if(array == NULL || (ptr == NULL && size)) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(size > (uint32_t)INT32_MAX) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid size");
+    }
+
+    if(__atomic_load_n(&array->concurrent, __ATOMIC_ACQUIRE)) {
+        int32_t offset = ArrayPriv_appendConcurrent(array, ptr, size);
+        if(offset < 0) {
+            RB_ERRC(offset, "Error appending data");
+        }
+
+        return offset;
+    }
+
     LOCK_ACQUIRE;
 
-    int32_t res = fwrite(ptr, 1, size, array->stream);
+    uint32_t offset = array->size;
+
+    if(size > (uint32_t)INT32_MAX - offset || ArrayPriv_grow(array, offset + size) != RB_OK) {
+        LOCK_RELEASE;
+        RB_ERRC(RB_ERROR, "Error growing buffer");
+    }
+
+    memcpy(array->buffer + offset, ptr, size);
+
+    array->size += size;
+
+    LOCK_RELEASE;
+
+    return (int32_t)offset;
+}
+
+int32_t Rb_Array_consolidate(Rb_ArrayHandle handle) {
+    ArrayContext* array = ArrayPriv_getContext(handle);
+    if(array == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE;
+
+    int32_t rc = ArrayPriv_consolidate(array);
+
+    LOCK_RELEASE;
+
+    if(rc != RB_OK) {
+        RB_ERRC(rc, "Error consolidating array");
+    }
+
+    return rc;
+}
+
+uint32_t Rb_Array_capacity(Rb_ArrayHandle handle) {
+    ArrayContext* array = ArrayPriv_getContext(handle);
+    if(array == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE_CONSOLIDATED(RB_ERROR);
+
+    uint32_t res = array->capacity;
 
     LOCK_RELEASE;
 
     return res;
 }
 
+int32_t Rb_Array_reserve(Rb_ArrayHandle handle, uint32_t capacity) {
+    ArrayContext* array = ArrayPriv_getContext(handle);
+    if(array == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE_CONSOLIDATED(RB_ERROR);
+
+    int32_t rc = capacity > array->capacity ? ArrayPriv_setCapacity(array, capacity) : RB_OK;
+
+    LOCK_RELEASE;
+
+    if(rc != RB_OK) {
+        RB_ERRC(rc, "Error allocating buffer");
+    }
+
+    return rc;
+}
+
+int32_t Rb_Array_shrinkToFit(Rb_ArrayHandle handle) {
+    ArrayContext* array = ArrayPriv_getContext(handle);
+    if(array == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE_CONSOLIDATED(RB_ERROR);
+
+    // Keep a valid buffer even if the array is empty
+    int32_t rc = ArrayPriv_setCapacity(array, array->size ? array->size : 1);
+
+    LOCK_RELEASE;
+
+    if(rc != RB_OK) {
+        RB_ERRC(rc, "Error reallocating buffer");
+    }
+
+    return rc;
+}
+
+int32_t ArrayPriv_grow(ArrayContext* array, uint32_t size) {
+    if(size <= array->capacity) {
+        return RB_OK;
+    }
+
+    // Geometric growth keeps appends amortized O(1)
+    uint32_t capacity = array->capacity > (uint32_t)INT32_MAX / 2 ? (uint32_t)INT32_MAX : array->capacity * 2;
+
+    if(capacity < ARRAY_MIN_CAPACITY) {
+        capacity = ARRAY_MIN_CAPACITY;
+    }
+
+    return ArrayPriv_setCapacity(array, capacity < size ? size : capacity);
+}
+
+int32_t ArrayPriv_appendConcurrent(ArrayContext* array, const void* ptr, uint32_t size) {
+    uint64_t offset = __atomic_load_n(&array->reserved, __ATOMIC_RELAXED);
+
+    // The reserved range belongs to this writer alone, and the chunks backing it never move. Ranges past the largest
+    // array size are never reserved, so an oversized append fails without affecting the following ones.
+    do {
+        if(offset + size > (uint64_t)INT32_MAX) {
+            return RB_ERROR;
+        }
+    } while(!__atomic_compare_exchange_n(&array->reserved, &offset, offset + size, true,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    int32_t rc = RB_OK;
+
+    const uint8_t* source = (const uint8_t*)ptr;
+    uint64_t position = offset;
+    uint32_t remaining = size;
+
+    // The range may span multiple chunks
+    while(remaining) {
+        uint64_t chunkStart;
+        uint32_t chunk = ArrayPriv_getChunk(array, position, &chunkStart);
+        uint64_t chunkSize = ArrayPriv_getChunkSize(array, chunk);
+
+        uint8_t* data = __atomic_load_n(&array->chunks[chunk], __ATOMIC_ACQUIRE);
+
+        if(data == NULL) {
+            uint8_t* expected = NULL;
+
+            // Zeroed, so the range of an append which fails to allocate a chunk reads as zeros once consolidated
+            data = (uint8_t*)RB_CALLOC((int32_t)chunkSize);
+            if(data == NULL) {
+                rc = RB_ERROR;
+                break;
+            }
+
+            // Another writer may have installed the chunk first
+            if(!__atomic_compare_exchange_n(&array->chunks[chunk], &expected, data, false,
+                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                RB_FREE(&data);
+                data = expected;
+            }
+        }
+
+        uint64_t available = chunkStart + chunkSize - position;
+        uint32_t numBytes = remaining < available ? remaining : (uint32_t)available;
+
+        memcpy(data + (position - chunkStart), source, numBytes);
+
+        source += numBytes;
+        position += numBytes;
+        remaining -= numBytes;
+    }
+
+    // Publish the data (failed appends are accounted for as well, so consolidation never waits for them)
+    __atomic_fetch_add(&array->committed, size, __ATOMIC_RELEASE);
+
+    return rc == RB_OK ? (int32_t)offset : rc;
+}
+
+int32_t ArrayPriv_consolidate(ArrayContext* array) {
+    if(!array->concurrent) {
+        return RB_OK;
+    }
+
+    uint64_t reserved = __atomic_load_n(&array->reserved, __ATOMIC_ACQUIRE);
+
+    // Wait for the appends which already reserved their range to finish copying
+    while(__atomic_load_n(&array->committed, __ATOMIC_ACQUIRE) != reserved) {
+        sched_yield();
+    }
+
+    if(ArrayPriv_setCapacity(array, reserved > ARRAY_MIN_CAPACITY ? (uint32_t)reserved : ARRAY_MIN_CAPACITY) != RB_OK) {
+        return RB_ERROR;
+    }
+
+    uint64_t copied = 0;
+    uint32_t chunk;
+
+    for(chunk=0; chunk<ARRAY_MAX_CHUNKS; chunk++) {
+        if(copied < reserved) {
+            uint64_t chunkSize = ArrayPriv_getChunkSize(array, chunk);
+            uint64_t numBytes = reserved - copied < chunkSize ? reserved - copied : chunkSize;
+
+            // A chunk may be missing if its allocation failed, the failed appends are left zero filled
+            if(array->chunks[chunk]) {
+                memcpy(array->buffer + copied, array->chunks[chunk], numBytes);
+            }
+            else {
+                memset(array->buffer + copied, 0x00, numBytes);
+            }
+
+            copied += numBytes;
+        }
+
+        if(array->chunks[chunk]) {
+            RB_FREE(&array->chunks[chunk]);
+        }
+    }
+
+    array->size = (uint32_t)reserved;
+    array->position = (uint32_t)reserved;
+
+    __atomic_store_n(&array->concurrent, false, __ATOMIC_RELEASE);
+
+    return RB_OK;
+}
+
+uint32_t ArrayPriv_getChunk(ArrayContext* array, uint64_t offset, uint64_t* chunkStart) {
+    // Chunk k starts at chunkSize * (2^k - 1)
+    uint64_t n = offset / array->chunkSize + 1;
+    uint32_t chunk = 63 - __builtin_clzll(n);
+
+    *chunkStart = (uint64_t)array->chunkSize * ((1ULL << chunk) - 1);
+
+    return chunk;
+}
+
+uint64_t ArrayPriv_getChunkSize(ArrayContext* array, uint32_t chunk) {
+    uint64_t start = (uint64_t)array->chunkSize * ((1ULL << chunk) - 1);
+    uint64_t size = (uint64_t)array->chunkSize << chunk;
+
+    // Nothing is stored past INT32_MAX
+    if(start + size > (uint64_t)INT32_MAX) {
+        size = start < (uint64_t)INT32_MAX ? (uint64_t)INT32_MAX - start : 0;
+    }
+
+    return size;
+}
+
+int32_t ArrayPriv_setCapacity(ArrayContext* array, uint32_t capacity) {
+    if(capacity == array->capacity) {
+        return RB_OK;
+    }
+
+    uint8_t* buffer = (uint8_t*)RB_REALLOC(array->buffer, capacity);
+    if(buffer == NULL) {
+        return RB_ERROR;
+    }
+
+    array->buffer = buffer;
+    array->capacity = capacity;
+
+    return RB_OK;
+}
+
 ArrayContext* ArrayPriv_getContext(Rb_ArrayHandle handle) {
     if(handle == NULL) {
         return NULL;
@@ -40,6 +40,8 @@ static int32_t FStreamPriv_tell(Rb_IOStreamHandle handle);
 
 static int32_t FStreamPriv_seek(Rb_IOStreamHandle handle, uint32_t position);
 
+static int32_t FStreamPriv_flush(Rb_IOStreamHandle handle);
+
 static int32_t FStreamPriv_open(const char* uri, Rb_IOMode mode, Rb_IOStreamHandle* handle);
 
 static int32_t FStreamPriv_close(Rb_IOStreamHandle* handle);
@@ -59,6 +61,7 @@ int32_t Rb_FileStream_getApi(Rb_IOApi* api){
     api->write = FStreamPriv_write;
     api->seek= FStreamPriv_seek;
     api->tell= FStreamPriv_tell;
+    api->flush = FStreamPriv_flush;
 
     return RB_OK;
 }
@@ -90,6 +93,15 @@ int32_t FStreamPriv_tell(Rb_IOStreamHandle handle) {
     return ftell(stream->fd);
 }
 
+int32_t FStreamPriv_flush(Rb_IOStreamHandle handle){
+    FileStreamContext* stream = FStreamPriv_getContext(handle);
+    if (stream == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    return fflush(stream->fd) == 0 ? RB_OK : RB_ERROR;
+}
+
 int32_t FStreamPriv_seek(Rb_IOStreamHandle handle, uint32_t position){
     FileStreamContext* stream = FStreamPriv_getContext(handle);
     if (stream == NULL) {
@@ -116,6 +128,9 @@ int32_t FStreamPriv_open(const char* uri, Rb_IOMode mode, Rb_IOStreamHandle* han
     case eRB_IO_MODE_READ_WRITE:
         strcpy(strMode, "rwb");
         break;
+    case eRB_IO_MODE_APPEND:
+        strcpy(strMode, "ab");
+        break;
     default:
         RB_FREE(&stream);
         return RB_INVALID_ARG;
@@ -127,6 +142,11 @@ int32_t FStreamPriv_open(const char* uri, Rb_IOMode mode, Rb_IOStreamHandle* han
         RB_ERRC(RB_INVALID_ARG, "fopen failed");
     }
 
+    // Initial position of an append stream is implementation defined, tell should report the file size
+    if(mode == eRB_IO_MODE_APPEND){
+        fseek(stream->fd, 0, SEEK_END);
+    }
+
     stream->uri = strdup(uri);
     stream->mode = mode;
 
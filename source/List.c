@@ -11,6 +11,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <stdbool.h>
 
 /*******************************************************/
 /*              Defines                                */
@@ -18,58 +20,216 @@
 
 #define LIST_MAGIC ( 0xFF3FA233 )
 
-#define LOCK_ACQUIRE do{ pthread_mutex_lock(&list->mutex); }while(0)
+#define LOCK_ACQUIRE do{ if(list->locking == eRB_LIST_LOCKING_READ_WRITE){ pthread_rwlock_wrlock(&list->rwlock); } \
+        else{ pthread_mutex_lock(&list->mutex); } }while(0)
 
-#define LOCK_RELEASE do{ pthread_mutex_unlock(&list->mutex); }while(0)
+#define LOCK_ACQUIRE_SHARED do{ if(list->locking == eRB_LIST_LOCKING_READ_WRITE){ pthread_rwlock_rdlock(&list->rwlock); } \
+        else{ pthread_mutex_lock(&list->mutex); } }while(0)
+
+#define LOCK_RELEASE do{ if(list->locking == eRB_LIST_LOCKING_READ_WRITE){ pthread_rwlock_unlock(&list->rwlock); } \
+        else{ pthread_mutex_unlock(&list->mutex); } }while(0)
+
+#define ARRAY_MIN_CAPACITY ( 16 )
+
+#define LIST_SLAB_MIN_NODES ( 16 )
+
+#define LIST_SLAB_MAX_NODES ( 4096 )
+
+#define LIST_SORT_INSERTION_THRESHOLD ( 16 )
+
+#define LIST_SORT_MAX_THREADS ( 16 )
 
 /*******************************************************/
 /*              Typedefs                               */
 /*******************************************************/
 
 typedef struct ListNode_t {
-    void* element;
     struct ListNode_t* next;
     struct ListNode_t* prev;
+    /**
+     * Element data, stored inline with the node.
+     */
+    uint64_t element[];
 } ListNode;
 
+typedef struct ListSlab_t {
+    struct ListSlab_t* next;
+    uint64_t nodes[];
+} ListSlab;
+
 typedef struct {
     uint32_t magic;
+    Rb_ListType type;
     uint32_t size;
     uint32_t elementSize;
     ListNode* head;
+    ListNode* tail;
+    /**
+     * Node pool. Nodes are carved out of slabs and recycled through the free list, slabs are released only
+     * when the list is freed.
+     */
+    ListSlab* slabs;
+    ListNode* freeNodes;
+    uint32_t numFreeNodes;
+    uint32_t nodeSize;
+    uint32_t slabCapacity;
+    uint8_t* data;
+    uint32_t capacity;
+    void* scratch;
+    /**
+     * Incremented on every structural modification, used to detect invalidated cursors.
+     */
+    uint32_t modCount;
+    /**
+     * Comparator keeping the list sorted, NULL for unsorted lists.
+     */
+    Rb_List_compareFnc compareFnc;
+    Rb_ListLocking locking;
     pthread_mutex_t mutex;
+    pthread_rwlock_t rwlock;
 } ListContext;
 
+typedef struct {
+    ListContext* list;
+    Rb_List_compareFnc compareFnc;
+    Rb_SortMode mode;
+    /**
+     * Size of the sorted items (elements for array lists, node pointers for linked lists).
+     */
+    uint32_t stride;
+} ListSortContext;
+
+typedef struct {
+    const ListSortContext* sort;
+    uint8_t* items;
+    uint8_t* aux;
+    /**
+     * Index where the second sorted run starts if the task is a merge, 0 if the range should be sorted.
+     */
+    uint32_t middle;
+    uint32_t count;
+} ListSortTask;
+
 /*******************************************************/
 /*              Functions Declarations                 */
 /*******************************************************/
 
 static ListContext* ListPriv_getContext(Rb_ListHandle handle);
 static ListNode* ListPriv_getNode(ListContext* list, int32_t index);
+static void* ListPriv_getElement(ListContext* list, int32_t index);
+static void* ListPriv_iterate(ListContext* list, int32_t index, ListNode** node);
+static uint32_t ListPriv_bound(ListContext* list, const void* element, bool upper);
+static int32_t ListPriv_reserve(ListContext* list, uint32_t capacity);
+static int32_t ListPriv_addSlab(ListContext* list, uint32_t numNodes);
+static int32_t ListPriv_reserveNodes(ListContext* list, uint32_t count);
+static ListNode* ListPriv_allocNode(ListContext* list);
+static void ListPriv_freeNode(ListContext* list, ListNode* node);
 static int32_t ListPriv_insertLockless(ListContext* list, int32_t index, const void* element);
 static int32_t ListPriv_swapLockless(ListContext* list, int32_t index1, int32_t index2);
 static int32_t ListPriv_clear(ListContext* list);
 static int32_t ListPriv_remove(ListContext* list, int32_t index);
+static int32_t ListPriv_insertRange(ListContext* list, int32_t index, const void* elements, uint32_t count);
+static int32_t ListPriv_addAll(ListContext* list, const void* elements, uint32_t count);
+static int32_t ListPriv_removeRange(ListContext* list, int32_t index, uint32_t count);
+static void ListPriv_getRange(ListContext* list, int32_t index, uint32_t count, void* elements);
+static int32_t ListPriv_sort(ListContext* list, Rb_List_compareFnc compareFnc, Rb_SortMode mode, uint32_t numThreads);
+static int32_t ListPriv_sortCompare(const ListSortContext* sort, const void* item1, const void* item2);
+static void ListPriv_sortMerge(const ListSortContext* sort, uint8_t* items, uint8_t* aux, uint32_t middle, uint32_t count);
+static void ListPriv_sortRange(const ListSortContext* sort, uint8_t* items, uint8_t* aux, uint32_t count);
+static void* ListPriv_sortThread(void* arg);
 
 /*******************************************************/
 /*              Functions Definitions                  */
 /*******************************************************/
 
 Rb_ListHandle Rb_List_new(uint32_t elementSize){
+    Rb_ListConfig config;
+
+    Rb_List_getDefaultConfig(&config);
+
+    return Rb_List_newWithConfig(elementSize, &config);
+}
+
+Rb_ListHandle Rb_List_newWithConfig(uint32_t elementSize, const Rb_ListConfig* config){
     if (elementSize == 0) {
         RB_ERR("Invalid element size");
         return NULL;
     }
 
+    if (config == NULL || (config->type != eRB_LIST_TYPE_LINKED && config->type != eRB_LIST_TYPE_ARRAY)
+            || (config->locking != eRB_LIST_LOCKING_MUTEX && config->locking != eRB_LIST_LOCKING_READ_WRITE)) {
+        RB_ERR("Invalid configuration");
+        return NULL;
+    }
+
+    if (config->compareFnc && config->type != eRB_LIST_TYPE_ARRAY) {
+        RB_ERR("Sorted lists require random access storage");
+        return NULL;
+    }
+
     ListContext* list = (ListContext*)RB_CALLOC(sizeof(ListContext));
+    if (list == NULL) {
+        RB_ERR("Error allocating list");
+        return NULL;
+    }
 
     list->magic = LIST_MAGIC;
+    list->type = config->type;
+    list->locking = config->locking;
+    list->compareFnc = config->compareFnc;
     list->elementSize = elementSize;
-    pthread_mutex_init(&list->mutex, NULL);
+    list->scratch = RB_MALLOC(elementSize);
+
+    // Keep inline elements 8 byte aligned
+    list->nodeSize = sizeof(ListNode) + ((elementSize + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1));
+
+    if (list->scratch == NULL
+            || (list->type == eRB_LIST_TYPE_ARRAY && config->capacity && ListPriv_reserve(list, config->capacity) != RB_OK)) {
+        if (list->scratch) {
+            RB_FREE(&list->scratch);
+        }
+
+        if (list->data) {
+            RB_FREE(&list->data);
+        }
+
+        RB_FREE(&list);
+
+        RB_ERR("Error allocating list");
+        return NULL;
+    }
+
+    if (list->locking == eRB_LIST_LOCKING_READ_WRITE) {
+        pthread_rwlockattr_t attr;
+
+        pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+        // Readers would otherwise be able to starve writers indefinitely
+        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+        pthread_rwlock_init(&list->rwlock, &attr);
+        pthread_rwlockattr_destroy(&attr);
+    }
+    else {
+        pthread_mutex_init(&list->mutex, NULL);
+    }
 
     return (Rb_ListHandle)list;
 }
 
+int32_t Rb_List_getDefaultConfig(Rb_ListConfig* config){
+    if (config == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid argument");
+    }
+
+    memset(config, 0x00, sizeof(Rb_ListConfig));
+
+    config->type = eRB_LIST_TYPE_LINKED;
+    config->locking = eRB_LIST_LOCKING_MUTEX;
+
+    return RB_OK;
+}
+
 int32_t Rb_List_free(Rb_ListHandle* handle){
     int32_t rc;
 
@@ -83,8 +243,26 @@ int32_t Rb_List_free(Rb_ListHandle* handle){
         return rc;
     }
 
-    pthread_mutex_destroy(&list->mutex);
+    if(list->locking == eRB_LIST_LOCKING_READ_WRITE){
+        pthread_rwlock_destroy(&list->rwlock);
+    }
+    else{
+        pthread_mutex_destroy(&list->mutex);
+    }
+
+    if(list->data){
+        RB_FREE(&list->data);
+    }
+
+    while(list->slabs){
+        ListSlab* slab = list->slabs;
+
+        list->slabs = slab->next;
+
+        RB_FREE(&slab);
+    }
 
+    RB_FREE(&list->scratch);
     RB_FREE(&list);
     *handle = NULL;
 
@@ -99,7 +277,9 @@ int32_t Rb_List_add(Rb_ListHandle handle, const void* element){
 
     LOCK_ACQUIRE;
 
-    int32_t rc = ListPriv_insertLockless(list, list->size, element);
+    // Sorted lists place the element after the ones comparing equal, so insertion order is kept among them
+    int32_t rc = ListPriv_insertLockless(list,
+            list->compareFnc ? ListPriv_bound(list, element, true) : list->size, element);
 
     LOCK_RELEASE;
 
@@ -112,16 +292,16 @@ int32_t Rb_List_get(Rb_ListHandle handle, int32_t index, void* element){
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    LOCK_ACQUIRE;
+    LOCK_ACQUIRE_SHARED;
 
-    ListNode* node = ListPriv_getNode(list, index);
+    void* source = ListPriv_getElement(list, index);
 
-    if(!node){
+    if(!source){
         LOCK_RELEASE;
         RB_ERRC(RB_INVALID_ARG, "Index out of bounds");
     }
 
-    memcpy(element, node->element, list->elementSize);
+    memcpy(element, source, list->elementSize);
 
     LOCK_RELEASE;
 
@@ -153,6 +333,10 @@ int32_t Rb_List_insert(Rb_ListHandle handle, int32_t index, const void* element)
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
+    if (list->compareFnc) {
+        RB_ERRC(RB_INVALID_ARG, "Operation not supported by sorted lists");
+    }
+
     LOCK_ACQUIRE;
 
     int32_t rc = ListPriv_insertLockless(list, index, element);
@@ -172,7 +356,7 @@ int32_t Rb_List_getSize(Rb_ListHandle handle){
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    LOCK_ACQUIRE;
+    LOCK_ACQUIRE_SHARED;
 
     int32_t res = list->size;
 
@@ -182,46 +366,42 @@ int32_t Rb_List_getSize(Rb_ListHandle handle){
 }
 
 int32_t Rb_List_sort(Rb_ListHandle handle, Rb_List_compareFnc compareFnc, Rb_SortMode mode){
+    return Rb_List_sortParallel(handle, compareFnc, mode, 1);
+}
+
+int32_t Rb_List_sortParallel(Rb_ListHandle handle, Rb_List_compareFnc compareFnc, Rb_SortMode mode, uint32_t numThreads){
     ListContext* list = ListPriv_getContext(handle);
     if(list == NULL) {
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    LOCK_ACQUIRE;
-
-    uint32_t i;
-    uint32_t j;
-    int32_t rc;
+    if(compareFnc == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid compare function");
+    }
 
-    for(i=0; i<list->size; i++){
-        j = i;
+    if(list->compareFnc) {
+        RB_ERRC(RB_INVALID_ARG, "Operation not supported by sorted lists");
+    }
 
-        while(j > 0){
-            ListNode* node1 = ListPriv_getNode(list, j);
-            ListNode* node2 = ListPriv_getNode(list, j-1);
+    if(numThreads == 0) {
+        long numProcessors = sysconf(_SC_NPROCESSORS_ONLN);
 
-            int32_t cmp = compareFnc(list, node1->element, node2->element);
+        numThreads = numProcessors > 0 ? (uint32_t)numProcessors : 1;
+    }
 
-            if(mode == eRB_SORT_ASCEND && cmp > 0){
-                break;
-            }
-            else if(mode == eRB_SORT_DESCEND && cmp < 0){
-                break;
-            }
+    LOCK_ACQUIRE;
 
-            rc = ListPriv_swapLockless(list, j, j-1);
-            if(rc != RB_OK){
-                LOCK_RELEASE;
-                return rc;
-            }
+    list->modCount++;
 
-            --j;
-        }
-    }
+    int32_t rc = ListPriv_sort(list, compareFnc, mode, numThreads);
 
     LOCK_RELEASE;
 
-    return RB_OK;
+    if(rc != RB_OK) {
+        RB_ERRC(rc, "Error sorting list");
+    }
+
+    return rc;
 }
 
 int32_t Rb_List_swap(Rb_ListHandle handle, int32_t index1, int32_t index2){
@@ -230,6 +410,10 @@ int32_t Rb_List_swap(Rb_ListHandle handle, int32_t index1, int32_t index2){
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
+    if(list->compareFnc) {
+        RB_ERRC(RB_INVALID_ARG, "Operation not supported by sorted lists");
+    }
+
     LOCK_ACQUIRE;
 
     int32_t res = ListPriv_swapLockless(list, index1, index2);
@@ -258,46 +442,237 @@ int32_t Rb_List_clear(Rb_ListHandle handle){
     return rc;
 }
 
-int32_t ListPriv_clear(ListContext* list){
-    int32_t rc;
+int32_t Rb_List_reserve(Rb_ListHandle handle, uint32_t capacity){
+    ListContext* list = ListPriv_getContext(handle);
+    if(list == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE;
+
+    int32_t rc = RB_OK;
+
+    if(list->type == eRB_LIST_TYPE_ARRAY){
+        rc = ListPriv_reserve(list, capacity);
+    }
+    else if(capacity > list->size){
+        rc = ListPriv_reserveNodes(list, capacity - list->size);
+    }
+
+    LOCK_RELEASE;
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error reserving elements");
+    }
+
+    return rc;
+}
+
+Rb_ListHandle Rb_List_fromArray(uint32_t elementSize, const Rb_ListConfig* config, const void* elements, uint32_t count){
+    Rb_ListConfig defaultConfig;
+
+    if(config == NULL){
+        Rb_List_getDefaultConfig(&defaultConfig);
+
+        config = &defaultConfig;
+    }
+
+    if(elements == NULL && count){
+        RB_ERR("Invalid elements");
+        return NULL;
+    }
+
+    // Array lists are allocated at their final size right away
+    Rb_ListConfig listConfig = *config;
+
+    if(listConfig.capacity < count){
+        listConfig.capacity = count;
+    }
+
+    Rb_ListHandle handle = Rb_List_newWithConfig(elementSize, &listConfig);
+    if(handle == NULL){
+        return NULL;
+    }
+
+    ListContext* list = ListPriv_getContext(handle);
+
+    if(ListPriv_addAll(list, elements, count) != RB_OK){
+        Rb_List_free(&handle);
+
+        RB_ERR("Error adding elements");
+        return NULL;
+    }
+
+    return handle;
+}
+
+int32_t Rb_List_addAll(Rb_ListHandle handle, const void* elements, uint32_t count){
+    ListContext* list = ListPriv_getContext(handle);
+    if(list == NULL || (elements == NULL && count)) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE;
 
-    while(list->size){
-        rc = ListPriv_remove(list, 0);
-        if(rc != RB_OK){
-            // Should never happen
-            return rc;
+    int32_t rc = ListPriv_addAll(list, elements, count);
+
+    LOCK_RELEASE;
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error adding elements");
+    }
+
+    return rc;
+}
+
+int32_t Rb_List_insertAll(Rb_ListHandle handle, int32_t index, const void* elements, uint32_t count){
+    ListContext* list = ListPriv_getContext(handle);
+    if(list == NULL || (elements == NULL && count)) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(list->compareFnc) {
+        RB_ERRC(RB_INVALID_ARG, "Operation not supported by sorted lists");
+    }
+
+    LOCK_ACQUIRE;
+
+    int32_t rc = ListPriv_insertRange(list, index, elements, count);
+
+    LOCK_RELEASE;
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Index out of bounds");
+    }
+
+    return rc;
+}
+
+int32_t Rb_List_removeRange(Rb_ListHandle handle, int32_t index, uint32_t count){
+    ListContext* list = ListPriv_getContext(handle);
+    if(list == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE;
+
+    int32_t rc = ListPriv_removeRange(list, index, count);
+
+    LOCK_RELEASE;
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Range out of bounds");
+    }
+
+    return rc;
+}
+
+int32_t Rb_List_getRange(Rb_ListHandle handle, int32_t index, uint32_t count, void* elements){
+    ListContext* list = ListPriv_getContext(handle);
+    if(list == NULL || (elements == NULL && count)) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE_SHARED;
+
+    if(index < 0 || index > (int32_t)list->size || count > list->size - index){
+        LOCK_RELEASE;
+        RB_ERRC(RB_INVALID_ARG, "Range out of bounds");
+    }
+
+    ListPriv_getRange(list, index, count, elements);
+
+    LOCK_RELEASE;
+
+    return RB_OK;
+}
+
+int32_t Rb_List_toArray(Rb_ListHandle handle, void** elements, uint32_t* count){
+    ListContext* list = ListPriv_getContext(handle);
+    if(list == NULL || elements == NULL || count == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE_SHARED;
+
+    *count = list->size;
+    *elements = NULL;
+
+    if(list->size){
+        *elements = RB_MALLOC((size_t)list->size * list->elementSize);
+
+        if(*elements == NULL){
+            LOCK_RELEASE;
+            RB_ERRC(RB_ERROR, "Error allocating array");
         }
+
+        ListPriv_getRange(list, 0, list->size, *elements);
+    }
+
+    LOCK_RELEASE;
+
+    return RB_OK;
+}
+
+int32_t ListPriv_clear(ListContext* list){
+    list->modCount++;
+
+    if(list->type == eRB_LIST_TYPE_ARRAY){
+        list->size = 0;
+
+        return RB_OK;
+    }
+
+    // The whole chain is returned to the pool at once
+    if(list->tail){
+        list->tail->next = list->freeNodes;
+        list->freeNodes = list->head;
+        list->numFreeNodes += list->size;
     }
 
+    list->head = NULL;
+    list->tail = NULL;
+    list->size = 0;
+
     return RB_OK;
 }
 
 int32_t ListPriv_remove(ListContext* list, int32_t index){
-    ListNode* node = ListPriv_getNode(list, index);
-    if (!node) {
+    if(index < 0 || index >= (int32_t)list->size){
         return RB_INVALID_ARG;
     }
 
+    list->modCount++;
+
+    if(list->type == eRB_LIST_TYPE_ARRAY){
+        memmove(list->data + (size_t)index * list->elementSize,
+                list->data + (size_t)(index + 1) * list->elementSize,
+                (size_t)(list->size - index - 1) * list->elementSize);
+
+        list->size--;
+
+        return RB_OK;
+    }
+
+    ListNode* node = ListPriv_getNode(list, index);
+
     if (node->prev) {
         node->prev->next = node->next;
     }
+    else {
+        list->head = node->next;
+    }
 
     if (node->next) {
         node->next->prev = node->prev;
     }
-
-    if (index == 0) {
-        list->head = node->next;
+    else {
+        list->tail = node->prev;
     }
 
     list->size--;
 
-    if (!list->size) {
-        list->head = NULL;
-    }
-
-    RB_FREE(&node->element);
-    RB_FREE(&node);
+    ListPriv_freeNode(list, node);
 
     return RB_OK;
 }
@@ -307,17 +682,13 @@ int32_t ListPriv_swapLockless(ListContext* list, int32_t index1, int32_t index2)
         return RB_INVALID_ARG;
     }
 
-    ListNode* node1 = ListPriv_getNode(list, index1);
-    ListNode* node2 = ListPriv_getNode(list, index2);
+    void* element1 = ListPriv_getElement(list, index1);
+    void* element2 = ListPriv_getElement(list, index2);
 
-    void* tmp = RB_MALLOC(list->elementSize);
+    memcpy(list->scratch, element1, list->elementSize);
 
-    memcpy(tmp, node1->element, list->elementSize);
-
-    memcpy(node1->element, node2->element, list->elementSize);
-    memcpy(node2->element, tmp, list->elementSize);
-
-    RB_FREE(&tmp);
+    memcpy(element1, element2, list->elementSize);
+    memcpy(element2, list->scratch, list->elementSize);
 
     return RB_OK;
 }
@@ -336,70 +707,806 @@ ListContext* ListPriv_getContext(Rb_ListHandle handle) {
 }
 
 ListNode* ListPriv_getNode(ListContext* list, int32_t index){
-    if(index >= (int32_t)list->size){
+    if(index < 0 || index >= (int32_t)list->size){
         return NULL;
     }
 
-    ListNode* node = list->head;
+    ListNode* node;
+    int32_t currIndex;
 
-    int32_t currIndex = 0;
+    // Walk from whichever end is closer
+    if(index < (int32_t)list->size / 2){
+        node = list->head;
 
-    while(currIndex < index){
-        if(currIndex == index){
-            return node;
+        for(currIndex = 0; currIndex < index; currIndex++){
+            node = node->next;
         }
+    }
+    else{
+        node = list->tail;
 
-        node = node->next;
-        currIndex++;
+        for(currIndex = list->size - 1; currIndex > index; currIndex--){
+            node = node->prev;
+        }
     }
 
     return node;
 }
 
-int32_t ListPriv_insertLockless(ListContext* list, int32_t index, const void* element){
-    if((int32_t)list->size > index){
-        return RB_INVALID_ARG;
+void* ListPriv_getElement(ListContext* list, int32_t index){
+    if(index < 0 || index >= (int32_t)list->size){
+        return NULL;
     }
 
-    ListNode* node = (ListNode*)RB_CALLOC(sizeof(ListNode));
-    node->element = RB_CALLOC(list->elementSize);
-    memcpy(node->element, element, list->elementSize);
-    if(!list->size){
-        list->head = node;
+    if(list->type == eRB_LIST_TYPE_ARRAY){
+        return list->data + (size_t)index * list->elementSize;
     }
-    else{
-        ListNode* parent = ListPriv_getNode(list, index-1);
-        parent->next = node;
-        node->prev = parent;
+
+    return ListPriv_getNode(list, index)->element;
+}
+
+void* ListPriv_iterate(ListContext* list, int32_t index, ListNode** node){
+    if(list->type == eRB_LIST_TYPE_ARRAY){
+        return list->data + (size_t)index * list->elementSize;
     }
 
-    list->size++;
+    // Linked lists advance the node instead of walking from either end
+    void* element = (*node)->element;
 
-    return RB_OK;
+    *node = (*node)->next;
+
+    return element;
 }
 
-int32_t Rb_List_indexOf(Rb_ListHandle handle, void* element){
-    ListContext* list = ListPriv_getContext(handle);
-    if(list == NULL) {
-        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+int32_t ListPriv_reserve(ListContext* list, uint32_t capacity){
+    if(capacity <= list->capacity){
+        return RB_OK;
     }
 
-    LOCK_ACQUIRE;
-
-    int32_t i;
+    uint8_t* data = (uint8_t*)RB_REALLOC(list->data, (size_t)capacity * list->elementSize);
+    if(data == NULL){
+        return RB_ERROR;
+    }
 
-    int32_t index = -1;
+    list->data = data;
+    list->capacity = capacity;
 
-    for(i=0; i<(int32_t)list->size; i++){
-        ListNode* node = ListPriv_getNode(list, i);
+    return RB_OK;
+}
 
-        if(memcmp(node->element, element, list->elementSize) == 0){
-            index = i;
-            break;
-        }
+int32_t ListPriv_addSlab(ListContext* list, uint32_t numNodes){
+    ListSlab* slab = (ListSlab*)RB_MALLOC(sizeof(ListSlab) + (size_t)numNodes * list->nodeSize);
+    if(slab == NULL){
+        return RB_ERROR;
     }
 
-    LOCK_RELEASE;
+    slab->next = list->slabs;
+    list->slabs = slab;
 
-    return index;
+    uint32_t i;
+    for(i=numNodes; i>0; i--){
+        ListPriv_freeNode(list, (ListNode*)((uint8_t*)slab->nodes + (size_t)(i - 1) * list->nodeSize));
+    }
+
+    return RB_OK;
+}
+
+int32_t ListPriv_reserveNodes(ListContext* list, uint32_t count){
+    if(list->numFreeNodes >= count){
+        return RB_OK;
+    }
+
+    // Slabs grow geometrically so large lists need few allocations, bulk insertions get a single one
+    uint32_t numNodes = list->slabCapacity ? list->slabCapacity * 2 : LIST_SLAB_MIN_NODES;
+    if(numNodes > LIST_SLAB_MAX_NODES){
+        numNodes = LIST_SLAB_MAX_NODES;
+    }
+
+    list->slabCapacity = numNodes;
+
+    if(numNodes < count - list->numFreeNodes){
+        numNodes = count - list->numFreeNodes;
+    }
+
+    return ListPriv_addSlab(list, numNodes);
+}
+
+ListNode* ListPriv_allocNode(ListContext* list){
+    if(ListPriv_reserveNodes(list, 1) != RB_OK){
+        return NULL;
+    }
+
+    ListNode* node = list->freeNodes;
+
+    list->freeNodes = node->next;
+    list->numFreeNodes--;
+
+    return node;
+}
+
+void ListPriv_freeNode(ListContext* list, ListNode* node){
+    node->next = list->freeNodes;
+
+    list->freeNodes = node;
+    list->numFreeNodes++;
+}
+
+int32_t ListPriv_insertRange(ListContext* list, int32_t index, const void* elements, uint32_t count){
+    if(index < 0 || index > (int32_t)list->size || count > (uint32_t)INT32_MAX - list->size){
+        return RB_INVALID_ARG;
+    }
+
+    if(count == 0){
+        return RB_OK;
+    }
+
+    list->modCount++;
+
+    if(list->type == eRB_LIST_TYPE_ARRAY){
+        if(list->size + count > list->capacity){
+            uint32_t capacity = list->capacity * 2;
+
+            if(capacity < list->size + count){
+                capacity = list->size + count;
+            }
+
+            if(ListPriv_reserve(list, capacity < ARRAY_MIN_CAPACITY ? ARRAY_MIN_CAPACITY : capacity) != RB_OK){
+                return RB_ERROR;
+            }
+        }
+
+        uint8_t* slot = list->data + (size_t)index * list->elementSize;
+
+        memmove(slot + (size_t)count * list->elementSize, slot, (size_t)(list->size - index) * list->elementSize);
+        memcpy(slot, elements, (size_t)count * list->elementSize);
+
+        list->size += count;
+
+        return RB_OK;
+    }
+
+    if(ListPriv_reserveNodes(list, count) != RB_OK){
+        return RB_ERROR;
+    }
+
+    // Build the chain first, then splice it in
+    ListNode* first = NULL;
+    ListNode* last = NULL;
+
+    uint32_t i;
+    for(i=0; i<count; i++){
+        ListNode* node = ListPriv_allocNode(list);
+
+        memcpy(node->element, (const uint8_t*)elements + (size_t)i * list->elementSize, list->elementSize);
+
+        node->prev = last;
+        node->next = NULL;
+
+        if(last){
+            last->next = node;
+        }
+        else{
+            first = node;
+        }
+
+        last = node;
+    }
+
+    ListNode* next = index == (int32_t)list->size ? NULL : ListPriv_getNode(list, index);
+    ListNode* prev = next ? next->prev : list->tail;
+
+    first->prev = prev;
+    last->next = next;
+
+    if(prev){
+        prev->next = first;
+    }
+    else{
+        list->head = first;
+    }
+
+    if(next){
+        next->prev = last;
+    }
+    else{
+        list->tail = last;
+    }
+
+    list->size += count;
+
+    return RB_OK;
+}
+
+int32_t ListPriv_addAll(ListContext* list, const void* elements, uint32_t count){
+    int32_t rc = ListPriv_insertRange(list, list->size, elements, count);
+    if(rc != RB_OK || list->compareFnc == NULL || count == 0){
+        return rc;
+    }
+
+    // Stable sort keeps the existing elements before the new ones comparing equal, same as adding them one by one
+    return ListPriv_sort(list, list->compareFnc, eRB_SORT_ASCEND, 1);
+}
+
+int32_t ListPriv_removeRange(ListContext* list, int32_t index, uint32_t count){
+    if(index < 0 || index > (int32_t)list->size || count > list->size - index){
+        return RB_INVALID_ARG;
+    }
+
+    if(count == 0){
+        return RB_OK;
+    }
+
+    list->modCount++;
+
+    if(list->type == eRB_LIST_TYPE_ARRAY){
+        memmove(list->data + (size_t)index * list->elementSize,
+                list->data + (size_t)(index + count) * list->elementSize,
+                (size_t)(list->size - index - count) * list->elementSize);
+
+        list->size -= count;
+
+        return RB_OK;
+    }
+
+    ListNode* first = ListPriv_getNode(list, index);
+    ListNode* last = first;
+
+    uint32_t i;
+    for(i=1; i<count; i++){
+        last = last->next;
+    }
+
+    if(first->prev){
+        first->prev->next = last->next;
+    }
+    else{
+        list->head = last->next;
+    }
+
+    if(last->next){
+        last->next->prev = first->prev;
+    }
+    else{
+        list->tail = first->prev;
+    }
+
+    // Return the whole chain to the pool
+    last->next = list->freeNodes;
+    list->freeNodes = first;
+    list->numFreeNodes += count;
+
+    list->size -= count;
+
+    return RB_OK;
+}
+
+void ListPriv_getRange(ListContext* list, int32_t index, uint32_t count, void* elements){
+    if(list->type == eRB_LIST_TYPE_ARRAY){
+        memcpy(elements, list->data + (size_t)index * list->elementSize, (size_t)count * list->elementSize);
+
+        return;
+    }
+
+    ListNode* node = count ? ListPriv_getNode(list, index) : NULL;
+
+    uint32_t i;
+    for(i=0; i<count; i++, node = node->next){
+        memcpy((uint8_t*)elements + (size_t)i * list->elementSize, node->element, list->elementSize);
+    }
+}
+
+int32_t ListPriv_insertLockless(ListContext* list, int32_t index, const void* element){
+    if(index < 0 || index > (int32_t)list->size){
+        return RB_INVALID_ARG;
+    }
+
+    list->modCount++;
+
+    if(list->type == eRB_LIST_TYPE_ARRAY){
+        if(list->size == list->capacity){
+            uint32_t capacity = list->capacity * 2;
+
+            if(ListPriv_reserve(list, capacity < ARRAY_MIN_CAPACITY ? ARRAY_MIN_CAPACITY : capacity) != RB_OK){
+                return RB_ERROR;
+            }
+        }
+
+        uint8_t* slot = list->data + (size_t)index * list->elementSize;
+
+        memmove(slot + list->elementSize, slot, (size_t)(list->size - index) * list->elementSize);
+        memcpy(slot, element, list->elementSize);
+
+        list->size++;
+
+        return RB_OK;
+    }
+
+    ListNode* node = ListPriv_allocNode(list);
+    if(node == NULL){
+        return RB_ERROR;
+    }
+
+    memcpy(node->element, element, list->elementSize);
+
+    node->next = NULL;
+    node->prev = NULL;
+
+    if(index == (int32_t)list->size){
+        // Append
+        node->prev = list->tail;
+
+        if(list->tail){
+            list->tail->next = node;
+        }
+        else{
+            list->head = node;
+        }
+
+        list->tail = node;
+    }
+    else{
+        ListNode* next = ListPriv_getNode(list, index);
+
+        node->next = next;
+        node->prev = next->prev;
+
+        if(next->prev){
+            next->prev->next = node;
+        }
+        else{
+            list->head = node;
+        }
+
+        next->prev = node;
+    }
+
+    list->size++;
+
+    return RB_OK;
+}
+
+int32_t Rb_List_indexOf(Rb_ListHandle handle, void* element){
+    ListContext* list = ListPriv_getContext(handle);
+    if(list == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE_SHARED;
+
+    int32_t i;
+
+    int32_t index = -1;
+
+    if(list->compareFnc){
+        // Only the elements comparing equal need to be checked
+        for(i=ListPriv_bound(list, element, false); i<(int32_t)list->size; i++){
+            void* current = list->data + (size_t)i * list->elementSize;
+
+            if(list->compareFnc(list, current, element) != 0){
+                break;
+            }
+
+            if(memcmp(current, element, list->elementSize) == 0){
+                index = i;
+                break;
+            }
+        }
+    }
+    else if(list->type == eRB_LIST_TYPE_ARRAY){
+        for(i=0; i<(int32_t)list->size; i++){
+            if(memcmp(list->data + (size_t)i * list->elementSize, element, list->elementSize) == 0){
+                index = i;
+                break;
+            }
+        }
+    }
+    else{
+        ListNode* node = list->head;
+
+        for(i=0; node; i++, node = node->next){
+            if(memcmp(node->element, element, list->elementSize) == 0){
+                index = i;
+                break;
+            }
+        }
+    }
+
+    LOCK_RELEASE;
+
+    return index;
+}
+
+int32_t Rb_List_search(Rb_ListHandle handle, const void* element){
+    ListContext* list = ListPriv_getContext(handle);
+    if(list == NULL || element == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(list->compareFnc == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Operation supported only by sorted lists");
+    }
+
+    LOCK_ACQUIRE_SHARED;
+
+    int32_t index = ListPriv_bound(list, element, false);
+
+    if(index == (int32_t)list->size
+            || list->compareFnc(list, list->data + (size_t)index * list->elementSize, (void*)element) != 0){
+        index = -1;
+    }
+
+    LOCK_RELEASE;
+
+    return index;
+}
+
+int32_t Rb_List_lowerBound(Rb_ListHandle handle, const void* element){
+    ListContext* list = ListPriv_getContext(handle);
+    if(list == NULL || element == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(list->compareFnc == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Operation supported only by sorted lists");
+    }
+
+    LOCK_ACQUIRE_SHARED;
+
+    int32_t index = ListPriv_bound(list, element, false);
+
+    LOCK_RELEASE;
+
+    return index;
+}
+
+uint32_t ListPriv_bound(ListContext* list, const void* element, bool upper){
+    uint32_t low = 0;
+    uint32_t high = list->size;
+
+    while(low < high){
+        uint32_t middle = low + (high - low) / 2;
+
+        int32_t cmp = list->compareFnc(list, list->data + (size_t)middle * list->elementSize, (void*)element);
+
+        if(cmp < 0 || (upper && cmp == 0)){
+            low = middle + 1;
+        }
+        else{
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+int32_t Rb_List_begin(Rb_ListHandle handle, Rb_ListCursor* cursor){
+    ListContext* list = ListPriv_getContext(handle);
+    if(list == NULL || cursor == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE_SHARED;
+
+    cursor->handle = handle;
+    cursor->node = list->head;
+    cursor->index = 0;
+    cursor->modCount = list->modCount;
+
+    LOCK_RELEASE;
+
+    return RB_OK;
+}
+
+int32_t Rb_List_next(Rb_ListCursor* cursor, void* element){
+    if(cursor == NULL || element == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid argument");
+    }
+
+    ListContext* list = ListPriv_getContext(cursor->handle);
+    if(list == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE_SHARED;
+
+    if(cursor->modCount != list->modCount){
+        LOCK_RELEASE;
+        RB_ERRC(RB_ERROR, "List modified during iteration");
+    }
+
+    if(cursor->index >= (int32_t)list->size){
+        LOCK_RELEASE;
+        return RB_FALSE;
+    }
+
+    ListNode* node = (ListNode*)cursor->node;
+
+    memcpy(element, ListPriv_iterate(list, cursor->index, &node), list->elementSize);
+
+    cursor->node = node;
+    cursor->index++;
+
+    LOCK_RELEASE;
+
+    return RB_TRUE;
+}
+
+int32_t Rb_List_forEach(Rb_ListHandle handle, Rb_List_forEachFnc fnc, void* arg){
+    ListContext* list = ListPriv_getContext(handle);
+    if(list == NULL || fnc == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE;
+
+    int32_t rc = RB_OK;
+    int32_t i;
+    ListNode* node = list->head;
+
+    for(i=0; i<(int32_t)list->size && rc == RB_OK; i++){
+        rc = fnc(handle, i, ListPriv_iterate(list, i, &node), arg);
+    }
+
+    LOCK_RELEASE;
+
+    return rc;
+}
+
+int32_t Rb_List_findIf(Rb_ListHandle handle, Rb_List_predicateFnc predicate, void* arg, void* element){
+    ListContext* list = ListPriv_getContext(handle);
+    if(list == NULL || predicate == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    LOCK_ACQUIRE_SHARED;
+
+    int32_t i;
+    int32_t index = -1;
+    ListNode* node = list->head;
+
+    for(i=0; i<(int32_t)list->size; i++){
+        void* current = ListPriv_iterate(list, i, &node);
+
+        if(predicate(handle, current, arg)){
+            if(element){
+                memcpy(element, current, list->elementSize);
+            }
+
+            index = i;
+            break;
+        }
+    }
+
+    LOCK_RELEASE;
+
+    return index;
+}
+
+int32_t ListPriv_sortCompare(const ListSortContext* sort, const void* item1, const void* item2){
+    const void* element1 = item1;
+    const void* element2 = item2;
+
+    if(sort->list->type == eRB_LIST_TYPE_LINKED){
+        element1 = (*(ListNode* const*)item1)->element;
+        element2 = (*(ListNode* const*)item2)->element;
+    }
+
+    int32_t cmp = sort->compareFnc(sort->list, (void*)element1, (void*)element2);
+
+    return sort->mode == eRB_SORT_DESCEND ? -cmp : cmp;
+}
+
+void ListPriv_sortMerge(const ListSortContext* sort, uint8_t* items, uint8_t* aux, uint32_t middle, uint32_t count){
+    const uint32_t stride = sort->stride;
+
+    // Already in order
+    if(ListPriv_sortCompare(sort, items + (size_t)(middle - 1) * stride, items + (size_t)middle * stride) <= 0){
+        return;
+    }
+
+    uint32_t left = 0;
+    uint32_t right = middle;
+    uint32_t out = 0;
+
+    while(left < middle && right < count){
+        // Taking from the left run on equality keeps the sort stable
+        if(ListPriv_sortCompare(sort, items + (size_t)right * stride, items + (size_t)left * stride) < 0){
+            memcpy(aux + (size_t)out++ * stride, items + (size_t)right++ * stride, stride);
+        }
+        else{
+            memcpy(aux + (size_t)out++ * stride, items + (size_t)left++ * stride, stride);
+        }
+    }
+
+    // Remaining right run elements are already in place
+    memcpy(aux + (size_t)out * stride, items + (size_t)left * stride, (size_t)(middle - left) * stride);
+    out += middle - left;
+
+    memcpy(items, aux, (size_t)out * stride);
+}
+
+void ListPriv_sortRange(const ListSortContext* sort, uint8_t* items, uint8_t* aux, uint32_t count){
+    const uint32_t stride = sort->stride;
+
+    if(count <= LIST_SORT_INSERTION_THRESHOLD){
+        // Insertion sort for short runs
+        uint32_t i;
+
+        for(i=1; i<count; i++){
+            uint32_t j = i;
+
+            if(ListPriv_sortCompare(sort, items + (size_t)(j - 1) * stride, items + (size_t)j * stride) <= 0){
+                continue;
+            }
+
+            memcpy(aux, items + (size_t)i * stride, stride);
+
+            while(j > 0 && ListPriv_sortCompare(sort, items + (size_t)(j - 1) * stride, aux) > 0){
+                --j;
+            }
+
+            memmove(items + (size_t)(j + 1) * stride, items + (size_t)j * stride, (size_t)(i - j) * stride);
+            memcpy(items + (size_t)j * stride, aux, stride);
+        }
+
+        return;
+    }
+
+    const uint32_t middle = count / 2;
+
+    ListPriv_sortRange(sort, items, aux, middle);
+    ListPriv_sortRange(sort, items + (size_t)middle * stride, aux, count - middle);
+    ListPriv_sortMerge(sort, items, aux, middle, count);
+}
+
+void* ListPriv_sortThread(void* arg){
+    ListSortTask* task = (ListSortTask*)arg;
+
+    if(task->middle){
+        ListPriv_sortMerge(task->sort, task->items, task->aux, task->middle, task->count);
+    }
+    else{
+        ListPriv_sortRange(task->sort, task->items, task->aux, task->count);
+    }
+
+    return NULL;
+}
+
+int32_t ListPriv_sort(ListContext* list, Rb_List_compareFnc compareFnc, Rb_SortMode mode, uint32_t numThreads){
+    if(list->size < 2){
+        return RB_OK;
+    }
+
+    ListSortContext sort;
+    sort.list = list;
+    sort.compareFnc = compareFnc;
+    sort.mode = mode;
+
+    uint8_t* items = NULL;
+    uint32_t i;
+
+    if(list->type == eRB_LIST_TYPE_ARRAY){
+        // Elements are sorted in place
+        items = list->data;
+        sort.stride = list->elementSize;
+    }
+    else{
+        // Node pointers are sorted, and the nodes relinked afterwards
+        sort.stride = sizeof(ListNode*);
+
+        items = (uint8_t*)RB_MALLOC((size_t)list->size * sizeof(ListNode*));
+        if(items == NULL){
+            return RB_ERROR;
+        }
+
+        ListNode* node = list->head;
+        for(i=0; i<list->size; i++, node = node->next){
+            ((ListNode**)items)[i] = node;
+        }
+    }
+
+    uint8_t* aux = (uint8_t*)RB_MALLOC((size_t)list->size * sort.stride);
+    if(aux == NULL){
+        if(items != list->data){
+            RB_FREE(&items);
+        }
+
+        return RB_ERROR;
+    }
+
+    if(list->size < RB_LIST_PARALLEL_SORT_THRESHOLD){
+        numThreads = 1;
+    }
+    else if(numThreads > LIST_SORT_MAX_THREADS){
+        numThreads = LIST_SORT_MAX_THREADS;
+    }
+
+    if(numThreads <= 1){
+        ListPriv_sortRange(&sort, items, aux, list->size);
+    }
+    else{
+        ListSortTask tasks[LIST_SORT_MAX_THREADS];
+        pthread_t threads[LIST_SORT_MAX_THREADS];
+        bool started[LIST_SORT_MAX_THREADS];
+        uint32_t bounds[LIST_SORT_MAX_THREADS + 1];
+        uint32_t numRuns = numThreads;
+
+        // Sort equally sized runs concurrently
+        for(i=0; i<=numRuns; i++){
+            bounds[i] = (uint32_t)(((uint64_t)list->size * i) / numRuns);
+        }
+
+        for(i=0; i<numRuns; i++){
+            tasks[i].sort = &sort;
+            tasks[i].items = items + (size_t)bounds[i] * sort.stride;
+            tasks[i].aux = aux + (size_t)bounds[i] * sort.stride;
+            tasks[i].middle = 0;
+            tasks[i].count = bounds[i + 1] - bounds[i];
+
+            // A run whose thread can't be started is sorted on the calling thread
+            started[i] = pthread_create(&threads[i], NULL, ListPriv_sortThread, &tasks[i]) == 0;
+            if(!started[i]){
+                ListPriv_sortThread(&tasks[i]);
+            }
+        }
+
+        for(i=0; i<numRuns; i++){
+            if(started[i]){
+                pthread_join(threads[i], NULL);
+            }
+        }
+
+        // Merge neighboring runs pairwise, each pair on its own thread
+        while(numRuns > 1){
+            uint32_t numTasks = numRuns / 2;
+
+            for(i=0; i<numTasks; i++){
+                tasks[i].sort = &sort;
+                tasks[i].items = items + (size_t)bounds[2 * i] * sort.stride;
+                tasks[i].aux = aux + (size_t)bounds[2 * i] * sort.stride;
+                tasks[i].middle = bounds[2 * i + 1] - bounds[2 * i];
+                tasks[i].count = bounds[2 * i + 2] - bounds[2 * i];
+
+                started[i] = pthread_create(&threads[i], NULL, ListPriv_sortThread, &tasks[i]) == 0;
+                if(!started[i]){
+                    ListPriv_sortThread(&tasks[i]);
+                }
+            }
+
+            for(i=0; i<numTasks; i++){
+                if(started[i]){
+                    pthread_join(threads[i], NULL);
+                }
+            }
+
+            // Collapse the merged run bounds (an odd trailing run is carried over)
+            for(i=0; i<=numRuns; i+=2){
+                bounds[i / 2] = bounds[i];
+            }
+
+            if(numRuns % 2){
+                bounds[numRuns / 2 + 1] = bounds[numRuns];
+            }
+
+            numRuns = (numRuns + 1) / 2;
+        }
+    }
+
+    RB_FREE(&aux);
+
+    if(list->type == eRB_LIST_TYPE_LINKED){
+        ListNode** nodes = (ListNode**)items;
+
+        for(i=0; i<list->size; i++){
+            nodes[i]->prev = i > 0 ? nodes[i - 1] : NULL;
+            nodes[i]->next = i + 1 < list->size ? nodes[i + 1] : NULL;
+        }
+
+        list->head = nodes[0];
+        list->tail = nodes[list->size - 1];
+
+        RB_FREE(&items);
+    }
+
+    return RB_OK;
 }
@@ -0,0 +1,280 @@
+/*******************************************************/
+/*              Includes                               */
+/*******************************************************/
+
+#include "rb/MemoryStream.h"
+#include "rb/Common.h"
+#include "rb/Utils.h"
+#include "rb/priv/ErrorPriv.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/*******************************************************/
+/*              Defines                                */
+/*******************************************************/
+
+#define MEMORY_STREAM_MAGIC ( 0x4D53A3C1 )
+
+/*******************************************************/
+/*              Typedefs                               */
+/*******************************************************/
+
+typedef struct {
+    int32_t magic;
+    /**
+     * Backing array, NULL for streams over caller owned buffers.
+     */
+    Rb_ArrayHandle array;
+    bool ownsArray;
+    const uint8_t* buffer;
+    uint32_t bufferSize;
+    uint32_t position;
+    Rb_IOMode mode;
+} MemoryStreamContext;
+
+/*******************************************************/
+/*              Functions Declarations                 */
+/*******************************************************/
+
+static int32_t MStreamPriv_read(Rb_IOStreamHandle handle, void* data, uint32_t size);
+
+static int32_t MStreamPriv_write(Rb_IOStreamHandle handle, const void* data, uint32_t size);
+
+static int32_t MStreamPriv_tell(Rb_IOStreamHandle handle);
+
+static int32_t MStreamPriv_seek(Rb_IOStreamHandle handle, uint32_t position);
+
+static int32_t MStreamPriv_open(const char* uri, Rb_IOMode mode, Rb_IOStreamHandle* handle);
+
+static int32_t MStreamPriv_close(Rb_IOStreamHandle* handle);
+
+static MemoryStreamContext* MStreamPriv_getContext(Rb_IOStreamHandle handle);
+
+static MemoryStreamContext* MStreamPriv_new(Rb_IOMode mode);
+
+/*******************************************************/
+/*              Functions Definitions                  */
+/*******************************************************/
+
+int32_t Rb_MemoryStream_getApi(Rb_IOApi* api){
+    if(api == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid argument");
+    }
+
+    memset(api, 0x00, sizeof(Rb_IOApi));
+
+    api->close = MStreamPriv_close;
+    api->open = MStreamPriv_open;
+    api->read = MStreamPriv_read;
+    api->write = MStreamPriv_write;
+    api->seek = MStreamPriv_seek;
+    api->tell = MStreamPriv_tell;
+
+    return RB_OK;
+}
+
+int32_t Rb_MemoryStream_openArray(Rb_ArrayHandle array, Rb_IOMode mode, Rb_IOStreamHandle* handle){
+    if(array == NULL || handle == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid argument");
+    }
+
+    MemoryStreamContext* stream = MStreamPriv_new(mode);
+    if(stream == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid mode");
+    }
+
+    stream->array = array;
+
+    if(mode == eRB_IO_MODE_APPEND){
+        stream->position = Rb_Array_size(array);
+    }
+
+    *handle = stream;
+
+    return RB_OK;
+}
+
+int32_t Rb_MemoryStream_openBuffer(const void* data, uint32_t size, Rb_IOStreamHandle* handle){
+    if((data == NULL && size) || handle == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid argument");
+    }
+
+    MemoryStreamContext* stream = MStreamPriv_new(eRB_IO_MODE_READ);
+
+    stream->buffer = (const uint8_t*)data;
+    stream->bufferSize = size;
+
+    *handle = stream;
+
+    return RB_OK;
+}
+
+const uint8_t* Rb_MemoryStream_data(Rb_IOStreamHandle handle){
+    MemoryStreamContext* stream = MStreamPriv_getContext(handle);
+    if(stream == NULL){
+        RB_ERR("Invalid handle");
+        return NULL;
+    }
+
+    return stream->array ? Rb_Array_data(stream->array) : stream->buffer;
+}
+
+int32_t Rb_MemoryStream_size(Rb_IOStreamHandle handle){
+    MemoryStreamContext* stream = MStreamPriv_getContext(handle);
+    if(stream == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    return stream->array ? (int32_t)Rb_Array_size(stream->array) : (int32_t)stream->bufferSize;
+}
+
+int32_t MStreamPriv_read(Rb_IOStreamHandle handle, void* data, uint32_t size){
+    MemoryStreamContext* stream = MStreamPriv_getContext(handle);
+    if(stream == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(stream->mode == eRB_IO_MODE_WRITE || stream->mode == eRB_IO_MODE_APPEND){
+        RB_ERRC(RB_ERROR, "Stream not opened for reading");
+    }
+
+    const uint8_t* source = Rb_MemoryStream_data(handle);
+    const uint32_t available = (uint32_t)Rb_MemoryStream_size(handle);
+
+    // Short read at the end of the data, same as fread
+    if(stream->position >= available){
+        return 0;
+    }
+
+    if(size > available - stream->position){
+        size = available - stream->position;
+    }
+
+    memcpy(data, source + stream->position, size);
+
+    stream->position += size;
+
+    return (int32_t)size;
+}
+
+int32_t MStreamPriv_write(Rb_IOStreamHandle handle, const void* data, uint32_t size){
+    MemoryStreamContext* stream = MStreamPriv_getContext(handle);
+    if(stream == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(stream->mode == eRB_IO_MODE_READ || stream->array == NULL){
+        RB_ERRC(RB_ERROR, "Stream not opened for writing");
+    }
+
+    if(stream->mode == eRB_IO_MODE_APPEND){
+        stream->position = Rb_Array_size(stream->array);
+    }
+
+    int32_t rc = Rb_Array_seek(stream->array, stream->position);
+    if(rc != RB_OK){
+        return rc;
+    }
+
+    int32_t res = Rb_Array_write(stream->array, data, size);
+
+    if(res > 0){
+        stream->position += res;
+    }
+
+    return res;
+}
+
+int32_t MStreamPriv_tell(Rb_IOStreamHandle handle){
+    MemoryStreamContext* stream = MStreamPriv_getContext(handle);
+    if(stream == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    return (int32_t)stream->position;
+}
+
+int32_t MStreamPriv_seek(Rb_IOStreamHandle handle, uint32_t position){
+    MemoryStreamContext* stream = MStreamPriv_getContext(handle);
+    if(stream == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(position > INT32_MAX){
+        RB_ERRC(RB_INVALID_ARG, "Invalid position");
+    }
+
+    stream->position = position;
+
+    return RB_OK;
+}
+
+int32_t MStreamPriv_open(const char* uri, Rb_IOMode mode, Rb_IOStreamHandle* handle){
+    RB_UNUSED(uri);
+
+    if(handle == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid argument");
+    }
+
+    MemoryStreamContext* stream = MStreamPriv_new(mode);
+    if(stream == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid mode");
+    }
+
+    stream->array = Rb_Array_new();
+    if(stream->array == NULL){
+        RB_FREE(&stream);
+        RB_ERRC(RB_ERROR, "Error allocating array");
+    }
+
+    stream->ownsArray = true;
+
+    *handle = stream;
+
+    return RB_OK;
+}
+
+int32_t MStreamPriv_close(Rb_IOStreamHandle* handle){
+    MemoryStreamContext* stream = MStreamPriv_getContext(*handle);
+    if(stream == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(stream->ownsArray){
+        Rb_Array_free(&stream->array);
+    }
+
+    RB_FREE(&stream);
+    *handle = NULL;
+
+    return RB_OK;
+}
+
+MemoryStreamContext* MStreamPriv_new(Rb_IOMode mode){
+    if(mode != eRB_IO_MODE_READ && mode != eRB_IO_MODE_WRITE && mode != eRB_IO_MODE_READ_WRITE
+            && mode != eRB_IO_MODE_APPEND){
+        return NULL;
+    }
+
+    MemoryStreamContext* stream = (MemoryStreamContext*)RB_CALLOC(sizeof(MemoryStreamContext));
+
+    stream->magic = MEMORY_STREAM_MAGIC;
+    stream->mode = mode;
+
+    return stream;
+}
+
+MemoryStreamContext* MStreamPriv_getContext(Rb_IOStreamHandle handle){
+    if(handle == NULL){
+        return NULL;
+    }
+
+    MemoryStreamContext* stream = (MemoryStreamContext*)handle;
+    if(stream->magic != MEMORY_STREAM_MAGIC){
+        return NULL;
+    }
+
+    return stream;
+}
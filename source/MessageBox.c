@@ -11,6 +11,8 @@
 #include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <errno.h>
 
 /*******************************************************/
 /*              Defines                                */
@@ -18,15 +20,41 @@
 
 #define MESSAGE_BOX_MAGIC ( 0xAAF345BD )
 
+#define LOCK_ACQUIRE do{ pthread_mutex_lock(&mb->mutex); }while(0)
+
+#define LOCK_RELEASE do{ pthread_mutex_unlock(&mb->mutex); }while(0)
+
+#define SCHEDULED_INITIAL_CAPACITY ( 16 )
+
 /*******************************************************/
 /*              Typedefs                               */
 /*******************************************************/
 
+typedef struct {
+    struct timespec deadline;
+    uint64_t sequence;
+} ScheduledMessage;
+
+typedef struct {
+    /**
+     * Binary min-heap ordered by (deadline, sequence). Each slot holds a ScheduledMessage header followed by the
+     * message data; an extra slot at the end is used as scratch memory while sifting.
+     */
+    uint8_t* slots;
+    uint32_t slotSize;
+    uint32_t size;
+    uint32_t capacity;
+    uint64_t sequence;
+} ScheduledQueue;
+
 typedef struct {
     uint32_t magic;
     int32_t messageSize;
     int32_t capacity;
     Rb_CRingBufferHandle buffer;
+    ScheduledQueue scheduled;
+    pthread_mutex_t mutex;
+    pthread_cond_t cv;
 } MessageBoxContext;
 
 /*******************************************************/
@@ -35,6 +63,22 @@ typedef struct {
 
 static MessageBoxContext* MessageBoxPriv_getContext(Rb_MessageBoxHandle handle);
 
+static int32_t MessageBoxPriv_compareTime(const struct timespec* time1, const struct timespec* time2);
+
+static ScheduledMessage* MessageBoxPriv_getSlot(MessageBoxContext* mb, uint32_t index);
+
+static int32_t MessageBoxPriv_compareSlots(MessageBoxContext* mb, uint32_t index1, uint32_t index2);
+
+static void MessageBoxPriv_swapSlots(MessageBoxContext* mb, uint32_t index1, uint32_t index2);
+
+static int32_t MessageBoxPriv_push(MessageBoxContext* mb, const void* message, const struct timespec* deadline);
+
+static bool MessageBoxPriv_popDue(MessageBoxContext* mb, void* message, const struct timespec* now);
+
+static uint32_t MessageBoxPriv_countDue(MessageBoxContext* mb, uint32_t index, const struct timespec* now);
+
+static void MessageBoxPriv_notify(MessageBoxContext* mb);
+
 /*******************************************************/
 /*              Functions Definitions                  */
 /*******************************************************/
@@ -63,6 +107,13 @@ Rb_MessageBoxHandle Rb_MessageBox_new(int32_t messageSize, int32_t capacity) {
         return NULL;
     }
 
+    // Keep the slot headers aligned
+    mb->scheduled.slotSize = sizeof(ScheduledMessage)
+            + ((messageSize + sizeof(ScheduledMessage) - 1) / sizeof(ScheduledMessage)) * sizeof(ScheduledMessage);
+
+    pthread_mutex_init(&mb->mutex, NULL);
+    pthread_cond_init(&mb->cv, NULL);
+
     return mb;
 }
 
@@ -77,6 +128,13 @@ int32_t Rb_MessageBox_free(Rb_MessageBoxHandle* handle) {
         RB_ERRC(rc, "Error freeing internal buffer");
     }
 
+    if(mb->scheduled.slots) {
+        RB_FREE(&mb->scheduled.slots);
+    }
+
+    pthread_mutex_destroy(&mb->mutex);
+    pthread_cond_destroy(&mb->cv);
+
     RB_FREE(&mb);
     *handle = NULL;
 
@@ -93,17 +151,68 @@ int32_t Rb_MessageBox_readTimed(Rb_MessageBoxHandle handle, void* message, int32
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    int32_t res = Rb_CRingBuffer_readTimed(mb->buffer, (uint8_t*) message,
-            mb->messageSize, eRB_READ_BLOCK_FULL, timeoutMs);
-
-    if(res != mb->messageSize && Rb_CRingBuffer_isEnabled(mb->buffer) == RB_FALSE) {
-        return RB_DISABLED;
+    struct timespec timeout;
+    if(timeoutMs != RB_WAIT_INFINITE) {
+        Rb_Utils_getOffsetTime(&timeout, timeoutMs);
     }
-    else if(res == RB_TIMEOUT) {
-        return res;
-    } else {
-        return res == mb->messageSize ? RB_OK : RB_ERROR;\
+
+    int32_t res = RB_ERROR;
+
+    LOCK_ACQUIRE;
+
+    while(true) {
+        if(Rb_CRingBuffer_isEnabled(mb->buffer) == RB_FALSE) {
+            res = RB_DISABLED;
+            break;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        // Scheduled messages which reached their deadline are delivered first
+        if(MessageBoxPriv_popDue(mb, message, &now)) {
+            res = RB_OK;
+            break;
+        }
+
+        int32_t bytesRead = Rb_CRingBuffer_read(mb->buffer, (uint8_t*) message,
+                mb->messageSize, eRB_READ_BLOCK_NONE);
+        if(bytesRead == mb->messageSize) {
+            res = RB_OK;
+            break;
+        }
+        else if(bytesRead != 0) {
+            res = RB_ERROR;
+            break;
+        }
+
+        if(timeoutMs != RB_WAIT_INFINITE && MessageBoxPriv_compareTime(&now, &timeout) >= 0) {
+            res = RB_TIMEOUT;
+            break;
+        }
+
+        // Wait for a write, or until either the nearest scheduled message or the timeout is due
+        const struct timespec* wakeup = timeoutMs == RB_WAIT_INFINITE ? NULL : &timeout;
+
+        if(mb->scheduled.size) {
+            const struct timespec* deadline = &MessageBoxPriv_getSlot(mb, 0)->deadline;
+
+            if(wakeup == NULL || MessageBoxPriv_compareTime(deadline, wakeup) < 0) {
+                wakeup = deadline;
+            }
+        }
+
+        if(wakeup) {
+            pthread_cond_timedwait(&mb->cv, &mb->mutex, wakeup);
+        }
+        else {
+            pthread_cond_wait(&mb->cv, &mb->mutex);
+        }
     }
+
+    LOCK_RELEASE;
+
+    return res;
 }
 
 int32_t Rb_MessageBox_write(Rb_MessageBoxHandle handle, const void* message) {
@@ -118,6 +227,10 @@ int32_t Rb_MessageBox_writeTimed(Rb_MessageBoxHandle handle, const void* message
     int32_t res = Rb_CRingBuffer_writeTimed(mb->buffer, (const uint8_t*) message,
             mb->messageSize, eRB_WRITE_BLOCK_FULL, timeoutMs);
 
+    if(res == mb->messageSize) {
+        MessageBoxPriv_notify(mb);
+    }
+
     if(res != mb->messageSize && Rb_CRingBuffer_isEnabled(mb->buffer) == RB_FALSE) {
         return RB_DISABLED;
     }
@@ -128,6 +241,40 @@ int32_t Rb_MessageBox_writeTimed(Rb_MessageBoxHandle handle, const void* message
     }
 }
 
+int32_t Rb_MessageBox_writeAt(Rb_MessageBoxHandle handle, const void* message, const struct timespec* time){
+    MessageBoxContext* mb = MessageBoxPriv_getContext(handle);
+    if(mb == NULL || message == NULL || time == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid argument");
+    }
+
+    LOCK_ACQUIRE;
+
+    if(Rb_CRingBuffer_isEnabled(mb->buffer) == RB_FALSE) {
+        LOCK_RELEASE;
+        return RB_DISABLED;
+    }
+
+    if(MessageBoxPriv_push(mb, message, time) != RB_OK) {
+        LOCK_RELEASE;
+        RB_ERRC(RB_ERROR, "Error allocating scheduled message");
+    }
+
+    // Readers may be sleeping until a later deadline
+    pthread_cond_broadcast(&mb->cv);
+
+    LOCK_RELEASE;
+
+    return RB_OK;
+}
+
+int32_t Rb_MessageBox_writeAfter(Rb_MessageBoxHandle handle, const void* message, uint32_t delayMs){
+    struct timespec time;
+
+    Rb_Utils_getOffsetTime(&time, delayMs);
+
+    return Rb_MessageBox_writeAt(handle, message, &time);
+}
+
 int32_t Rb_MessageBox_getNumMessages(Rb_MessageBoxHandle handle) {
     MessageBoxContext* mb = MessageBoxPriv_getContext(handle);
     if(mb == NULL) {
@@ -138,9 +285,18 @@ int32_t Rb_MessageBox_getNumMessages(Rb_MessageBoxHandle handle) {
 
     if(res < 0) {
         return RB_ERROR;
-    } else {
-        return res / mb->messageSize;
     }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    LOCK_ACQUIRE;
+
+    uint32_t numDue = MessageBoxPriv_countDue(mb, 0, &now);
+
+    LOCK_RELEASE;
+
+    return res / mb->messageSize + numDue;
 }
 
 int32_t Rb_MessageBox_getCapacity(Rb_MessageBoxHandle handle){
@@ -158,7 +314,11 @@ int32_t Rb_MessageBox_disable(Rb_MessageBoxHandle handle) {
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    return Rb_CRingBuffer_disable(mb->buffer);
+    int32_t rc = Rb_CRingBuffer_disable(mb->buffer);
+
+    MessageBoxPriv_notify(mb);
+
+    return rc;
 }
 
 int32_t Rb_MessageBox_enable(Rb_MessageBoxHandle handle) {
@@ -200,5 +360,149 @@ int32_t Rb_MessageBox_clear(Rb_MessageBoxHandle handle) {
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
+    LOCK_ACQUIRE;
+
+    mb->scheduled.size = 0;
+
+    LOCK_RELEASE;
+
     return Rb_CRingBuffer_clear(mb->buffer);
 }
+
+int32_t MessageBoxPriv_compareTime(const struct timespec* time1, const struct timespec* time2){
+    if(time1->tv_sec != time2->tv_sec) {
+        return time1->tv_sec < time2->tv_sec ? -1 : 1;
+    }
+
+    if(time1->tv_nsec != time2->tv_nsec) {
+        return time1->tv_nsec < time2->tv_nsec ? -1 : 1;
+    }
+
+    return 0;
+}
+
+ScheduledMessage* MessageBoxPriv_getSlot(MessageBoxContext* mb, uint32_t index){
+    return (ScheduledMessage*)(mb->scheduled.slots + (size_t)index * mb->scheduled.slotSize);
+}
+
+int32_t MessageBoxPriv_compareSlots(MessageBoxContext* mb, uint32_t index1, uint32_t index2){
+    ScheduledMessage* msg1 = MessageBoxPriv_getSlot(mb, index1);
+    ScheduledMessage* msg2 = MessageBoxPriv_getSlot(mb, index2);
+
+    int32_t cmp = MessageBoxPriv_compareTime(&msg1->deadline, &msg2->deadline);
+    if(cmp != 0) {
+        return cmp;
+    }
+
+    // Messages with the same deadline are delivered in the order they were written
+    return msg1->sequence < msg2->sequence ? -1 : 1;
+}
+
+void MessageBoxPriv_swapSlots(MessageBoxContext* mb, uint32_t index1, uint32_t index2){
+    ScheduledMessage* tmp = MessageBoxPriv_getSlot(mb, mb->scheduled.capacity);
+    ScheduledMessage* slot1 = MessageBoxPriv_getSlot(mb, index1);
+    ScheduledMessage* slot2 = MessageBoxPriv_getSlot(mb, index2);
+
+    memcpy(tmp, slot1, mb->scheduled.slotSize);
+    memcpy(slot1, slot2, mb->scheduled.slotSize);
+    memcpy(slot2, tmp, mb->scheduled.slotSize);
+}
+
+int32_t MessageBoxPriv_push(MessageBoxContext* mb, const void* message, const struct timespec* deadline){
+    ScheduledQueue* queue = &mb->scheduled;
+
+    if(queue->size == queue->capacity) {
+        uint32_t capacity = queue->capacity ? queue->capacity * 2 : SCHEDULED_INITIAL_CAPACITY;
+
+        // One additional scratch slot used for swapping
+        uint8_t* slots = (uint8_t*)RB_REALLOC(queue->slots, (size_t)(capacity + 1) * queue->slotSize);
+        if(slots == NULL) {
+            return RB_ERROR;
+        }
+
+        queue->slots = slots;
+        queue->capacity = capacity;
+    }
+
+    uint32_t index = queue->size++;
+
+    ScheduledMessage* slot = MessageBoxPriv_getSlot(mb, index);
+    slot->deadline = *deadline;
+    slot->sequence = queue->sequence++;
+    memcpy(slot + 1, message, mb->messageSize);
+
+    // Sift up
+    while(index > 0) {
+        uint32_t parent = (index - 1) / 2;
+
+        if(MessageBoxPriv_compareSlots(mb, index, parent) >= 0) {
+            break;
+        }
+
+        MessageBoxPriv_swapSlots(mb, index, parent);
+        index = parent;
+    }
+
+    return RB_OK;
+}
+
+bool MessageBoxPriv_popDue(MessageBoxContext* mb, void* message, const struct timespec* now){
+    ScheduledQueue* queue = &mb->scheduled;
+
+    if(queue->size == 0 || MessageBoxPriv_compareTime(&MessageBoxPriv_getSlot(mb, 0)->deadline, now) > 0) {
+        return false;
+    }
+
+    memcpy(message, MessageBoxPriv_getSlot(mb, 0) + 1, mb->messageSize);
+
+    queue->size--;
+    if(queue->size == 0) {
+        return true;
+    }
+
+    memcpy(MessageBoxPriv_getSlot(mb, 0), MessageBoxPriv_getSlot(mb, queue->size), queue->slotSize);
+
+    // Sift down
+    uint32_t index = 0;
+
+    while(true) {
+        uint32_t smallest = index;
+        uint32_t left = 2 * index + 1;
+        uint32_t right = left + 1;
+
+        if(left < queue->size && MessageBoxPriv_compareSlots(mb, left, smallest) < 0) {
+            smallest = left;
+        }
+
+        if(right < queue->size && MessageBoxPriv_compareSlots(mb, right, smallest) < 0) {
+            smallest = right;
+        }
+
+        if(smallest == index) {
+            break;
+        }
+
+        MessageBoxPriv_swapSlots(mb, index, smallest);
+        index = smallest;
+    }
+
+    return true;
+}
+
+uint32_t MessageBoxPriv_countDue(MessageBoxContext* mb, uint32_t index, const struct timespec* now){
+    // Children are never due before their parent, so only the due part of the heap is visited
+    if(index >= mb->scheduled.size
+            || MessageBoxPriv_compareTime(&MessageBoxPriv_getSlot(mb, index)->deadline, now) > 0) {
+        return 0;
+    }
+
+    return 1 + MessageBoxPriv_countDue(mb, 2 * index + 1, now) + MessageBoxPriv_countDue(mb, 2 * index + 2, now);
+}
+
+void MessageBoxPriv_notify(MessageBoxContext* mb){
+    LOCK_ACQUIRE;
+
+    pthread_cond_broadcast(&mb->cv);
+
+    LOCK_RELEASE;
+}
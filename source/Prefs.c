@@ -8,41 +8,168 @@
 #include "rb/priv/PrefsPriv.h"
 #include "rb/priv/PrefsBackend.h"
 #include "rb/FileStream.h"
+#include "rb/MemoryStream.h"
 #include "rb/Utils.h"
 #include "rb/priv/ErrorPriv.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /*******************************************************/
 /*              Defines                                */
 /*******************************************************/
 
 #define PREFS_MAGIC ( 0x565634A5 )
+#define PREFS_KEY_MAGIC ( 0x565634A6 )
+#define PREFS_TRANSACTION_MAGIC ( 0x565634A7 )
+#define PREFS_BLOB_STREAM_MAGIC ( 0x565634A8 )
+
+#define PREFS_TRANSACTION_MIN_CAPACITY ( 16 )
+#define PREFS_SAVE_MIN_CALLBACKS ( 4 )
+
+/**
+ * Type filter of PrefsPriv_beginGet matching entries of any type.
+ */
+#define PREFS_ANY_TYPE ( -1 )
 
 
 /*******************************************************/
 /*              Typedefs                               */
 /*******************************************************/
 
+/**
+ * State of a single lookup (see PrefsPriv_beginGet).
+ */
+typedef struct {
+    /**
+     * Storage of the entry if the preferences are mapped.
+     */
+    PrefEntry mapped;
+    /**
+     * Read indicator held in concurrent mode, negative otherwise.
+     */
+    int32_t epoch;
+} PrefsRead;
+
 /*******************************************************/
 /*              Functions Declarations                 */
 /*******************************************************/
 
-static PrefsContext* PrefsPriv_getContext(Rb_PrefsHandle handle);
-static int32_t PrefsPriv_add(PrefsContext* prefs, const char* key, const Variant* var);
-static PrefEntry* PrefsPriv_get(PrefsContext* prefs, const char* key);
+static int32_t PrefsPriv_add(PrefsContext* prefs, const char* key, Variant* var);
+static int32_t PrefsPriv_addLocked(PrefsContext* prefs, const char* key, Variant* var);
+static int32_t PrefsPriv_addHashed(PrefsContext* prefs, const char* key, uint32_t hash, Variant* var, PrefEntry** added);
+static int32_t PrefsPriv_addByKey(PrefsContext* prefs, PrefsKeyContext* keyContext, Variant* var);
+static int32_t PrefsPriv_setLocked(PrefsContext* prefs, const char* key, Variant* var);
+static PrefEntry* PrefsPriv_get(PrefsContext* prefs, const char* key, PrefEntry* mapped);
 static int32_t PrefsPriv_remove(PrefsContext* prefs, const char* key);
+static int32_t PrefsPriv_removeEntry(PrefsContext* prefs, const char* key);
+static PrefEntry* PrefsPriv_unlinkEntry(PrefsContext* prefs, const char* key);
+static void PrefsPriv_freeEntry(PrefEntry* entry);
+static void PrefsPriv_freeVariant(Variant* var);
+static void PrefsPriv_unmap(PrefsContext* prefs);
+static int32_t PrefsPriv_journal(PrefsContext* prefs, const char* key);
+static int32_t PrefsPriv_appendJournal(PrefsContext* prefs, const char* key);
+static int32_t PrefsPriv_repairJournal(PrefsContext* prefs);
+static int32_t PrefsPriv_compact(PrefsContext* prefs);
+static int32_t PrefsPriv_flushJournal(PrefsContext* prefs);
+static void PrefsPriv_closeJournal(PrefsContext* prefs);
+static char* PrefsPriv_makePath(const char* filePath, const char* suffix);
+static PrefsKeyContext* PrefsPriv_getKeyContext(PrefsContext* prefs, Rb_PrefsKeyHandle key);
+static const PrefEntry* PrefsPriv_getByKey(PrefsContext* prefs, Rb_PrefsKeyHandle key, Rb_VariantType type,
+        PrefsRead* read);
+static int32_t PrefsPriv_clear(PrefsContext* prefs);
+static int32_t PrefsPriv_openJournal(Rb_PrefsHandle handle, const char* filePath, uint32_t compactThreshold);
+static const PrefEntry* PrefsPriv_beginGet(PrefsContext* prefs, const char* key, int32_t type, PrefsRead* read);
+static void PrefsPriv_endGet(PrefsContext* prefs, PrefsRead* read);
+static int32_t PrefsPriv_enterRead(PrefsContext* prefs);
+static void PrefsPriv_exitRead(PrefsContext* prefs, int32_t epoch);
+static void PrefsPriv_lock(PrefsContext* prefs);
+static int32_t PrefsPriv_unlock(PrefsContext* prefs, int32_t rc);
+static int32_t PrefsPriv_publish(PrefsContext* prefs);
+static void PrefsPriv_waitReaders(PrefsContext* prefs, int32_t epoch);
+static PrefsSnapshot* PrefsPriv_newSnapshot(PrefsContext* prefs);
+static void PrefsPriv_freeSnapshot(PrefsSnapshot* snapshot);
+static PrefsTransactionContext* PrefsPriv_getTransactionContext(Rb_PrefsTransactionHandle handle);
+static int32_t PrefsPriv_stage(PrefsTransactionContext* transaction, const char* key, Variant* var, int32_t remove);
+static void* PrefsPriv_saveThread(void* arg);
+static int32_t PrefsPriv_writeFile(const char* filePath, const uint8_t* data, uint32_t size);
+static int32_t PrefsPriv_syncPath(const char* path);
+static int32_t PrefsPriv_replaceFile(const char* tmpPath, const char* filePath);
+static void PrefsPriv_stopSaver(PrefsContext* prefs);
+static int32_t PrefsPriv_saveFile(Rb_PrefsHandle handle, const char* filePath);
+static PrefsBlobStream* PrefsPriv_getBlobStream(Rb_IOStreamHandle handle);
+static int32_t PrefsPriv_readBlobStream(Rb_IOStreamHandle handle, void* data, uint32_t size);
+static int32_t PrefsPriv_writeBlobStream(Rb_IOStreamHandle handle, const void* data, uint32_t size);
+static int32_t PrefsPriv_tellBlobStream(Rb_IOStreamHandle handle);
+static int32_t PrefsPriv_seekBlobStream(Rb_IOStreamHandle handle, uint32_t position);
+static int32_t PrefsPriv_closeBlobStream(Rb_IOStreamHandle* handle);
+static int32_t PrefsPriv_loadBlob(PrefsContext* prefs, PrefEntry* entry);
+static PrefsBlobFile* PrefsPriv_openBlobFile(const char* filePath);
+static void PrefsPriv_releaseBlobFile(PrefsBlobFile* file);
+static void* PrefsPriv_alloc(PrefsContext* prefs, uint32_t size);
+static PrefEntry* PrefsPriv_newEntry(PrefsContext* prefs, const char* key, const Variant* var);
+static void PrefsPriv_releaseEntry(PrefsContext* prefs, PrefEntry* entry);
+static void PrefsPriv_releaseVariant(PrefsContext* prefs, Variant* var);
+static int32_t PrefsPriv_adopt(PrefsContext* prefs, Variant* var);
+static int32_t PrefsPriv_removePrefix(PrefsContext* prefs, const char* prefix);
+static int32_t PrefsPriv_compareKeys(Rb_ListHandle handle, void* elem1, void* elem2);
+static Rb_ListHandle PrefsPriv_getOrdered(PrefsContext* prefs);
+static void PrefsPriv_order(PrefsContext* prefs, PrefEntry* entry);
+static void PrefsPriv_unorder(PrefsContext* prefs, PrefEntry* entry);
 
 /*******************************************************/
 /*              Functions Definitions                  */
 /*******************************************************/
 
 Rb_PrefsHandle Rb_Prefs_new(const Rb_PrefsBackend* backend){
+    Rb_PrefsConfig config;
+
+    Rb_Prefs_getDefaultConfig(&config);
+    config.backend = backend;
+
+    return Rb_Prefs_newWithConfig(&config);
+}
+
+int32_t Rb_Prefs_getDefaultConfig(Rb_PrefsConfig* config){
+    if(config == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid argument");
+    }
+
+    memset(config, 0x00, sizeof(Rb_PrefsConfig));
+
+    config->backend = NULL;
+    config->concurrency = eRB_PREFS_CONCURRENCY_NONE;
+    config->lazyBlobSize = 0;
+    config->arenaChunkSize = 0;
+
+    return RB_OK;
+}
+
+Rb_PrefsHandle Rb_Prefs_newWithConfig(const Rb_PrefsConfig* config){
+    if(config == NULL || (config->concurrency != eRB_PREFS_CONCURRENCY_NONE
+            && config->concurrency != eRB_PREFS_CONCURRENCY_SNAPSHOT)
+            || ((config->lazyBlobSize || config->arenaChunkSize) && config->concurrency != eRB_PREFS_CONCURRENCY_NONE)){
+        RB_ERR("Invalid configuration");
+        return NULL;
+    }
+
+    const Rb_PrefsBackend* backend = config->backend;
+
     PrefsContext* prefs = (PrefsContext*)RB_CALLOC(sizeof(PrefsContext));
 
     prefs->magic = PREFS_MAGIC;
+    prefs->concurrency = config->concurrency;
+    prefs->lazyBlobSize = config->lazyBlobSize;
+
+    PrefsArena_init(&prefs->arena, config->arenaChunkSize);
 
     if(backend){
         prefs->backend = *backend;
@@ -52,14 +179,52 @@ Rb_PrefsHandle Rb_Prefs_new(const Rb_PrefsBackend* backend){
 
         prefs->backend.load = Rb_PrefsBackendLoad;
         prefs->backend.save = Rb_PrefsBackendSave;
+        prefs->backend.append = Rb_PrefsBackendAppend;
+        prefs->backend.replay = Rb_PrefsBackendReplay;
     }
 
-    prefs->entries = Rb_List_new(sizeof(PrefEntry*));
+    Rb_ListConfig listConfig;
+    Rb_List_getDefaultConfig(&listConfig);
+
+    // Entries are accessed by index, so keep them in contiguous memory
+    listConfig.type = eRB_LIST_TYPE_ARRAY;
+
+    prefs->entries = Rb_List_newWithConfig(sizeof(PrefEntry*), &listConfig);
     if(prefs->entries == NULL){
         RB_ERR("Error allocating internal list");
         return NULL;
     }
 
+    if(PrefsIndex_init(&prefs->index) != RB_OK){
+        RB_ERR("Error allocating index");
+        Rb_List_free(&prefs->entries);
+        RB_FREE(&prefs);
+        return NULL;
+    }
+
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        // Updates may be nested (e.g. load clears and puts)
+        pthread_mutexattr_t attr;
+
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&prefs->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+
+        prefs->snapshot = PrefsPriv_newSnapshot(prefs);
+        if(prefs->snapshot == NULL){
+            RB_ERR("Error allocating snapshot");
+            pthread_mutex_destroy(&prefs->mutex);
+            PrefsIndex_destroy(&prefs->index);
+            Rb_List_free(&prefs->entries);
+            RB_FREE(&prefs);
+            return NULL;
+        }
+    }
+
+    pthread_mutex_init(&prefs->saver.mutex, NULL);
+    pthread_cond_init(&prefs->saver.cv, NULL);
+
     return (Rb_PrefsHandle)prefs;
 }
 
@@ -71,6 +236,12 @@ int32_t Rb_Prefs_free(Rb_PrefsHandle* handle){
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
+    // Requested saves are written first
+    PrefsPriv_stopSaver(prefs);
+
+    // Freeing must not persist the cleared state
+    PrefsPriv_closeJournal(prefs);
+
     rc = Rb_Prefs_clear(*handle);
     if(rc != RB_OK){
         RB_ERRC(rc, "Error clearing preferences");
@@ -83,6 +254,13 @@ int32_t Rb_Prefs_free(Rb_PrefsHandle* handle){
         return rc;
     }
 
+    PrefsIndex_destroy(&prefs->index);
+
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        PrefsPriv_freeSnapshot(prefs->snapshot);
+        pthread_mutex_destroy(&prefs->mutex);
+    }
+
     RB_FREE(&prefs);
     *handle = NULL;
 
@@ -148,7 +326,7 @@ int32_t Rb_Prefs_putString(Rb_PrefsHandle handle, const char* key, const char* v
     Variant var;
 
     var.type = eRB_VAR_TYPE_STRING;
-    var.val.stringVal = (char*)RB_MALLOC(strlen(value) + 1);
+    var.val.stringVal = (char*)PrefsPriv_alloc(prefs, strlen(value) + 1);
     strcpy(var.val.stringVal, value);
 
     return PrefsPriv_add(prefs, key, &var);
@@ -166,7 +344,8 @@ int32_t Rb_Prefs_putBlob(Rb_PrefsHandle handle, const char* key, const void* dat
 
     var.type = eRB_VAR_TYPE_BLOB;
     var.val.blobVal.size = size;
-    var.val.blobVal.data = RB_MALLOC(size);
+    var.val.blobVal.data = PrefsPriv_alloc(prefs, size);
+    var.val.blobVal.file = NULL;
     memcpy(var.val.blobVal.data, data, size);
 
     return PrefsPriv_add(prefs, key, &var);
@@ -178,17 +357,16 @@ int32_t Rb_Prefs_getInt32(Rb_PrefsHandle handle, const char* key, int32_t* value
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    PrefEntry* entry = PrefsPriv_get(prefs, key);
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_beginGet(prefs, key, eRB_VAR_TYPE_INT32, &read);
     if(entry == NULL){
-        RB_ERRC(RB_INVALID_ARG, "Invalid key");
-    }
-
-    if(entry->value.type != eRB_VAR_TYPE_INT32){
-        return RB_INVALID_ARG;
+        RB_ERRC(RB_INVALID_ARG, "Invalid key or type");
     }
 
     *value = entry->value.val.int32Val;
 
+    PrefsPriv_endGet(prefs, &read);
+
     return RB_OK;
 }
 
@@ -198,17 +376,16 @@ int32_t Rb_Prefs_getInt64(Rb_PrefsHandle handle, const char* key, int64_t* value
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    PrefEntry* entry = PrefsPriv_get(prefs, key);
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_beginGet(prefs, key, eRB_VAR_TYPE_INT64, &read);
     if(entry == NULL){
-        RB_ERRC(RB_INVALID_ARG, "Invalid key");
-    }
-
-    if(entry->value.type != eRB_VAR_TYPE_INT64){
-        RB_ERRC(RB_INVALID_ARG, "Invalid type (expected %d but got %d)", eRB_VAR_TYPE_INT64, entry->value->type);
+        RB_ERRC(RB_INVALID_ARG, "Invalid key or type");
     }
 
     *value = entry->value.val.int64Val;
 
+    PrefsPriv_endGet(prefs, &read);
+
     return RB_OK;
 }
 
@@ -218,17 +395,16 @@ int32_t Rb_Prefs_getFloat(Rb_PrefsHandle handle, const char* key, float* value){
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    PrefEntry* entry = PrefsPriv_get(prefs, key);
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_beginGet(prefs, key, eRB_VAR_TYPE_FLOAT, &read);
     if(entry == NULL){
-        RB_ERRC(RB_INVALID_ARG, "Invalid key");
-    }
-
-    if(entry->value.type != eRB_VAR_TYPE_FLOAT){
-        RB_ERRC(RB_INVALID_ARG, "Invalid type (expected %d but got %d)", eRB_VAR_TYPE_FLOAT, entry->value->type);
+        RB_ERRC(RB_INVALID_ARG, "Invalid key or type");
     }
 
     *value = entry->value.val.floatVal;
 
+    PrefsPriv_endGet(prefs, &read);
+
     return RB_OK;
 }
 
@@ -238,18 +414,17 @@ int32_t Rb_Prefs_getString(Rb_PrefsHandle handle, const char* key, char** value)
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    PrefEntry* entry = PrefsPriv_get(prefs, key);
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_beginGet(prefs, key, eRB_VAR_TYPE_STRING, &read);
     if(entry == NULL){
-        RB_ERRC(RB_INVALID_ARG, "Invalid key");
-    }
-
-    if(entry->value.type != eRB_VAR_TYPE_STRING){
-        RB_ERRC(RB_INVALID_ARG, "Invalid type (expected %d but got %d)", eRB_VAR_TYPE_STRING, entry->value->type);
+        RB_ERRC(RB_INVALID_ARG, "Invalid key or type");
     }
 
     *value = (char*)RB_MALLOC(strlen(entry->value.val.stringVal) + 1);
     strcpy(*value, entry->value.val.stringVal);
 
+    PrefsPriv_endGet(prefs, &read);
+
     return RB_OK;
 }
 
@@ -259,18 +434,163 @@ int32_t Rb_Prefs_getBlob(Rb_PrefsHandle handle, const char* key, void** data, ui
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    PrefEntry* entry = PrefsPriv_get(prefs, key);
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_beginGet(prefs, key, eRB_VAR_TYPE_BLOB, &read);
     if(entry == NULL){
-        RB_ERRC(RB_INVALID_ARG, "Invalid key");
+        RB_ERRC(RB_INVALID_ARG, "Invalid key or type");
+    }
+
+    *size = entry->value.val.blobVal.size;
+    *data = RB_MALLOC(*size);
+
+    int32_t rc = PrefsPriv_readBlob(&entry->value, 0, *data, *size);
+
+    PrefsPriv_endGet(prefs, &read);
+
+    if(rc != RB_OK){
+        RB_FREE(data);
+        RB_ERRC(rc, "Error reading blob");
+    }
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_getStringView(Rb_PrefsHandle handle, const char* key, const char** value, uint32_t* length){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || value == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    // Snapshots may be released as soon as the call returns
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        RB_ERRC(RB_NOT_IMPLEMENTED, "Views aren't available in concurrent mode");
+    }
+
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_beginGet(prefs, key, eRB_VAR_TYPE_STRING, &read);
+    if(entry == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key or type");
+    }
+
+    *value = entry->value.val.stringVal;
+
+    if(length){
+        *length = strlen(entry->value.val.stringVal);
+    }
+
+    PrefsPriv_endGet(prefs, &read);
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_getBlobView(Rb_PrefsHandle handle, const char* key, const void** data, uint32_t* size){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || data == NULL || size == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        RB_ERRC(RB_NOT_IMPLEMENTED, "Views aren't available in concurrent mode");
     }
 
-    if(entry->value.type != eRB_VAR_TYPE_BLOB){
-        RB_ERRC(RB_INVALID_ARG, "Invalid type (expected %d but got %d)", eRB_VAR_TYPE_BLOB, entry->value->type);
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_beginGet(prefs, key, eRB_VAR_TYPE_BLOB, &read);
+    if(entry == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key or type");
+    }
+
+    // Blobs left in a file are loaded for good by the first view
+    if(PrefsPriv_loadBlob(prefs, (PrefEntry*)entry) != RB_OK){
+        PrefsPriv_endGet(prefs, &read);
+        RB_ERRC(RB_ERROR, "Error reading blob");
     }
 
+    *data = entry->value.val.blobVal.data;
     *size = entry->value.val.blobVal.size;
-    *data = RB_MALLOC(*size);
-    memcpy(*data, entry->value.val.blobVal.data, *size);
+
+    PrefsPriv_endGet(prefs, &read);
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_copyString(Rb_PrefsHandle handle, const char* key, char* buffer, uint32_t bufferSize){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || buffer == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_beginGet(prefs, key, eRB_VAR_TYPE_STRING, &read);
+    if(entry == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key or type");
+    }
+
+    const uint32_t length = strlen(entry->value.val.stringVal);
+
+    if(length < bufferSize){
+        memcpy(buffer, entry->value.val.stringVal, length + 1);
+    }
+
+    PrefsPriv_endGet(prefs, &read);
+
+    if(length >= bufferSize){
+        RB_ERRC(RB_INVALID_ARG, "Buffer too small");
+    }
+
+    return (int32_t)length;
+}
+
+int32_t Rb_Prefs_copyBlob(Rb_PrefsHandle handle, const char* key, void* buffer, uint32_t bufferSize){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || (buffer == NULL && bufferSize)){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_beginGet(prefs, key, eRB_VAR_TYPE_BLOB, &read);
+    if(entry == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key or type");
+    }
+
+    const uint32_t size = entry->value.val.blobVal.size;
+    const int32_t fits = size <= bufferSize && size <= (uint32_t)INT32_MAX;
+    int32_t rc = RB_OK;
+
+    if(fits){
+        rc = PrefsPriv_readBlob(&entry->value, 0, buffer, size);
+    }
+
+    PrefsPriv_endGet(prefs, &read);
+
+    if(!fits){
+        RB_ERRC(RB_INVALID_ARG, "Buffer too small");
+    }
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error reading blob");
+    }
+
+    return (int32_t)size;
+}
+
+int32_t Rb_Prefs_getGeneration(Rb_PrefsHandle handle, uint32_t* generation){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || generation == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    // Readers see the generation of the published snapshot
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        int32_t epoch = PrefsPriv_enterRead(prefs);
+
+        *generation = __atomic_load_n(&prefs->snapshot, __ATOMIC_SEQ_CST)->generation;
+
+        PrefsPriv_exitRead(prefs, epoch);
+
+        return RB_OK;
+    }
+
+    *generation = prefs->generation;
 
     return RB_OK;
 }
@@ -281,20 +601,53 @@ int32_t Rb_Prefs_clear(Rb_PrefsHandle handle){
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
+    PrefsPriv_lock(prefs);
+
+    return PrefsPriv_unlock(prefs, PrefsPriv_clear(prefs));
+}
+
+int32_t PrefsPriv_clear(PrefsContext* prefs){
     int32_t rc;
+    int32_t i;
 
-    while(Rb_List_getSize(prefs->entries)){
+    prefs->generation++;
+
+    PrefsPriv_unmap(prefs);
+
+    // Free all the entries at once, removing them one by one would shift the list for each. Arena entries are freed
+    // with the arena, only the files their blobs may be left in are released one by one.
+    for(i=0; (prefs->arena.chunkSize == 0 || prefs->lazyBlobSize) && i<Rb_List_getSize(prefs->entries); i++){
         PrefEntry* entry;
 
-        rc = Rb_List_get(prefs->entries, 0, &entry);
+        rc = Rb_List_get(prefs->entries, i, &entry);
         if(rc != RB_OK){
             return rc;
         }
 
-        rc = PrefsPriv_remove(prefs, entry->key);
-        if(rc != RB_OK){
-            return rc;
-        }
+        PrefsPriv_releaseEntry(prefs, entry);
+    }
+
+    PrefsIndex_clear(&prefs->index);
+
+    // Rebuilt by the next prefix query, so loaded entries aren't inserted into it one by one
+    if(prefs->ordered){
+        Rb_List_free(&prefs->ordered);
+    }
+
+    rc = Rb_List_clear(prefs->entries);
+    if(rc != RB_OK){
+        return rc;
+    }
+
+    PrefsArena_clear(&prefs->arena);
+
+    if(prefs->arenaReserve && PrefsArena_reserve(&prefs->arena, prefs->arenaReserve) != RB_OK){
+        return RB_ERROR;
+    }
+
+    // Empty snapshot replaces the journal
+    if(prefs->journal.stream.handle){
+        return PrefsPriv_compact(prefs);
     }
 
     return RB_OK;
@@ -306,6 +659,20 @@ int32_t Rb_Prefs_getNumEntries(Rb_PrefsHandle handle){
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        int32_t epoch = PrefsPriv_enterRead(prefs);
+
+        int32_t numEntries = (int32_t)__atomic_load_n(&prefs->snapshot, __ATOMIC_SEQ_CST)->numEntries;
+
+        PrefsPriv_exitRead(prefs, epoch);
+
+        return numEntries;
+    }
+
+    if(prefs->mapping.data){
+        return prefs->mapping.numEntries;
+    }
+
     return Rb_List_getSize(prefs->entries);
 }
 
@@ -317,6 +684,23 @@ int32_t Rb_Prefs_getKey(Rb_PrefsHandle handle, uint32_t index, const char** key)
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        RB_ERRC(RB_NOT_IMPLEMENTED, "Views aren't available in concurrent mode");
+    }
+
+    if(prefs->mapping.data){
+        PrefEntry mapped;
+
+        rc = Rb_PrefsBackendMappedGet(&prefs->mapping, (int32_t)index, &mapped);
+        if(rc != RB_OK){
+            RB_ERRC(RB_INVALID_ARG, "Index out of bounds");
+        }
+
+        *key = mapped.key;
+
+        return RB_OK;
+    }
+
     PrefEntry* entry = NULL;
     rc = Rb_List_get(prefs->entries, index, &entry);
     if (rc != RB_OK) {
@@ -329,20 +713,21 @@ int32_t Rb_Prefs_getKey(Rb_PrefsHandle handle, uint32_t index, const char** key)
 }
 
 int32_t Rb_Prefs_getEntryType(Rb_PrefsHandle handle, const char* key, Rb_VariantType* type){
-    int32_t rc;
-
     PrefsContext* prefs = PrefsPriv_getContext(handle);
-    if (prefs == NULL) {
+    if (prefs == NULL || type == NULL) {
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    PrefEntry* entry = PrefsPriv_get(prefs, key);
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_beginGet(prefs, key, PREFS_ANY_TYPE, &read);
     if(entry == NULL){
         RB_ERRC(RB_INVALID_ARG, "Invalid key");
     }
 
     *type = entry->value.type;
 
+    PrefsPriv_endGet(prefs, &read);
+
     return RB_OK;
 }
 
@@ -352,7 +737,14 @@ int32_t Rb_Prefs_contains(Rb_PrefsHandle handle, const char* key){
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    return PrefsPriv_get(prefs, key) != NULL;
+    PrefsRead read;
+    if(PrefsPriv_beginGet(prefs, key, PREFS_ANY_TYPE, &read) == NULL){
+        return RB_FALSE;
+    }
+
+    PrefsPriv_endGet(prefs, &read);
+
+    return RB_TRUE;
 }
 
 int32_t Rb_Prefs_remove(Rb_PrefsHandle handle, const char* key){
@@ -361,7 +753,9 @@ int32_t Rb_Prefs_remove(Rb_PrefsHandle handle, const char* key){
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    int32_t res = PrefsPriv_remove(prefs, key);
+    PrefsPriv_lock(prefs);
+
+    int32_t res = PrefsPriv_unlock(prefs, PrefsPriv_remove(prefs, key));
 
     if(res != RB_OK){
         RB_ERRC(res, "Invalid key");
@@ -370,121 +764,350 @@ int32_t Rb_Prefs_remove(Rb_PrefsHandle handle, const char* key){
     return res;
 }
 
-int32_t PrefsPriv_add(PrefsContext* prefs, const char* key, const Variant* var){
-    if(PrefsPriv_get(prefs, key)){
+int32_t Rb_Prefs_forEachPrefix(Rb_PrefsHandle handle, const char* prefix, Rb_PrefsKeyFnc fnc, void* userData){
+    int32_t rc = RB_OK;
+
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || prefix == NULL || fnc == NULL){
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    PrefEntry* entry = (PrefEntry*)RB_CALLOC(sizeof(PrefEntry));
-
-    entry->key = (char*)RB_MALLOC(strlen(key) + 1);
-    strcpy(entry->key, key);
+    size_t length = strlen(prefix);
 
-    memcpy(&entry->value, var, sizeof(Variant));
+    // Mapped files carry a sorted table of their own
+    if(prefs->mapping.data){
+        PrefEntry mapped;
+        int32_t position;
 
-    return Rb_List_add(prefs->entries, &entry);
-}
+        if(Rb_PrefsBackendMappedLowerBound(&prefs->mapping, prefix, &position) != RB_OK){
+            RB_ERRC(RB_ERROR, "Invalid entry");
+        }
 
+        for(; rc == RB_OK && position < prefs->mapping.numEntries; position++){
+            if(Rb_PrefsBackendMappedGetSorted(&prefs->mapping, position, &mapped) != RB_OK){
+                RB_ERRC(RB_ERROR, "Invalid entry");
+            }
 
-PrefEntry* PrefsPriv_get(PrefsContext* prefs, const char* key){
-    int32_t i;
-    int32_t rc;
+            if(strncmp(mapped.key, prefix, length) != 0){
+                break;
+            }
 
-    for(i=0; i<Rb_List_getSize(prefs->entries); i++){
-        PrefEntry* entry = NULL;
-        rc = Rb_List_get(prefs->entries, i, &entry);
-        if(rc != RB_OK){
-            return NULL;
+            rc = fnc(handle, mapped.key, userData);
         }
 
-        if(strcmp(key, entry->key) == 0){
-            return entry;
-        }
+        return rc;
     }
 
-    return NULL;
-}
+    // Holds off writers (not readers) while the keys are visited
+    PrefsPriv_lock(prefs);
 
-int32_t PrefsPriv_remove(PrefsContext* prefs, const char* key){
-    int32_t i;
-    int32_t rc;
+    Rb_ListHandle ordered = PrefsPriv_getOrdered(prefs);
+    if(ordered == NULL){
+        PrefsPriv_unlock(prefs, RB_ERROR);
+        RB_ERRC(RB_ERROR, "Error sorting keys");
+    }
 
-    for (i = 0; i < Rb_List_getSize(prefs->entries); i++) {
-        PrefEntry* entry = NULL;
-        rc = Rb_List_get(prefs->entries, i, &entry);
-        if (rc != RB_OK) {
-            return rc;
-        }
+    PrefEntry bound;
+    PrefEntry* boundPtr = &bound;
 
-        if(strcmp(key, entry->key) == 0){
-            rc = Rb_List_remove(prefs->entries, i);
-            if(rc != RB_OK){
-                return rc;
-            }
+    bound.key = (char*)prefix;
 
-            if(entry->value.type == eRB_VAR_TYPE_BLOB){
-                RB_FREE(&entry->value.val.blobVal.data);
-            }
-            else if(entry->value.type == eRB_VAR_TYPE_STRING){
-                RB_FREE(&entry->value.val.stringVal);
-            }
+    // Keys sharing the prefix are contiguous in the sorted order, starting at the prefix itself
+    int32_t index = Rb_List_lowerBound(ordered, &boundPtr);
+    int32_t size = Rb_List_getSize(ordered);
 
-            RB_FREE(&entry->key);
-            RB_FREE(&entry);
+    for(; rc == RB_OK && index >= 0 && index < size; index++){
+        PrefEntry* entry;
+
+        Rb_List_get(ordered, index, &entry);
+
+        if(strncmp(entry->key, prefix, length) != 0){
+            break;
         }
+
+        rc = fnc(handle, entry->key, userData);
     }
 
-    return RB_OK;
+    return PrefsPriv_unlock(prefs, rc);
 }
 
-
-int32_t Rb_Prefs_save(Rb_PrefsHandle handle, const Rb_IOStream* stream){
+int32_t Rb_Prefs_removePrefix(Rb_PrefsHandle handle, const char* prefix){
     PrefsContext* prefs = PrefsPriv_getContext(handle);
-    if(prefs == NULL){
+    if(prefs == NULL || prefix == NULL){
         RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    return prefs->backend.save(handle, stream);
-}
+    PrefsPriv_lock(prefs);
 
-int32_t Rb_Prefs_load(Rb_PrefsHandle handle, const Rb_IOStream* stream){
-    PrefsContext* prefs = PrefsPriv_getContext(handle);
-    if (prefs == NULL) {
-        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    int32_t res = PrefsPriv_unlock(prefs, PrefsPriv_removePrefix(prefs, prefix));
+
+    if(res < 0){
+        RB_ERRC(res, "Error removing entries");
     }
 
-    return prefs->backend.load(handle, stream);
+    return res;
 }
 
-PrefsContext* PrefsPriv_getContext(Rb_PrefsHandle handle){
-    if(handle == NULL) {
-        return NULL;
-    }
+int32_t PrefsPriv_add(PrefsContext* prefs, const char* key, Variant* var){
+    PrefsPriv_lock(prefs);
 
-    PrefsContext* prefs = (PrefsContext*)handle;
-    if(prefs->magic != PREFS_MAGIC) {
-        return NULL;
+    return PrefsPriv_unlock(prefs, PrefsPriv_addLocked(prefs, key, var));
+}
+
+int32_t PrefsPriv_setLocked(PrefsContext* prefs, const char* key, Variant* var){
+    // Takes ownership of the variant data, like PrefsPriv_addLocked
+    PrefEntry* existing = prefs->mapping.data ? NULL : PrefsIndex_find(&prefs->index, key);
+    if(existing == NULL){
+        return PrefsPriv_addLocked(prefs, key, var);
     }
 
-    return prefs;
+    // Replaced in place, the entry keeps its position
+    PrefsPriv_releaseVariant(prefs, &existing->value);
+    memcpy(&existing->value, var, sizeof(Variant));
+
+    prefs->generation++;
+
+    return PrefsPriv_journal(prefs, key);
 }
 
-int32_t Rb_Prefs_loadFile(Rb_PrefsHandle handle, const char* filePath) {
-    int32_t rc = RB_OK;
-    Rb_IOStream stream;
+int32_t PrefsPriv_addLocked(PrefsContext* prefs, const char* key, Variant* var){
+    return PrefsPriv_addHashed(prefs, key, PrefsIndex_hash(key), var, NULL);
+}
 
-    rc = Rb_FileStream_getApi(&stream.api);
-    if (rc != RB_OK) {
-        RB_ERRC(RB_ERROR, "Error acquiring file API");
+int32_t PrefsPriv_addHashed(PrefsContext* prefs, const char* key, uint32_t hash, Variant* var, PrefEntry** added){
+    // Takes ownership of the variant data (allocated with PrefsPriv_alloc)
+    if(prefs->mapping.data){
+        PrefsPriv_releaseVariant(prefs, var);
+        RB_ERRC(RB_ERROR, "Preferences are read-only");
     }
 
-    rc = stream.api.open(filePath, eRB_IO_MODE_READ, &stream.handle);
-    if (rc != RB_OK) {
-        RB_ERRC(rc, "Error opening file");
+    if(PrefsIndex_findHashed(&prefs->index, key, hash)){
+        PrefsPriv_releaseVariant(prefs, var);
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    PrefEntry* entry = PrefsPriv_newEntry(prefs, key, var);
+    if(entry == NULL){
+        PrefsPriv_releaseVariant(prefs, var);
+        RB_ERRC(RB_ERROR, "Error allocating entry");
+    }
+
+    int32_t rc = Rb_List_add(prefs->entries, &entry);
+    if(rc != RB_OK){
+        PrefsPriv_releaseEntry(prefs, entry);
+        return rc;
+    }
+
+    rc = PrefsIndex_insertHashed(&prefs->index, entry, hash);
+    if(rc != RB_OK){
+        Rb_List_remove(prefs->entries, Rb_List_getSize(prefs->entries) - 1);
+        PrefsPriv_releaseEntry(prefs, entry);
+        return rc;
+    }
+
+    PrefsPriv_order(prefs, entry);
+
+    prefs->generation++;
+
+    if(added){
+        *added = entry;
+    }
+
+    return PrefsPriv_journal(prefs, key);
+}
+
+int32_t PrefsPriv_addByKey(PrefsContext* prefs, PrefsKeyContext* keyContext, Variant* var){
+    PrefsPriv_lock(prefs);
+
+    // Handles are only cached outside of concurrent mode (see PrefsPriv_getByKey), a cached entry means the key exists
+    const int32_t cached = prefs->concurrency == eRB_PREFS_CONCURRENCY_NONE && !prefs->mapping.data;
+
+    if(cached && keyContext->generation == prefs->generation && keyContext->entry){
+        PrefsPriv_releaseVariant(prefs, var);
+        PrefsPriv_unlock(prefs, RB_OK);
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    // Neither hashed nor looked up again, the new entry is cached for the gets which follow
+    PrefEntry* entry = NULL;
+
+    int32_t rc = PrefsPriv_addHashed(prefs, keyContext->key, keyContext->hash, var, &entry);
+
+    if(cached && entry){
+        keyContext->entry = entry;
+        keyContext->generation = prefs->generation;
+    }
+
+    return PrefsPriv_unlock(prefs, rc);
+}
+
+
+PrefEntry* PrefsPriv_get(PrefsContext* prefs, const char* key, PrefEntry* mapped){
+    // Mapped entries are decoded into the caller's storage
+    if(prefs->mapping.data){
+        return Rb_PrefsBackendMappedFind(&prefs->mapping, key, mapped) == RB_OK ? mapped : NULL;
+    }
+
+    return PrefsIndex_find(&prefs->index, key);
+}
+
+int32_t PrefsPriv_remove(PrefsContext* prefs, const char* key){
+    if(prefs->mapping.data){
+        RB_ERRC(RB_ERROR, "Preferences are read-only");
+    }
+
+    int32_t rc = PrefsPriv_removeEntry(prefs, key);
+    if(rc != RB_TRUE){
+        return rc;
+    }
+
+    prefs->generation++;
+
+    return PrefsPriv_journal(prefs, key);
+}
+
+int32_t PrefsPriv_removeEntry(PrefsContext* prefs, const char* key){
+    PrefEntry* entry = PrefsPriv_unlinkEntry(prefs, key);
+    if(entry == NULL){
+        return RB_FALSE;
+    }
+
+    PrefsPriv_releaseEntry(prefs, entry);
+
+    return RB_TRUE;
+}
+
+PrefEntry* PrefsPriv_unlinkEntry(PrefsContext* prefs, const char* key){
+    PrefEntry* entry = PrefsIndex_remove(&prefs->index, key);
+    if(entry == NULL){
+        return NULL;
+    }
+
+    // The list holds entry pointers, so finding it is a plain pointer comparison (removing doesn't allocate)
+    int32_t index = Rb_List_indexOf(prefs->entries, &entry);
+    if(index >= 0){
+        Rb_List_remove(prefs->entries, index);
+    }
+
+    PrefsPriv_unorder(prefs, entry);
+
+    return entry;
+}
+
+void PrefsPriv_freeEntry(PrefEntry* entry){
+    PrefsPriv_freeVariant(&entry->value);
+
+    RB_FREE(&entry->key);
+    RB_FREE(&entry);
+}
+
+void PrefsPriv_freeVariant(Variant* var){
+    if(var->type == eRB_VAR_TYPE_BLOB && var->val.blobVal.file){
+        PrefsPriv_releaseBlobFile(var->val.blobVal.file);
+    }
+    else if(var->type == eRB_VAR_TYPE_BLOB){
+        RB_FREE(&var->val.blobVal.data);
+    }
+    else if(var->type == eRB_VAR_TYPE_STRING){
+        RB_FREE(&var->val.stringVal);
+    }
+}
+
+void PrefsPriv_unmap(PrefsContext* prefs){
+    if(prefs->mapping.data){
+        munmap((void*)prefs->mapping.data, prefs->mapping.size);
+
+        memset(&prefs->mapping, 0x00, sizeof(PrefsMapping));
+    }
+}
+
+
+int32_t Rb_Prefs_save(Rb_PrefsHandle handle, const Rb_IOStream* stream){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    // Writers are held off while the entries are serialized
+    PrefsPriv_lock(prefs);
+
+    return PrefsPriv_unlock(prefs, prefs->backend.save(handle, stream));
+}
+
+int32_t Rb_Prefs_load(Rb_PrefsHandle handle, const Rb_IOStream* stream){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if (prefs == NULL) {
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    // Published once, when all the entries are loaded
+    PrefsPriv_lock(prefs);
+
+    PrefsPriv_closeJournal(prefs);
+
+    return PrefsPriv_unlock(prefs, prefs->backend.load(handle, stream));
+}
+
+PrefsContext* PrefsPriv_getContext(Rb_PrefsHandle handle){
+    if(handle == NULL) {
+        return NULL;
+    }
+
+    PrefsContext* prefs = (PrefsContext*)handle;
+    if(prefs->magic != PREFS_MAGIC) {
+        return NULL;
+    }
+
+    return prefs;
+}
+
+int32_t Rb_Prefs_loadFile(Rb_PrefsHandle handle, const char* filePath) {
+    int32_t rc = RB_OK;
+    Rb_IOStream stream;
+
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    rc = Rb_FileStream_getApi(&stream.api);
+    if (rc != RB_OK) {
+        RB_ERRC(RB_ERROR, "Error acquiring file API");
+    }
+
+    rc = stream.api.open(filePath, eRB_IO_MODE_READ, &stream.handle);
+    if (rc != RB_OK) {
+        RB_ERRC(rc, "Error opening file");
+    }
+
+    // Everything loaded fits into one arena chunk, unless large blobs are left in the file
+    struct stat fileStat;
+
+    if(prefs->arena.chunkSize && prefs->lazyBlobSize == 0 && stat(filePath, &fileStat) == 0
+            && (uint64_t)fileStat.st_size < (uint64_t)INT32_MAX){
+        prefs->arenaReserve = (uint32_t)fileStat.st_size;
+    }
+
+    // Large blobs may stay in the file, the backend references it from their values
+    if(prefs->lazyBlobSize){
+        prefs->blobSource = PrefsPriv_openBlobFile(filePath);
+        if(prefs->blobSource == NULL){
+            stream.api.close(&stream.handle);
+            RB_ERRC(RB_ERROR, "Error opening file");
+        }
     }
 
     rc = Rb_Prefs_load(handle, &stream);
+
+    prefs->arenaReserve = 0;
+
+    if(prefs->blobSource){
+        PrefsPriv_releaseBlobFile(prefs->blobSource);
+        prefs->blobSource = NULL;
+    }
+
     if (rc != RB_OK) {
+        stream.api.close(&stream.handle);
         return rc;
     }
 
@@ -497,6 +1120,40 @@ int32_t Rb_Prefs_loadFile(Rb_PrefsHandle handle, const char* filePath) {
 }
 
 int32_t Rb_Prefs_saveFile(Rb_PrefsHandle handle, const char* filePath) {
+    int32_t rc;
+
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(prefs->lazyBlobSize == 0){
+        return PrefsPriv_saveFile(handle, filePath);
+    }
+
+    // Blobs may be read from the destination while it's written, it's replaced only once complete (the old file stays
+    // readable through the descriptors referencing it)
+    char* tmpPath = PrefsPriv_makePath(filePath, ".tmp");
+
+    rc = PrefsPriv_saveFile(handle, tmpPath);
+    if(rc == RB_OK && rename(tmpPath, filePath) != 0){
+        rc = RB_ERROR;
+    }
+
+    if(rc != RB_OK){
+        remove(tmpPath);
+    }
+
+    RB_FREE(&tmpPath);
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error writing file");
+    }
+
+    return RB_OK;
+}
+
+int32_t PrefsPriv_saveFile(Rb_PrefsHandle handle, const char* filePath) {
     int32_t rc = RB_OK;
     Rb_IOStream stream;
 
@@ -512,6 +1169,7 @@ int32_t Rb_Prefs_saveFile(Rb_PrefsHandle handle, const char* filePath) {
 
     rc = Rb_Prefs_save(handle, &stream);
     if (rc != RB_OK) {
+        stream.api.close(&stream.handle);
         return rc;
     }
 
@@ -522,3 +1180,2014 @@ int32_t Rb_Prefs_saveFile(Rb_PrefsHandle handle, const char* filePath) {
 
     return rc;
 }
+
+int32_t Rb_Prefs_setFormat(Rb_PrefsHandle handle, Rb_PrefsFormat format){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(format != eRB_PREFS_FORMAT_STREAM && format != eRB_PREFS_FORMAT_INDEXED && format != eRB_PREFS_FORMAT_COMPACT){
+        RB_ERRC(RB_INVALID_ARG, "Invalid format");
+    }
+
+    PrefsPriv_lock(prefs);
+
+    prefs->format = format;
+
+    return PrefsPriv_unlock(prefs, RB_OK);
+}
+
+int32_t Rb_Prefs_mapFile(Rb_PrefsHandle handle, const char* filePath){
+    int32_t rc;
+
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || filePath == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    // Lookups would bypass the snapshot
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        RB_ERRC(RB_NOT_IMPLEMENTED, "Mapping isn't available in concurrent mode");
+    }
+
+    PrefsPriv_closeJournal(prefs);
+
+    rc = Rb_Prefs_clear(handle);
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error clearing preferences");
+    }
+
+    int fd = open(filePath, O_RDONLY);
+    if(fd < 0){
+        RB_ERRC(RB_ERROR, "Error opening file");
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0 || st.st_size > INT32_MAX){
+        close(fd);
+        RB_ERRC(RB_ERROR, "Invalid file size");
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // Mapping stays valid after the descriptor is closed
+    close(fd);
+
+    if(data == MAP_FAILED){
+        RB_ERRC(RB_ERROR, "Error mapping file");
+    }
+
+    PrefsMapping mapping;
+
+    mapping.data = (const uint8_t*)data;
+    mapping.size = (uint32_t)st.st_size;
+    mapping.numEntries = 0;
+
+    rc = Rb_PrefsBackendCheckMapping(&mapping);
+    if(rc != RB_OK){
+        munmap(data, mapping.size);
+        RB_ERRC(rc, "Invalid file format");
+    }
+
+    prefs->mapping = mapping;
+    prefs->generation++;
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_openJournal(Rb_PrefsHandle handle, const char* filePath, uint32_t compactThreshold){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || filePath == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    // Snapshot and journal are published together
+    PrefsPriv_lock(prefs);
+
+    return PrefsPriv_unlock(prefs, PrefsPriv_openJournal(handle, filePath, compactThreshold));
+}
+
+int32_t PrefsPriv_openJournal(Rb_PrefsHandle handle, const char* filePath, uint32_t compactThreshold){
+    int32_t rc;
+
+    PrefsContext* prefs = (PrefsContext*)handle;
+
+    if(prefs->backend.append == NULL || prefs->backend.replay == NULL){
+        RB_ERRC(RB_NOT_IMPLEMENTED, "Backend doesn't support journaling");
+    }
+
+    PrefsPriv_closeJournal(prefs);
+
+    // Snapshot first
+    if(access(filePath, F_OK) == 0){
+        rc = Rb_Prefs_loadFile(handle, filePath);
+    }
+    else{
+        rc = Rb_Prefs_clear(handle);
+    }
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error loading snapshot");
+    }
+
+    PrefsJournal* journal = &prefs->journal;
+
+    journal->filePath = PrefsPriv_makePath(filePath, "");
+    journal->journalPath = PrefsPriv_makePath(filePath, ".journal");
+    journal->compactThreshold = compactThreshold;
+
+    rc = Rb_FileStream_getApi(&journal->stream.api);
+    if(rc != RB_OK){
+        PrefsPriv_closeJournal(prefs);
+        RB_ERRC(RB_ERROR, "Error acquiring file API");
+    }
+
+    // Then the changes made since (the journal stream stays closed while replaying, so nothing is recorded)
+    int32_t replayRc = RB_OK;
+
+    if(access(journal->journalPath, F_OK) == 0){
+        Rb_IOStream replayStream;
+
+        replayStream.api = journal->stream.api;
+
+        rc = replayStream.api.open(journal->journalPath, eRB_IO_MODE_READ, &replayStream.handle);
+        if(rc != RB_OK){
+            PrefsPriv_closeJournal(prefs);
+            RB_ERRC(rc, "Error opening journal");
+        }
+
+        replayRc = prefs->backend.replay(handle, &replayStream);
+
+        replayStream.api.close(&replayStream.handle);
+    }
+
+    rc = journal->stream.api.open(journal->journalPath, eRB_IO_MODE_APPEND, &journal->stream.handle);
+    if(rc != RB_OK){
+        PrefsPriv_closeJournal(prefs);
+        RB_ERRC(rc, "Error opening journal");
+    }
+
+    journal->size = journal->stream.api.tell(journal->stream.handle);
+
+    // Drop a damaged journal tail right away, new records can't follow it
+    if(replayRc != RB_OK){
+        RB_ERR("Journal damaged, compacting");
+
+        rc = PrefsPriv_compact(prefs);
+        if(rc != RB_OK){
+            PrefsPriv_closeJournal(prefs);
+            RB_ERRC(rc, "Error compacting journal");
+        }
+    }
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_compact(Rb_PrefsHandle handle){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    PrefsPriv_lock(prefs);
+
+    if(prefs->journal.journalPath == NULL){
+        PrefsPriv_unlock(prefs, RB_OK);
+        RB_ERRC(RB_ERROR, "Journal not open");
+    }
+
+    return PrefsPriv_unlock(prefs, PrefsPriv_compact(prefs));
+}
+
+int32_t Rb_Prefs_closeJournal(Rb_PrefsHandle handle){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    PrefsPriv_lock(prefs);
+
+    PrefsPriv_closeJournal(prefs);
+
+    return PrefsPriv_unlock(prefs, RB_OK);
+}
+
+int32_t PrefsPriv_journal(PrefsContext* prefs, const char* key){
+    int32_t rc = PrefsPriv_appendJournal(prefs, key);
+    if(rc != RB_OK){
+        return rc;
+    }
+
+    return PrefsPriv_flushJournal(prefs);
+}
+
+int32_t PrefsPriv_appendJournal(PrefsContext* prefs, const char* key){
+    PrefsJournal* journal = &prefs->journal;
+
+    if(journal->damaged && PrefsPriv_repairJournal(prefs) != RB_OK){
+        RB_ERRC(RB_ERROR, "Journal damaged");
+    }
+
+    if(journal->stream.handle == NULL){
+        return RB_OK;
+    }
+
+    int32_t rc = prefs->backend.append((Rb_PrefsHandle)prefs, &journal->stream, key);
+    if(rc != RB_OK){
+        PrefsPriv_repairJournal(prefs);
+        RB_ERRC(rc, "Error appending journal record");
+    }
+
+    return RB_OK;
+}
+
+int32_t PrefsPriv_repairJournal(PrefsContext* prefs){
+    PrefsJournal* journal = &prefs->journal;
+    int32_t rc = RB_OK;
+
+    // Replay stops at a torn record, the ones appended after it would be lost. The journal is cut back to its complete
+    // records, once the stream is closed (torn bytes still buffered in it can't be written past the cut then).
+    if(journal->stream.handle){
+        journal->stream.api.close(&journal->stream.handle);
+    }
+
+    journal->stream.handle = NULL;
+
+    if(truncate(journal->journalPath, journal->size) != 0){
+        rc = RB_ERROR;
+    }
+
+    if(rc == RB_OK){
+        rc = journal->stream.api.open(journal->journalPath, eRB_IO_MODE_APPEND, &journal->stream.handle);
+    }
+
+    journal->damaged = rc != RB_OK;
+
+    return rc;
+}
+
+int32_t PrefsPriv_flushJournal(PrefsContext* prefs){
+    PrefsJournal* journal = &prefs->journal;
+    int32_t rc = RB_OK;
+
+    if(journal->stream.handle == NULL){
+        return RB_OK;
+    }
+
+    if(journal->stream.api.flush){
+        rc = journal->stream.api.flush(journal->stream.handle);
+        if(rc != RB_OK){
+            PrefsPriv_repairJournal(prefs);
+            RB_ERRC(rc, "Error flushing journal");
+        }
+    }
+
+    journal->size = journal->stream.api.tell(journal->stream.handle);
+
+    if(journal->size > journal->compactThreshold){
+        return PrefsPriv_compact(prefs);
+    }
+
+    return RB_OK;
+}
+
+int32_t PrefsPriv_compact(PrefsContext* prefs){
+    int32_t rc;
+    PrefsJournal* journal = &prefs->journal;
+
+    // New snapshot replaces the old one atomically, and is on the disk before the journal is reset (otherwise a power
+    // loss could keep the reset but not the snapshot data). A crash before the journal is reset replays records which
+    // are already part of it, which yields the same state.
+    char* tmpPath = PrefsPriv_makePath(journal->filePath, ".tmp");
+
+    rc = PrefsPriv_saveFile((Rb_PrefsHandle)prefs, tmpPath);
+    if(rc == RB_OK){
+        rc = PrefsPriv_syncPath(tmpPath);
+    }
+
+    if(rc == RB_OK){
+        rc = PrefsPriv_replaceFile(tmpPath, journal->filePath);
+    }
+
+    if(rc != RB_OK){
+        remove(tmpPath);
+    }
+
+    RB_FREE(&tmpPath);
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error writing snapshot");
+    }
+
+    // The old journal is only replaced once the new one is open, if opening fails journaling continues on the old one
+    // (its records are part of the snapshot now, replaying them again yields the same state)
+    Rb_IOStreamHandle stream = NULL;
+
+    if(journal->stream.handle && journal->stream.api.flush){
+        rc = journal->stream.api.flush(journal->stream.handle);
+    }
+
+    if(rc == RB_OK){
+        rc = journal->stream.api.open(journal->journalPath, eRB_IO_MODE_WRITE, &stream);
+    }
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error resetting journal");
+    }
+
+    if(journal->stream.handle){
+        journal->stream.api.close(&journal->stream.handle);
+    }
+
+    journal->stream.handle = stream;
+
+    // A damaged tail is gone with the old journal
+    journal->size = 0;
+    journal->damaged = RB_FALSE;
+
+    return RB_OK;
+}
+
+void PrefsPriv_closeJournal(PrefsContext* prefs){
+    PrefsJournal* journal = &prefs->journal;
+
+    if(journal->stream.handle){
+        journal->stream.api.close(&journal->stream.handle);
+    }
+
+    if(journal->filePath){
+        RB_FREE(&journal->filePath);
+    }
+
+    if(journal->journalPath){
+        RB_FREE(&journal->journalPath);
+    }
+
+    memset(journal, 0x00, sizeof(PrefsJournal));
+}
+
+char* PrefsPriv_makePath(const char* filePath, const char* suffix){
+    char* path = (char*)RB_MALLOC(strlen(filePath) + strlen(suffix) + 1);
+
+    strcpy(path, filePath);
+    strcat(path, suffix);
+
+    return path;
+}
+
+Rb_PrefsKeyHandle Rb_Prefs_resolveKey(Rb_PrefsHandle handle, const char* key){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || key == NULL){
+        RB_ERR("Invalid handle");
+        return NULL;
+    }
+
+    PrefsKeyContext* keyContext = (PrefsKeyContext*)RB_CALLOC(sizeof(PrefsKeyContext));
+    if(keyContext == NULL){
+        RB_ERR("Error allocating key");
+        return NULL;
+    }
+
+    keyContext->key = (char*)RB_MALLOC(strlen(key) + 1);
+    if(keyContext->key == NULL){
+        RB_FREE(&keyContext);
+        RB_ERR("Error allocating key");
+        return NULL;
+    }
+
+    strcpy(keyContext->key, key);
+
+    keyContext->magic = PREFS_KEY_MAGIC;
+    keyContext->hash = PrefsIndex_hash(key);
+    keyContext->prefs = prefs;
+
+    // Resolved on first use
+    keyContext->generation = prefs->generation - 1;
+
+    return (Rb_PrefsKeyHandle)keyContext;
+}
+
+int32_t Rb_Prefs_releaseKey(Rb_PrefsKeyHandle* key){
+    PrefsKeyContext* keyContext = PrefsPriv_getKeyContext(NULL, key ? *key : NULL);
+    if(keyContext == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key handle");
+    }
+
+    keyContext->magic = 0;
+
+    RB_FREE(&keyContext->key);
+    RB_FREE(&keyContext);
+
+    *key = NULL;
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_getInt32ByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, int32_t* value){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || value == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_getByKey(prefs, key, eRB_VAR_TYPE_INT32, &read);
+    if(entry == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key");
+    }
+
+    *value = entry->value.val.int32Val;
+
+    PrefsPriv_endGet(prefs, &read);
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_getInt64ByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, int64_t* value){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || value == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_getByKey(prefs, key, eRB_VAR_TYPE_INT64, &read);
+    if(entry == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key");
+    }
+
+    *value = entry->value.val.int64Val;
+
+    PrefsPriv_endGet(prefs, &read);
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_getFloatByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, float* value){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || value == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_getByKey(prefs, key, eRB_VAR_TYPE_FLOAT, &read);
+    if(entry == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key");
+    }
+
+    *value = entry->value.val.floatVal;
+
+    PrefsPriv_endGet(prefs, &read);
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_getStringViewByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, const char** value, uint32_t* length){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || value == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        RB_ERRC(RB_NOT_IMPLEMENTED, "Views aren't available in concurrent mode");
+    }
+
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_getByKey(prefs, key, eRB_VAR_TYPE_STRING, &read);
+    if(entry == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key");
+    }
+
+    *value = entry->value.val.stringVal;
+
+    if(length){
+        *length = strlen(entry->value.val.stringVal);
+    }
+
+    PrefsPriv_endGet(prefs, &read);
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_getBlobViewByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, const void** data, uint32_t* size){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || data == NULL || size == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        RB_ERRC(RB_NOT_IMPLEMENTED, "Views aren't available in concurrent mode");
+    }
+
+    PrefsRead read;
+    const PrefEntry* entry = PrefsPriv_getByKey(prefs, key, eRB_VAR_TYPE_BLOB, &read);
+    if(entry == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key");
+    }
+
+    if(PrefsPriv_loadBlob(prefs, (PrefEntry*)entry) != RB_OK){
+        PrefsPriv_endGet(prefs, &read);
+        RB_ERRC(RB_ERROR, "Error reading blob");
+    }
+
+    *data = entry->value.val.blobVal.data;
+    *size = entry->value.val.blobVal.size;
+
+    PrefsPriv_endGet(prefs, &read);
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_putInt32ByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, int32_t value){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    PrefsKeyContext* keyContext = PrefsPriv_getKeyContext(prefs, key);
+    if(prefs == NULL || keyContext == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key handle");
+    }
+
+    Variant var;
+
+    var.type = eRB_VAR_TYPE_INT32;
+    var.val.int32Val = value;
+
+    return PrefsPriv_addByKey(prefs, keyContext, &var);
+}
+
+int32_t Rb_Prefs_putInt64ByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, int64_t value){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    PrefsKeyContext* keyContext = PrefsPriv_getKeyContext(prefs, key);
+    if(prefs == NULL || keyContext == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key handle");
+    }
+
+    Variant var;
+
+    var.type = eRB_VAR_TYPE_INT64;
+    var.val.int64Val = value;
+
+    return PrefsPriv_addByKey(prefs, keyContext, &var);
+}
+
+int32_t Rb_Prefs_putFloatByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, float value){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    PrefsKeyContext* keyContext = PrefsPriv_getKeyContext(prefs, key);
+    if(prefs == NULL || keyContext == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key handle");
+    }
+
+    Variant var;
+
+    var.type = eRB_VAR_TYPE_FLOAT;
+    var.val.floatVal = value;
+
+    return PrefsPriv_addByKey(prefs, keyContext, &var);
+}
+
+int32_t Rb_Prefs_putStringByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, const char* value){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    PrefsKeyContext* keyContext = PrefsPriv_getKeyContext(prefs, key);
+    if(prefs == NULL || keyContext == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key handle");
+    }
+
+    Variant var;
+
+    var.type = eRB_VAR_TYPE_STRING;
+    var.val.stringVal = (char*)PrefsPriv_alloc(prefs, strlen(value) + 1);
+    if(var.val.stringVal == NULL){
+        RB_ERRC(RB_ERROR, "Error allocating value");
+    }
+
+    strcpy(var.val.stringVal, value);
+
+    return PrefsPriv_addByKey(prefs, keyContext, &var);
+}
+
+int32_t Rb_Prefs_putBlobByKey(Rb_PrefsHandle handle, Rb_PrefsKeyHandle key, const void* data, uint32_t size){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    PrefsKeyContext* keyContext = PrefsPriv_getKeyContext(prefs, key);
+    if(prefs == NULL || keyContext == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid key handle");
+    }
+
+    Variant var;
+
+    var.type = eRB_VAR_TYPE_BLOB;
+    var.val.blobVal.size = size;
+    var.val.blobVal.data = PrefsPriv_alloc(prefs, size);
+    var.val.blobVal.file = NULL;
+    if(var.val.blobVal.data == NULL && size){
+        RB_ERRC(RB_ERROR, "Error allocating value");
+    }
+
+    memcpy(var.val.blobVal.data, data, size);
+
+    return PrefsPriv_addByKey(prefs, keyContext, &var);
+}
+
+PrefsKeyContext* PrefsPriv_getKeyContext(PrefsContext* prefs, Rb_PrefsKeyHandle key){
+    PrefsKeyContext* keyContext = (PrefsKeyContext*)key;
+
+    if(keyContext == NULL || keyContext->magic != PREFS_KEY_MAGIC){
+        return NULL;
+    }
+
+    // Keys are bound to the preferences they were resolved with
+    if(prefs && keyContext->prefs != prefs){
+        return NULL;
+    }
+
+    return keyContext;
+}
+
+const PrefEntry* PrefsPriv_getByKey(PrefsContext* prefs, Rb_PrefsKeyHandle key, Rb_VariantType type,
+        PrefsRead* read){
+    read->epoch = -1;
+
+    PrefsKeyContext* keyContext = PrefsPriv_getKeyContext(prefs, key);
+    if(keyContext == NULL){
+        return NULL;
+    }
+
+    // Handles may be shared by readers, so nothing is cached in concurrent mode (the hash still is)
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        read->epoch = PrefsPriv_enterRead(prefs);
+
+        const PrefsSnapshot* snapshot = __atomic_load_n(&prefs->snapshot, __ATOMIC_SEQ_CST);
+        const PrefEntry* entry = PrefsIndex_findHashed(&snapshot->index, keyContext->key, keyContext->hash);
+
+        if(entry == NULL || entry->value.type != type){
+            PrefsPriv_endGet(prefs, read);
+            return NULL;
+        }
+
+        return entry;
+    }
+
+    // Cached lookup stays valid until an entry is added or removed, after that the key is looked up again (without
+    // hashing it)
+    if(keyContext->generation != prefs->generation){
+        if(prefs->mapping.data){
+            keyContext->entry = Rb_PrefsBackendMappedFind(&prefs->mapping, keyContext->key, &keyContext->mapped) == RB_OK
+                    ? &keyContext->mapped : NULL;
+        }
+        else{
+            keyContext->entry = PrefsIndex_findHashed(&prefs->index, keyContext->key, keyContext->hash);
+        }
+
+        keyContext->generation = prefs->generation;
+    }
+
+    if(keyContext->entry == NULL || keyContext->entry->value.type != type){
+        return NULL;
+    }
+
+    return keyContext->entry;
+}
+
+int32_t Rb_Prefs_beginUpdate(Rb_PrefsHandle handle){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    PrefsPriv_lock(prefs);
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_endUpdate(Rb_PrefsHandle handle){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE && prefs->updateDepth == 0){
+        RB_ERRC(RB_ERROR, "No update in progress");
+    }
+
+    return PrefsPriv_unlock(prefs, RB_OK);
+}
+
+const PrefEntry* PrefsPriv_beginGet(PrefsContext* prefs, const char* key, int32_t type, PrefsRead* read){
+    const PrefEntry* entry;
+
+    read->epoch = -1;
+
+    if(key == NULL){
+        return NULL;
+    }
+
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        // The snapshot stays alive until the read indicator is released
+        read->epoch = PrefsPriv_enterRead(prefs);
+
+        const PrefsSnapshot* snapshot = __atomic_load_n(&prefs->snapshot, __ATOMIC_SEQ_CST);
+
+        entry = PrefsIndex_find(&snapshot->index, key);
+    }
+    else{
+        entry = PrefsPriv_get(prefs, key, &read->mapped);
+    }
+
+    if(entry == NULL || (type != PREFS_ANY_TYPE && (int32_t)entry->value.type != type)){
+        PrefsPriv_endGet(prefs, read);
+        return NULL;
+    }
+
+    return entry;
+}
+
+void PrefsPriv_endGet(PrefsContext* prefs, PrefsRead* read){
+    if(read->epoch >= 0){
+        PrefsPriv_exitRead(prefs, read->epoch);
+        read->epoch = -1;
+    }
+}
+
+int32_t PrefsPriv_enterRead(PrefsContext* prefs){
+    int32_t epoch = __atomic_load_n(&prefs->readEpoch, __ATOMIC_SEQ_CST);
+
+    __atomic_add_fetch(&prefs->readers[epoch], 1, __ATOMIC_SEQ_CST);
+
+    return epoch;
+}
+
+void PrefsPriv_exitRead(PrefsContext* prefs, int32_t epoch){
+    __atomic_sub_fetch(&prefs->readers[epoch], 1, __ATOMIC_RELEASE);
+}
+
+void PrefsPriv_lock(PrefsContext* prefs){
+    if(prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        pthread_mutex_lock(&prefs->mutex);
+        prefs->updateDepth++;
+    }
+}
+
+int32_t PrefsPriv_unlock(PrefsContext* prefs, int32_t rc){
+    if(prefs->concurrency == eRB_PREFS_CONCURRENCY_NONE){
+        return rc;
+    }
+
+    // Changes become visible to readers together, once the outermost update ends
+    if(--prefs->updateDepth == 0 && prefs->snapshot->generation != prefs->generation){
+        int32_t publishRc = PrefsPriv_publish(prefs);
+
+        if(rc == RB_OK){
+            rc = publishRc;
+        }
+    }
+
+    pthread_mutex_unlock(&prefs->mutex);
+
+    return rc;
+}
+
+int32_t PrefsPriv_publish(PrefsContext* prefs){
+    PrefsSnapshot* snapshot = PrefsPriv_newSnapshot(prefs);
+    if(snapshot == NULL){
+        RB_ERRC(RB_ERROR, "Error creating snapshot");
+    }
+
+    PrefsSnapshot* old = __atomic_exchange_n(&prefs->snapshot, snapshot, __ATOMIC_SEQ_CST);
+
+    // Readers which may still use the old snapshot entered before the swap, under either epoch. Wait for those of
+    // the idle epoch, switch new readers over to it, then wait for those of the previous one.
+    int32_t epoch = __atomic_load_n(&prefs->readEpoch, __ATOMIC_SEQ_CST);
+
+    PrefsPriv_waitReaders(prefs, !epoch);
+
+    __atomic_store_n(&prefs->readEpoch, !epoch, __ATOMIC_SEQ_CST);
+
+    PrefsPriv_waitReaders(prefs, epoch);
+
+    PrefsPriv_freeSnapshot(old);
+
+    return RB_OK;
+}
+
+void PrefsPriv_waitReaders(PrefsContext* prefs, int32_t epoch){
+    while(__atomic_load_n(&prefs->readers[epoch], __ATOMIC_ACQUIRE) != 0){
+        sched_yield();
+    }
+}
+
+PrefsSnapshot* PrefsPriv_newSnapshot(PrefsContext* prefs){
+    uint32_t i;
+    PrefEntry** entries = NULL;
+    uint32_t numEntries = 0;
+
+    if(Rb_List_toArray(prefs->entries, (void**)&entries, &numEntries) != RB_OK){
+        return NULL;
+    }
+
+    // Entries and their data are copied into a single block
+    uint64_t size = sizeof(PrefsSnapshot) + (uint64_t)numEntries * sizeof(PrefEntry);
+
+    for(i=0; i<numEntries; i++){
+        size += strlen(entries[i]->key) + 1;
+
+        if(entries[i]->value.type == eRB_VAR_TYPE_STRING){
+            size += strlen(entries[i]->value.val.stringVal) + 1;
+        }
+        else if(entries[i]->value.type == eRB_VAR_TYPE_BLOB){
+            size += entries[i]->value.val.blobVal.size;
+        }
+    }
+
+    PrefsSnapshot* snapshot = size <= (uint64_t)INT32_MAX ? (PrefsSnapshot*)RB_MALLOC((int32_t)size) : NULL;
+
+    if(snapshot == NULL || PrefsIndex_init(&snapshot->index) != RB_OK){
+        if(snapshot){
+            RB_FREE(&snapshot);
+        }
+
+        if(entries){
+            RB_FREE(&entries);
+        }
+
+        return NULL;
+    }
+
+    snapshot->entries = (PrefEntry*)(snapshot + 1);
+    snapshot->numEntries = numEntries;
+    snapshot->generation = prefs->generation;
+
+    char* data = (char*)(snapshot->entries + numEntries);
+    int32_t rc = RB_OK;
+
+    for(i=0; i<numEntries && rc == RB_OK; i++){
+        PrefEntry* entry = &snapshot->entries[i];
+
+        memcpy(entry, entries[i], sizeof(PrefEntry));
+
+        entry->key = strcpy(data, entries[i]->key);
+        data += strlen(data) + 1;
+
+        if(entry->value.type == eRB_VAR_TYPE_STRING){
+            entry->value.val.stringVal = strcpy(data, entries[i]->value.val.stringVal);
+            data += strlen(data) + 1;
+        }
+        else if(entry->value.type == eRB_VAR_TYPE_BLOB){
+            entry->value.val.blobVal.data = memcpy(data, entries[i]->value.val.blobVal.data, entry->value.val.blobVal.size);
+            data += entry->value.val.blobVal.size;
+        }
+
+        rc = PrefsIndex_insert(&snapshot->index, entry);
+    }
+
+    if(entries){
+        RB_FREE(&entries);
+    }
+
+    if(rc != RB_OK){
+        PrefsPriv_freeSnapshot(snapshot);
+        return NULL;
+    }
+
+    return snapshot;
+}
+
+void PrefsPriv_freeSnapshot(PrefsSnapshot* snapshot){
+    PrefsIndex_destroy(&snapshot->index);
+
+    RB_FREE(&snapshot);
+}
+
+Rb_PrefsTransactionHandle Rb_Prefs_beginTransaction(Rb_PrefsHandle handle){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL){
+        RB_ERR("Invalid handle");
+        return NULL;
+    }
+
+    PrefsTransactionContext* transaction = (PrefsTransactionContext*)RB_CALLOC(sizeof(PrefsTransactionContext));
+    if(transaction == NULL){
+        RB_ERR("Error allocating transaction");
+        return NULL;
+    }
+
+    transaction->magic = PREFS_TRANSACTION_MAGIC;
+    transaction->prefs = prefs;
+
+    return (Rb_PrefsTransactionHandle)transaction;
+}
+
+int32_t Rb_PrefsTransaction_putInt32(Rb_PrefsTransactionHandle handle, const char* key, int32_t value){
+    Variant var;
+
+    var.type = eRB_VAR_TYPE_INT32;
+    var.val.int32Val = value;
+
+    return PrefsPriv_stage(PrefsPriv_getTransactionContext(handle), key, &var, RB_FALSE);
+}
+
+int32_t Rb_PrefsTransaction_putInt64(Rb_PrefsTransactionHandle handle, const char* key, int64_t value){
+    Variant var;
+
+    var.type = eRB_VAR_TYPE_INT64;
+    var.val.int64Val = value;
+
+    return PrefsPriv_stage(PrefsPriv_getTransactionContext(handle), key, &var, RB_FALSE);
+}
+
+int32_t Rb_PrefsTransaction_putFloat(Rb_PrefsTransactionHandle handle, const char* key, float value){
+    Variant var;
+
+    var.type = eRB_VAR_TYPE_FLOAT;
+    var.val.floatVal = value;
+
+    return PrefsPriv_stage(PrefsPriv_getTransactionContext(handle), key, &var, RB_FALSE);
+}
+
+int32_t Rb_PrefsTransaction_putString(Rb_PrefsTransactionHandle handle, const char* key, const char* value){
+    PrefsTransactionContext* transaction = PrefsPriv_getTransactionContext(handle);
+    if(transaction == NULL || value == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    Variant var;
+
+    var.type = eRB_VAR_TYPE_STRING;
+    var.val.stringVal = (char*)RB_MALLOC(strlen(value) + 1);
+    strcpy(var.val.stringVal, value);
+
+    return PrefsPriv_stage(transaction, key, &var, RB_FALSE);
+}
+
+int32_t Rb_PrefsTransaction_putBlob(Rb_PrefsTransactionHandle handle, const char* key, const void* data, uint32_t size){
+    PrefsTransactionContext* transaction = PrefsPriv_getTransactionContext(handle);
+    if(transaction == NULL || (data == NULL && size)){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    Variant var;
+
+    var.type = eRB_VAR_TYPE_BLOB;
+    var.val.blobVal.size = size;
+    var.val.blobVal.data = RB_MALLOC(size);
+    var.val.blobVal.file = NULL;
+    memcpy(var.val.blobVal.data, data, size);
+
+    return PrefsPriv_stage(transaction, key, &var, RB_FALSE);
+}
+
+int32_t Rb_PrefsTransaction_remove(Rb_PrefsTransactionHandle handle, const char* key){
+    Variant var;
+
+    var.type = eRB_VAR_TYPE_INT32;
+    var.val.int32Val = 0;
+
+    return PrefsPriv_stage(PrefsPriv_getTransactionContext(handle), key, &var, RB_TRUE);
+}
+
+int32_t Rb_PrefsTransaction_commit(Rb_PrefsTransactionHandle* handle){
+    int32_t rc = RB_OK;
+    uint32_t i;
+
+    PrefsTransactionContext* transaction = PrefsPriv_getTransactionContext(handle ? *handle : NULL);
+    if(transaction == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    PrefsContext* prefs = transaction->prefs;
+    const uint32_t numOps = transaction->numOps;
+
+    PrefsPriv_lock(prefs);
+
+    // Everything which may fail is done before the entries are modified, so readers see all the changes or none
+    PrefEntry** prepared = NULL;
+    PrefEntry** unlinked = NULL;
+    uint32_t numUnlinked = 0;
+
+    if(prefs->mapping.data){
+        rc = RB_ERROR;
+    }
+
+    if(rc == RB_OK && numOps){
+        prepared = (PrefEntry**)RB_CALLOC(sizeof(PrefEntry*) * numOps);
+        unlinked = (PrefEntry**)RB_MALLOC(sizeof(PrefEntry*) * numOps);
+
+        rc = prepared && unlinked ? RB_OK : RB_ERROR;
+    }
+
+    // Room for all the new keys
+    if(rc == RB_OK){
+        rc = PrefsIndex_reserve(&prefs->index, prefs->index.size + numOps);
+    }
+
+    if(rc == RB_OK){
+        rc = Rb_List_reserve(prefs->entries, (uint32_t)Rb_List_getSize(prefs->entries) + numOps);
+    }
+
+    for(i=0; i<numOps && rc == RB_OK; i++){
+        PrefsTransactionOp* op = &transaction->ops[i];
+
+        prepared[i] = op->entry;
+
+        // Staged entries are heap allocated, the arena gets copies (the staged ones are freed with the transaction)
+        if(!op->remove && prefs->arena.chunkSize){
+            rc = PrefsPriv_adopt(prefs, &op->entry->value);
+
+            if(rc == RB_OK){
+                Variant value = op->entry->value;
+
+                op->entry->value.type = eRB_VAR_TYPE_INT32;
+
+                prepared[i] = PrefsPriv_newEntry(prefs, op->entry->key, &value);
+                if(prepared[i] == NULL){
+                    PrefsPriv_releaseVariant(prefs, &value);
+                    rc = RB_ERROR;
+                }
+            }
+            else{
+                prepared[i] = NULL;
+            }
+        }
+    }
+
+    if(rc != RB_OK){
+        for(i=0; prepared && i<numOps; i++){
+            if(prepared[i] && prepared[i] != transaction->ops[i].entry){
+                PrefsPriv_releaseEntry(prefs, prepared[i]);
+            }
+        }
+    }
+
+    // Can't fail from here on. Removed entries are released at the end, keys of the prepared entries are journaled.
+    for(i=0; i<numOps && rc == RB_OK; i++){
+        PrefsTransactionOp* op = &transaction->ops[i];
+        PrefEntry* entry = prepared[i];
+        PrefEntry* existing = PrefsIndex_find(&prefs->index, entry->key);
+
+        if(op->remove){
+            if(existing){
+                unlinked[numUnlinked++] = PrefsPriv_unlinkEntry(prefs, entry->key);
+            }
+        }
+        else if(existing){
+            // Replaced in place, the entry keeps its position
+            PrefsPriv_releaseVariant(prefs, &existing->value);
+            memcpy(&existing->value, &entry->value, sizeof(Variant));
+
+            entry->value.type = eRB_VAR_TYPE_INT32;
+        }
+        else{
+            Rb_List_add(prefs->entries, &entry);
+            PrefsIndex_insert(&prefs->index, entry);
+            PrefsPriv_order(prefs, entry);
+
+            // Owned by the preferences now
+            if(entry == op->entry){
+                op->entry = NULL;
+            }
+        }
+    }
+
+    if(rc == RB_OK && numOps){
+        prefs->generation++;
+    }
+
+    // Records are only buffered here, the journal is flushed once for the whole commit (and cut back to before the commit
+    // if that fails). Like with a single put, the changes stay applied if they can't be journaled.
+    for(i=0; i<numOps && rc == RB_OK; i++){
+        rc = PrefsPriv_appendJournal(prefs, prepared[i]->key);
+    }
+
+    if(rc == RB_OK){
+        rc = PrefsPriv_flushJournal(prefs);
+    }
+
+    for(i=0; i<numUnlinked; i++){
+        PrefsPriv_releaseEntry(prefs, unlinked[i]);
+    }
+
+    if(prepared){
+        RB_FREE(&prepared);
+    }
+
+    if(unlinked){
+        RB_FREE(&unlinked);
+    }
+
+    rc = PrefsPriv_unlock(prefs, rc);
+
+    Rb_PrefsTransaction_abort(handle);
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error committing transaction");
+    }
+
+    return RB_OK;
+}
+
+int32_t Rb_PrefsTransaction_abort(Rb_PrefsTransactionHandle* handle){
+    uint32_t i;
+
+    PrefsTransactionContext* transaction = PrefsPriv_getTransactionContext(handle ? *handle : NULL);
+    if(transaction == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    for(i=0; i<transaction->numOps; i++){
+        if(transaction->ops[i].entry){
+            PrefsPriv_freeEntry(transaction->ops[i].entry);
+        }
+    }
+
+    if(transaction->ops){
+        RB_FREE(&transaction->ops);
+    }
+
+    transaction->magic = 0;
+
+    RB_FREE(&transaction);
+    *handle = NULL;
+
+    return RB_OK;
+}
+
+PrefsTransactionContext* PrefsPriv_getTransactionContext(Rb_PrefsTransactionHandle handle){
+    PrefsTransactionContext* transaction = (PrefsTransactionContext*)handle;
+
+    if(transaction == NULL || transaction->magic != PREFS_TRANSACTION_MAGIC){
+        return NULL;
+    }
+
+    return transaction;
+}
+
+int32_t PrefsPriv_stage(PrefsTransactionContext* transaction, const char* key, Variant* var, int32_t remove){
+    // Takes ownership of the variant data
+    if(transaction == NULL || key == NULL){
+        PrefsPriv_freeVariant(var);
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(transaction->numOps == transaction->capacity){
+        uint32_t capacity = transaction->capacity ? transaction->capacity * 2 : PREFS_TRANSACTION_MIN_CAPACITY;
+
+        PrefsTransactionOp* ops = (PrefsTransactionOp*)RB_REALLOC(transaction->ops, capacity * sizeof(PrefsTransactionOp));
+        if(ops == NULL){
+            PrefsPriv_freeVariant(var);
+            RB_ERRC(RB_ERROR, "Error allocating transaction");
+        }
+
+        transaction->ops = ops;
+        transaction->capacity = capacity;
+    }
+
+    // Staged entries are moved into the preferences on commit, not copied again
+    PrefEntry* entry = (PrefEntry*)RB_CALLOC(sizeof(PrefEntry));
+
+    entry->key = (char*)RB_MALLOC(strlen(key) + 1);
+    strcpy(entry->key, key);
+
+    memcpy(&entry->value, var, sizeof(Variant));
+
+    PrefsTransactionOp* op = &transaction->ops[transaction->numOps++];
+
+    op->entry = entry;
+    op->remove = remove;
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_saveAsync(Rb_PrefsHandle handle, const char* filePath, Rb_PrefsSaveCallbackFnc fnc, void* userData){
+    int32_t rc;
+    Rb_IOStream stream;
+
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || filePath == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    // Serializing into memory is the only part done on the calling thread
+    Rb_ArrayHandle data = Rb_Array_new();
+    if(data == NULL){
+        RB_ERRC(RB_ERROR, "Error allocating buffer");
+    }
+
+    Rb_MemoryStream_getApi(&stream.api);
+
+    rc = Rb_MemoryStream_openArray(data, eRB_IO_MODE_WRITE, &stream.handle);
+    if(rc == RB_OK){
+        rc = Rb_Prefs_save(handle, &stream);
+
+        stream.api.close(&stream.handle);
+    }
+
+    if(rc != RB_OK){
+        Rb_Array_free(&data);
+        RB_ERRC(rc, "Error serializing preferences");
+    }
+
+    PrefsSaver* saver = &prefs->saver;
+
+    pthread_mutex_lock(&saver->mutex);
+
+    if(!saver->running){
+        if(pthread_create(&saver->thread, NULL, PrefsPriv_saveThread, prefs) != 0){
+            pthread_mutex_unlock(&saver->mutex);
+            Rb_Array_free(&data);
+            RB_ERRC(RB_ERROR, "Error starting save thread");
+        }
+
+        saver->running = RB_TRUE;
+    }
+
+    while(saver->pending && strcmp(saver->filePath, filePath) != 0){
+        pthread_cond_wait(&saver->cv, &saver->mutex);
+    }
+
+    // Room for the callback is made first, so a failure leaves the pending save untouched
+    if(fnc && saver->numCallbacks == saver->callbackCapacity){
+        uint32_t capacity = saver->callbackCapacity ? saver->callbackCapacity * 2 : PREFS_SAVE_MIN_CALLBACKS;
+
+        PrefsSaveCallback* callbacks = (PrefsSaveCallback*)RB_REALLOC(saver->callbacks,
+                capacity * sizeof(PrefsSaveCallback));
+        if(callbacks == NULL){
+            pthread_mutex_unlock(&saver->mutex);
+            Rb_Array_free(&data);
+            RB_ERRC(RB_ERROR, "Error allocating callback");
+        }
+
+        saver->callbacks = callbacks;
+        saver->callbackCapacity = capacity;
+    }
+
+    if(saver->pending){
+        // Superseded by the newer entries
+        Rb_Array_free(&saver->pending);
+    }
+    else{
+        saver->filePath = PrefsPriv_makePath(filePath, "");
+    }
+
+    saver->pending = data;
+
+    if(fnc){
+        saver->callbacks[saver->numCallbacks].fnc = fnc;
+        saver->callbacks[saver->numCallbacks].userData = userData;
+        saver->numCallbacks++;
+    }
+
+    pthread_cond_broadcast(&saver->cv);
+    pthread_mutex_unlock(&saver->mutex);
+
+    return RB_OK;
+}
+
+int32_t Rb_Prefs_waitSave(Rb_PrefsHandle handle){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    PrefsSaver* saver = &prefs->saver;
+
+    pthread_mutex_lock(&saver->mutex);
+
+    // Callbacks run on the thread writing the saves, it can't wait for itself
+    if(saver->running && pthread_equal(pthread_self(), saver->thread)){
+        pthread_mutex_unlock(&saver->mutex);
+        RB_ERRC(RB_ERROR, "Can't wait from a save callback");
+    }
+
+    while(saver->pending || saver->busy){
+        pthread_cond_wait(&saver->cv, &saver->mutex);
+    }
+
+    int32_t rc = saver->result;
+
+    pthread_mutex_unlock(&saver->mutex);
+
+    return rc;
+}
+
+void* PrefsPriv_saveThread(void* arg){
+    PrefsContext* prefs = (PrefsContext*)arg;
+    PrefsSaver* saver = &prefs->saver;
+    uint32_t i;
+
+    pthread_mutex_lock(&saver->mutex);
+
+    while(RB_TRUE){
+        while(saver->pending == NULL && !saver->stop){
+            pthread_cond_wait(&saver->cv, &saver->mutex);
+        }
+
+        // Pending saves are still written when stopping
+        if(saver->pending == NULL){
+            break;
+        }
+
+        Rb_ArrayHandle data = saver->pending;
+        char* filePath = saver->filePath;
+        PrefsSaveCallback* callbacks = saver->callbacks;
+        uint32_t numCallbacks = saver->numCallbacks;
+
+        saver->pending = NULL;
+        saver->filePath = NULL;
+        saver->callbacks = NULL;
+        saver->numCallbacks = 0;
+        saver->callbackCapacity = 0;
+        saver->busy = RB_TRUE;
+
+        // Requests for other files may proceed now
+        pthread_cond_broadcast(&saver->cv);
+        pthread_mutex_unlock(&saver->mutex);
+
+        int32_t rc = PrefsPriv_writeFile(filePath, Rb_Array_data(data), Rb_Array_size(data));
+
+        for(i=0; i<numCallbacks; i++){
+            callbacks[i].fnc((Rb_PrefsHandle)prefs, rc, callbacks[i].userData);
+        }
+
+        if(callbacks){
+            RB_FREE(&callbacks);
+        }
+
+        RB_FREE(&filePath);
+        Rb_Array_free(&data);
+
+        pthread_mutex_lock(&saver->mutex);
+
+        saver->busy = RB_FALSE;
+        saver->result = rc;
+
+        pthread_cond_broadcast(&saver->cv);
+    }
+
+    pthread_mutex_unlock(&saver->mutex);
+
+    return NULL;
+}
+
+int32_t PrefsPriv_writeFile(const char* filePath, const uint8_t* data, uint32_t size){
+    int32_t rc = RB_OK;
+
+    // Written next to the destination, so the rename replaces it atomically. The data is synced first, otherwise the
+    // rename may reach the disk before it and leave an empty or truncated file after a power loss.
+    char* tmpPath = PrefsPriv_makePath(filePath, ".tmp");
+
+    int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        rc = RB_ERROR;
+    }
+
+    uint32_t written = 0;
+
+    while(rc == RB_OK && written < size){
+        ssize_t res = write(fd, data + written, size - written);
+
+        if(res < 0 && errno != EINTR){
+            rc = RB_ERROR;
+        }
+        else if(res > 0){
+            written += (uint32_t)res;
+        }
+    }
+
+    if(rc == RB_OK && fsync(fd) != 0){
+        rc = RB_ERROR;
+    }
+
+    if(fd >= 0 && close(fd) != 0){
+        rc = RB_ERROR;
+    }
+
+    if(rc == RB_OK){
+        rc = PrefsPriv_replaceFile(tmpPath, filePath);
+    }
+
+    RB_FREE(&tmpPath);
+
+    return rc;
+}
+
+int32_t PrefsPriv_syncPath(const char* path){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        return RB_ERROR;
+    }
+
+    int32_t rc = fsync(fd) == 0 ? RB_OK : RB_ERROR;
+
+    close(fd);
+
+    return rc;
+}
+
+int32_t PrefsPriv_replaceFile(const char* tmpPath, const char* filePath){
+    if(rename(tmpPath, filePath) != 0){
+        return RB_ERROR;
+    }
+
+    // The rename itself is only durable once the directory holding the file is synced
+    const char* separator = strrchr(filePath, '/');
+    uint32_t dirLength = separator == NULL ? 0 : (separator == filePath ? 1 : (uint32_t)(separator - filePath));
+
+    char* dirPath = (char*)RB_MALLOC(dirLength + 2);
+    if(dirPath == NULL){
+        return RB_ERROR;
+    }
+
+    if(dirLength){
+        memcpy(dirPath, filePath, dirLength);
+        dirPath[dirLength] = 0;
+    }
+    else{
+        strcpy(dirPath, ".");
+    }
+
+    int32_t rc = PrefsPriv_syncPath(dirPath);
+
+    RB_FREE(&dirPath);
+
+    return rc;
+}
+
+void PrefsPriv_stopSaver(PrefsContext* prefs){
+    PrefsSaver* saver = &prefs->saver;
+
+    pthread_mutex_lock(&saver->mutex);
+
+    saver->stop = RB_TRUE;
+    pthread_cond_broadcast(&saver->cv);
+
+    int32_t running = saver->running;
+
+    pthread_mutex_unlock(&saver->mutex);
+
+    if(running){
+        pthread_join(saver->thread, NULL);
+    }
+
+    pthread_mutex_destroy(&saver->mutex);
+    pthread_cond_destroy(&saver->cv);
+}
+
+int32_t Rb_Prefs_openBlobStream(Rb_PrefsHandle handle, const char* key, Rb_IOMode mode, Rb_IOStream* stream){
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || key == NULL || stream == NULL || (mode != eRB_IO_MODE_READ && mode != eRB_IO_MODE_WRITE)){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(mode == eRB_IO_MODE_READ && prefs->concurrency != eRB_PREFS_CONCURRENCY_NONE){
+        RB_ERRC(RB_NOT_IMPLEMENTED, "Reading streams aren't available in concurrent mode");
+    }
+
+    if(mode == eRB_IO_MODE_WRITE && prefs->mapping.data){
+        RB_ERRC(RB_ERROR, "Preferences are read-only");
+    }
+
+    PrefsBlobStream* blobStream = (PrefsBlobStream*)RB_CALLOC(sizeof(PrefsBlobStream));
+    if(blobStream == NULL){
+        RB_ERRC(RB_ERROR, "Error allocating stream");
+    }
+
+    blobStream->magic = PREFS_BLOB_STREAM_MAGIC;
+    blobStream->mode = mode;
+    blobStream->prefs = prefs;
+
+    if(mode == eRB_IO_MODE_READ){
+        PrefsRead read;
+        const PrefEntry* entry = PrefsPriv_beginGet(prefs, key, eRB_VAR_TYPE_BLOB, &read);
+        if(entry == NULL){
+            RB_FREE(&blobStream);
+            RB_ERRC(RB_INVALID_ARG, "Invalid key or type");
+        }
+
+        memcpy(&blobStream->value, &entry->value, sizeof(Variant));
+
+        // Keeps the file open even if the entry goes away
+        if(blobStream->value.val.blobVal.file){
+            blobStream->value.val.blobVal.file->refs++;
+        }
+
+        PrefsPriv_endGet(prefs, &read);
+    }
+    else{
+        blobStream->key = (char*)RB_MALLOC(strlen(key) + 1);
+        strcpy(blobStream->key, key);
+
+        blobStream->data = Rb_Array_new();
+        if(blobStream->data == NULL){
+            RB_FREE(&blobStream->key);
+            RB_FREE(&blobStream);
+            RB_ERRC(RB_ERROR, "Error allocating buffer");
+        }
+    }
+
+    memset(&stream->api, 0x00, sizeof(Rb_IOApi));
+
+    stream->api.read = PrefsPriv_readBlobStream;
+    stream->api.write = PrefsPriv_writeBlobStream;
+    stream->api.close = PrefsPriv_closeBlobStream;
+    stream->api.tell = PrefsPriv_tellBlobStream;
+    stream->api.seek = PrefsPriv_seekBlobStream;
+    stream->handle = (Rb_IOStreamHandle)blobStream;
+
+    return RB_OK;
+}
+
+PrefsBlobStream* PrefsPriv_getBlobStream(Rb_IOStreamHandle handle){
+    PrefsBlobStream* blobStream = (PrefsBlobStream*)handle;
+
+    if(blobStream == NULL || blobStream->magic != PREFS_BLOB_STREAM_MAGIC){
+        return NULL;
+    }
+
+    return blobStream;
+}
+
+int32_t PrefsPriv_readBlobStream(Rb_IOStreamHandle handle, void* data, uint32_t size){
+    PrefsBlobStream* blobStream = PrefsPriv_getBlobStream(handle);
+    if(blobStream == NULL || blobStream->mode != eRB_IO_MODE_READ || (data == NULL && size)){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    const uint32_t available = blobStream->value.val.blobVal.size - blobStream->position;
+    const uint32_t numBytes = size < available ? size : available;
+
+    if(PrefsPriv_readBlob(&blobStream->value, blobStream->position, data, numBytes) != RB_OK){
+        RB_ERRC(RB_ERROR, "Error reading blob");
+    }
+
+    blobStream->position += numBytes;
+
+    return (int32_t)numBytes;
+}
+
+int32_t PrefsPriv_writeBlobStream(Rb_IOStreamHandle handle, const void* data, uint32_t size){
+    PrefsBlobStream* blobStream = PrefsPriv_getBlobStream(handle);
+    if(blobStream == NULL || blobStream->mode != eRB_IO_MODE_WRITE || size > (uint32_t)INT32_MAX){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    int32_t rc = Rb_Array_write(blobStream->data, data, size);
+    if(rc != (int32_t)size){
+        RB_ERRC(rc < 0 ? rc : RB_ERROR, "Error writing blob");
+    }
+
+    return rc;
+}
+
+int32_t PrefsPriv_tellBlobStream(Rb_IOStreamHandle handle){
+    PrefsBlobStream* blobStream = PrefsPriv_getBlobStream(handle);
+    if(blobStream == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(blobStream->mode == eRB_IO_MODE_WRITE){
+        return Rb_Array_tell(blobStream->data);
+    }
+
+    return (int32_t)blobStream->position;
+}
+
+int32_t PrefsPriv_seekBlobStream(Rb_IOStreamHandle handle, uint32_t position){
+    PrefsBlobStream* blobStream = PrefsPriv_getBlobStream(handle);
+    if(blobStream == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(blobStream->mode == eRB_IO_MODE_WRITE){
+        return Rb_Array_seek(blobStream->data, position);
+    }
+
+    if(position > blobStream->value.val.blobVal.size){
+        RB_ERRC(RB_INVALID_ARG, "Invalid position");
+    }
+
+    blobStream->position = position;
+
+    return RB_OK;
+}
+
+int32_t PrefsPriv_closeBlobStream(Rb_IOStreamHandle* handle){
+    int32_t rc = RB_OK;
+
+    PrefsBlobStream* blobStream = PrefsPriv_getBlobStream(handle ? *handle : NULL);
+    if(blobStream == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    if(blobStream->mode == eRB_IO_MODE_WRITE){
+        PrefsContext* prefs = blobStream->prefs;
+        Variant var;
+        uint8_t* data;
+
+        memset(&var, 0x00, sizeof(Variant));
+        var.type = eRB_VAR_TYPE_BLOB;
+
+        // The written buffer becomes the value, without another copy
+        rc = Rb_Array_detach(blobStream->data, &data, &var.val.blobVal.size);
+        var.val.blobVal.data = data;
+
+        if(rc == RB_OK){
+            PrefsPriv_lock(prefs);
+
+            // The new value is prepared first, the old one is only replaced once nothing can fail
+            if(prefs->mapping.data){
+                RB_ERR("Preferences are read-only");
+                rc = RB_ERROR;
+            }
+            else{
+                rc = PrefsPriv_adopt(prefs, &var);
+            }
+
+            if(rc == RB_OK){
+                rc = PrefsPriv_setLocked(prefs, blobStream->key, &var);
+            }
+            else{
+                PrefsPriv_freeVariant(&var);
+            }
+
+            rc = PrefsPriv_unlock(prefs, rc);
+        }
+
+        Rb_Array_free(&blobStream->data);
+        RB_FREE(&blobStream->key);
+    }
+    else if(blobStream->value.val.blobVal.file){
+        PrefsPriv_releaseBlobFile(blobStream->value.val.blobVal.file);
+    }
+
+    blobStream->magic = 0;
+
+    RB_FREE(&blobStream);
+    *handle = NULL;
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error storing blob");
+    }
+
+    return RB_OK;
+}
+
+int32_t PrefsPriv_put(PrefsContext* prefs, const char* key, const Variant* var, int32_t replace){
+    Variant copy;
+
+    memcpy(&copy, var, sizeof(Variant));
+
+    if(var->type == eRB_VAR_TYPE_STRING){
+        copy.val.stringVal = (char*)PrefsPriv_alloc(prefs, strlen(var->val.stringVal) + 1);
+        if(copy.val.stringVal == NULL){
+            RB_ERRC(RB_ERROR, "Error allocating value");
+        }
+
+        strcpy(copy.val.stringVal, var->val.stringVal);
+    }
+    else if(var->type == eRB_VAR_TYPE_BLOB){
+        copy.val.blobVal.data = PrefsPriv_alloc(prefs, var->val.blobVal.size);
+        if(copy.val.blobVal.data == NULL && var->val.blobVal.size){
+            RB_ERRC(RB_ERROR, "Error allocating value");
+        }
+
+        memcpy(copy.val.blobVal.data, var->val.blobVal.data, var->val.blobVal.size);
+        copy.val.blobVal.file = NULL;
+    }
+
+    PrefsPriv_lock(prefs);
+
+    return PrefsPriv_unlock(prefs, replace ? PrefsPriv_setLocked(prefs, key, &copy) : PrefsPriv_addLocked(prefs, key, &copy));
+}
+
+int32_t PrefsPriv_putLazyBlob(PrefsContext* prefs, const char* key, uint32_t offset, uint32_t size){
+    Variant var;
+
+    var.type = eRB_VAR_TYPE_BLOB;
+    var.val.blobVal.data = NULL;
+    var.val.blobVal.size = size;
+    var.val.blobVal.file = prefs->blobSource;
+    var.val.blobVal.offset = offset;
+
+    prefs->blobSource->refs++;
+
+    return PrefsPriv_add(prefs, key, &var);
+}
+
+int32_t PrefsPriv_readBlob(const Variant* var, uint32_t position, void* data, uint32_t size){
+    if(var->val.blobVal.file == NULL){
+        memcpy(data, (const uint8_t*)var->val.blobVal.data + position, size);
+        return RB_OK;
+    }
+
+    uint8_t* dest = (uint8_t*)data;
+    off_t offset = (off_t)var->val.blobVal.offset + position;
+
+    while(size){
+        ssize_t res = pread(var->val.blobVal.file->fd, dest, size, offset);
+        if(res < 0 && errno == EINTR){
+            continue;
+        }
+
+        // The file was truncated if it ends early
+        if(res <= 0){
+            return RB_ERROR;
+        }
+
+        dest += res;
+        offset += res;
+        size -= res;
+    }
+
+    return RB_OK;
+}
+
+int32_t PrefsPriv_loadBlob(PrefsContext* prefs, PrefEntry* entry){
+    Variant* var = &entry->value;
+
+    if(var->val.blobVal.file == NULL){
+        return RB_OK;
+    }
+
+    void* data = PrefsPriv_alloc(prefs, var->val.blobVal.size);
+    if(data == NULL && var->val.blobVal.size){
+        return RB_ERROR;
+    }
+
+    if(PrefsPriv_readBlob(var, 0, data, var->val.blobVal.size) != RB_OK){
+        if(prefs->arena.chunkSize == 0){
+            RB_FREE(&data);
+        }
+
+        return RB_ERROR;
+    }
+
+    PrefsPriv_releaseBlobFile(var->val.blobVal.file);
+
+    var->val.blobVal.data = data;
+    var->val.blobVal.file = NULL;
+
+    return RB_OK;
+}
+
+PrefsBlobFile* PrefsPriv_openBlobFile(const char* filePath){
+    PrefsBlobFile* file = (PrefsBlobFile*)RB_CALLOC(sizeof(PrefsBlobFile));
+    if(file == NULL){
+        return NULL;
+    }
+
+    file->fd = open(filePath, O_RDONLY);
+    if(file->fd < 0){
+        RB_FREE(&file);
+        return NULL;
+    }
+
+    file->refs = 1;
+
+    return file;
+}
+
+void PrefsPriv_releaseBlobFile(PrefsBlobFile* file){
+    if(--file->refs == 0){
+        close(file->fd);
+        RB_FREE(&file);
+    }
+}
+
+void* PrefsPriv_alloc(PrefsContext* prefs, uint32_t size){
+    if(prefs->arena.chunkSize){
+        return PrefsArena_alloc(&prefs->arena, size);
+    }
+
+    return RB_MALLOC(size);
+}
+
+PrefEntry* PrefsPriv_newEntry(PrefsContext* prefs, const char* key, const Variant* var){
+    PrefEntry* entry = (PrefEntry*)PrefsPriv_alloc(prefs, sizeof(PrefEntry));
+    if(entry == NULL){
+        return NULL;
+    }
+
+    memset(entry, 0x00, sizeof(PrefEntry));
+
+    entry->key = (char*)PrefsPriv_alloc(prefs, strlen(key) + 1);
+    if(entry->key == NULL){
+        if(prefs->arena.chunkSize == 0){
+            RB_FREE(&entry);
+        }
+
+        return NULL;
+    }
+
+    strcpy(entry->key, key);
+
+    memcpy(&entry->value, var, sizeof(Variant));
+
+    return entry;
+}
+
+void PrefsPriv_releaseEntry(PrefsContext* prefs, PrefEntry* entry){
+    if(prefs->arena.chunkSize == 0){
+        PrefsPriv_freeEntry(entry);
+    }
+    else{
+        PrefsPriv_releaseVariant(prefs, &entry->value);
+    }
+}
+
+void PrefsPriv_releaseVariant(PrefsContext* prefs, Variant* var){
+    // Arena memory is only freed with the whole arena, files are still referenced per value
+    if(prefs->arena.chunkSize == 0){
+        PrefsPriv_freeVariant(var);
+    }
+    else if(var->type == eRB_VAR_TYPE_BLOB && var->val.blobVal.file){
+        PrefsPriv_releaseBlobFile(var->val.blobVal.file);
+    }
+}
+
+int32_t PrefsPriv_adopt(PrefsContext* prefs, Variant* var){
+    void** data;
+    uint32_t size;
+
+    if(prefs->arena.chunkSize == 0){
+        return RB_OK;
+    }
+
+    if(var->type == eRB_VAR_TYPE_STRING){
+        data = (void**)&var->val.stringVal;
+        size = strlen(var->val.stringVal) + 1;
+    }
+    else if(var->type == eRB_VAR_TYPE_BLOB && var->val.blobVal.file == NULL){
+        data = &var->val.blobVal.data;
+        size = var->val.blobVal.size;
+    }
+    else{
+        return RB_OK;
+    }
+
+    void* arenaData = PrefsArena_alloc(&prefs->arena, size);
+    if(arenaData){
+        memcpy(arenaData, *data, size);
+    }
+
+    RB_FREE(data);
+
+    if(arenaData == NULL){
+        var->type = eRB_VAR_TYPE_INT32;
+        return RB_ERROR;
+    }
+
+    *data = arenaData;
+
+    return RB_OK;
+}
+
+int32_t PrefsPriv_removePrefix(PrefsContext* prefs, const char* prefix){
+    int32_t rc;
+    uint32_t i;
+
+    if(prefs->mapping.data){
+        RB_ERRC(RB_ERROR, "Preferences are read-only");
+    }
+
+    Rb_ListHandle ordered = PrefsPriv_getOrdered(prefs);
+    if(ordered == NULL){
+        RB_ERRC(RB_ERROR, "Error sorting keys");
+    }
+
+    size_t length = strlen(prefix);
+
+    PrefEntry bound;
+    PrefEntry* boundPtr = &bound;
+
+    bound.key = (char*)prefix;
+
+    int32_t first = Rb_List_lowerBound(ordered, &boundPtr);
+    if(first < 0){
+        return first;
+    }
+
+    int32_t size = Rb_List_getSize(ordered);
+    int32_t last = first;
+    PrefEntry* entry;
+
+    while(last < size && Rb_List_get(ordered, last, &entry) == RB_OK && strncmp(entry->key, prefix, length) == 0){
+        last++;
+    }
+
+    uint32_t count = (uint32_t)(last - first);
+    if(count == 0){
+        return 0;
+    }
+
+    // Everything which may fail is done before the entries are unlinked
+    PrefEntry** removed = (PrefEntry**)RB_MALLOC(sizeof(PrefEntry*) * count);
+    PrefEntry** entries = NULL;
+    uint32_t numEntries = 0;
+
+    rc = removed ? Rb_List_getRange(ordered, first, count, removed) : RB_ERROR;
+    if(rc == RB_OK){
+        rc = Rb_List_toArray(prefs->entries, (void**)&entries, &numEntries);
+    }
+
+    if(rc != RB_OK){
+        if(removed){
+            RB_FREE(&removed);
+        }
+
+        RB_ERRC(RB_ERROR, "Error removing entries");
+    }
+
+    Rb_List_removeRange(ordered, first, count);
+
+    for(i=0; i<count; i++){
+        PrefsIndex_remove(&prefs->index, removed[i]->key);
+    }
+
+    // The entry list is in insertion order, so it's compacted in one pass instead of being searched for each entry
+    // (clearing an array list keeps its storage, adding the remaining entries back doesn't allocate)
+    uint32_t numKept = 0;
+
+    for(i=0; i<numEntries; i++){
+        if(strncmp(entries[i]->key, prefix, length) != 0){
+            entries[numKept++] = entries[i];
+        }
+    }
+
+    Rb_List_clear(prefs->entries);
+    Rb_List_addAll(prefs->entries, entries, numKept);
+
+    RB_FREE(&entries);
+
+    prefs->generation++;
+
+    // Records are only buffered here, the journal is flushed once for the whole subtree
+    for(i=0; i<count && rc == RB_OK; i++){
+        rc = PrefsPriv_appendJournal(prefs, removed[i]->key);
+    }
+
+    if(rc == RB_OK){
+        rc = PrefsPriv_flushJournal(prefs);
+    }
+
+    for(i=0; i<count; i++){
+        PrefsPriv_releaseEntry(prefs, removed[i]);
+    }
+
+    RB_FREE(&removed);
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error appending journal records");
+    }
+
+    return (int32_t)count;
+}
+
+int32_t PrefsPriv_compareKeys(Rb_ListHandle handle, void* elem1, void* elem2){
+    RB_UNUSED(handle);
+
+    return strcmp((*(PrefEntry**)elem1)->key, (*(PrefEntry**)elem2)->key);
+}
+
+Rb_ListHandle PrefsPriv_getOrdered(PrefsContext* prefs){
+    if(prefs->ordered){
+        return prefs->ordered;
+    }
+
+    PrefEntry** entries = NULL;
+    uint32_t numEntries = 0;
+
+    if(Rb_List_toArray(prefs->entries, (void**)&entries, &numEntries) != RB_OK){
+        return NULL;
+    }
+
+    Rb_ListConfig listConfig;
+    Rb_List_getDefaultConfig(&listConfig);
+
+    // Sorted once here, afterwards entries are inserted at their position
+    listConfig.type = eRB_LIST_TYPE_ARRAY;
+    listConfig.compareFnc = PrefsPriv_compareKeys;
+
+    prefs->ordered = Rb_List_fromArray(sizeof(PrefEntry*), &listConfig, entries, numEntries);
+
+    if(entries){
+        RB_FREE(&entries);
+    }
+
+    return prefs->ordered;
+}
+
+void PrefsPriv_order(PrefsContext* prefs, PrefEntry* entry){
+    // Binary search plus a shift of the following pointers (O(n), see Rb_Prefs_forEachPrefix). Dropped if it can't be
+    // kept in sync, the next prefix query rebuilds it
+    if(prefs->ordered && Rb_List_add(prefs->ordered, &entry) != RB_OK){
+        Rb_List_free(&prefs->ordered);
+    }
+}
+
+void PrefsPriv_unorder(PrefsContext* prefs, PrefEntry* entry){
+    if(prefs->ordered == NULL){
+        return;
+    }
+
+    // Keys are unique, so the entry is the one comparing equal
+    int32_t index = Rb_List_search(prefs->ordered, &entry);
+
+    if(index < 0 || Rb_List_remove(prefs->ordered, index) != RB_OK){
+        Rb_List_free(&prefs->ordered);
+    }
+}
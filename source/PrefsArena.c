@@ -0,0 +1,112 @@
+/*******************************************************/
+/*              Includes                               */
+/*******************************************************/
+
+#include "rb/priv/PrefsArena.h"
+#include "rb/Common.h"
+#include "rb/Utils.h"
+
+#include <string.h>
+
+/*******************************************************/
+/*              Defines                                */
+/*******************************************************/
+
+#define PREFS_ARENA_ALIGNMENT ( 8 )
+
+#define PREFS_ARENA_ALIGN(size) ( ((size) + PREFS_ARENA_ALIGNMENT - 1) & ~(uint32_t)(PREFS_ARENA_ALIGNMENT - 1) )
+
+/**
+ * Chunk header size, rounded so the chunk data is aligned.
+ */
+#define PREFS_ARENA_HEADER_SIZE ( PREFS_ARENA_ALIGN(sizeof(PrefsArenaChunk)) )
+
+/*******************************************************/
+/*              Functions Declarations                 */
+/*******************************************************/
+
+static PrefsArenaChunk* PrefsArenaPriv_addChunk(PrefsArena* arena, uint32_t size);
+
+/*******************************************************/
+/*              Functions Definitions                  */
+/*******************************************************/
+
+int32_t PrefsArena_init(PrefsArena* arena, uint32_t chunkSize){
+    memset(arena, 0x00, sizeof(PrefsArena));
+
+    arena->chunkSize = PREFS_ARENA_ALIGN(chunkSize);
+
+    return RB_OK;
+}
+
+void PrefsArena_clear(PrefsArena* arena){
+    while(arena->chunks){
+        PrefsArenaChunk* next = arena->chunks->next;
+
+        RB_FREE(&arena->chunks);
+
+        arena->chunks = next;
+    }
+}
+
+int32_t PrefsArena_reserve(PrefsArena* arena, uint32_t size){
+    size = PREFS_ARENA_ALIGN(size);
+
+    if(arena->chunks && arena->chunks->size - arena->chunks->used >= size){
+        return RB_OK;
+    }
+
+    return PrefsArenaPriv_addChunk(arena, size) ? RB_OK : RB_ERROR;
+}
+
+void* PrefsArena_alloc(PrefsArena* arena, uint32_t size){
+    size = PREFS_ARENA_ALIGN(size);
+
+    PrefsArenaChunk* chunk = arena->chunks;
+
+    if(chunk == NULL || chunk->size - chunk->used < size){
+        chunk = PrefsArenaPriv_addChunk(arena, size);
+        if(chunk == NULL){
+            return NULL;
+        }
+    }
+
+    void* ptr = (uint8_t*)chunk + PREFS_ARENA_HEADER_SIZE + chunk->used;
+
+    chunk->used += size;
+
+    return ptr;
+}
+
+PrefsArenaChunk* PrefsArenaPriv_addChunk(PrefsArena* arena, uint32_t size){
+    // Allocations larger than a chunk get a chunk of their own
+    if(size < arena->chunkSize){
+        size = arena->chunkSize;
+    }
+
+    if(size > (uint32_t)INT32_MAX - PREFS_ARENA_HEADER_SIZE){
+        return NULL;
+    }
+
+    PrefsArenaChunk* chunk = (PrefsArenaChunk*)RB_MALLOC(PREFS_ARENA_HEADER_SIZE + size);
+    if(chunk == NULL){
+        return NULL;
+    }
+
+    chunk->size = size;
+    chunk->used = 0;
+
+    // The current chunk keeps serving allocations if it has more room left than the new one
+    PrefsArenaChunk* current = arena->chunks;
+
+    if(current && current->size - current->used > size){
+        chunk->next = current->next;
+        current->next = chunk;
+    }
+    else{
+        chunk->next = current;
+        arena->chunks = chunk;
+    }
+
+    return chunk;
+}
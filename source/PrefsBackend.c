@@ -3,17 +3,36 @@
 /*******************************************************/
 
 #include "rb/priv/PrefsBackend.h"
+#include "rb/priv/PrefsPriv.h"
 #include "rb/Utils.h"
 #include "rb/priv/ErrorPriv.h"
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
 
 /*******************************************************/
 /*              Defines                                */
 /*******************************************************/
 
 #define PREFS_BACKEND_MAGIC ( 0x6369AABC )
+#define PREFS_JOURNAL_MAGIC ( 0x6369AABD )
+
+/**
+ * Journal record types, each followed by an entry (put) or a key (remove).
+ */
+#define PREFS_JOURNAL_PUT ( 1 )
+#define PREFS_JOURNAL_REMOVE ( 2 )
+
+/**
+ * Size of the chunks preferences are written and read in.
+ */
+#define PREFS_BACKEND_CHUNK_SIZE ( 64 * 1024 )
+
+/**
+ * Size of the stack buffer journal records are built in.
+ */
+#define PREFS_BACKEND_RECORD_SIZE ( 256 )
 
 #define SYNTAX_VERSION_MAJOR ( 1 )
 #define SYNTAX_VERSION_MINOR ( 0 )
@@ -21,6 +40,29 @@
 
 #define SYNTAX_VERSION RB_VERSION_NUMBER(SYNTAX_VERSION_MAJOR, SYNTAX_VERSION_MINOR, SYNTAX_VERSION_PATCH)
 
+/**
+ * Version of the eRB_PREFS_FORMAT_INDEXED format.
+ */
+#define SYNTAX_VERSION_INDEXED RB_VERSION_NUMBER(SYNTAX_VERSION_MAJOR, 1, 0)
+
+/**
+ * Version of the eRB_PREFS_FORMAT_COMPACT format.
+ */
+#define SYNTAX_VERSION_COMPACT RB_VERSION_NUMBER(SYNTAX_VERSION_MAJOR, 2, 0)
+
+#define PREFS_BACKEND_MAX_VARINT_SIZE ( 10 )
+
+/**
+ * Initial number of key offsets allocated while reading the eRB_PREFS_FORMAT_COMPACT key table.
+ */
+#define PREFS_BACKEND_MIN_KEY_OFFSETS ( 64 )
+
+/**
+ * Maps signed integers to unsigned ones so small magnitudes of either sign get short varints.
+ */
+#define PREFS_BACKEND_ZIGZAG(value) ( ((uint64_t)(int64_t)(value) << 1) ^ (uint64_t)((int64_t)(value) >> 63) )
+#define PREFS_BACKEND_UNZIGZAG(value) ( (int64_t)((value) >> 1) ^ -(int64_t)((value) & 1) )
+
 /*******************************************************/
 /*              Typedefs                               */
 /*******************************************************/
@@ -31,307 +73,1508 @@ typedef struct {
     int32_t numEntries;
 } PrefsBackend_Header;
 
+/**
+ * Follows the header in indexed format. All offsets are relative to the start of the file.
+ */
+typedef struct {
+    /**
+     * Table of PrefsBackend_IndexEntry, in the order the entries were added.
+     */
+    uint32_t entriesOffset;
+
+    /**
+     * Entry table indices (uint32_t) sorted by key.
+     */
+    uint32_t sortedOffset;
+
+    /**
+     * Keys (NUL terminated), strings (NUL terminated) and blobs.
+     */
+    uint32_t dataOffset;
+
+    /**
+     * Size of the whole file.
+     */
+    uint32_t size;
+} PrefsBackend_IndexHeader;
+
+typedef struct {
+    uint32_t keyOffset;
+    /**
+     * Key length, without the NUL terminator.
+     */
+    uint32_t keySize;
+    int32_t type;
+    /**
+     * String length (without the NUL terminator) or blob size.
+     */
+    uint32_t valueSize;
+
+    union {
+        int32_t int32Val;
+        int64_t int64Val;
+        float floatVal;
+        uint64_t offset;
+    } value;
+} PrefsBackend_IndexEntry;
+
+typedef struct {
+    const char* key;
+    uint32_t index;
+} PrefsBackend_SortKey;
+
+/**
+ * Gathers small writes, so the stream is written in PREFS_BACKEND_CHUNK_SIZE chunks.
+ */
+typedef struct {
+    const Rb_IOStream* stream;
+    uint8_t* buffer;
+    uint32_t size;
+    uint32_t capacity;
+
+    /**
+     * CRC-32C of the data written while checksum is set.
+     */
+    uint32_t crc;
+    int32_t checksum;
+} PrefsBackend_Writer;
+
+/**
+ * Reads the stream ahead in PREFS_BACKEND_CHUNK_SIZE chunks. Keys and values are read into buffers which are reused
+ * for every entry.
+ */
+typedef struct {
+    const Rb_IOStream* stream;
+    uint8_t* buffer;
+    uint32_t size;
+    uint32_t position;
+    uint32_t capacity;
+
+    /**
+     * CRC-32C of the data read while checksum is set.
+     */
+    uint32_t crc;
+    int32_t checksum;
+
+    uint8_t* key;
+    uint32_t keyCapacity;
+    uint8_t* value;
+    uint32_t valueCapacity;
+} PrefsBackend_Reader;
+
 
 /*******************************************************/
 /*              Functions Declarations                 */
 /*******************************************************/
 
-static int32_t PrefsBackendPriv_writeVar(Rb_PrefsHandle handle, const Rb_IOStream* stream, const char* key);
+static int32_t PrefsBackendPriv_writeVar(Rb_ListHandle handle, int32_t index, void* element, void* arg);
+
+static int32_t PrefsBackendPriv_readVar(Rb_PrefsHandle handle, PrefsBackend_Reader* reader, int32_t replace);
+
+static int32_t PrefsBackendPriv_writeIndexed(PrefsContext* prefs, PrefsBackend_Writer* writer);
+
+static int32_t PrefsBackendPriv_readIndexed(Rb_PrefsHandle handle, const PrefsBackend_Header* header,
+        PrefsBackend_Reader* reader);
+
+static int32_t PrefsBackendPriv_writeCompact(PrefsContext* prefs, PrefsBackend_Writer* writer);
+
+static int32_t PrefsBackendPriv_readCompact(Rb_PrefsHandle handle, const PrefsBackend_Header* header,
+        PrefsBackend_Reader* reader);
+
+static int32_t PrefsBackendPriv_getEntries(PrefsContext* prefs, PrefEntry*** entries, PrefEntry** mappedEntries,
+        uint32_t* numEntries);
+
+static int32_t PrefsBackendPriv_putEntry(Rb_PrefsHandle handle, const PrefEntry* entry);
+
+static void PrefsBackendPriv_getIndexHeader(const PrefsMapping* mapping, PrefsBackend_IndexHeader* indexHeader);
+
+static int PrefsBackendPriv_compareKeys(const void* key1, const void* key2);
+
+static void PrefsBackendPriv_initWriter(PrefsBackend_Writer* writer, const Rb_IOStream* stream, uint8_t* buffer,
+        uint32_t capacity);
+
+static int32_t PrefsBackendPriv_write(PrefsBackend_Writer* writer, const void* data, uint32_t size);
+
+static int32_t PrefsBackendPriv_writeBlob(PrefsBackend_Writer* writer, const Variant* value);
+
+static int32_t PrefsBackendPriv_flush(PrefsBackend_Writer* writer);
 
-static int32_t PrefsBackendPriv_readVar(Rb_PrefsHandle handle, const Rb_IOStream* stream);
+static int32_t PrefsBackendPriv_initReader(PrefsBackend_Reader* reader, const Rb_IOStream* stream);
+
+static void PrefsBackendPriv_freeReader(PrefsBackend_Reader* reader);
+
+static int32_t PrefsBackendPriv_read(PrefsBackend_Reader* reader, void* data, uint32_t size);
+
+static int32_t PrefsBackendPriv_tell(PrefsBackend_Reader* reader);
+
+static int32_t PrefsBackendPriv_skip(PrefsBackend_Reader* reader, uint32_t size);
+
+static int32_t PrefsBackendPriv_readInto(PrefsBackend_Reader* reader, uint8_t** buffer, uint32_t* capacity,
+        uint32_t size);
+
+static int32_t PrefsBackendPriv_writeVarint(PrefsBackend_Writer* writer, uint64_t value);
+
+static int32_t PrefsBackendPriv_readVarint(PrefsBackend_Reader* reader, uint64_t* value);
+
+static uint32_t PrefsBackendPriv_crc32c(uint32_t crc, const void* data, uint32_t size);
 
 /*******************************************************/
 /*              Functions Definitions                  */
 /*******************************************************/
 
 int32_t Rb_PrefsBackendSave(Rb_PrefsHandle handle, const Rb_IOStream* stream){
-    PrefsBackend_Header header;
-    memset(&header, 0x00, sizeof(PrefsBackend_Header));
-
-    header.magic = PREFS_BACKEND_MAGIC;
-    header.syntaxVersion = SYNTAX_VERSION;
-    header.numEntries = Rb_Prefs_getNumEntries(handle);
-
-    if (stream->api.write(stream->handle, &header, sizeof(PrefsBackend_Header))
-            != sizeof(PrefsBackend_Header)) {
-        return RB_ERROR;
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
     }
 
-    int32_t i;
     int32_t rc;
 
-    for (i = 0; i < Rb_Prefs_getNumEntries(handle); i++){
-        const char* key = NULL;
-
-        rc = Rb_Prefs_getKey(handle, i, &key);
-        if(rc != RB_OK){
-            return rc;
+    // A mapped file is already in indexed format
+    if(prefs->mapping.data && prefs->format == eRB_PREFS_FORMAT_INDEXED){
+        if(stream->api.write(stream->handle, prefs->mapping.data, prefs->mapping.size) != (int32_t)prefs->mapping.size){
+            RB_ERRC(RB_ERROR, "Error writing data");
         }
 
-        rc = PrefsBackendPriv_writeVar(handle, stream, key);
-        if(rc != RB_OK){
-            RB_ERRC(rc, "Error writing value");
-        }
+        return RB_OK;
     }
 
-    return RB_OK;
-}
+    // Everything goes through one buffer, the stream only sees large writes
+    PrefsBackend_Writer writer;
+    uint8_t* buffer = (uint8_t*)RB_MALLOC(PREFS_BACKEND_CHUNK_SIZE);
+    if(buffer == NULL){
+        RB_ERRC(RB_ERROR, "Error allocating buffer");
+    }
+
+    PrefsBackendPriv_initWriter(&writer, stream, buffer, PREFS_BACKEND_CHUNK_SIZE);
 
-int32_t Rb_PrefsBackendLoad(Rb_PrefsHandle handle, const Rb_IOStream* stream){
     PrefsBackend_Header header;
-    if(stream->api.read(stream->handle, &header, sizeof(PrefsBackend_Header))!= sizeof(PrefsBackend_Header)){
-        return RB_ERROR;
-    }
+    memset(&header, 0x00, sizeof(PrefsBackend_Header));
 
-    if(header.magic != PREFS_BACKEND_MAGIC){
-        RB_ERRC(RB_ERROR, "Invalid data header");
-    }
+    header.magic = PREFS_BACKEND_MAGIC;
+    header.syntaxVersion = prefs->format == eRB_PREFS_FORMAT_INDEXED ? SYNTAX_VERSION_INDEXED
+            : prefs->format == eRB_PREFS_FORMAT_COMPACT ? SYNTAX_VERSION_COMPACT : SYNTAX_VERSION;
+    // Entries not published yet (concurrent mode) are saved as well
+    header.numEntries = prefs->mapping.data ? prefs->mapping.numEntries : Rb_List_getSize(prefs->entries);
 
-    if(header.syntaxVersion != SYNTAX_VERSION){
-        RB_ERRC(RB_ERROR, "Invalid syntax version");
-    }
+    writer.checksum = prefs->format == eRB_PREFS_FORMAT_COMPACT;
 
-    int32_t i;
-    int32_t rc;
+    rc = PrefsBackendPriv_write(&writer, &header, sizeof(PrefsBackend_Header));
 
-    rc = Rb_Prefs_clear(handle);
     if(rc != RB_OK){
-        return rc;
+        // Nothing else to write
+    }
+    else if(prefs->format == eRB_PREFS_FORMAT_INDEXED){
+        rc = PrefsBackendPriv_writeIndexed(prefs, &writer);
+    }
+    else if(prefs->format == eRB_PREFS_FORMAT_COMPACT){
+        rc = PrefsBackendPriv_writeCompact(prefs, &writer);
     }
+    else if(prefs->mapping.data){
+        int32_t i;
 
-    for(i=0; i<header.numEntries; i++){
-        rc = PrefsBackendPriv_readVar(handle, stream);
-        if(rc != RB_OK){
-            RB_ERRC(rc, "Error reading value");
+        for(i=0; i<prefs->mapping.numEntries && rc == RB_OK; i++){
+            PrefEntry entry;
+            PrefEntry* entryPtr = &entry;
+
+            rc = Rb_PrefsBackendMappedGet(&prefs->mapping, i, &entry);
+            if(rc == RB_OK){
+                rc = PrefsBackendPriv_writeVar(NULL, i, &entryPtr, &writer);
+            }
         }
     }
+    else{
+        // Entries are written straight from the list, in a single pass
+        rc = Rb_List_forEach(prefs->entries, PrefsBackendPriv_writeVar, &writer);
+    }
+
+    if(rc == RB_OK){
+        rc = PrefsBackendPriv_flush(&writer);
+    }
+
+    RB_FREE(&buffer);
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error writing value");
+    }
 
     return RB_OK;
 }
 
-
-int32_t PrefsBackendPriv_writeVar(Rb_PrefsHandle handle, const Rb_IOStream* stream, const char* key){
+int32_t Rb_PrefsBackendLoad(Rb_PrefsHandle handle, const Rb_IOStream* stream){
     int32_t rc;
 
-    Rb_VariantType type;
-    rc = Rb_Prefs_getEntryType(handle, key, &type);
+    PrefsBackend_Reader reader;
+
+    rc = PrefsBackendPriv_initReader(&reader, stream);
     if(rc != RB_OK){
-        return rc;
+        RB_ERRC(rc, "Error allocating buffer");
     }
 
-    // Key
-    const int32_t keySize = strlen(key) + 1;
-    if(stream->api.write(stream->handle, &keySize, sizeof(int32_t)) != sizeof(int32_t)){
-        return RB_ERROR;
-    }
+    PrefsBackend_Header header;
 
-    rc = Rb_IOStream_print(stream, "%s", key);
-    if(rc != RB_OK){
-        return rc;
+    if(PrefsBackendPriv_read(&reader, &header, sizeof(PrefsBackend_Header)) != sizeof(PrefsBackend_Header)){
+        rc = RB_ERROR;
     }
-
-    // Type
-    if(stream->api.write(stream->handle, &type, sizeof(int32_t)) != sizeof(int32_t)){
-        return RB_ERROR;
+    else if(header.magic != PREFS_BACKEND_MAGIC){
+        rc = RB_ERROR;
     }
+    else if(header.syntaxVersion == SYNTAX_VERSION_INDEXED){
+        rc = PrefsBackendPriv_readIndexed(handle, &header, &reader);
+    }
+    else if(header.syntaxVersion == SYNTAX_VERSION_COMPACT){
+        reader.crc = PrefsBackendPriv_crc32c(0, &header, sizeof(PrefsBackend_Header));
+        reader.checksum = RB_TRUE;
 
-    switch(type){
-    case eRB_VAR_TYPE_INT32: {
-        int32_t val;
-
-        rc = Rb_Prefs_getInt32(handle, key, &val);
-        if(rc != RB_OK){
-            return rc;
-        }
-
-        if(stream->api.write(stream->handle, &val, sizeof(int32_t)) != sizeof(int32_t)){
-            return RB_ERROR;
-        }
-        break;
+        rc = PrefsBackendPriv_readCompact(handle, &header, &reader);
+    }
+    else if(header.syntaxVersion != SYNTAX_VERSION){
+        rc = RB_ERROR;
     }
-    case eRB_VAR_TYPE_INT64: {
-        int64_t val;
+    else{
+        int32_t i;
 
-        rc = Rb_Prefs_getInt64(handle, key, &val);
-        if(rc != RB_OK){
-            return rc;
-        }
+        rc = Rb_Prefs_clear(handle);
 
-        if(stream->api.write(stream->handle, &val, sizeof(int64_t)) != sizeof(int64_t)){
-            return RB_ERROR;
+        for(i=0; i<header.numEntries && rc == RB_OK; i++){
+            rc = PrefsBackendPriv_readVar(handle, &reader, RB_FALSE);
         }
-        break;
     }
-    case eRB_VAR_TYPE_FLOAT: {
-        float val;
 
-        rc = Rb_Prefs_getFloat(handle, key, &val);
-        if(rc != RB_OK){
-            return rc;
-        }
+    PrefsBackendPriv_freeReader(&reader);
 
-        if(stream->api.write(stream->handle, &val, sizeof(float)) != sizeof(float)){
-            return RB_ERROR;
-        }
-        break;
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error reading preferences");
     }
-    case eRB_VAR_TYPE_STRING: {
-        char* val;
 
-        rc = Rb_Prefs_getString(handle, key, &val);
-        if(rc != RB_OK){
-            return rc;
-        }
+    return RB_OK;
+}
 
-        const int32_t strSize = strlen(val) + 1;
 
-        if(stream->api.write(stream->handle, &strSize, sizeof(int32_t)) != sizeof(int32_t)){
-            return RB_ERROR;
-        }
+int32_t PrefsBackendPriv_writeVar(Rb_ListHandle handle, int32_t index, void* element, void* arg){
+    RB_UNUSED(handle);
+    RB_UNUSED(index);
 
-        rc = Rb_IOStream_print(stream, "%s", val);
-        if(rc != RB_OK){
-            return rc;
-        }
+    const PrefEntry* entry = *(PrefEntry**)element;
+    PrefsBackend_Writer* writer = (PrefsBackend_Writer*)arg;
+    const int32_t type = entry->value.type;
 
-        RB_FREE(&val);
+    // Key and type
+    const int32_t keySize = strlen(entry->key) + 1;
 
-        break;
+    if(PrefsBackendPriv_write(writer, &keySize, sizeof(int32_t)) != RB_OK
+            || PrefsBackendPriv_write(writer, entry->key, keySize) != RB_OK
+            || PrefsBackendPriv_write(writer, &type, sizeof(int32_t)) != RB_OK){
+        return RB_ERROR;
     }
-    case eRB_VAR_TYPE_BLOB: {
-        void* val;
-        uint32_t size;
 
-        rc = Rb_Prefs_getBlob(handle, key, &val, &size);
-        if(rc != RB_OK){
-            return rc;
-        }
+    switch(type){
+    case eRB_VAR_TYPE_INT32:
+        return PrefsBackendPriv_write(writer, &entry->value.val.int32Val, sizeof(int32_t));
+    case eRB_VAR_TYPE_INT64:
+        return PrefsBackendPriv_write(writer, &entry->value.val.int64Val, sizeof(int64_t));
+    case eRB_VAR_TYPE_FLOAT:
+        return PrefsBackendPriv_write(writer, &entry->value.val.floatVal, sizeof(float));
+    case eRB_VAR_TYPE_STRING: {
+        const int32_t strSize = strlen(entry->value.val.stringVal) + 1;
 
-        if(stream->api.write(stream->handle, &size, sizeof(int32_t)) != sizeof(int32_t)){
+        if(PrefsBackendPriv_write(writer, &strSize, sizeof(int32_t)) != RB_OK){
             return RB_ERROR;
         }
 
-        if(stream->api.write(stream->handle, val, size) != (int32_t)size){
+        return PrefsBackendPriv_write(writer, entry->value.val.stringVal, strSize);
+    }
+    case eRB_VAR_TYPE_BLOB: {
+        const uint32_t size = entry->value.val.blobVal.size;
+
+        if(PrefsBackendPriv_write(writer, &size, sizeof(int32_t)) != RB_OK){
             return RB_ERROR;
         }
 
-        RB_FREE(&val);
-        break;
+        return PrefsBackendPriv_writeBlob(writer, &entry->value);
     }
     default:
         return RB_INVALID_ARG;
     }
-
-    return RB_OK;
 }
 
-int32_t PrefsBackendPriv_readVar(Rb_PrefsHandle handle, const Rb_IOStream* stream){
+int32_t PrefsBackendPriv_readVar(Rb_PrefsHandle handle, PrefsBackend_Reader* reader, int32_t replace){
     int32_t rc;
 
     int32_t size;
-    Rb_VariantType type;
+    int32_t type;
 
-    // Key
-    if(stream->api.read(stream->handle, &size, sizeof(int32_t)) != sizeof(int32_t)){
+    // Key (read into the reader's key buffer, reused for every entry)
+    if(PrefsBackendPriv_read(reader, &size, sizeof(int32_t)) != sizeof(int32_t) || size <= 0){
         return RB_ERROR;
     }
 
-    char* key = (char*)RB_CALLOC(size);
-    if(stream->api.read(stream->handle, key, size) != size){
+    rc = PrefsBackendPriv_readInto(reader, &reader->key, &reader->keyCapacity, size);
+    if(rc != RB_OK || reader->key[size - 1] != 0){
         return RB_ERROR;
     }
 
+    const char* key = (const char*)reader->key;
+
     // Type
-    if(stream->api.read(stream->handle, &type, sizeof(int32_t)) != sizeof(int32_t)){
+    if(PrefsBackendPriv_read(reader, &type, sizeof(int32_t)) != sizeof(int32_t)){
         return RB_ERROR;
     }
 
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL){
+        return RB_INVALID_ARG;
+    }
+
+    // Values point into the reader, they're copied when put
+    Variant var;
+
+    memset(&var, 0x00, sizeof(Variant));
+    var.type = (Rb_VariantType)type;
+
     switch(type){
-    case eRB_VAR_TYPE_INT32: {
-        int32_t val;
-        if(stream->api.read(stream->handle, &val, sizeof(int32_t)) != sizeof(int32_t)){
+    case eRB_VAR_TYPE_INT32:
+        if(PrefsBackendPriv_read(reader, &var.val.int32Val, sizeof(int32_t)) != sizeof(int32_t)){
             return RB_ERROR;
         }
-
-        rc = Rb_Prefs_putInt32(handle, key, val);
-        if(rc != RB_OK){
-            return rc;
-        }
-
         break;
-    }
-    case eRB_VAR_TYPE_INT64: {
-        int64_t val;
-        if(stream->api.read(stream->handle, &val, sizeof(int64_t)) != sizeof(int64_t)){
+    case eRB_VAR_TYPE_INT64:
+        if(PrefsBackendPriv_read(reader, &var.val.int64Val, sizeof(int64_t)) != sizeof(int64_t)){
             return RB_ERROR;
         }
-
-        rc = Rb_Prefs_putInt64(handle, key, val);
-        if(rc != RB_OK){
-            return rc;
+        break;
+    case eRB_VAR_TYPE_FLOAT:
+        if(PrefsBackendPriv_read(reader, &var.val.floatVal, sizeof(float)) != sizeof(float)){
+            return RB_ERROR;
         }
-
         break;
-    }
-    case eRB_VAR_TYPE_FLOAT: {
-        float val;
-        if(stream->api.read(stream->handle, &val, sizeof(float)) != sizeof(float)){
+    case eRB_VAR_TYPE_STRING:
+        if(PrefsBackendPriv_read(reader, &size, sizeof(int32_t)) != sizeof(int32_t) || size <= 0){
             return RB_ERROR;
         }
 
-        rc = Rb_Prefs_putFloat(handle, key, val);
-        if(rc != RB_OK){
-            return rc;
+        rc = PrefsBackendPriv_readInto(reader, &reader->value, &reader->valueCapacity, size);
+        if(rc != RB_OK || reader->value[size - 1] != 0){
+            return RB_ERROR;
         }
+
+        var.val.stringVal = (char*)reader->value;
         break;
-    }
-    case eRB_VAR_TYPE_STRING: {
-        if(stream->api.read(stream->handle, &size, sizeof(int32_t)) != sizeof(int32_t)){
+    case eRB_VAR_TYPE_BLOB:
+        if(PrefsBackendPriv_read(reader, &size, sizeof(int32_t)) != sizeof(int32_t) || size < 0){
             return RB_ERROR;
         }
 
-        char* val = (char*)RB_CALLOC(size);
-        if(stream->api.read(stream->handle, val, size) != size){
-            RB_FREE(&val);
-            return RB_ERROR;
+        // Large blobs are left in the file being loaded, only their position is kept
+        if(prefs->blobSource && (uint32_t)size >= prefs->lazyBlobSize){
+            int32_t offset = PrefsBackendPriv_tell(reader);
+
+            if(offset < 0 || PrefsBackendPriv_skip(reader, size) != RB_OK){
+                return RB_ERROR;
+            }
+
+            return PrefsPriv_putLazyBlob(prefs, key, offset, size);
         }
 
-        rc = Rb_Prefs_putString(handle, key, val);
+        rc = PrefsBackendPriv_readInto(reader, &reader->value, &reader->valueCapacity, size);
         if(rc != RB_OK){
-            RB_FREE(&val);
-            return rc;
+            return RB_ERROR;
         }
 
-        RB_FREE(&val);
+        var.val.blobVal.data = reader->value;
+        var.val.blobVal.size = size;
         break;
+    default:
+        return RB_INVALID_ARG;
     }
-    case eRB_VAR_TYPE_BLOB: {
-        if(stream->api.read(stream->handle, &size, sizeof(int32_t)) != sizeof(int32_t)){
-            return RB_ERROR;
+
+    // Journal records overwrite existing values in place, like the operations which wrote them
+    return PrefsPriv_put(prefs, key, &var, replace);
+}
+
+int32_t Rb_PrefsBackendAppend(Rb_PrefsHandle handle, const Rb_IOStream* stream, const char* key){
+    int32_t rc;
+
+    PrefsContext* prefs = PrefsPriv_getContext(handle);
+    if(prefs == NULL || key == NULL){
+        RB_ERRC(RB_INVALID_ARG, "Invalid handle");
+    }
+
+    // Records are small, build them on the stack and write each one at once (larger values go straight through)
+    uint8_t buffer[PREFS_BACKEND_RECORD_SIZE];
+    PrefsBackend_Writer writer;
+
+    PrefsBackendPriv_initWriter(&writer, stream, buffer, sizeof(buffer));
+
+    // New journal starts with a header
+    if(stream->api.tell(stream->handle) == 0){
+        PrefsBackend_Header header;
+        memset(&header, 0x00, sizeof(PrefsBackend_Header));
+
+        header.magic = PREFS_JOURNAL_MAGIC;
+        header.syntaxVersion = SYNTAX_VERSION;
+
+        rc = PrefsBackendPriv_write(&writer, &header, sizeof(PrefsBackend_Header));
+        if(rc != RB_OK){
+            RB_ERRC(rc, "Error writing journal header");
         }
+    }
 
-        void* data = RB_CALLOC(size);
+    PrefEntry* entry = PrefsIndex_find(&prefs->index, key);
 
-        if(stream->api.read(stream->handle, data, size) != size){
-            RB_FREE(&data);
-            return RB_ERROR;
+    const int32_t op = entry ? PREFS_JOURNAL_PUT : PREFS_JOURNAL_REMOVE;
+
+    rc = PrefsBackendPriv_write(&writer, &op, sizeof(int32_t));
+
+    // Puts are recorded the same way snapshot entries are
+    if(rc == RB_OK && entry){
+        rc = PrefsBackendPriv_writeVar(NULL, 0, &entry, &writer);
+    }
+    else if(rc == RB_OK){
+        const int32_t keySize = strlen(key) + 1;
+
+        rc = PrefsBackendPriv_write(&writer, &keySize, sizeof(int32_t));
+        if(rc == RB_OK){
+            rc = PrefsBackendPriv_write(&writer, key, keySize);
         }
+    }
 
-        rc = Rb_Prefs_putBlob(handle, key, data, size);
-        if(rc != RB_OK){
-            RB_FREE(&data);
-            return rc;
+    if(rc == RB_OK){
+        rc = PrefsBackendPriv_flush(&writer);
+    }
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error writing journal record");
+    }
+
+    return RB_OK;
+}
+
+int32_t Rb_PrefsBackendReplay(Rb_PrefsHandle handle, const Rb_IOStream* stream){
+    int32_t rc;
+    PrefsBackend_Header header;
+    PrefsBackend_Reader reader;
+
+    rc = PrefsBackendPriv_initReader(&reader, stream);
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error allocating buffer");
+    }
+
+    int32_t res = PrefsBackendPriv_read(&reader, &header, sizeof(PrefsBackend_Header));
+
+    if(res == 0){
+        // Empty journal
+    }
+    else if(res != sizeof(PrefsBackend_Header) || header.magic != PREFS_JOURNAL_MAGIC || header.syntaxVersion != SYNTAX_VERSION){
+        rc = RB_ERROR;
+    }
+    else{
+        while(rc == RB_OK){
+            int32_t op;
+
+            res = PrefsBackendPriv_read(&reader, &op, sizeof(int32_t));
+            if(res == 0){
+                break;
+            }
+
+            // Records are applied up to a torn one (e.g. interrupted write)
+            if(res != sizeof(int32_t)){
+                rc = RB_ERROR;
+            }
+            else if(op == PREFS_JOURNAL_PUT){
+                rc = PrefsBackendPriv_readVar(handle, &reader, RB_TRUE);
+            }
+            else if(op == PREFS_JOURNAL_REMOVE){
+                int32_t keySize;
+
+                rc = RB_ERROR;
+
+                if(PrefsBackendPriv_read(&reader, &keySize, sizeof(int32_t)) == sizeof(int32_t) && keySize > 0
+                        && PrefsBackendPriv_readInto(&reader, &reader.key, &reader.keyCapacity, keySize) == RB_OK
+                        && reader.key[keySize - 1] == 0){
+                    rc = Rb_Prefs_remove(handle, (const char*)reader.key);
+                }
+            }
+            else{
+                rc = RB_ERROR;
+            }
         }
+    }
 
-        RB_FREE(&data);
+    PrefsBackendPriv_freeReader(&reader);
 
-        break;
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Invalid journal");
     }
-    default:
-        return RB_INVALID_ARG;
+
+    return RB_OK;
+}
+
+int32_t Rb_PrefsBackendCheckMapping(PrefsMapping* mapping){
+    PrefsBackend_Header header;
+    PrefsBackend_IndexHeader indexHeader;
+
+    if(mapping->data == NULL || mapping->size < sizeof(PrefsBackend_Header) + sizeof(PrefsBackend_IndexHeader)){
+        RB_ERRC(RB_ERROR, "Invalid data size");
+    }
+
+    memcpy(&header, mapping->data, sizeof(PrefsBackend_Header));
+    PrefsBackendPriv_getIndexHeader(mapping, &indexHeader);
+
+    if(header.magic != PREFS_BACKEND_MAGIC){
+        RB_ERRC(RB_ERROR, "Invalid data header");
+    }
+
+    if(header.syntaxVersion != SYNTAX_VERSION_INDEXED){
+        RB_ERRC(RB_ERROR, "Invalid syntax version");
+    }
+
+    // Only the tables are validated here, so mapping is O(1), entries are validated when accessed
+    if(header.numEntries < 0 || indexHeader.size != mapping->size
+            || (uint64_t)indexHeader.entriesOffset + (uint64_t)header.numEntries * sizeof(PrefsBackend_IndexEntry) > mapping->size
+            || (uint64_t)indexHeader.sortedOffset + (uint64_t)header.numEntries * sizeof(uint32_t) > mapping->size){
+        RB_ERRC(RB_ERROR, "Invalid index");
     }
 
-    RB_FREE(&key);
+    mapping->numEntries = header.numEntries;
 
     return RB_OK;
 }
+
+int32_t Rb_PrefsBackendMappedGet(const PrefsMapping* mapping, int32_t index, PrefEntry* entry){
+    PrefsBackend_IndexHeader indexHeader;
+    PrefsBackend_IndexEntry indexEntry;
+
+    if(index < 0 || index >= mapping->numEntries){
+        return RB_INVALID_ARG;
+    }
+
+    PrefsBackendPriv_getIndexHeader(mapping, &indexHeader);
+
+    memcpy(&indexEntry, mapping->data + indexHeader.entriesOffset + (uint32_t)index * sizeof(PrefsBackend_IndexEntry),
+            sizeof(PrefsBackend_IndexEntry));
+
+    // Key and string values have to be terminated within the mapping
+    if((uint64_t)indexEntry.keyOffset + indexEntry.keySize >= mapping->size
+            || mapping->data[indexEntry.keyOffset + indexEntry.keySize] != 0){
+        RB_ERRC(RB_ERROR, "Invalid key");
+    }
+
+    // Entry points into the mapping, it must never be modified or freed
+    entry->key = (char*)(mapping->data + indexEntry.keyOffset);
+    entry->value.type = (Rb_VariantType)indexEntry.type;
+
+    switch(indexEntry.type){
+    case eRB_VAR_TYPE_INT32:
+        entry->value.val.int32Val = indexEntry.value.int32Val;
+        break;
+    case eRB_VAR_TYPE_INT64:
+        entry->value.val.int64Val = indexEntry.value.int64Val;
+        break;
+    case eRB_VAR_TYPE_FLOAT:
+        entry->value.val.floatVal = indexEntry.value.floatVal;
+        break;
+    case eRB_VAR_TYPE_STRING:
+        // Offset is checked on its own first, a corrupt one near UINT64_MAX would wrap the sum
+        if(indexEntry.value.offset >= mapping->size || indexEntry.valueSize >= mapping->size - indexEntry.value.offset
+                || mapping->data[indexEntry.value.offset + indexEntry.valueSize] != 0){
+            RB_ERRC(RB_ERROR, "Invalid string");
+        }
+
+        entry->value.val.stringVal = (char*)(mapping->data + indexEntry.value.offset);
+        break;
+    case eRB_VAR_TYPE_BLOB:
+        if(indexEntry.value.offset > mapping->size || indexEntry.valueSize > mapping->size - indexEntry.value.offset){
+            RB_ERRC(RB_ERROR, "Invalid blob");
+        }
+
+        entry->value.val.blobVal.data = (void*)(mapping->data + indexEntry.value.offset);
+        entry->value.val.blobVal.size = indexEntry.valueSize;
+        entry->value.val.blobVal.file = NULL;
+        break;
+    default:
+        RB_ERRC(RB_ERROR, "Invalid type");
+    }
+
+    return RB_OK;
+}
+
+int32_t Rb_PrefsBackendMappedFind(const PrefsMapping* mapping, const char* key, PrefEntry* entry){
+    int32_t position;
+
+    int32_t rc = Rb_PrefsBackendMappedLowerBound(mapping, key, &position);
+    if(rc != RB_OK){
+        return rc;
+    }
+
+    if(position == mapping->numEntries){
+        return RB_INVALID_ARG;
+    }
+
+    rc = Rb_PrefsBackendMappedGetSorted(mapping, position, entry);
+    if(rc != RB_OK){
+        return rc;
+    }
+
+    return strcmp(entry->key, key) == 0 ? RB_OK : RB_INVALID_ARG;
+}
+
+int32_t Rb_PrefsBackendMappedGetSorted(const PrefsMapping* mapping, int32_t position, PrefEntry* entry){
+    PrefsBackend_IndexHeader indexHeader;
+    uint32_t index;
+
+    if(position < 0 || position >= mapping->numEntries){
+        return RB_INVALID_ARG;
+    }
+
+    PrefsBackendPriv_getIndexHeader(mapping, &indexHeader);
+
+    memcpy(&index, mapping->data + indexHeader.sortedOffset + (uint32_t)position * sizeof(uint32_t), sizeof(uint32_t));
+
+    return Rb_PrefsBackendMappedGet(mapping, (int32_t)index, entry);
+}
+
+int32_t Rb_PrefsBackendMappedLowerBound(const PrefsMapping* mapping, const char* key, int32_t* position){
+    PrefEntry entry;
+
+    // Binary search over the sorted table
+    int32_t low = 0;
+    int32_t high = mapping->numEntries;
+
+    while(low < high){
+        int32_t mid = low + (high - low) / 2;
+
+        int32_t rc = Rb_PrefsBackendMappedGetSorted(mapping, mid, &entry);
+        if(rc != RB_OK){
+            return rc;
+        }
+
+        if(strcmp(entry.key, key) < 0){
+            low = mid + 1;
+        }
+        else{
+            high = mid;
+        }
+    }
+
+    *position = low;
+
+    return RB_OK;
+}
+
+int32_t PrefsBackendPriv_writeIndexed(PrefsContext* prefs, PrefsBackend_Writer* writer){
+    int32_t rc;
+    uint32_t i;
+
+    PrefEntry** entries = NULL;
+    uint32_t numEntries = 0;
+
+    rc = Rb_List_toArray(prefs->entries, (void**)&entries, &numEntries);
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error acquiring entries");
+    }
+
+    PrefsBackend_IndexHeader indexHeader;
+
+    indexHeader.entriesOffset = sizeof(PrefsBackend_Header) + sizeof(PrefsBackend_IndexHeader);
+    indexHeader.sortedOffset = indexHeader.entriesOffset + numEntries * sizeof(PrefsBackend_IndexEntry);
+    indexHeader.dataOffset = indexHeader.sortedOffset + numEntries * sizeof(uint32_t);
+
+    PrefsBackend_IndexEntry* table = (PrefsBackend_IndexEntry*)RB_CALLOC((numEntries + 1) * sizeof(PrefsBackend_IndexEntry));
+    PrefsBackend_SortKey* sortKeys = (PrefsBackend_SortKey*)RB_CALLOC((numEntries + 1) * sizeof(PrefsBackend_SortKey));
+    uint32_t* sorted = (uint32_t*)RB_CALLOC((numEntries + 1) * sizeof(uint32_t));
+
+    // Lay out the data in entry order
+    uint64_t offset = indexHeader.dataOffset;
+
+    for(i=0; i<numEntries; i++){
+        const PrefEntry* entry = entries[i];
+        PrefsBackend_IndexEntry* indexEntry = &table[i];
+
+        indexEntry->keyOffset = (uint32_t)offset;
+        indexEntry->keySize = strlen(entry->key);
+        indexEntry->type = entry->value.type;
+
+        offset += indexEntry->keySize + 1;
+
+        switch(entry->value.type){
+        case eRB_VAR_TYPE_INT32:
+            indexEntry->value.int32Val = entry->value.val.int32Val;
+            break;
+        case eRB_VAR_TYPE_INT64:
+            indexEntry->value.int64Val = entry->value.val.int64Val;
+            break;
+        case eRB_VAR_TYPE_FLOAT:
+            indexEntry->value.floatVal = entry->value.val.floatVal;
+            break;
+        case eRB_VAR_TYPE_STRING:
+            indexEntry->valueSize = strlen(entry->value.val.stringVal);
+            indexEntry->value.offset = offset;
+            offset += indexEntry->valueSize + 1;
+            break;
+        case eRB_VAR_TYPE_BLOB:
+            indexEntry->valueSize = entry->value.val.blobVal.size;
+            indexEntry->value.offset = offset;
+            offset += indexEntry->valueSize;
+            break;
+        default:
+            rc = RB_INVALID_ARG;
+            break;
+        }
+
+        sortKeys[i].key = entry->key;
+        sortKeys[i].index = i;
+    }
+
+    if(offset > (uint64_t)INT32_MAX){
+        rc = RB_ERROR;
+    }
+
+    indexHeader.size = (uint32_t)offset;
+
+    qsort(sortKeys, numEntries, sizeof(PrefsBackend_SortKey), PrefsBackendPriv_compareKeys);
+
+    for(i=0; i<numEntries; i++){
+        sorted[i] = sortKeys[i].index;
+    }
+
+    if(rc == RB_OK){
+        const int32_t tableSize = numEntries * sizeof(PrefsBackend_IndexEntry);
+        const int32_t sortedSize = numEntries * sizeof(uint32_t);
+
+        if(PrefsBackendPriv_write(writer, &indexHeader, sizeof(PrefsBackend_IndexHeader)) != RB_OK
+                || PrefsBackendPriv_write(writer, table, tableSize) != RB_OK
+                || PrefsBackendPriv_write(writer, sorted, sortedSize) != RB_OK){
+            rc = RB_ERROR;
+        }
+    }
+
+    for(i=0; i<numEntries && rc == RB_OK; i++){
+        const PrefEntry* entry = entries[i];
+
+        rc = PrefsBackendPriv_write(writer, entry->key, table[i].keySize + 1);
+
+        if(rc == RB_OK && entry->value.type == eRB_VAR_TYPE_STRING){
+            rc = PrefsBackendPriv_write(writer, entry->value.val.stringVal, table[i].valueSize + 1);
+        }
+        else if(rc == RB_OK && entry->value.type == eRB_VAR_TYPE_BLOB){
+            rc = PrefsBackendPriv_writeBlob(writer, &entry->value);
+        }
+    }
+
+    RB_FREE(&sorted);
+    RB_FREE(&sortKeys);
+    RB_FREE(&table);
+
+    if(entries){
+        RB_FREE(&entries);
+    }
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error writing entries");
+    }
+
+    return RB_OK;
+}
+
+int32_t PrefsBackendPriv_readIndexed(Rb_PrefsHandle handle, const PrefsBackend_Header* header,
+        PrefsBackend_Reader* reader){
+    int32_t rc;
+    PrefsBackend_IndexHeader indexHeader;
+
+    if(PrefsBackendPriv_read(reader, &indexHeader, sizeof(PrefsBackend_IndexHeader)) != sizeof(PrefsBackend_IndexHeader)){
+        RB_ERRC(RB_ERROR, "Error reading index header");
+    }
+
+    const uint32_t headersSize = sizeof(PrefsBackend_Header) + sizeof(PrefsBackend_IndexHeader);
+
+    if(indexHeader.size < headersSize || indexHeader.size > (uint32_t)INT32_MAX){
+        RB_ERRC(RB_ERROR, "Invalid index header");
+    }
+
+    // Read the rest of the file in one go, and parse it the same way a mapped one is
+    PrefsMapping mapping;
+    uint8_t* data = (uint8_t*)RB_MALLOC(indexHeader.size);
+    if(data == NULL){
+        RB_ERRC(RB_ERROR, "Error allocating buffer");
+    }
+
+    memcpy(data, header, sizeof(PrefsBackend_Header));
+    memcpy(data + sizeof(PrefsBackend_Header), &indexHeader, sizeof(PrefsBackend_IndexHeader));
+
+    const int32_t remaining = indexHeader.size - headersSize;
+
+    if(PrefsBackendPriv_read(reader, data + headersSize, remaining) != remaining){
+        RB_FREE(&data);
+        RB_ERRC(RB_ERROR, "Error reading entries");
+    }
+
+    mapping.data = data;
+    mapping.size = indexHeader.size;
+    mapping.numEntries = 0;
+
+    rc = Rb_PrefsBackendCheckMapping(&mapping);
+    if(rc == RB_OK){
+        rc = Rb_Prefs_clear(handle);
+    }
+
+    int32_t i;
+    for(i=0; i<mapping.numEntries && rc == RB_OK; i++){
+        PrefEntry entry;
+
+        rc = Rb_PrefsBackendMappedGet(&mapping, i, &entry);
+        if(rc == RB_OK){
+            rc = PrefsBackendPriv_putEntry(handle, &entry);
+        }
+    }
+
+    RB_FREE(&data);
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error reading value");
+    }
+
+    return RB_OK;
+}
+
+int32_t PrefsBackendPriv_writeCompact(PrefsContext* prefs, PrefsBackend_Writer* writer){
+    int32_t rc;
+    uint32_t i;
+
+    PrefEntry** entries = NULL;
+    PrefEntry* mappedEntries = NULL;
+    uint32_t numEntries = 0;
+
+    rc = PrefsBackendPriv_getEntries(prefs, &entries, &mappedEntries, &numEntries);
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error acquiring entries");
+    }
+
+    PrefsBackend_SortKey* sortKeys = (PrefsBackend_SortKey*)RB_CALLOC((numEntries + 1) * sizeof(PrefsBackend_SortKey));
+    uint32_t* keyIndices = (uint32_t*)RB_CALLOC((numEntries + 1) * sizeof(uint32_t));
+
+    if(sortKeys == NULL || keyIndices == NULL){
+        rc = RB_ERROR;
+    }
+
+    for(i=0; i<numEntries && rc == RB_OK; i++){
+        sortKeys[i].key = entries[i]->key;
+        sortKeys[i].index = i;
+    }
+
+    if(rc == RB_OK){
+        qsort(sortKeys, numEntries, sizeof(PrefsBackend_SortKey), PrefsBackendPriv_compareKeys);
+    }
+
+    // Key table, each key stored as the length of the prefix it shares with the previous one, plus the rest of it
+    const char* previous = "";
+
+    for(i=0; i<numEntries && rc == RB_OK; i++){
+        const char* key = sortKeys[i].key;
+        uint32_t shared = 0;
+
+        while(previous[shared] && previous[shared] == key[shared]){
+            shared++;
+        }
+
+        const uint32_t suffixSize = strlen(key + shared);
+
+        rc = PrefsBackendPriv_writeVarint(writer, shared);
+        if(rc == RB_OK){
+            rc = PrefsBackendPriv_writeVarint(writer, suffixSize);
+        }
+
+        if(rc == RB_OK){
+            rc = PrefsBackendPriv_write(writer, key + shared, suffixSize);
+        }
+
+        keyIndices[sortKeys[i].index] = i;
+        previous = key;
+    }
+
+    // Values in entry order, each referring to its key in the table
+    for(i=0; i<numEntries && rc == RB_OK; i++){
+        const PrefEntry* entry = entries[i];
+        const uint8_t type = (uint8_t)entry->value.type;
+
+        rc = PrefsBackendPriv_writeVarint(writer, keyIndices[i]);
+        if(rc == RB_OK){
+            rc = PrefsBackendPriv_write(writer, &type, sizeof(uint8_t));
+        }
+
+        if(rc != RB_OK){
+            break;
+        }
+
+        switch(entry->value.type){
+        case eRB_VAR_TYPE_INT32:
+            rc = PrefsBackendPriv_writeVarint(writer, PREFS_BACKEND_ZIGZAG(entry->value.val.int32Val));
+            break;
+        case eRB_VAR_TYPE_INT64:
+            rc = PrefsBackendPriv_writeVarint(writer, PREFS_BACKEND_ZIGZAG(entry->value.val.int64Val));
+            break;
+        case eRB_VAR_TYPE_FLOAT:
+            rc = PrefsBackendPriv_write(writer, &entry->value.val.floatVal, sizeof(float));
+            break;
+        case eRB_VAR_TYPE_STRING: {
+            const uint32_t size = strlen(entry->value.val.stringVal);
+
+            rc = PrefsBackendPriv_writeVarint(writer, size);
+            if(rc == RB_OK){
+                rc = PrefsBackendPriv_write(writer, entry->value.val.stringVal, size);
+            }
+            break;
+        }
+        case eRB_VAR_TYPE_BLOB:
+            rc = PrefsBackendPriv_writeVarint(writer, entry->value.val.blobVal.size);
+            if(rc == RB_OK){
+                rc = PrefsBackendPriv_writeBlob(writer, &entry->value);
+            }
+            break;
+        default:
+            rc = RB_INVALID_ARG;
+            break;
+        }
+    }
+
+    // Checksum of everything written so far, header included
+    if(rc == RB_OK){
+        const uint32_t crc = writer->crc;
+
+        writer->checksum = RB_FALSE;
+
+        rc = PrefsBackendPriv_write(writer, &crc, sizeof(uint32_t));
+    }
+
+    if(keyIndices){
+        RB_FREE(&keyIndices);
+    }
+
+    if(sortKeys){
+        RB_FREE(&sortKeys);
+    }
+
+    if(entries){
+        RB_FREE(&entries);
+    }
+
+    if(mappedEntries){
+        RB_FREE(&mappedEntries);
+    }
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error writing entries");
+    }
+
+    return RB_OK;
+}
+
+int32_t PrefsBackendPriv_readCompact(Rb_PrefsHandle handle, const PrefsBackend_Header* header,
+        PrefsBackend_Reader* reader){
+    int32_t rc;
+    int32_t i;
+    uint64_t value;
+
+    if(header->numEntries < 0){
+        RB_ERRC(RB_ERROR, "Invalid header");
+    }
+
+    const int32_t numEntries = header->numEntries;
+
+    // Keys are rebuilt one after another into a single buffer (NUL terminated). Their offsets grow with the keys read,
+    // so an entry count the input can't hold fails once the input runs out, instead of being allocated up front.
+    uint32_t* keyOffsets = NULL;
+    size_t offsetsCapacity = 0;
+    uint8_t* keys = NULL;
+    uint32_t keysCapacity = 0;
+    uint32_t keysSize = 0;
+    uint32_t previousSize = 0;
+
+    rc = Rb_Prefs_clear(handle);
+
+    for(i=0; i<numEntries && rc == RB_OK; i++){
+        uint64_t shared;
+        uint64_t suffixSize;
+
+        if((size_t)i == offsetsCapacity){
+            size_t newCapacity = offsetsCapacity ? offsetsCapacity * 2 : PREFS_BACKEND_MIN_KEY_OFFSETS;
+            if(newCapacity > (size_t)numEntries){
+                newCapacity = (size_t)numEntries;
+            }
+
+            uint32_t* newOffsets = (uint32_t*)RB_REALLOC(keyOffsets, newCapacity * sizeof(uint32_t));
+            if(newOffsets == NULL){
+                rc = RB_ERROR;
+                break;
+            }
+
+            keyOffsets = newOffsets;
+            offsetsCapacity = newCapacity;
+        }
+
+        if(PrefsBackendPriv_readVarint(reader, &shared) != RB_OK || PrefsBackendPriv_readVarint(reader, &suffixSize) != RB_OK
+                || shared > previousSize || suffixSize > (uint64_t)INT32_MAX
+                || keysSize + shared + suffixSize + 1 > (uint64_t)INT32_MAX){
+            rc = RB_ERROR;
+            break;
+        }
+
+        const uint32_t keySize = (uint32_t)(shared + suffixSize);
+
+        if(keysSize + keySize + 1 > keysCapacity){
+            uint32_t newCapacity = (keysSize + keySize + 1) * 2;
+            if(newCapacity > (uint32_t)INT32_MAX){
+                newCapacity = INT32_MAX;
+            }
+
+            uint8_t* newKeys = (uint8_t*)RB_REALLOC(keys, newCapacity);
+            if(newKeys == NULL){
+                rc = RB_ERROR;
+                break;
+            }
+
+            keys = newKeys;
+            keysCapacity = newCapacity;
+        }
+
+        uint8_t* key = keys + keysSize;
+
+        if(shared){
+            memmove(key, keys + keyOffsets[i - 1], shared);
+        }
+
+        if(PrefsBackendPriv_read(reader, key + shared, suffixSize) != (int32_t)suffixSize
+                || memchr(key + shared, 0, suffixSize) != NULL){
+            rc = RB_ERROR;
+            break;
+        }
+
+        key[keySize] = 0;
+
+        keyOffsets[i] = keysSize;
+        keysSize += keySize + 1;
+        previousSize = keySize;
+    }
+
+    for(i=0; i<numEntries && rc == RB_OK; i++){
+        uint8_t type;
+
+        if(PrefsBackendPriv_readVarint(reader, &value) != RB_OK || value >= (uint64_t)numEntries
+                || PrefsBackendPriv_read(reader, &type, sizeof(uint8_t)) != sizeof(uint8_t)){
+            rc = RB_ERROR;
+            break;
+        }
+
+        const char* key = (const char*)keys + keyOffsets[value];
+
+        switch(type){
+        case eRB_VAR_TYPE_INT32:
+            rc = PrefsBackendPriv_readVarint(reader, &value);
+            if(rc == RB_OK){
+                rc = Rb_Prefs_putInt32(handle, key, (int32_t)PREFS_BACKEND_UNZIGZAG(value));
+            }
+            break;
+        case eRB_VAR_TYPE_INT64:
+            rc = PrefsBackendPriv_readVarint(reader, &value);
+            if(rc == RB_OK){
+                rc = Rb_Prefs_putInt64(handle, key, PREFS_BACKEND_UNZIGZAG(value));
+            }
+            break;
+        case eRB_VAR_TYPE_FLOAT: {
+            float floatVal;
+
+            rc = PrefsBackendPriv_read(reader, &floatVal, sizeof(float)) == sizeof(float) ? RB_OK : RB_ERROR;
+            if(rc == RB_OK){
+                rc = Rb_Prefs_putFloat(handle, key, floatVal);
+            }
+            break;
+        }
+        case eRB_VAR_TYPE_STRING:
+            rc = PrefsBackendPriv_readVarint(reader, &value);
+            if(rc == RB_OK && value >= (uint64_t)INT32_MAX){
+                rc = RB_ERROR;
+            }
+
+            if(rc == RB_OK){
+                rc = PrefsBackendPriv_readInto(reader, &reader->value, &reader->valueCapacity, value);
+            }
+
+            if(rc == RB_OK){
+                reader->value[value] = 0;
+
+                rc = memchr(reader->value, 0, value) == NULL ? Rb_Prefs_putString(handle, key, (const char*)reader->value) : RB_ERROR;
+            }
+            break;
+        case eRB_VAR_TYPE_BLOB:
+            rc = PrefsBackendPriv_readVarint(reader, &value);
+            if(rc == RB_OK && value > (uint64_t)INT32_MAX){
+                rc = RB_ERROR;
+            }
+
+            if(rc == RB_OK){
+                rc = PrefsBackendPriv_readInto(reader, &reader->value, &reader->valueCapacity, value);
+            }
+
+            if(rc == RB_OK){
+                rc = Rb_Prefs_putBlob(handle, key, reader->value, value);
+            }
+            break;
+        default:
+            rc = RB_INVALID_ARG;
+            break;
+        }
+    }
+
+    if(keys){
+        RB_FREE(&keys);
+    }
+
+    if(keyOffsets){
+        RB_FREE(&keyOffsets);
+    }
+
+    // Entries are only kept if the checksum matches
+    if(rc == RB_OK){
+        const uint32_t crc = reader->crc;
+        uint32_t expected;
+
+        reader->checksum = RB_FALSE;
+
+        if(PrefsBackendPriv_read(reader, &expected, sizeof(uint32_t)) != sizeof(uint32_t) || expected != crc){
+            Rb_Prefs_clear(handle);
+
+            RB_ERRC(RB_ERROR, "Checksum mismatch");
+        }
+    }
+
+    if(rc != RB_OK){
+        RB_ERRC(rc, "Error reading entries");
+    }
+
+    return RB_OK;
+}
+
+int32_t PrefsBackendPriv_putEntry(Rb_PrefsHandle handle, const PrefEntry* entry){
+    switch(entry->value.type){
+    case eRB_VAR_TYPE_INT32:
+        return Rb_Prefs_putInt32(handle, entry->key, entry->value.val.int32Val);
+    case eRB_VAR_TYPE_INT64:
+        return Rb_Prefs_putInt64(handle, entry->key, entry->value.val.int64Val);
+    case eRB_VAR_TYPE_FLOAT:
+        return Rb_Prefs_putFloat(handle, entry->key, entry->value.val.floatVal);
+    case eRB_VAR_TYPE_STRING:
+        return Rb_Prefs_putString(handle, entry->key, entry->value.val.stringVal);
+    case eRB_VAR_TYPE_BLOB:
+        return Rb_Prefs_putBlob(handle, entry->key, entry->value.val.blobVal.data, entry->value.val.blobVal.size);
+    default:
+        return RB_INVALID_ARG;
+    }
+}
+
+void PrefsBackendPriv_getIndexHeader(const PrefsMapping* mapping, PrefsBackend_IndexHeader* indexHeader){
+    memcpy(indexHeader, mapping->data + sizeof(PrefsBackend_Header), sizeof(PrefsBackend_IndexHeader));
+}
+
+int PrefsBackendPriv_compareKeys(const void* key1, const void* key2){
+    return strcmp(((const PrefsBackend_SortKey*)key1)->key, ((const PrefsBackend_SortKey*)key2)->key);
+}
+
+void PrefsBackendPriv_initWriter(PrefsBackend_Writer* writer, const Rb_IOStream* stream, uint8_t* buffer, uint32_t capacity){
+    writer->stream = stream;
+    writer->buffer = buffer;
+    writer->size = 0;
+    writer->capacity = capacity;
+    writer->crc = 0;
+    writer->checksum = RB_FALSE;
+}
+
+int32_t PrefsBackendPriv_write(PrefsBackend_Writer* writer, const void* data, uint32_t size){
+    if(writer->checksum){
+        writer->crc = PrefsBackendPriv_crc32c(writer->crc, data, size);
+    }
+
+    if(size > writer->capacity - writer->size){
+        if(PrefsBackendPriv_flush(writer) != RB_OK){
+            return RB_ERROR;
+        }
+
+        // Too large to be buffered
+        if(size >= writer->capacity){
+            return writer->stream->api.write(writer->stream->handle, data, size) == (int32_t)size ? RB_OK : RB_ERROR;
+        }
+    }
+
+    memcpy(writer->buffer + writer->size, data, size);
+    writer->size += size;
+
+    return RB_OK;
+}
+
+int32_t PrefsBackendPriv_writeBlob(PrefsBackend_Writer* writer, const Variant* value){
+    const uint32_t size = value->val.blobVal.size;
+    uint32_t position = 0;
+
+    if(value->val.blobVal.file == NULL){
+        return PrefsBackendPriv_write(writer, value->val.blobVal.data, size);
+    }
+
+    // Copied from the file it's left in through the buffer, without loading it whole
+    while(position < size){
+        if(writer->size == writer->capacity && PrefsBackendPriv_flush(writer) != RB_OK){
+            return RB_ERROR;
+        }
+
+        uint8_t* dest = writer->buffer + writer->size;
+        uint32_t numBytes = writer->capacity - writer->size;
+
+        if(numBytes > size - position){
+            numBytes = size - position;
+        }
+
+        if(PrefsPriv_readBlob(value, position, dest, numBytes) != RB_OK){
+            return RB_ERROR;
+        }
+
+        if(writer->checksum){
+            writer->crc = PrefsBackendPriv_crc32c(writer->crc, dest, numBytes);
+        }
+
+        writer->size += numBytes;
+        position += numBytes;
+    }
+
+    return RB_OK;
+}
+
+int32_t PrefsBackendPriv_flush(PrefsBackend_Writer* writer){
+    if(writer->size == 0){
+        return RB_OK;
+    }
+
+    int32_t res = writer->stream->api.write(writer->stream->handle, writer->buffer, writer->size);
+    if(res != (int32_t)writer->size){
+        return RB_ERROR;
+    }
+
+    writer->size = 0;
+
+    return RB_OK;
+}
+
+int32_t PrefsBackendPriv_initReader(PrefsBackend_Reader* reader, const Rb_IOStream* stream){
+    memset(reader, 0x00, sizeof(PrefsBackend_Reader));
+
+    reader->stream = stream;
+    reader->capacity = PREFS_BACKEND_CHUNK_SIZE;
+    reader->buffer = (uint8_t*)RB_MALLOC(reader->capacity);
+
+    return reader->buffer ? RB_OK : RB_ERROR;
+}
+
+void PrefsBackendPriv_freeReader(PrefsBackend_Reader* reader){
+    // Give back what was read ahead, so the stream ends up right after the preferences
+    const uint32_t unread = reader->size - reader->position;
+
+    if(unread && reader->stream->api.tell && reader->stream->api.seek){
+        int32_t position = reader->stream->api.tell(reader->stream->handle);
+
+        if(position >= (int32_t)unread){
+            reader->stream->api.seek(reader->stream->handle, position - unread);
+        }
+    }
+
+    RB_FREE(&reader->buffer);
+
+    if(reader->key){
+        RB_FREE(&reader->key);
+    }
+
+    if(reader->value){
+        RB_FREE(&reader->value);
+    }
+}
+
+int32_t PrefsBackendPriv_read(PrefsBackend_Reader* reader, void* data, uint32_t size){
+    uint8_t* dest = (uint8_t*)data;
+    uint32_t total = 0;
+
+    if(size == 0){
+        return 0;
+    }
+
+    while(total < size){
+        if(reader->position == reader->size){
+            // Large reads bypass the buffer
+            if(size - total >= reader->capacity){
+                int32_t res = reader->stream->api.read(reader->stream->handle, dest + total, size - total);
+                if(res > 0){
+                    total += res;
+                }
+
+                break;
+            }
+
+            int32_t res = reader->stream->api.read(reader->stream->handle, reader->buffer, reader->capacity);
+
+            reader->position = 0;
+            reader->size = res > 0 ? (uint32_t)res : 0;
+
+            if(reader->size == 0){
+                break;
+            }
+        }
+
+        uint32_t available = reader->size - reader->position;
+        uint32_t numBytes = size - total < available ? size - total : available;
+
+        memcpy(dest + total, reader->buffer + reader->position, numBytes);
+
+        reader->position += numBytes;
+        total += numBytes;
+    }
+
+    if(reader->checksum){
+        reader->crc = PrefsBackendPriv_crc32c(reader->crc, dest, total);
+    }
+
+    return (int32_t)total;
+}
+
+int32_t PrefsBackendPriv_tell(PrefsBackend_Reader* reader){
+    if(reader->stream->api.tell == NULL){
+        return RB_ERROR;
+    }
+
+    int32_t position = reader->stream->api.tell(reader->stream->handle);
+    if(position < 0){
+        return position;
+    }
+
+    // The stream is ahead by what's buffered
+    return position - (int32_t)(reader->size - reader->position);
+}
+
+int32_t PrefsBackendPriv_skip(PrefsBackend_Reader* reader, uint32_t size){
+    const uint32_t available = reader->size - reader->position;
+
+    if(size <= available){
+        reader->position += size;
+        return RB_OK;
+    }
+
+    reader->position = reader->size;
+
+    int32_t position = reader->stream->api.tell ? reader->stream->api.tell(reader->stream->handle) : RB_ERROR;
+    if(position < 0 || reader->stream->api.seek == NULL){
+        return RB_ERROR;
+    }
+
+    return reader->stream->api.seek(reader->stream->handle, position + (size - available));
+}
+
+int32_t PrefsBackendPriv_readInto(PrefsBackend_Reader* reader, uint8_t** buffer, uint32_t* capacity, uint32_t size){
+    // Always leaves room for a terminator after the data
+    if(size >= *capacity || *buffer == NULL){
+        uint32_t newCapacity = size + 1 > PREFS_BACKEND_RECORD_SIZE ? size + 1 : PREFS_BACKEND_RECORD_SIZE;
+
+        uint8_t* newBuffer = (uint8_t*)RB_REALLOC(*buffer, newCapacity);
+        if(newBuffer == NULL){
+            return RB_ERROR;
+        }
+
+        *buffer = newBuffer;
+        *capacity = newCapacity;
+    }
+
+    return PrefsBackendPriv_read(reader, *buffer, size) == (int32_t)size ? RB_OK : RB_ERROR;
+}
+
+int32_t PrefsBackendPriv_getEntries(PrefsContext* prefs, PrefEntry*** entries, PrefEntry** mappedEntries,
+        uint32_t* numEntries){
+    int32_t i;
+
+    *entries = NULL;
+    *mappedEntries = NULL;
+    *numEntries = 0;
+
+    if(prefs->mapping.data == NULL){
+        return Rb_List_toArray(prefs->entries, (void**)entries, numEntries);
+    }
+
+    // Mapped entries point into the mapping
+    *mappedEntries = (PrefEntry*)RB_CALLOC((prefs->mapping.numEntries + 1) * sizeof(PrefEntry));
+    *entries = (PrefEntry**)RB_CALLOC((prefs->mapping.numEntries + 1) * sizeof(PrefEntry*));
+
+    if(*mappedEntries == NULL || *entries == NULL){
+        return RB_ERROR;
+    }
+
+    for(i=0; i<prefs->mapping.numEntries; i++){
+        if(Rb_PrefsBackendMappedGet(&prefs->mapping, i, &(*mappedEntries)[i]) != RB_OK){
+            return RB_ERROR;
+        }
+
+        (*entries)[i] = &(*mappedEntries)[i];
+    }
+
+    *numEntries = prefs->mapping.numEntries;
+
+    return RB_OK;
+}
+
+int32_t PrefsBackendPriv_writeVarint(PrefsBackend_Writer* writer, uint64_t value){
+    uint8_t data[PREFS_BACKEND_MAX_VARINT_SIZE];
+    uint32_t size = 0;
+
+    // LEB128, 7 bits per byte, high bit set on all but the last one
+    while(value >= 0x80){
+        data[size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+
+    data[size++] = (uint8_t)value;
+
+    return PrefsBackendPriv_write(writer, data, size);
+}
+
+int32_t PrefsBackendPriv_readVarint(PrefsBackend_Reader* reader, uint64_t* value){
+    uint32_t shift;
+    uint8_t byte;
+
+    *value = 0;
+
+    for(shift=0; shift<64; shift+=7){
+        if(PrefsBackendPriv_read(reader, &byte, sizeof(uint8_t)) != sizeof(uint8_t)){
+            return RB_ERROR;
+        }
+
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+
+        if((byte & 0x80) == 0){
+            return RB_OK;
+        }
+    }
+
+    return RB_ERROR;
+}
+
+uint32_t PrefsBackendPriv_crc32c(uint32_t crc, const void* data, uint32_t size){
+    // CRC-32C (Castagnoli, reflected), one nibble at a time
+    static const uint32_t kTABLE[16] = {
+        0x00000000, 0x105EC76F, 0x20BD8EDE, 0x30E349B1, 0x417B1DBC, 0x5125DAD3, 0x61C69362, 0x7198540D,
+        0x82F63B78, 0x92A8FC17, 0xA24BB5A6, 0xB21572C9, 0xC38D26C4, 0xD3D3E1AB, 0xE330A81A, 0xF36E6F75
+    };
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint32_t i;
+
+    crc = ~crc;
+
+    for(i=0; i<size; i++){
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ kTABLE[crc & 0x0F];
+        crc = (crc >> 4) ^ kTABLE[crc & 0x0F];
+    }
+
+    return ~crc;
+}
@@ -0,0 +1,203 @@
+/*******************************************************/
+/*              Includes                               */
+/*******************************************************/
+
+#include "rb/priv/PrefsIndex.h"
+#include "rb/priv/PrefsPriv.h"
+#include "rb/Common.h"
+#include "rb/Utils.h"
+#include "rb/priv/ErrorPriv.h"
+
+#include <string.h>
+
+/*******************************************************/
+/*              Defines                                */
+/*******************************************************/
+
+#define PREFS_INDEX_MIN_CAPACITY ( 16 )
+
+#define FNV_OFFSET_BASIS ( 2166136261u )
+#define FNV_PRIME ( 16777619u )
+
+/*******************************************************/
+/*              Functions Declarations                 */
+/*******************************************************/
+
+static int32_t PrefsIndexPriv_resize(PrefsIndex* index, uint32_t capacity);
+static uint32_t PrefsIndexPriv_findSlot(const PrefsIndex* index, const char* key, uint32_t hash);
+
+/*******************************************************/
+/*              Functions Definitions                  */
+/*******************************************************/
+
+int32_t PrefsIndex_init(PrefsIndex* index){
+    memset(index, 0x00, sizeof(PrefsIndex));
+
+    return PrefsIndexPriv_resize(index, PREFS_INDEX_MIN_CAPACITY);
+}
+
+int32_t PrefsIndex_destroy(PrefsIndex* index){
+    if(index->slots){
+        RB_FREE(&index->slots);
+    }
+
+    index->capacity = 0;
+    index->size = 0;
+
+    return RB_OK;
+}
+
+int32_t PrefsIndex_reserve(PrefsIndex* index, uint32_t size){
+    uint32_t capacity = index->capacity;
+
+    while(size * 2 > capacity){
+        capacity *= 2;
+    }
+
+    if(capacity == index->capacity){
+        return RB_OK;
+    }
+
+    return PrefsIndexPriv_resize(index, capacity);
+}
+
+int32_t PrefsIndex_clear(PrefsIndex* index){
+    memset(index->slots, 0x00, sizeof(PrefsIndexSlot) * index->capacity);
+
+    index->size = 0;
+
+    return RB_OK;
+}
+
+PrefEntry* PrefsIndex_find(const PrefsIndex* index, const char* key){
+    return PrefsIndex_findHashed(index, key, PrefsIndex_hash(key));
+}
+
+PrefEntry* PrefsIndex_findHashed(const PrefsIndex* index, const char* key, uint32_t hash){
+    uint32_t slot = PrefsIndexPriv_findSlot(index, key, hash);
+
+    return index->slots[slot].entry;
+}
+
+int32_t PrefsIndex_insert(PrefsIndex* index, PrefEntry* entry){
+    return PrefsIndex_insertHashed(index, entry, PrefsIndex_hash(entry->key));
+}
+
+int32_t PrefsIndex_insertHashed(PrefsIndex* index, PrefEntry* entry, uint32_t hash){
+    int32_t rc;
+
+    // Keep the load factor at or below 1/2, so probe sequences stay short
+    if((index->size + 1) * 2 > index->capacity){
+        rc = PrefsIndexPriv_resize(index, index->capacity * 2);
+        if(rc != RB_OK){
+            RB_ERRC(rc, "Error growing index");
+        }
+    }
+
+    uint32_t slot = PrefsIndexPriv_findSlot(index, entry->key, hash);
+
+    if(index->slots[slot].entry){
+        RB_ERRC(RB_INVALID_ARG, "Key already indexed");
+    }
+
+    index->slots[slot].hash = hash;
+    index->slots[slot].entry = entry;
+    index->size++;
+
+    return RB_OK;
+}
+
+PrefEntry* PrefsIndex_remove(PrefsIndex* index, const char* key){
+    const uint32_t mask = index->capacity - 1;
+
+    uint32_t slot = PrefsIndexPriv_findSlot(index, key, PrefsIndex_hash(key));
+
+    PrefEntry* entry = index->slots[slot].entry;
+    if(entry == NULL){
+        return NULL;
+    }
+
+    // Backward shift deletion: move back the following entries of the cluster which would no longer be reachable,
+    // so no tombstones are needed
+    uint32_t hole = slot;
+    uint32_t next = (slot + 1) & mask;
+
+    while(index->slots[next].entry){
+        uint32_t home = index->slots[next].hash & mask;
+
+        // Entry can fill the hole only if its home slot isn't cyclically within (hole, next]
+        if(((next - home) & mask) >= ((next - hole) & mask)){
+            index->slots[hole] = index->slots[next];
+            hole = next;
+        }
+
+        next = (next + 1) & mask;
+    }
+
+    index->slots[hole].hash = 0;
+    index->slots[hole].entry = NULL;
+    index->size--;
+
+    return entry;
+}
+
+uint32_t PrefsIndex_hash(const char* key){
+    uint32_t hash = FNV_OFFSET_BASIS;
+
+    while(*key){
+        hash ^= (uint8_t)*key++;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+int32_t PrefsIndexPriv_resize(PrefsIndex* index, uint32_t capacity){
+    PrefsIndexSlot* slots = (PrefsIndexSlot*)RB_CALLOC(sizeof(PrefsIndexSlot) * capacity);
+    if(slots == NULL){
+        return RB_ERROR;
+    }
+
+    PrefsIndexSlot* oldSlots = index->slots;
+    uint32_t oldCapacity = index->capacity;
+
+    index->slots = slots;
+    index->capacity = capacity;
+
+    // Rehash the existing entries (capacity is always a power of two)
+    uint32_t i;
+    for(i=0; i<oldCapacity; i++){
+        if(oldSlots[i].entry){
+            uint32_t slot = oldSlots[i].hash & (capacity - 1);
+
+            while(slots[slot].entry){
+                slot = (slot + 1) & (capacity - 1);
+            }
+
+            slots[slot] = oldSlots[i];
+        }
+    }
+
+    if(oldSlots){
+        RB_FREE(&oldSlots);
+    }
+
+    return RB_OK;
+}
+
+uint32_t PrefsIndexPriv_findSlot(const PrefsIndex* index, const char* key, uint32_t hash){
+    const uint32_t mask = index->capacity - 1;
+
+    uint32_t slot = hash & mask;
+
+    // Index is never full, so the probe always ends at an empty slot if the key isn't there
+    while(index->slots[slot].entry){
+        if(index->slots[slot].hash == hash && strcmp(index->slots[slot].entry->key, key) == 0){
+            break;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
@@ -0,0 +1,210 @@
+/*******************************************************/
+/*              Includes                               */
+/*******************************************************/
+
+#include <rb/List.h>
+#include <rb/Utils.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*******************************************************/
+/*              Defines                                */
+/*******************************************************/
+
+/**
+ * Largest list size the legacy sort is measured with (quadratic for array lists, cubic for linked ones).
+ */
+#define LEGACY_SORT_MAX_ELEMS ( 10000 )
+#define LEGACY_SORT_MAX_LINKED_ELEMS ( 2000 )
+
+/*******************************************************/
+/*              Typedefs                               */
+/*******************************************************/
+
+typedef struct {
+    int32_t key;
+    char payload[60];
+} BenchElement;
+
+typedef int32_t (*BenchSortFnc)(Rb_ListHandle handle, uint32_t numThreads);
+
+/*******************************************************/
+/*              Functions Declarations                 */
+/*******************************************************/
+
+static int32_t benchCompareFnc(Rb_ListHandle handle, void* elem1, void* elem2);
+static int32_t benchLegacySort(Rb_ListHandle handle, uint32_t numThreads);
+static int32_t benchSort(Rb_ListHandle handle, uint32_t numThreads);
+static double benchRun(Rb_ListType type, uint32_t numElems, BenchSortFnc fnc, uint32_t numThreads);
+static double benchLoad(Rb_ListType type, uint32_t numElems, int32_t bulk);
+static double benchElapsed(const struct timespec* start);
+
+/*******************************************************/
+/*              Functions Definitions                  */
+/*******************************************************/
+
+int main(int argc, char* argv[]) {
+    static const uint32_t kSIZES[] = { 1000, 10000, 100000, 1000000 };
+    static const Rb_ListType kTYPES[] = { eRB_LIST_TYPE_LINKED, eRB_LIST_TYPE_ARRAY };
+    static const char* kTYPE_NAMES[] = { "linked", "array" };
+
+    uint32_t i;
+    uint32_t j;
+
+    RB_UNUSED(argc);
+    RB_UNUSED(argv);
+
+    printf("%-8s %10s %14s %14s %14s\n", "type", "elements", "legacy [ms]", "sort [ms]", "parallel [ms]");
+    fflush(stdout);
+
+    for(i=0; i<sizeof(kTYPES) / sizeof(kTYPES[0]); i++){
+        for(j=0; j<sizeof(kSIZES) / sizeof(kSIZES[0]); j++){
+            uint32_t legacyMax = kTYPES[i] == eRB_LIST_TYPE_LINKED ? LEGACY_SORT_MAX_LINKED_ELEMS : LEGACY_SORT_MAX_ELEMS;
+
+            double legacy = kSIZES[j] <= legacyMax
+                    ? benchRun(kTYPES[i], kSIZES[j], benchLegacySort, 1) : -1.0;
+            double sort = benchRun(kTYPES[i], kSIZES[j], benchSort, 1);
+            double parallel = benchRun(kTYPES[i], kSIZES[j], benchSort, 0);
+
+            if(legacy < 0){
+                printf("%-8s %10u %14s %14.2f %14.2f\n", kTYPE_NAMES[i], kSIZES[j], "-", sort, parallel);
+            }
+            else{
+                printf("%-8s %10u %14.2f %14.2f %14.2f\n", kTYPE_NAMES[i], kSIZES[j], legacy, sort, parallel);
+            }
+
+            fflush(stdout);
+        }
+    }
+
+    printf("\n%-8s %10s %14s %14s\n", "type", "elements", "add [ms]", "addAll [ms]");
+
+    for(i=0; i<sizeof(kTYPES) / sizeof(kTYPES[0]); i++){
+        for(j=0; j<sizeof(kSIZES) / sizeof(kSIZES[0]); j++){
+            printf("%-8s %10u %14.2f %14.2f\n", kTYPE_NAMES[i], kSIZES[j],
+                    benchLoad(kTYPES[i], kSIZES[j], 0), benchLoad(kTYPES[i], kSIZES[j], 1));
+
+            fflush(stdout);
+        }
+    }
+
+    return 0;
+}
+
+double benchLoad(Rb_ListType type, uint32_t numElems, int32_t bulk){
+    Rb_ListConfig config;
+    Rb_List_getDefaultConfig(&config);
+    config.type = type;
+
+    BenchElement* elements = (BenchElement*)calloc(numElems, sizeof(BenchElement));
+
+    uint32_t i;
+    for(i=0; i<numElems; i++){
+        elements[i].key = (int32_t)i;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Rb_ListHandle list = Rb_List_newWithConfig(sizeof(BenchElement), &config);
+
+    if(bulk){
+        Rb_List_addAll(list, elements, numElems);
+    }
+    else{
+        for(i=0; i<numElems; i++){
+            Rb_List_add(list, &elements[i]);
+        }
+    }
+
+    Rb_List_free(&list);
+
+    double elapsed = benchElapsed(&start);
+
+    free(elements);
+
+    return elapsed;
+}
+
+double benchElapsed(const struct timespec* start){
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start->tv_sec) * 1000.0 + (end.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+double benchRun(Rb_ListType type, uint32_t numElems, BenchSortFnc fnc, uint32_t numThreads){
+    Rb_ListConfig config;
+    Rb_List_getDefaultConfig(&config);
+    config.type = type;
+
+    Rb_ListHandle list = Rb_List_newWithConfig(sizeof(BenchElement), &config);
+
+    uint32_t i;
+    BenchElement e;
+    memset(&e, 0x00, sizeof(BenchElement));
+
+    srand(1234);
+    for(i=0; i<numElems; i++){
+        e.key = rand();
+        Rb_List_add(list, &e);
+    }
+
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    fnc(list, numThreads);
+
+    double elapsed = benchElapsed(&start);
+
+    Rb_List_free(&list);
+
+    return elapsed;
+}
+
+int32_t benchSort(Rb_ListHandle handle, uint32_t numThreads){
+    return Rb_List_sortParallel(handle, benchCompareFnc, eRB_SORT_ASCEND, numThreads);
+}
+
+int32_t benchLegacySort(Rb_ListHandle handle, uint32_t numThreads){
+    // Insertion sort previously used by Rb_List_sort (one swap per inversion)
+    int32_t i;
+    int32_t j;
+    BenchElement e1;
+    BenchElement e2;
+
+    RB_UNUSED(numThreads);
+
+    for(i=0; i<Rb_List_getSize(handle); i++){
+        j = i;
+
+        while(j > 0){
+            Rb_List_get(handle, j, &e1);
+            Rb_List_get(handle, j - 1, &e2);
+
+            if(benchCompareFnc(handle, &e1, &e2) > 0){
+                break;
+            }
+
+            Rb_List_swap(handle, j, j - 1);
+
+            --j;
+        }
+    }
+
+    return RB_OK;
+}
+
+int32_t benchCompareFnc(Rb_ListHandle handle, void* elem1, void* elem2){
+    RB_UNUSED(handle);
+
+    int32_t v1 = ((BenchElement*)elem1)->key;
+    int32_t v2 = ((BenchElement*)elem2)->key;
+
+    return v1 < v2 ? -1 : v1 > v2 ? 1 : 0;
+}
@@ -5,6 +5,9 @@
 #include <rb/Array.h>
 #include <rb/Log.h>
 
+#include <pthread.h>
+#include <string.h>
+
 /*******************************************************/
 /*              Defines                                */
 /*******************************************************/
@@ -14,6 +17,33 @@
 #endif
 #define RB_LOG_TAG "TestArray"
 
+#define NUM_APPEND_THREADS ( 8 )
+#define NUM_APPEND_RECORDS ( 2000 )
+
+/*******************************************************/
+/*              Typedefs                               */
+/*******************************************************/
+
+typedef struct {
+	uint32_t thread;
+	uint32_t index;
+	uint8_t payload[16];
+} TestArrayRecord;
+
+typedef struct {
+	Rb_ArrayHandle array;
+	uint32_t thread;
+	int32_t offsets[NUM_APPEND_RECORDS];
+} TestArrayWriter;
+
+/*******************************************************/
+/*              Functions Declarations                 */
+/*******************************************************/
+
+static void* testArrayWriter(void* arg);
+static int testArrayConcurrentAppend();
+static int testArrayFailedAppend();
+
 /*******************************************************/
 /*              Functions Definitions                  */
 /*******************************************************/
@@ -76,11 +106,248 @@ int testArray() {
 		}
 	}
 
+	// Overwrite the beginning, size stays the same
+	const uint32_t kSIZE = kNUM_PASSES * kBFR_SIZE;
+
+	if(Rb_Array_seek(ar, 0) != RB_OK || Rb_Array_write(ar, bfr, 4) != 4 || Rb_Array_tell(ar) != 4){
+		RBLE("Rb_Array_seek failed");
+		return -1;
+	}
+
+	if(Rb_Array_size(ar) != kSIZE || memcmp(Rb_Array_data(ar), bfr, 4)){
+		RBLE("Overwrite failed");
+		return -1;
+	}
+
+	// Write past the end, the gap is zero filled
+	if(Rb_Array_seek(ar, kSIZE + 16) != RB_OK || Rb_Array_write(ar, bfr, 1) != 1 || Rb_Array_size(ar) != kSIZE + 17){
+		RBLE("Write past the end failed");
+		return -1;
+	}
+
+	data = Rb_Array_data(ar);
+	for(i=kSIZE; i<kSIZE + 16; i++){
+		if(data[i] != 0){
+			RBLE("Gap not zero filled");
+			return -1;
+		}
+	}
+
+	// Reserved capacity doesn't move the data
+	rc = Rb_Array_reserve(ar, kSIZE * 4);
+	if(rc != RB_OK || Rb_Array_capacity(ar) < kSIZE * 4){
+		RBLE("Rb_Array_reserve failed");
+		return -1;
+	}
+
+	data = Rb_Array_data(ar);
+	while(Rb_Array_size(ar) + kBFR_SIZE <= kSIZE * 4){
+		Rb_Array_write(ar, bfr, kBFR_SIZE);
+	}
+
+	if(Rb_Array_data(ar) != data){
+		RBLE("Data moved within reserved capacity");
+		return -1;
+	}
+
+	rc = Rb_Array_shrinkToFit(ar);
+	if(rc != RB_OK || Rb_Array_capacity(ar) != Rb_Array_size(ar) || memcmp(Rb_Array_data(ar), bfr, 4)){
+		RBLE("Rb_Array_shrinkToFit failed");
+		return -1;
+	}
+
+	// Read at offset and slice views
+	uint8_t chunk[8];
+	const uint8_t* slice = NULL;
+
+	if(Rb_Array_read(ar, 4, chunk, sizeof(chunk)) != sizeof(chunk) || memcmp(chunk, Rb_Array_data(ar) + 4, sizeof(chunk))){
+		RBLE("Rb_Array_read failed");
+		return -1;
+	}
+
+	if(Rb_Array_read(ar, Rb_Array_size(ar) - 2, chunk, sizeof(chunk)) != 2 || Rb_Array_read(ar, Rb_Array_size(ar), chunk, 1) != 0){
+		RBLE("Rb_Array_read past the end failed");
+		return -1;
+	}
+
+	if(Rb_Array_slice(ar, 4, 8, &slice) != RB_OK || slice != Rb_Array_data(ar) + 4
+			|| Rb_Array_slice(ar, Rb_Array_size(ar) - 4, 8, &slice) == RB_OK){
+		RBLE("Rb_Array_slice failed");
+		return -1;
+	}
+
+	// Take the buffer, the array starts over empty
+	uint8_t* detached = NULL;
+	uint32_t detachedSize = 0;
+	const uint32_t kFULL_SIZE = Rb_Array_size(ar);
+
+	data = Rb_Array_data(ar);
+
+	rc = Rb_Array_detach(ar, &detached, &detachedSize);
+	if(rc != RB_OK || detached != data || detachedSize != kFULL_SIZE || Rb_Array_size(ar) != 0 || Rb_Array_tell(ar) != 0){
+		RBLE("Rb_Array_detach failed");
+		return -1;
+	}
+
+	if(Rb_Array_write(ar, bfr, kBFR_SIZE) != kBFR_SIZE || Rb_Array_size(ar) != (uint32_t)kBFR_SIZE){
+		RBLE("Rb_Array_write after detach failed");
+		return -1;
+	}
+
+	rc = Rb_Array_free(&ar);
+	if(rc != RB_OK){
+		RBLE("Rb_Array_free failed");
+		return -1;
+	}
+
+	// Wrap it again, writes append to the adopted data
+	ar = Rb_Array_adopt(detached, detachedSize);
+	if(!ar || Rb_Array_data(ar) != detached || Rb_Array_size(ar) != kFULL_SIZE || Rb_Array_tell(ar) != (int32_t)kFULL_SIZE){
+		RBLE("Rb_Array_adopt failed");
+		return -1;
+	}
+
+	if(Rb_Array_write(ar, bfr, kBFR_SIZE) != kBFR_SIZE || Rb_Array_size(ar) != kFULL_SIZE + kBFR_SIZE
+			|| memcmp(Rb_Array_data(ar) + kFULL_SIZE, bfr, kBFR_SIZE)){
+		RBLE("Rb_Array_write after adopt failed");
+		return -1;
+	}
+
 	rc = Rb_Array_free(&ar);
 	if(rc != RB_OK || ar){
 		RBLE("Rb_Array_free failed");
 		return -1;
 	}
 
+	return testArrayConcurrentAppend();
+}
+
+void* testArrayWriter(void* arg) {
+	TestArrayWriter* writer = (TestArrayWriter*)arg;
+	TestArrayRecord record;
+	uint32_t i;
+
+	for(i=0; i<NUM_APPEND_RECORDS; i++){
+		record.thread = writer->thread;
+		record.index = i;
+		memset(record.payload, (int)(writer->thread * 31 + i) & 0xFF, sizeof(record.payload));
+
+		writer->offsets[i] = Rb_Array_append(writer->array, &record, sizeof(record));
+		if(writer->offsets[i] < 0){
+			return (void*)-1;
+		}
+	}
+
+	return NULL;
+}
+
+int testArrayConcurrentAppend() {
+	static TestArrayWriter writers[NUM_APPEND_THREADS];
+	pthread_t threads[NUM_APPEND_THREADS];
+	uint32_t i;
+	uint32_t j;
+	int res = 0;
+
+	// Small chunks, so records span chunk boundaries
+	Rb_ArrayHandle ar = Rb_Array_newConcurrent(100);
+	if(!ar){
+		RBLE("Rb_Array_newConcurrent failed");
+		return -1;
+	}
+
+	for(i=0; i<NUM_APPEND_THREADS; i++){
+		writers[i].array = ar;
+		writers[i].thread = i;
+		pthread_create(&threads[i], NULL, testArrayWriter, &writers[i]);
+	}
+
+	for(i=0; i<NUM_APPEND_THREADS; i++){
+		void* vrc = NULL;
+		pthread_join(threads[i], &vrc);
+
+		if(vrc != NULL){
+			RBLE("Rb_Array_append failed");
+			res = -1;
+		}
+	}
+
+	const uint32_t kTOTAL_SIZE = NUM_APPEND_THREADS * NUM_APPEND_RECORDS * sizeof(TestArrayRecord);
+
+	if(res != 0 || Rb_Array_size(ar) != kTOTAL_SIZE || Rb_Array_consolidate(ar) != RB_OK){
+		RBLE("Rb_Array_consolidate failed");
+		Rb_Array_free(&ar);
+		return -1;
+	}
+
+	// Every record is intact at the offset its append returned
+	const uint8_t* data = Rb_Array_data(ar);
+
+	for(i=0; i<NUM_APPEND_THREADS && res == 0; i++){
+		for(j=0; j<NUM_APPEND_RECORDS; j++){
+			TestArrayRecord record;
+			uint8_t payload[sizeof(record.payload)];
+
+			memcpy(&record, data + writers[i].offsets[j], sizeof(record));
+			memset(payload, (int)(i * 31 + j) & 0xFF, sizeof(payload));
+
+			if(writers[i].offsets[j] % sizeof(record) || record.thread != i || record.index != j
+					|| memcmp(record.payload, payload, sizeof(payload))){
+				RBLE("Invalid record");
+				res = -1;
+				break;
+			}
+		}
+	}
+
+	// Consolidated array behaves like a regular one
+	TestArrayRecord record;
+	memset(&record, 0x00, sizeof(record));
+
+	if(res == 0 && (Rb_Array_size(ar) != kTOTAL_SIZE || Rb_Array_tell(ar) != (int32_t)kTOTAL_SIZE
+			|| Rb_Array_append(ar, &record, sizeof(record)) != (int32_t)kTOTAL_SIZE)){
+		RBLE("Regular append after consolidation failed");
+		res = -1;
+	}
+
+	if(Rb_Array_free(&ar) != RB_OK){
+		RBLE("Rb_Array_free failed");
+		return -1;
+	}
+
+	if(res != 0){
+		return res;
+	}
+
+	return testArrayFailedAppend();
+}
+
+int testArrayFailedAppend() {
+	static const char kDATA[] = "0123456789";
+
+	Rb_ArrayHandle ar = Rb_Array_newConcurrent(4);
+	if(!ar){
+		RBLE("Rb_Array_newConcurrent failed");
+		return -1;
+	}
+
+	// Oversized append fails on its own, the appends around it are kept
+	if(Rb_Array_append(ar, kDATA, 5) != 0 || Rb_Array_append(ar, kDATA, (uint32_t)INT32_MAX) >= 0
+			|| Rb_Array_append(ar, kDATA + 5, 5) != 5){
+		RBLE("Rb_Array_append failed");
+		Rb_Array_free(&ar);
+		return -1;
+	}
+
+	if(Rb_Array_consolidate(ar) != RB_OK || Rb_Array_size(ar) != 10 || memcmp(Rb_Array_data(ar), kDATA, 10)){
+		RBLE("Rb_Array_consolidate after failed append failed");
+		Rb_Array_free(&ar);
+		return -1;
+	}
+
+	if(Rb_Array_free(&ar) != RB_OK){
+		RBLE("Rb_Array_free failed");
+		return -1;
+	}
+
 	return 0;
 }
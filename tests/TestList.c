@@ -4,6 +4,10 @@
 
 #include <rb/List.h>
 #include <rb/Log.h>
+#include <rb/Utils.h>
+
+#include <pthread.h>
+#include <stdlib.h>
 
 /*******************************************************/
 /*              Defines                                */
@@ -14,6 +18,8 @@
 #endif
 #define RB_LOG_TAG "TestList"
 
+#define NUM_READER_THREADS ( 4 )
+
 /*******************************************************/
 /*              Typedefs                               */
 /*******************************************************/
@@ -29,23 +35,67 @@ typedef struct {
 /*******************************************************/
 
 static int32_t testCompareFnc(Rb_ListHandle handle, void* elem1, void* elem2);
+static int testListType(Rb_ListType type, Rb_ListLocking locking);
+static int testListConcurrentReads();
+static int testListSorted();
+static void* testListReader(void* arg);
+static int testListInsertRemove(Rb_ListHandle list);
+static int testListSortLarge(Rb_ListHandle list, Rb_SortMode mode, uint32_t numThreads);
+static int testListIterate(Rb_ListHandle list);
+static int testListBulk(Rb_ListHandle list);
+static int32_t testDoubleFnc(Rb_ListHandle handle, int32_t index, void* element, void* arg);
+static int32_t testMatchFnc(Rb_ListHandle handle, const void* element, void* arg);
 
 /*******************************************************/
 /*              Functions Definitions                  */
 /*******************************************************/
 
 int testList() {
-    int32_t rc;
-    ListElement e1;
-
     if(!RB_CHECK_VERSION){
         RBLE("Invalid binary version");
         return -1;
     }
 
-    Rb_ListHandle list = Rb_List_new(sizeof(ListElement));
+    if(testListType(eRB_LIST_TYPE_LINKED, eRB_LIST_LOCKING_MUTEX)){
+        RBLE("Linked list test failed");
+        return -1;
+    }
+
+    if(testListType(eRB_LIST_TYPE_ARRAY, eRB_LIST_LOCKING_MUTEX)){
+        RBLE("Array list test failed");
+        return -1;
+    }
+
+    if(testListType(eRB_LIST_TYPE_ARRAY, eRB_LIST_LOCKING_READ_WRITE)){
+        RBLE("Read-write array list test failed");
+        return -1;
+    }
+
+    if(testListConcurrentReads()){
+        RBLE("Concurrent read test failed");
+        return -1;
+    }
+
+    if(testListSorted()){
+        RBLE("Sorted list test failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+int testListType(Rb_ListType type, Rb_ListLocking locking) {
+    int32_t rc;
+    ListElement e1;
+
+    Rb_ListConfig config;
+    Rb_List_getDefaultConfig(&config);
+    config.type = type;
+    config.locking = locking;
+
+    Rb_ListHandle list = Rb_List_newWithConfig(sizeof(ListElement), &config);
     if(!list){
-        RBLE("Rb_List_new failed");
+        RBLE("Rb_List_newWithConfig failed");
         return -1;
     }
 
@@ -132,6 +182,29 @@ int testList() {
         prevVal = e.testData1;
     }
 
+    rc = Rb_List_clear(list);
+    if(rc != RB_OK){
+        RBLE("Rb_List_clear failed");
+        return -1;
+    }
+
+    if(testListSortLarge(list, eRB_SORT_ASCEND, 1) || testListSortLarge(list, eRB_SORT_DESCEND, 1)
+            || testListSortLarge(list, eRB_SORT_ASCEND, 4) || testListSortLarge(list, eRB_SORT_DESCEND, 0)){
+        return -1;
+    }
+
+    if(testListInsertRemove(list)){
+        return -1;
+    }
+
+    if(testListIterate(list)){
+        return -1;
+    }
+
+    if(testListBulk(list)){
+        return -1;
+    }
+
     rc = Rb_List_free(&list);
     if(rc != RB_OK || list){
         RBLE("Rb_List_free failed");
@@ -141,6 +214,559 @@ int testList() {
     return 0;
 }
 
+int testListBulk(Rb_ListHandle list){
+    int32_t rc;
+    int32_t i;
+
+    #define NUM_BULK_ELEMS 1000
+    static ListElement elements[NUM_BULK_ELEMS];
+    static ListElement inserted[5];
+    ListElement range[9];
+
+    memset(elements, 0x00, sizeof(elements));
+    memset(inserted, 0x00, sizeof(inserted));
+
+    for(i=0; i<NUM_BULK_ELEMS; i++){
+        elements[i].testData1 = i;
+    }
+
+    for(i=0; i<5; i++){
+        inserted[i].testData1 = -1 - i;
+    }
+
+    rc = Rb_List_clear(list);
+    if(rc != RB_OK){
+        RBLE("Rb_List_clear failed");
+        return -1;
+    }
+
+    if(Rb_List_addAll(list, elements, NUM_BULK_ELEMS / 2) != RB_OK
+            || Rb_List_addAll(list, elements + NUM_BULK_ELEMS / 2, NUM_BULK_ELEMS / 2) != RB_OK
+            || Rb_List_getSize(list) != NUM_BULK_ELEMS){
+        RBLE("Rb_List_addAll failed");
+        return -1;
+    }
+
+    // Insert in the middle -> [..., 8, 9, -1, -2, -3, -4, -5, 10, 11, ...]
+    if(Rb_List_insertAll(list, 10, inserted, 5) != RB_OK){
+        RBLE("Rb_List_insertAll failed");
+        return -1;
+    }
+
+    if(Rb_List_getRange(list, 8, 9, range) != RB_OK){
+        RBLE("Rb_List_getRange failed");
+        return -1;
+    }
+
+    static const int32_t kEXPECTED_RANGE[] = { 8, 9, -1, -2, -3, -4, -5, 10, 11 };
+    for(i=0; i<9; i++){
+        if(range[i].testData1 != kEXPECTED_RANGE[i]){
+            RBLE("Rb_List_insertAll failed at %d", i);
+            return -1;
+        }
+    }
+
+    if(Rb_List_getRange(list, NUM_BULK_ELEMS, 6, range) == RB_OK){
+        RBLE("Rb_List_getRange out of bounds succeeded");
+        return -1;
+    }
+
+    if(Rb_List_removeRange(list, 10, 5) != RB_OK || Rb_List_removeRange(list, NUM_BULK_ELEMS - 1, 2) == RB_OK){
+        RBLE("Rb_List_removeRange failed");
+        return -1;
+    }
+
+    void* array = NULL;
+    uint32_t count = 0;
+
+    rc = Rb_List_toArray(list, &array, &count);
+    if(rc != RB_OK || count != NUM_BULK_ELEMS || memcmp(array, elements, sizeof(elements))){
+        RBLE("Rb_List_toArray failed");
+        return -1;
+    }
+
+    RB_FREE(&array);
+
+    // Remove the tail, then everything
+    if(Rb_List_removeRange(list, NUM_BULK_ELEMS - 10, 10) != RB_OK || Rb_List_getSize(list) != NUM_BULK_ELEMS - 10
+            || Rb_List_removeRange(list, 0, NUM_BULK_ELEMS - 10) != RB_OK || Rb_List_getSize(list) != 0){
+        RBLE("Rb_List_removeRange failed");
+        return -1;
+    }
+
+    // Nodes are reused after bulk removal
+    if(Rb_List_insertAll(list, 0, elements, 3) != RB_OK || Rb_List_getRange(list, 0, 3, range) != RB_OK
+            || memcmp(range, elements, 3 * sizeof(ListElement))){
+        RBLE("Rb_List_insertAll failed");
+        return -1;
+    }
+
+    Rb_ListHandle copy = Rb_List_fromArray(sizeof(ListElement), NULL, elements, NUM_BULK_ELEMS);
+    if(!copy){
+        RBLE("Rb_List_fromArray failed");
+        return -1;
+    }
+
+    rc = Rb_List_toArray(copy, &array, &count);
+    if(rc != RB_OK || count != NUM_BULK_ELEMS || memcmp(array, elements, sizeof(elements))){
+        RBLE("Rb_List_fromArray failed");
+        return -1;
+    }
+
+    RB_FREE(&array);
+    Rb_List_free(&copy);
+
+    return 0;
+}
+
+int testListConcurrentReads(){
+    int32_t i;
+    ListElement e;
+
+    const int32_t kNUM_ELEMS = 20000;
+
+    Rb_ListConfig config;
+    Rb_List_getDefaultConfig(&config);
+    config.type = eRB_LIST_TYPE_ARRAY;
+    config.locking = eRB_LIST_LOCKING_READ_WRITE;
+
+    Rb_ListHandle list = Rb_List_newWithConfig(sizeof(ListElement), &config);
+    if(!list){
+        RBLE("Rb_List_newWithConfig failed");
+        return -1;
+    }
+
+    pthread_t readers[NUM_READER_THREADS];
+
+    for(i=0; i<NUM_READER_THREADS; i++){
+        pthread_create(&readers[i], NULL, testListReader, list);
+    }
+
+    // Append while the readers verify the elements
+    memset(&e, 0x00, sizeof(ListElement));
+
+    for(i=0; i<kNUM_ELEMS; i++){
+        e.testData1 = i;
+
+        if(Rb_List_add(list, &e) != RB_OK){
+            RBLE("Rb_List_add failed");
+            return -1;
+        }
+    }
+
+    // Negative value tells the readers to stop
+    e.testData1 = -1;
+    Rb_List_add(list, &e);
+
+    int res = 0;
+
+    for(i=0; i<NUM_READER_THREADS; i++){
+        void* vrc = NULL;
+
+        pthread_join(readers[i], &vrc);
+
+        if(vrc != NULL){
+            res = -1;
+        }
+    }
+
+    Rb_List_free(&list);
+
+    return res;
+}
+
+int testListSorted(){
+    int32_t rc;
+    int32_t i;
+    ListElement e;
+
+    const int32_t kNUM_ELEMS = 1000;
+    const int32_t kNUM_KEYS = 100;
+
+    Rb_ListConfig config;
+    Rb_List_getDefaultConfig(&config);
+    config.type = eRB_LIST_TYPE_ARRAY;
+    config.compareFnc = testCompareFnc;
+
+    Rb_ListHandle list = Rb_List_newWithConfig(sizeof(ListElement), &config);
+    if(!list){
+        RBLE("Rb_List_newWithConfig failed");
+        return -1;
+    }
+
+    // Only even keys are added, in scrambled order
+    memset(&e, 0x00, sizeof(ListElement));
+
+    for(i=0; i<kNUM_ELEMS; i++){
+        e.testData1 = ((i * 7919) % kNUM_KEYS) * 2;
+        e.testData2 = (char)(i / kNUM_KEYS);
+
+        rc = Rb_List_add(list, &e);
+        if(rc != RB_OK){
+            RBLE("Rb_List_add failed");
+            return -1;
+        }
+    }
+
+    // Order, and insertion order among equal elements
+    ListElement prev;
+    for(i=0; i<kNUM_ELEMS; i++){
+        if(Rb_List_get(list, i, &e) != RB_OK){
+            RBLE("Rb_List_get failed");
+            return -1;
+        }
+
+        if(i && (e.testData1 < prev.testData1 || (e.testData1 == prev.testData1 && e.testData2 <= prev.testData2))){
+            RBLE("Sorted insert failed at %d", i);
+            return -1;
+        }
+
+        prev = e;
+    }
+
+    for(i=0; i<kNUM_KEYS * 2; i++){
+        e.testData1 = i;
+
+        int32_t index = Rb_List_search(list, &e);
+        int32_t lowerBound = Rb_List_lowerBound(list, &e);
+
+        if(lowerBound != ((i + 1) / 2) * (kNUM_ELEMS / kNUM_KEYS)){
+            RBLE("Rb_List_lowerBound failed for %d: %d", i, lowerBound);
+            return -1;
+        }
+
+        if((i % 2 == 0 && index != lowerBound) || (i % 2 && index >= 0)){
+            RBLE("Rb_List_search failed for %d: %d", i, index);
+            return -1;
+        }
+    }
+
+    // Exact match among the elements comparing equal
+    e.testData1 = 10;
+    e.testData2 = 3;
+    if(Rb_List_indexOf(list, &e) != 5 * (kNUM_ELEMS / kNUM_KEYS) + 3){
+        RBLE("Rb_List_indexOf failed");
+        return -1;
+    }
+
+    // Bulk insertion sorts the same way
+    ListElement* elements = (ListElement*)calloc(kNUM_ELEMS, sizeof(ListElement));
+    ListElement* sorted = (ListElement*)calloc(kNUM_ELEMS, sizeof(ListElement));
+
+    for(i=0; i<kNUM_ELEMS; i++){
+        elements[i].testData1 = ((i * 7919) % kNUM_KEYS) * 2;
+        elements[i].testData2 = (char)(i / kNUM_KEYS);
+    }
+
+    Rb_ListHandle copy = Rb_List_fromArray(sizeof(ListElement), &config, elements, kNUM_ELEMS / 2);
+    if(!copy || Rb_List_addAll(copy, elements + kNUM_ELEMS / 2, kNUM_ELEMS / 2) != RB_OK){
+        RBLE("Rb_List_addAll failed");
+        return -1;
+    }
+
+    if(Rb_List_getRange(list, 0, kNUM_ELEMS, elements) != RB_OK || Rb_List_getRange(copy, 0, kNUM_ELEMS, sorted) != RB_OK
+            || memcmp(elements, sorted, kNUM_ELEMS * sizeof(ListElement))){
+        RBLE("Rb_List_addAll failed to keep the order");
+        return -1;
+    }
+
+    free(elements);
+    free(sorted);
+    Rb_List_free(&copy);
+
+    if(Rb_List_insert(list, 0, &e) == RB_OK || Rb_List_swap(list, 0, 1) == RB_OK
+            || Rb_List_sort(list, testCompareFnc, eRB_SORT_ASCEND) == RB_OK){
+        RBLE("Order breaking operation succeeded");
+        return -1;
+    }
+
+    Rb_List_free(&list);
+
+    // Sorted lists need random access
+    config.type = eRB_LIST_TYPE_LINKED;
+
+    list = Rb_List_newWithConfig(sizeof(ListElement), &config);
+    if(list){
+        RBLE("Rb_List_newWithConfig succeeded with a sorted linked list");
+        return -1;
+    }
+
+    return 0;
+}
+
+void* testListReader(void* arg){
+    Rb_ListHandle list = (Rb_ListHandle)arg;
+    ListElement e;
+    int32_t index = 0;
+
+    while(true){
+        int32_t size = Rb_List_getSize(list);
+
+        if(index >= size){
+            continue;
+        }
+
+        if(Rb_List_get(list, index, &e) != RB_OK){
+            RBLE("Rb_List_get failed");
+            return (void*)-1;
+        }
+
+        if(e.testData1 < 0){
+            break;
+        }
+
+        if(e.testData1 != index){
+            RBLE("Invalid element at %d: %d", index, e.testData1);
+            return (void*)-1;
+        }
+
+        index++;
+    }
+
+    return NULL;
+}
+
+int testListInsertRemove(Rb_ListHandle list){
+    int32_t rc;
+    int32_t i;
+    ListElement e;
+
+    // Build [0, 1, 2, 3, 4] by inserting at the front, the back and in the middle
+    static const int32_t kINSERT_INDICES[] = { 0, 1, 0, 2, 2 };
+    static const int32_t kINSERT_VALUES[] = { 1, 4, 0, 3, 2 };
+
+    for(i=0; i<(int32_t)(sizeof(kINSERT_INDICES) / sizeof(kINSERT_INDICES[0])); i++){
+        memset(&e, 0x00, sizeof(ListElement));
+        e.testData1 = kINSERT_VALUES[i];
+
+        rc = Rb_List_insert(list, kINSERT_INDICES[i], &e);
+        if(rc != RB_OK){
+            RBLE("Rb_List_insert failed");
+            return -1;
+        }
+    }
+
+    rc = Rb_List_insert(list, Rb_List_getSize(list) + 1, &e);
+    if(rc == RB_OK){
+        RBLE("Rb_List_insert out of bounds succeeded");
+        return -1;
+    }
+
+    for(i=0; i<Rb_List_getSize(list); i++){
+        rc = Rb_List_get(list, i, &e);
+        if(rc != RB_OK || e.testData1 != i){
+            RBLE("Rb_List_insert failed");
+            return -1;
+        }
+
+        if(Rb_List_indexOf(list, &e) != i){
+            RBLE("Rb_List_indexOf failed");
+            return -1;
+        }
+    }
+
+    // Remove the middle, the last and the first element -> [1, 3]
+    if(Rb_List_remove(list, 2) != RB_OK || Rb_List_remove(list, 3) != RB_OK || Rb_List_remove(list, 0) != RB_OK){
+        RBLE("Rb_List_remove failed");
+        return -1;
+    }
+
+    if(Rb_List_remove(list, 2) == RB_OK || Rb_List_getSize(list) != 2){
+        RBLE("Rb_List_remove failed");
+        return -1;
+    }
+
+    if(Rb_List_get(list, 0, &e) != RB_OK || e.testData1 != 1 || Rb_List_get(list, 1, &e) != RB_OK || e.testData1 != 3){
+        RBLE("Rb_List_remove failed");
+        return -1;
+    }
+
+    // Appending must still work after removing the tail
+    e.testData1 = 5;
+    if(Rb_List_add(list, &e) != RB_OK || Rb_List_get(list, 2, &e) != RB_OK || e.testData1 != 5){
+        RBLE("Rb_List_add failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int testListSortLarge(Rb_ListHandle list, Rb_SortMode mode, uint32_t numThreads){
+    int32_t rc;
+    int32_t i;
+    ListElement e;
+
+    // Large enough to take the parallel path, with many duplicate keys to verify stability
+    const int32_t kNUM_ELEMS = RB_LIST_PARALLEL_SORT_THRESHOLD + 1000;
+    const int32_t kNUM_KEYS = 97;
+
+    memset(&e, 0x00, sizeof(ListElement));
+
+    for(i=0; i<kNUM_ELEMS; i++){
+        e.testData1 = (i * 7919) % kNUM_KEYS;
+        memcpy(e.testData3, &i, sizeof(i));
+
+        rc = Rb_List_add(list, &e);
+        if(rc != RB_OK){
+            RBLE("Rb_List_add failed");
+            return -1;
+        }
+    }
+
+    rc = Rb_List_sortParallel(list, testCompareFnc, mode, numThreads);
+    if(rc != RB_OK || Rb_List_getSize(list) != kNUM_ELEMS){
+        RBLE("Rb_List_sortParallel failed");
+        return -1;
+    }
+
+    // Consume the list from the back, so the check stays linear for both list types
+    ListElement next;
+    for(i=kNUM_ELEMS-1; i>=0; i--){
+        rc = Rb_List_get(list, i, &e);
+        if(rc != RB_OK || Rb_List_remove(list, i) != RB_OK){
+            RBLE("Rb_List_get failed");
+            return -1;
+        }
+
+        if(i != kNUM_ELEMS-1){
+            int32_t cmp = testCompareFnc(list, &e, &next);
+            int32_t order;
+            int32_t nextOrder;
+
+            memcpy(&order, e.testData3, sizeof(order));
+            memcpy(&nextOrder, next.testData3, sizeof(nextOrder));
+
+            if((mode == eRB_SORT_ASCEND && cmp > 0) || (mode == eRB_SORT_DESCEND && cmp < 0)){
+                RBLE("Rb_List_sortParallel failed: invalid order at %d", i);
+                return -1;
+            }
+
+            if(cmp == 0 && order > nextOrder){
+                RBLE("Rb_List_sortParallel failed: not stable at %d", i);
+                return -1;
+            }
+        }
+
+        next = e;
+    }
+
+    return 0;
+}
+
+int testListIterate(Rb_ListHandle list){
+    int32_t rc;
+    int32_t i;
+    ListElement e;
+    Rb_ListCursor cursor;
+
+    const int32_t kNUM_ELEMS = 100;
+
+    rc = Rb_List_clear(list);
+    if(rc != RB_OK){
+        RBLE("Rb_List_clear failed");
+        return -1;
+    }
+
+    memset(&e, 0x00, sizeof(ListElement));
+
+    for(i=0; i<kNUM_ELEMS; i++){
+        e.testData1 = i;
+
+        rc = Rb_List_add(list, &e);
+        if(rc != RB_OK){
+            RBLE("Rb_List_add failed");
+            return -1;
+        }
+    }
+
+    // Cursor
+    rc = Rb_List_begin(list, &cursor);
+    if(rc != RB_OK){
+        RBLE("Rb_List_begin failed");
+        return -1;
+    }
+
+    for(i=0; (rc = Rb_List_next(&cursor, &e)) == RB_TRUE; i++){
+        if(e.testData1 != i){
+            RBLE("Rb_List_next failed: expected %d got %d", i, e.testData1);
+            return -1;
+        }
+    }
+
+    if(rc != RB_FALSE || i != kNUM_ELEMS){
+        RBLE("Rb_List_next failed");
+        return -1;
+    }
+
+    // Cursor is invalidated by modifications
+    Rb_List_begin(list, &cursor);
+
+    if(Rb_List_remove(list, kNUM_ELEMS - 1) != RB_OK || Rb_List_next(&cursor, &e) >= 0){
+        RBLE("Rb_List_next succeeded after modification");
+        return -1;
+    }
+
+    // For-each with in-place modification
+    int32_t numVisited = 0;
+
+    rc = Rb_List_forEach(list, testDoubleFnc, &numVisited);
+    if(rc != RB_OK || numVisited != kNUM_ELEMS - 1){
+        RBLE("Rb_List_forEach failed");
+        return -1;
+    }
+
+    for(i=0; i<kNUM_ELEMS - 1; i+=10){
+        if(Rb_List_get(list, i, &e) != RB_OK || e.testData1 != i * 2){
+            RBLE("Rb_List_forEach failed");
+            return -1;
+        }
+    }
+
+    // Callback stopping the iteration
+    numVisited = kNUM_ELEMS - 10;
+
+    rc = Rb_List_forEach(list, testDoubleFnc, &numVisited);
+    if(rc != RB_TRUE || numVisited != kNUM_ELEMS){
+        RBLE("Rb_List_forEach failed to stop");
+        return -1;
+    }
+
+    // Find
+    int32_t value = 50 * 2;
+
+    rc = Rb_List_findIf(list, testMatchFnc, &value, &e);
+    if(rc != 50 || e.testData1 != value){
+        RBLE("Rb_List_findIf failed");
+        return -1;
+    }
+
+    value = -1;
+
+    if(Rb_List_findIf(list, testMatchFnc, &value, NULL) >= 0){
+        RBLE("Rb_List_findIf failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+int32_t testDoubleFnc(Rb_ListHandle handle, int32_t index, void* element, void* arg){
+    RB_UNUSED(handle);
+    RB_UNUSED(index);
+
+    int32_t* numVisited = (int32_t*)arg;
+
+    ((ListElement*)element)->testData1 *= 2;
+
+    return ++(*numVisited) == 100 ? RB_TRUE : RB_OK;
+}
+
+int32_t testMatchFnc(Rb_ListHandle handle, const void* element, void* arg){
+    RB_UNUSED(handle);
+
+    return ((const ListElement*)element)->testData1 == *(int32_t*)arg;
+}
 
 int32_t testCompareFnc(Rb_ListHandle handle, void* elem1, void* elem2){
     RB_UNUSED(handle);
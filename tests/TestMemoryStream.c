@@ -0,0 +1,226 @@
+/*******************************************************/
+/*              Includes                               */
+/*******************************************************/
+
+#include <rb/MemoryStream.h>
+#include <rb/Prefs.h>
+#include <rb/Utils.h>
+#include <rb/Log.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/*******************************************************/
+/*              Defines                                */
+/*******************************************************/
+
+#ifdef RB_LOG_TAG
+#undef RB_LOG_TAG
+#endif
+#define RB_LOG_TAG "TestMemoryStream"
+
+#define NUM_TEST_VALUES ( 1024 )
+
+/**
+ * Prefs data spans several serialization chunks.
+ */
+#define NUM_TEST_PREFS ( 4096 )
+#define TEST_BLOB_SIZE ( 100000 )
+
+#define TEST_TRAILER ( 0x7E57DA7A )
+
+/*******************************************************/
+/*              Functions Declarations                 */
+/*******************************************************/
+
+static int testMemoryStreamPrefs(const Rb_IOApi* api);
+
+/*******************************************************/
+/*              Functions Definitions                  */
+/*******************************************************/
+
+int testMemoryStream() {
+    if(!RB_CHECK_VERSION){
+        RBLE("Invalid binary version");
+        return -1;
+    }
+
+    int32_t rc;
+    int32_t i;
+    int32_t value;
+    Rb_IOStream stream;
+
+    rc = Rb_MemoryStream_getApi(&stream.api);
+    if(rc != RB_OK){
+        RBLE("Rb_MemoryStream_getApi failed");
+        return -1;
+    }
+
+    rc = stream.api.open(NULL, eRB_IO_MODE_READ_WRITE, &stream.handle);
+    if(rc != RB_OK){
+        RBLE("open failed");
+        return -1;
+    }
+
+    for(i=0; i<NUM_TEST_VALUES; i++){
+        if(stream.api.write(stream.handle, &i, sizeof(int32_t)) != sizeof(int32_t)){
+            RBLE("write failed");
+            return -1;
+        }
+    }
+
+    if(stream.api.tell(stream.handle) != NUM_TEST_VALUES * sizeof(int32_t)
+            || Rb_MemoryStream_size(stream.handle) != NUM_TEST_VALUES * sizeof(int32_t)){
+        RBLE("tell failed");
+        return -1;
+    }
+
+    // Patch the first value, then read everything back
+    value = -1;
+    if(stream.api.seek(stream.handle, 0) != RB_OK || stream.api.write(stream.handle, &value, sizeof(int32_t)) != sizeof(int32_t)
+            || stream.api.seek(stream.handle, 0) != RB_OK){
+        RBLE("seek failed");
+        return -1;
+    }
+
+    for(i=0; i<NUM_TEST_VALUES; i++){
+        if(stream.api.read(stream.handle, &value, sizeof(int32_t)) != sizeof(int32_t) || value != (i ? i : -1)){
+            RBLE("read failed at %d", i);
+            return -1;
+        }
+    }
+
+    if(stream.api.read(stream.handle, &value, sizeof(int32_t)) != 0){
+        RBLE("read past the end failed");
+        return -1;
+    }
+
+    // Read only stream over the data written, without copying it
+    Rb_IOStream view = stream;
+
+    rc = Rb_MemoryStream_openBuffer(Rb_MemoryStream_data(stream.handle), Rb_MemoryStream_size(stream.handle), &view.handle);
+    if(rc != RB_OK){
+        RBLE("Rb_MemoryStream_openBuffer failed");
+        return -1;
+    }
+
+    if(view.api.seek(view.handle, 4 * sizeof(int32_t)) != RB_OK
+            || view.api.read(view.handle, &value, sizeof(int32_t)) != sizeof(int32_t) || value != 4){
+        RBLE("Buffer read failed");
+        return -1;
+    }
+
+    if(view.api.write(view.handle, &value, sizeof(int32_t)) >= 0){
+        RBLE("Write to a read only stream succeeded");
+        return -1;
+    }
+
+    if(view.api.close(&view.handle) != RB_OK || stream.api.close(&stream.handle) != RB_OK || stream.handle){
+        RBLE("close failed");
+        return -1;
+    }
+
+    if(testMemoryStreamPrefs(&stream.api)){
+        return -1;
+    }
+
+    return 0;
+}
+
+int testMemoryStreamPrefs(const Rb_IOApi* api){
+    int32_t rc;
+    int32_t i;
+    int32_t value;
+    char key[32];
+    char* stringVal = NULL;
+    uint8_t* blob = (uint8_t*)RB_MALLOC(TEST_BLOB_SIZE);
+    const int32_t trailer = TEST_TRAILER;
+
+    for(i=0; i<TEST_BLOB_SIZE; i++){
+        blob[i] = i % 0xFF;
+    }
+
+    Rb_PrefsHandle prefs = Rb_Prefs_new(NULL);
+
+    Rb_Prefs_putInt32(prefs, "int32", 42);
+    Rb_Prefs_putString(prefs, "string", "value");
+    Rb_Prefs_putBlob(prefs, "blob", blob, TEST_BLOB_SIZE);
+
+    for(i=0; i<NUM_TEST_PREFS; i++){
+        snprintf(key, sizeof(key), "key_%d", i);
+        Rb_Prefs_putInt32(prefs, key, i);
+    }
+
+    // Serialize into a caller owned array
+    Rb_ArrayHandle array = Rb_Array_new();
+    Rb_IOStream stream;
+
+    stream.api = *api;
+
+    rc = Rb_MemoryStream_openArray(array, eRB_IO_MODE_WRITE, &stream.handle);
+    if(rc != RB_OK){
+        RBLE("Rb_MemoryStream_openArray failed");
+        return -1;
+    }
+
+    // Followed by other data, which must be left in place by the load
+    rc = Rb_Prefs_save(prefs, &stream);
+    if(rc != RB_OK || stream.api.write(stream.handle, &trailer, sizeof(int32_t)) != sizeof(int32_t)
+            || stream.api.close(&stream.handle) != RB_OK){
+        RBLE("Rb_Prefs_save failed");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    // Load them back from the array
+    rc = Rb_MemoryStream_openBuffer(Rb_Array_data(array), Rb_Array_size(array), &stream.handle);
+    if(rc != RB_OK){
+        RBLE("Rb_MemoryStream_openBuffer failed");
+        return -1;
+    }
+
+    prefs = Rb_Prefs_new(NULL);
+
+    rc = Rb_Prefs_load(prefs, &stream);
+    if(rc != RB_OK){
+        RBLE("Rb_Prefs_load failed");
+        return -1;
+    }
+
+    if(Rb_Prefs_getInt32(prefs, "int32", &value) != RB_OK || value != 42
+            || Rb_Prefs_getString(prefs, "string", &stringVal) != RB_OK || strcmp(stringVal, "value")){
+        RBLE("Invalid values loaded");
+        return -1;
+    }
+
+    RB_FREE(&stringVal);
+
+    if(Rb_Prefs_copyBlob(prefs, "blob", blob, TEST_BLOB_SIZE) != TEST_BLOB_SIZE
+            || blob[TEST_BLOB_SIZE - 1] != (TEST_BLOB_SIZE - 1) % 0xFF){
+        RBLE("Invalid blob loaded");
+        return -1;
+    }
+
+    for(i=0; i<NUM_TEST_PREFS; i++){
+        snprintf(key, sizeof(key), "key_%d", i);
+
+        if(Rb_Prefs_getInt32(prefs, key, &value) != RB_OK || value != i){
+            RBLE("Invalid value loaded");
+            return -1;
+        }
+    }
+
+    // Stream is left right after the preferences
+    if(stream.api.read(stream.handle, &value, sizeof(int32_t)) != sizeof(int32_t) || value != TEST_TRAILER){
+        RBLE("Invalid stream position after load");
+        return -1;
+    }
+
+    stream.api.close(&stream.handle);
+    Rb_Prefs_free(&prefs);
+    Rb_Array_free(&array);
+    RB_FREE(&blob);
+
+    return 0;
+}
@@ -4,6 +4,8 @@
 
 #include <rb/MessageBox.h>
 #include <rb/Log.h>
+#include <rb/Stopwatch.h>
+#include <rb/Utils.h>
 
 /*******************************************************/
 /*              Defines                                */
@@ -16,6 +18,8 @@
 
 #define NUM_MESSAGES ( 32 )
 
+#define SCHEDULE_DELAY_MS ( 100 )
+
 /*******************************************************/
 /*              Typedefs                               */
 /*******************************************************/
@@ -83,6 +87,67 @@ int testMessageBox() {
 		return -1;
 	}
 
+	// Scheduled messages (written in reverse order of delivery)
+	Message msgLate = { 2 };
+	Message msgEarly = { 1 };
+
+	Rb_StopwatchHandle sw = Rb_Stopwatch_new();
+	Rb_Stopwatch_start(sw);
+
+	rc = Rb_MessageBox_writeAfter(mb, &msgLate, 2 * SCHEDULE_DELAY_MS);
+	if(rc != RB_OK){
+		RBLE("Rb_MessageBox_writeAfter failed");
+		return -1;
+	}
+
+	rc = Rb_MessageBox_writeAfter(mb, &msgEarly, SCHEDULE_DELAY_MS);
+	if(rc != RB_OK){
+		RBLE("Rb_MessageBox_writeAfter failed");
+		return -1;
+	}
+
+	// Not visible before the deadline
+	if(Rb_MessageBox_getNumMessages(mb)){
+		RBLE("Rb_MessageBox_getNumMessages failed");
+		return -1;
+	}
+
+	rc = Rb_MessageBox_readTimed(mb, &msgOut, 10);
+	if(rc != RB_TIMEOUT){
+		RBLE("Rb_MessageBox_readTimed failed");
+		return -1;
+	}
+
+	rc = Rb_MessageBox_read(mb, &msgOut);
+	if(rc != RB_OK || msgOut.test != msgEarly.test || Rb_Stopwatch_elapsedMs(sw) < SCHEDULE_DELAY_MS - 1){
+		RBLE("Scheduled read failed");
+		return -1;
+	}
+
+	rc = Rb_MessageBox_read(mb, &msgOut);
+	if(rc != RB_OK || msgOut.test != msgLate.test || Rb_Stopwatch_elapsedMs(sw) < 2 * SCHEDULE_DELAY_MS - 1){
+		RBLE("Scheduled read failed");
+		return -1;
+	}
+
+	Rb_Stopwatch_free(&sw);
+
+	// Deadline which already passed is delivered immediately
+	struct timespec now;
+	Rb_Utils_getOffsetTime(&now, 0);
+
+	rc = Rb_MessageBox_writeAt(mb, &msgIn, &now);
+	if(rc != RB_OK || Rb_MessageBox_getNumMessages(mb) != 1){
+		RBLE("Rb_MessageBox_writeAt failed");
+		return -1;
+	}
+
+	rc = Rb_MessageBox_readTimed(mb, &msgOut, 0);
+	if(rc != RB_OK || memcmp(&msgIn, &msgOut, sizeof(Message))){
+		RBLE("Rb_MessageBox_readTimed failed");
+		return -1;
+	}
+
 	// Destroy message box
 	rc = Rb_MessageBox_free(&mb);
 	if(rc != RB_OK && mb){
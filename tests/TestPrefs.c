@@ -7,6 +7,8 @@
 #include <rb/FileStream.h>
 #include <rb/Utils.h>
 
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 /*******************************************************/
@@ -35,12 +37,66 @@
 
 #define NUM_TEST_VALUES ( 5 )
 
+#define NUM_INDEXED_KEYS ( 20000 )
+
+#define NUM_JOURNAL_COUNTERS ( 8 )
+
+#define NUM_COMPACT_KEYS ( 1000 )
+
+#define NUM_CONCURRENT_READERS ( 4 )
+#define NUM_CONCURRENT_UPDATES ( 200 )
+#define CONCURRENT_SUM ( 1000000 )
+
+#define NUM_TRANSACTION_KEYS ( 1000 )
+
+#define NUM_ASYNC_SAVES ( 20 )
+
+#define LAZY_BLOB_SIZE ( 1024 * 1024 )
+
+#define ARENA_CHUNK_SIZE ( 4096 )
+
+#define NUM_PREFIX_MODULES ( 8 )
+#define NUM_PREFIX_KEYS ( 100 )
+
 #ifdef ANDROID
 #define TEST_FILE_PATH "/data/test_prefs_file.bin"
 #else
 #define TEST_FILE_PATH "test_prefs_file.bin"
 #endif
 
+/*******************************************************/
+/*              Functions Declarations                 */
+/*******************************************************/
+
+static int testPrefsMapped();
+static int testPrefsJournal();
+static int testPrefsJournalCheck(Rb_PrefsHandle prefs, int32_t numCounters, int32_t counterValue);
+static long testPrefsFileSize(const char* filePath);
+static int testPrefsCompact();
+static int testPrefsKeys();
+static int testPrefsConcurrent();
+static void* testPrefsReader(void* arg);
+static int testPrefsTransaction();
+static int testPrefsFailedCommit();
+static void* testPrefsCommitReader(void* arg);
+static int32_t testPrefsNoopSave(Rb_PrefsHandle handle, const Rb_IOStream* stream);
+static int32_t testPrefsNoopLoad(Rb_PrefsHandle handle, const Rb_IOStream* stream);
+static int32_t testPrefsFailingAppend(Rb_PrefsHandle handle, const Rb_IOStream* stream, const char* key);
+static int testPrefsSaveAsync();
+static void testPrefsSaved(Rb_PrefsHandle handle, int32_t rc, void* userData);
+static int testPrefsLazyBlobs();
+static int testPrefsArena();
+static int testPrefsPrefix();
+static int32_t testPrefsCountPrefix(Rb_PrefsHandle prefs, const char* prefix);
+static int32_t testPrefsVisit(Rb_PrefsHandle handle, const char* key, void* userData);
+
+static int32_t gPrefsReadersDone;
+static int32_t gPrefsSaved;
+static int32_t gPrefsAppends;
+static int32_t gPrefsVisited;
+static int32_t gPrefsVisitLimit;
+static char gPrefsLastKey[64];
+
 
 /*******************************************************/
 /*              Functions Definitions                  */
@@ -141,6 +197,45 @@ int testPrefs() {
 
     RB_FREE(&outBlob);
 
+    // Borrowed views and copies into caller buffers, no allocations
+    const char* stringView = NULL;
+    const void* blobView = NULL;
+    uint32_t viewSize = 0;
+    uint32_t generation = 0;
+    uint32_t newGeneration = 0;
+    char stringBuffer[sizeof(STRING_VAL)];
+    uint8_t blobBuffer[BLOB_SIZE];
+
+    if(Rb_Prefs_getGeneration(prefs, &generation) != RB_OK
+            || Rb_Prefs_getStringView(prefs, STRING_KEY, &stringView, &viewSize) != RB_OK
+            || viewSize != strlen(STRING_VAL) || strcmp(stringView, STRING_VAL) != 0
+            || Rb_Prefs_getBlobView(prefs, BLOB_KEY, &blobView, &viewSize) != RB_OK
+            || viewSize != BLOB_SIZE || memcmp(blobView, blob, BLOB_SIZE) != 0){
+        RBLE("Borrowed views failed");
+        return -1;
+    }
+
+    if(Rb_Prefs_copyString(prefs, STRING_KEY, stringBuffer, sizeof(stringBuffer)) != (int32_t)strlen(STRING_VAL)
+            || strcmp(stringBuffer, STRING_VAL) != 0
+            || Rb_Prefs_copyString(prefs, STRING_KEY, stringBuffer, sizeof(stringBuffer) - 1) >= 0
+            || Rb_Prefs_copyBlob(prefs, BLOB_KEY, blobBuffer, sizeof(blobBuffer)) != BLOB_SIZE
+            || memcmp(blobBuffer, blob, BLOB_SIZE) != 0
+            || Rb_Prefs_copyBlob(prefs, BLOB_KEY, blobBuffer, BLOB_SIZE - 1) >= 0
+            || Rb_Prefs_copyBlob(prefs, STRING_KEY, blobBuffer, sizeof(blobBuffer)) >= 0){
+        RBLE("Copy getters failed");
+        return -1;
+    }
+
+    // Reads keep the generation, modifications advance it
+    if(Rb_Prefs_getGeneration(prefs, &newGeneration) != RB_OK || newGeneration != generation
+            || Rb_Prefs_putInt32(prefs, "generation_key", 1) != RB_OK
+            || Rb_Prefs_getGeneration(prefs, &newGeneration) != RB_OK || newGeneration == generation
+            || Rb_Prefs_remove(prefs, "generation_key") != RB_OK
+            || Rb_Prefs_getGeneration(prefs, &generation) != RB_OK || newGeneration == generation){
+        RBLE("Rb_Prefs_getGeneration failed");
+        return -1;
+    }
+
     if(Rb_Prefs_getNumEntries(prefs) != NUM_TEST_VALUES){
         RBLE("Rb_Prefs_getNumEntries failed");
         return -1;
@@ -209,6 +304,58 @@ int testPrefs() {
 
     RB_FREE(&stringVal);
 
+    // Many keys, removing every third one keeps the index and the key order in sync
+    char key[32];
+    for(i=0; i<NUM_INDEXED_KEYS; i++){
+        snprintf(key, sizeof(key), "indexed_%d", i);
+
+        if(Rb_Prefs_putInt32(prefs, key, i) != RB_OK){
+            RBLE("Rb_Prefs_putInt32 failed");
+            return -1;
+        }
+    }
+
+    if(Rb_Prefs_putInt32(prefs, "indexed_0", 0) == RB_OK){
+        RBLE("Duplicate key accepted");
+        return -1;
+    }
+
+    for(i=0; i<NUM_INDEXED_KEYS; i+=3){
+        snprintf(key, sizeof(key), "indexed_%d", i);
+
+        if(Rb_Prefs_remove(prefs, key) != RB_OK || Rb_Prefs_contains(prefs, key)){
+            RBLE("Rb_Prefs_remove failed");
+            return -1;
+        }
+    }
+
+    int32_t index = NUM_TEST_VALUES;
+    for(i=0; i<NUM_INDEXED_KEYS; i++){
+        const char* indexedKey = NULL;
+
+        snprintf(key, sizeof(key), "indexed_%d", i);
+
+        if(i % 3 == 0){
+            continue;
+        }
+
+        if(Rb_Prefs_getInt32(prefs, key, &int32Val) != RB_OK || int32Val != i
+                || Rb_Prefs_getKey(prefs, index++, &indexedKey) != RB_OK || strcmp(indexedKey, key) != 0){
+            RBLE("Indexed lookup failed");
+            return -1;
+        }
+    }
+
+    if(Rb_Prefs_getNumEntries(prefs) != index){
+        RBLE("Rb_Prefs_getNumEntries failed");
+        return -1;
+    }
+
+    if(Rb_Prefs_clear(prefs) != RB_OK || Rb_Prefs_getNumEntries(prefs) != 0 || Rb_Prefs_contains(prefs, INT32_KEY)){
+        RBLE("Rb_Prefs_clear failed");
+        return -1;
+    }
+
     rc = Rb_Prefs_free(&prefs);
     if (rc != RB_OK || prefs) {
         RBLE("Rb_Prefs_free failed");
@@ -217,5 +364,1337 @@ int testPrefs() {
 
     system("rm " TEST_FILE_PATH);
 
+    return testPrefsMapped();
+}
+
+int testPrefsMapped() {
+    int32_t rc;
+    int32_t i;
+    char key[32];
+    uint8_t blob[BLOB_SIZE];
+
+    for(i=0; i<BLOB_SIZE; i++){
+        blob[i] = (i * 7) % 0xFF;
+    }
+
+    Rb_PrefsHandle prefs = Rb_Prefs_new(NULL);
+    if(!prefs){
+        RBLE("Rb_Prefs_new failed");
+        return -1;
+    }
+
+    // Keys added out of order, the file keeps the insertion order and a sorted table
+    for(i=NUM_INDEXED_KEYS / 10 - 1; i>=0; i--){
+        snprintf(key, sizeof(key), "mapped_%d", i);
+
+        if(Rb_Prefs_putInt32(prefs, key, i) != RB_OK){
+            RBLE("Rb_Prefs_putInt32 failed");
+            return -1;
+        }
+    }
+
+    if(Rb_Prefs_putInt64(prefs, INT64_KEY, INT64_VAL) != RB_OK || Rb_Prefs_putFloat(prefs, FLOAT_KEY, FLOAT_VAL) != RB_OK
+            || Rb_Prefs_putString(prefs, STRING_KEY, STRING_VAL) != RB_OK || Rb_Prefs_putBlob(prefs, BLOB_KEY, blob, BLOB_SIZE) != RB_OK){
+        RBLE("Rb_Prefs_put failed");
+        return -1;
+    }
+
+    const int32_t kNUM_ENTRIES = Rb_Prefs_getNumEntries(prefs);
+
+    if(Rb_Prefs_setFormat(prefs, eRB_PREFS_FORMAT_INDEXED) != RB_OK || Rb_Prefs_saveFile(prefs, TEST_FILE_PATH) != RB_OK){
+        RBLE("Indexed Rb_Prefs_saveFile failed");
+        return -1;
+    }
+
+    rc = Rb_Prefs_free(&prefs);
+    if(rc != RB_OK){
+        RBLE("Rb_Prefs_free failed");
+        return -1;
+    }
+
+    // Both mapping and regular loading read the indexed format
+    int32_t pass;
+    for(pass=0; pass<2; pass++){
+        prefs = Rb_Prefs_new(NULL);
+
+        rc = pass == 0 ? Rb_Prefs_mapFile(prefs, TEST_FILE_PATH) : Rb_Prefs_loadFile(prefs, TEST_FILE_PATH);
+        if(rc != RB_OK || Rb_Prefs_getNumEntries(prefs) != kNUM_ENTRIES){
+            RBLE("Loading indexed file failed");
+            return -1;
+        }
+
+        for(i=0; i<NUM_INDEXED_KEYS / 10; i++){
+            const char* indexedKey = NULL;
+            int32_t int32Val;
+
+            snprintf(key, sizeof(key), "mapped_%d", i);
+
+            if(Rb_Prefs_getInt32(prefs, key, &int32Val) != RB_OK || int32Val != i
+                    || Rb_Prefs_getKey(prefs, NUM_INDEXED_KEYS / 10 - 1 - i, &indexedKey) != RB_OK || strcmp(indexedKey, key) != 0){
+                RBLE("Indexed lookup failed");
+                return -1;
+            }
+        }
+
+        int64_t int64Val;
+        float floatVal;
+        const char* stringView = NULL;
+        const void* blobView = NULL;
+        uint32_t blobSize = 0;
+
+        if(Rb_Prefs_getInt64(prefs, INT64_KEY, &int64Val) != RB_OK || int64Val != INT64_VAL
+                || Rb_Prefs_getFloat(prefs, FLOAT_KEY, &floatVal) != RB_OK || floatVal != FLOAT_VAL
+                || Rb_Prefs_getStringView(prefs, STRING_KEY, &stringView, NULL) != RB_OK || strcmp(stringView, STRING_VAL) != 0
+                || Rb_Prefs_getBlobView(prefs, BLOB_KEY, &blobView, &blobSize) != RB_OK || blobSize != BLOB_SIZE
+                || memcmp(blobView, blob, BLOB_SIZE) != 0){
+            RBLE("Indexed getters failed");
+            return -1;
+        }
+
+        if(Rb_Prefs_contains(prefs, "missing") != 0 || Rb_Prefs_contains(prefs, "mapped_0") != 1){
+            RBLE("Rb_Prefs_contains failed");
+            return -1;
+        }
+
+        // Mapped preferences are read-only, clearing them makes them writable again
+        if(pass == 0){
+            if(Rb_Prefs_putInt32(prefs, "new_key", 1) == RB_OK || Rb_Prefs_remove(prefs, "mapped_0") == RB_OK){
+                RBLE("Mapped preferences modified");
+                return -1;
+            }
+
+            if(Rb_Prefs_clear(prefs) != RB_OK || Rb_Prefs_getNumEntries(prefs) != 0 || Rb_Prefs_putInt32(prefs, "new_key", 1) != RB_OK){
+                RBLE("Rb_Prefs_clear failed");
+                return -1;
+            }
+        }
+
+        rc = Rb_Prefs_free(&prefs);
+        if(rc != RB_OK){
+            RBLE("Rb_Prefs_free failed");
+            return -1;
+        }
+    }
+
+    // Value offsets are validated, also when adding the size wraps them around
+    FILE* file = fopen(TEST_FILE_PATH, "r+b");
+    const long fileSize = testPrefsFileSize(TEST_FILE_PATH);
+    uint8_t* data = (uint8_t*)malloc(fileSize);
+
+    if(!file || fread(data, 1, fileSize, file) != (size_t)fileSize){
+        RBLE("Reading indexed file failed");
+        return -1;
+    }
+
+    // Index entry of the blob: key size, type and value size, followed by the value offset
+    const uint32_t blobEntry[] = { strlen(BLOB_KEY), eRB_VAR_TYPE_BLOB, BLOB_SIZE };
+    const uint64_t blobOffset = UINT64_MAX - BLOB_SIZE + 1;
+    long position;
+
+    for(position=0; position + (long)(sizeof(blobEntry) + sizeof(blobOffset)) <= fileSize; position++){
+        if(memcmp(data + position, blobEntry, sizeof(blobEntry)) == 0){
+            break;
+        }
+    }
+
+    free(data);
+
+    fseek(file, position + sizeof(blobEntry), SEEK_SET);
+    fwrite(&blobOffset, 1, sizeof(blobOffset), file);
+    fclose(file);
+
+    const void* blobView = NULL;
+    uint32_t blobSize = 0;
+
+    prefs = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_loadFile(prefs, TEST_FILE_PATH) == RB_OK || Rb_Prefs_mapFile(prefs, TEST_FILE_PATH) != RB_OK
+            || Rb_Prefs_getBlobView(prefs, BLOB_KEY, &blobView, &blobSize) == RB_OK){
+        RBLE("Invalid blob offset accepted");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    // Stream format files can't be mapped
+    prefs = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_putInt32(prefs, INT32_KEY, INT32_VAL) != RB_OK || Rb_Prefs_saveFile(prefs, TEST_FILE_PATH) != RB_OK
+            || Rb_Prefs_mapFile(prefs, TEST_FILE_PATH) == RB_OK){
+        RBLE("Mapping stream format succeeded");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    system("rm " TEST_FILE_PATH);
+
+    return testPrefsJournal();
+}
+
+int testPrefsJournal() {
+    int32_t i;
+    int32_t j;
+    char key[32];
+
+    system("rm -f " TEST_FILE_PATH " " TEST_FILE_PATH ".journal");
+
+    Rb_PrefsHandle prefs = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_openJournal(prefs, TEST_FILE_PATH, 1 << 20) != RB_OK){
+        RBLE("Rb_Prefs_openJournal failed");
+        return -1;
+    }
+
+    // Counters updated a few times, plus a removed entry
+    for(j=0; j<4; j++){
+        for(i=0; i<NUM_JOURNAL_COUNTERS; i++){
+            snprintf(key, sizeof(key), "counter_%d", i);
+
+            if(Rb_Prefs_remove(prefs, key) != RB_OK || Rb_Prefs_putInt32(prefs, key, j) != RB_OK){
+                RBLE("Journaled update failed");
+                return -1;
+            }
+        }
+    }
+
+    if(Rb_Prefs_putString(prefs, STRING_KEY, STRING_VAL) != RB_OK || Rb_Prefs_putInt32(prefs, INT32_KEY, INT32_VAL) != RB_OK
+            || Rb_Prefs_remove(prefs, INT32_KEY) != RB_OK){
+        RBLE("Journaled update failed");
+        return -1;
+    }
+
+    // Nothing was compacted, all of it lives in the journal
+    if(testPrefsFileSize(TEST_FILE_PATH) >= 0 || testPrefsFileSize(TEST_FILE_PATH ".journal") <= 0){
+        RBLE("Unexpected compaction");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    // Replayed on open, compacted once the threshold is exceeded
+    prefs = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_openJournal(prefs, TEST_FILE_PATH, 512) != RB_OK || testPrefsJournalCheck(prefs, NUM_JOURNAL_COUNTERS, 3) != 0){
+        RBLE("Journal replay failed");
+        return -1;
+    }
+
+    for(i=0; i<NUM_JOURNAL_COUNTERS; i++){
+        snprintf(key, sizeof(key), "counter_%d", i);
+
+        if(Rb_Prefs_remove(prefs, key) != RB_OK || Rb_Prefs_putInt32(prefs, key, 4) != RB_OK){
+            RBLE("Journaled update failed");
+            return -1;
+        }
+    }
+
+    if(testPrefsFileSize(TEST_FILE_PATH) <= 0 || testPrefsFileSize(TEST_FILE_PATH ".journal") > 512){
+        RBLE("Compaction failed");
+        return -1;
+    }
+
+    if(Rb_Prefs_closeJournal(prefs) != RB_OK || Rb_Prefs_putInt32(prefs, "not_journaled", 1) != RB_OK){
+        RBLE("Rb_Prefs_closeJournal failed");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    // Torn record at the end of the journal is dropped
+    FILE* journal = fopen(TEST_FILE_PATH ".journal", "ab");
+    fwrite("\x01\x00", 1, 2, journal);
+    fclose(journal);
+
+    prefs = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_openJournal(prefs, TEST_FILE_PATH, 512) != RB_OK || testPrefsJournalCheck(prefs, NUM_JOURNAL_COUNTERS, 4) != 0
+            || Rb_Prefs_contains(prefs, "not_journaled") || testPrefsFileSize(TEST_FILE_PATH ".journal") != 0){
+        RBLE("Damaged journal recovery failed");
+        return -1;
+    }
+
+    // Values replaced in place keep their position after the replay
+    const char* firstKey = NULL;
+    char replacedKey[32];
+    int32_t value;
+
+    Rb_Prefs_getKey(prefs, 0, &firstKey);
+    snprintf(replacedKey, sizeof(replacedKey), "%s", firstKey);
+
+    Rb_PrefsTransactionHandle transaction = Rb_Prefs_beginTransaction(prefs);
+
+    if(Rb_PrefsTransaction_putInt32(transaction, replacedKey, 5) != RB_OK || Rb_PrefsTransaction_commit(&transaction) != RB_OK
+            || testPrefsFileSize(TEST_FILE_PATH ".journal") <= 0){
+        RBLE("Journaled commit failed");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    prefs = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_openJournal(prefs, TEST_FILE_PATH, 512) != RB_OK || Rb_Prefs_getKey(prefs, 0, &firstKey) != RB_OK
+            || strcmp(firstKey, replacedKey) != 0 || Rb_Prefs_getInt32(prefs, replacedKey, &value) != RB_OK || value != 5){
+        RBLE("Replaced value moved by the replay");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    system("rm -f " TEST_FILE_PATH " " TEST_FILE_PATH ".journal");
+
+    return testPrefsCompact();
+}
+
+int testPrefsJournalCheck(Rb_PrefsHandle prefs, int32_t numCounters, int32_t counterValue) {
+    int32_t i;
+    int32_t value;
+    char key[32];
+    const char* stringView = NULL;
+
+    for(i=0; i<numCounters; i++){
+        snprintf(key, sizeof(key), "counter_%d", i);
+
+        if(Rb_Prefs_getInt32(prefs, key, &value) != RB_OK || value != counterValue){
+            return -1;
+        }
+    }
+
+    if(Rb_Prefs_getStringView(prefs, STRING_KEY, &stringView, NULL) != RB_OK || strcmp(stringView, STRING_VAL) != 0
+            || Rb_Prefs_contains(prefs, INT32_KEY) || Rb_Prefs_getNumEntries(prefs) != numCounters + 1){
+        return -1;
+    }
+
     return 0;
 }
+
+long testPrefsFileSize(const char* filePath) {
+    FILE* file = fopen(filePath, "rb");
+    if(!file){
+        return -1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+
+    return size;
+}
+
+int testPrefsCompact() {
+    int32_t i;
+    char key[64];
+    uint8_t blob[BLOB_SIZE];
+    int32_t int32Val;
+    int64_t int64Val;
+    float floatVal;
+    const char* view;
+
+    for(i=0; i<BLOB_SIZE; i++){
+        blob[i] = (i * 3) % 0xFF;
+    }
+
+    Rb_PrefsHandle prefs = Rb_Prefs_new(NULL);
+
+    // Long shared key prefixes and small values of both signs
+    for(i=0; i<NUM_COMPACT_KEYS; i++){
+        snprintf(key, sizeof(key), "com.example.settings.section_%d.value", i);
+
+        if(Rb_Prefs_putInt32(prefs, key, i % 2 ? i : -i) != RB_OK){
+            RBLE("Rb_Prefs_putInt32 failed");
+            return -1;
+        }
+    }
+
+    if(Rb_Prefs_putInt64(prefs, INT64_KEY, -INT64_VAL) != RB_OK || Rb_Prefs_putFloat(prefs, FLOAT_KEY, FLOAT_VAL) != RB_OK
+            || Rb_Prefs_putString(prefs, STRING_KEY, STRING_VAL) != RB_OK || Rb_Prefs_putString(prefs, "", "") != RB_OK
+            || Rb_Prefs_putBlob(prefs, BLOB_KEY, blob, BLOB_SIZE) != RB_OK){
+        RBLE("Rb_Prefs_put failed");
+        return -1;
+    }
+
+    if(Rb_Prefs_saveFile(prefs, TEST_FILE_PATH) != RB_OK){
+        RBLE("Rb_Prefs_saveFile failed");
+        return -1;
+    }
+
+    const long streamSize = testPrefsFileSize(TEST_FILE_PATH);
+
+    if(Rb_Prefs_setFormat(prefs, eRB_PREFS_FORMAT_COMPACT) != RB_OK || Rb_Prefs_saveFile(prefs, TEST_FILE_PATH) != RB_OK){
+        RBLE("Rb_Prefs_saveFile failed");
+        return -1;
+    }
+
+    const long compactSize = testPrefsFileSize(TEST_FILE_PATH);
+
+    if(compactSize <= 0 || compactSize * 2 > streamSize){
+        RBLE("Compact file too large: %ld (stream format %ld)", compactSize, streamSize);
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    // Loading detects the format
+    prefs = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_loadFile(prefs, TEST_FILE_PATH) != RB_OK || Rb_Prefs_getNumEntries(prefs) != NUM_COMPACT_KEYS + 5){
+        RBLE("Rb_Prefs_loadFile failed");
+        return -1;
+    }
+
+    for(i=0; i<NUM_COMPACT_KEYS; i++){
+        snprintf(key, sizeof(key), "com.example.settings.section_%d.value", i);
+
+        if(Rb_Prefs_getInt32(prefs, key, &int32Val) != RB_OK || int32Val != (i % 2 ? i : -i)){
+            RBLE("Rb_Prefs_getInt32 failed");
+            return -1;
+        }
+    }
+
+    if(Rb_Prefs_getInt64(prefs, INT64_KEY, &int64Val) != RB_OK || int64Val != -INT64_VAL
+            || Rb_Prefs_getFloat(prefs, FLOAT_KEY, &floatVal) != RB_OK || floatVal != FLOAT_VAL
+            || Rb_Prefs_getStringView(prefs, STRING_KEY, &view, NULL) != RB_OK || strcmp(view, STRING_VAL) != 0
+            || Rb_Prefs_getStringView(prefs, "", &view, NULL) != RB_OK || strcmp(view, "") != 0
+            || Rb_Prefs_copyBlob(prefs, BLOB_KEY, blob, BLOB_SIZE) != BLOB_SIZE || blob[BLOB_SIZE - 1] != ((BLOB_SIZE - 1) * 3) % 0xFF){
+        RBLE("Invalid values loaded");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    // Damaged files are rejected
+    FILE* file = fopen(TEST_FILE_PATH, "r+b");
+    fseek(file, compactSize / 2, SEEK_SET);
+    fputc(~fgetc(file), file);
+    fclose(file);
+
+    prefs = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_loadFile(prefs, TEST_FILE_PATH) == RB_OK){
+        RBLE("Damaged file loaded");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    system("rm " TEST_FILE_PATH);
+
+    return testPrefsKeys();
+}
+
+int testPrefsKeys() {
+    int32_t i;
+    int32_t int32Val;
+    float floatVal;
+    const char* view;
+
+    Rb_PrefsHandle prefs = Rb_Prefs_new(NULL);
+    Rb_PrefsHandle other = Rb_Prefs_new(NULL);
+
+    // Keys can be resolved before they exist
+    Rb_PrefsKeyHandle intKey = Rb_Prefs_resolveKey(prefs, INT32_KEY);
+    Rb_PrefsKeyHandle stringKey = Rb_Prefs_resolveKey(prefs, STRING_KEY);
+
+    if(intKey == NULL || stringKey == NULL){
+        RBLE("Rb_Prefs_resolveKey failed");
+        return -1;
+    }
+
+    if(Rb_Prefs_getInt32ByKey(prefs, intKey, &int32Val) == RB_OK){
+        RBLE("Rb_Prefs_getInt32ByKey succeeded on a missing key");
+        return -1;
+    }
+
+    if(Rb_Prefs_putInt32ByKey(prefs, intKey, INT32_VAL) != RB_OK || Rb_Prefs_putStringByKey(prefs, stringKey, STRING_VAL) != RB_OK){
+        RBLE("Rb_Prefs_put*ByKey failed");
+        return -1;
+    }
+
+    for(i=0; i<NUM_TEST_VALUES; i++){
+        if(Rb_Prefs_getInt32ByKey(prefs, intKey, &int32Val) != RB_OK || int32Val != INT32_VAL
+                || Rb_Prefs_getStringViewByKey(prefs, stringKey, &view, NULL) != RB_OK || strcmp(view, STRING_VAL) != 0){
+            RBLE("Rb_Prefs_get*ByKey failed");
+            return -1;
+        }
+    }
+
+    // Existing keys aren't added twice, also when known from the handle
+    if(Rb_Prefs_putInt32ByKey(prefs, intKey, 0) == RB_OK || Rb_Prefs_putInt32(prefs, INT32_KEY, 0) == RB_OK
+            || Rb_Prefs_getNumEntries(prefs) != 2){
+        RBLE("Existing key added again");
+        return -1;
+    }
+
+    // Values are shared with the string keyed API, types are checked
+    if(Rb_Prefs_getInt32(prefs, INT32_KEY, &int32Val) != RB_OK || int32Val != INT32_VAL
+            || Rb_Prefs_getFloatByKey(prefs, intKey, &floatVal) == RB_OK){
+        RBLE("Rb_Prefs_get*ByKey type check failed");
+        return -1;
+    }
+
+    // Handles fall back to a lookup once the entry is gone
+    if(Rb_Prefs_remove(prefs, INT32_KEY) != RB_OK || Rb_Prefs_getInt32ByKey(prefs, intKey, &int32Val) == RB_OK){
+        RBLE("Removed entry still found");
+        return -1;
+    }
+
+    if(Rb_Prefs_putFloat(prefs, INT32_KEY, FLOAT_VAL) != RB_OK || Rb_Prefs_getFloatByKey(prefs, intKey, &floatVal) != RB_OK
+            || floatVal != FLOAT_VAL){
+        RBLE("Re-added entry not found");
+        return -1;
+    }
+
+    // Handles are bound to their preferences
+    if(Rb_Prefs_putInt32ByKey(other, intKey, INT32_VAL) == RB_OK || Rb_Prefs_getFloatByKey(other, intKey, &floatVal) == RB_OK){
+        RBLE("Key used with other preferences");
+        return -1;
+    }
+
+    Rb_Prefs_free(&other);
+
+    // Mapped preferences
+    if(Rb_Prefs_setFormat(prefs, eRB_PREFS_FORMAT_INDEXED) != RB_OK || Rb_Prefs_saveFile(prefs, TEST_FILE_PATH) != RB_OK
+            || Rb_Prefs_mapFile(prefs, TEST_FILE_PATH) != RB_OK){
+        RBLE("Rb_Prefs_mapFile failed");
+        return -1;
+    }
+
+    if(Rb_Prefs_getFloatByKey(prefs, intKey, &floatVal) != RB_OK || floatVal != FLOAT_VAL
+            || Rb_Prefs_getStringViewByKey(prefs, stringKey, &view, NULL) != RB_OK || strcmp(view, STRING_VAL) != 0){
+        RBLE("Rb_Prefs_get*ByKey failed on mapped preferences");
+        return -1;
+    }
+
+    // Keys outlive the preferences
+    Rb_Prefs_free(&prefs);
+
+    if(Rb_Prefs_releaseKey(&intKey) != RB_OK || Rb_Prefs_releaseKey(&stringKey) != RB_OK || intKey != NULL){
+        RBLE("Rb_Prefs_releaseKey failed");
+        return -1;
+    }
+
+    system("rm " TEST_FILE_PATH);
+
+    return testPrefsConcurrent();
+}
+
+int testPrefsConcurrent() {
+    int32_t i;
+    int32_t rc = 0;
+    pthread_t threads[NUM_CONCURRENT_READERS];
+
+    Rb_PrefsConfig config;
+    Rb_Prefs_getDefaultConfig(&config);
+    config.concurrency = eRB_PREFS_CONCURRENCY_SNAPSHOT;
+
+    Rb_PrefsHandle prefs = Rb_Prefs_newWithConfig(&config);
+    if(!prefs){
+        RBLE("Rb_Prefs_newWithConfig failed");
+        return -1;
+    }
+
+    if(Rb_Prefs_putInt32(prefs, "first", 0) != RB_OK || Rb_Prefs_putInt32(prefs, "second", CONCURRENT_SUM) != RB_OK
+            || Rb_Prefs_putString(prefs, STRING_KEY, STRING_VAL) != RB_OK){
+        RBLE("Rb_Prefs_putInt32 failed");
+        return -1;
+    }
+
+    // Views can't be handed out
+    const char* view;
+    if(Rb_Prefs_getStringView(prefs, STRING_KEY, &view, NULL) == RB_OK){
+        RBLE("Rb_Prefs_getStringView succeeded in concurrent mode");
+        return -1;
+    }
+
+    gPrefsReadersDone = 0;
+
+    for(i=0; i<NUM_CONCURRENT_READERS; i++){
+        pthread_create(&threads[i], NULL, testPrefsReader, prefs);
+    }
+
+    // Both values change within one update, readers must never see only one of them changed
+    for(i=1; i<=NUM_CONCURRENT_UPDATES; i++){
+        if(Rb_Prefs_beginUpdate(prefs) != RB_OK || Rb_Prefs_remove(prefs, "first") != RB_OK
+                || Rb_Prefs_remove(prefs, "second") != RB_OK || Rb_Prefs_putInt32(prefs, "first", i) != RB_OK
+                || Rb_Prefs_putInt32(prefs, "second", CONCURRENT_SUM - i) != RB_OK || Rb_Prefs_endUpdate(prefs) != RB_OK){
+            RBLE("Update failed");
+            rc = -1;
+            break;
+        }
+    }
+
+    __atomic_store_n(&gPrefsReadersDone, 1, __ATOMIC_SEQ_CST);
+
+    for(i=0; i<NUM_CONCURRENT_READERS; i++){
+        void* vrc;
+
+        pthread_join(threads[i], &vrc);
+
+        if(vrc != NULL){
+            RBLE("Reader failed");
+            rc = -1;
+        }
+    }
+
+    int32_t value;
+
+    if(Rb_Prefs_getInt32(prefs, "first", &value) != RB_OK || value != NUM_CONCURRENT_UPDATES
+            || Rb_Prefs_getNumEntries(prefs) != 3){
+        RBLE("Invalid final state");
+        rc = -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    if(rc != 0){
+        return rc;
+    }
+
+    return testPrefsTransaction();
+}
+
+void* testPrefsReader(void* arg) {
+    Rb_PrefsHandle prefs = (Rb_PrefsHandle)arg;
+    char buffer[32];
+    int32_t first;
+    int32_t second;
+    int32_t last = 0;
+
+    while(!__atomic_load_n(&gPrefsReadersDone, __ATOMIC_SEQ_CST)){
+        // Each getter sees a published snapshot, which one may change between calls
+        uint32_t before;
+        uint32_t after;
+
+        Rb_Prefs_getGeneration(prefs, &before);
+
+        if(Rb_Prefs_getInt32(prefs, "first", &first) != RB_OK || Rb_Prefs_getInt32(prefs, "second", &second) != RB_OK){
+            return (void*)-1;
+        }
+
+        Rb_Prefs_getGeneration(prefs, &after);
+
+        if((before == after && first + second != CONCURRENT_SUM) || first < last){
+            return (void*)-1;
+        }
+
+        last = first;
+
+        if(Rb_Prefs_copyString(prefs, STRING_KEY, buffer, sizeof(buffer)) < 0 || strcmp(buffer, STRING_VAL) != 0){
+            return (void*)-1;
+        }
+    }
+
+    return NULL;
+}
+
+int testPrefsTransaction() {
+    int32_t i;
+    char key[64];
+    int32_t int32Val;
+    uint32_t generation;
+    uint32_t committedGeneration;
+
+    system("rm -f " TEST_FILE_PATH);
+
+    Rb_PrefsHandle prefs = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_openJournal(prefs, TEST_FILE_PATH, 0) != RB_OK){
+        RBLE("Rb_Prefs_openJournal failed");
+        return -1;
+    }
+
+    if(Rb_Prefs_putInt32(prefs, INT32_KEY, 0) != RB_OK || Rb_Prefs_putString(prefs, STRING_KEY, STRING_VAL) != RB_OK){
+        RBLE("Rb_Prefs_put failed");
+        return -1;
+    }
+
+    Rb_Prefs_getGeneration(prefs, &generation);
+
+    Rb_PrefsTransactionHandle transaction = Rb_Prefs_beginTransaction(prefs);
+    if(!transaction){
+        RBLE("Rb_Prefs_beginTransaction failed");
+        return -1;
+    }
+
+    for(i=0; i<NUM_TRANSACTION_KEYS; i++){
+        snprintf(key, sizeof(key), "transaction_%d", i);
+
+        if(Rb_PrefsTransaction_putInt32(transaction, key, i) != RB_OK){
+            RBLE("Rb_PrefsTransaction_putInt32 failed");
+            return -1;
+        }
+    }
+
+    // Existing values are replaced, and a key can be staged more than once
+    if(Rb_PrefsTransaction_putInt32(transaction, INT32_KEY, INT32_VAL) != RB_OK
+            || Rb_PrefsTransaction_remove(transaction, STRING_KEY) != RB_OK
+            || Rb_PrefsTransaction_putString(transaction, FLOAT_KEY, STRING_VAL) != RB_OK
+            || Rb_PrefsTransaction_putFloat(transaction, FLOAT_KEY, FLOAT_VAL) != RB_OK
+            || Rb_PrefsTransaction_remove(transaction, "missing") != RB_OK){
+        RBLE("Rb_PrefsTransaction staging failed");
+        return -1;
+    }
+
+    // Nothing is visible before the commit
+    Rb_Prefs_getGeneration(prefs, &committedGeneration);
+
+    if(committedGeneration != generation || Rb_Prefs_getNumEntries(prefs) != 2 || Rb_Prefs_contains(prefs, "transaction_0")){
+        RBLE("Staged changes visible");
+        return -1;
+    }
+
+    if(Rb_PrefsTransaction_commit(&transaction) != RB_OK || transaction != NULL){
+        RBLE("Rb_PrefsTransaction_commit failed");
+        return -1;
+    }
+
+    // One generation for the whole commit
+    Rb_Prefs_getGeneration(prefs, &committedGeneration);
+
+    if(committedGeneration != generation + 1 || Rb_Prefs_getNumEntries(prefs) != NUM_TRANSACTION_KEYS + 2){
+        RBLE("Invalid state after commit");
+        return -1;
+    }
+
+    // Aborted changes are dropped
+    transaction = Rb_Prefs_beginTransaction(prefs);
+
+    if(Rb_PrefsTransaction_putInt32(transaction, "aborted", 0) != RB_OK || Rb_PrefsTransaction_remove(transaction, INT32_KEY) != RB_OK
+            || Rb_PrefsTransaction_abort(&transaction) != RB_OK || transaction != NULL
+            || Rb_Prefs_contains(prefs, "aborted") || !Rb_Prefs_contains(prefs, INT32_KEY)){
+        RBLE("Rb_PrefsTransaction_abort failed");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    // Committed changes were journaled
+    prefs = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_openJournal(prefs, TEST_FILE_PATH, 0) != RB_OK){
+        RBLE("Rb_Prefs_openJournal failed");
+        return -1;
+    }
+
+    for(i=0; i<NUM_TRANSACTION_KEYS; i++){
+        snprintf(key, sizeof(key), "transaction_%d", i);
+
+        if(Rb_Prefs_getInt32(prefs, key, &int32Val) != RB_OK || int32Val != i){
+            RBLE("Journaled value invalid");
+            return -1;
+        }
+    }
+
+    float floatVal;
+
+    if(Rb_Prefs_getInt32(prefs, INT32_KEY, &int32Val) != RB_OK || int32Val != INT32_VAL
+            || Rb_Prefs_getFloat(prefs, FLOAT_KEY, &floatVal) != RB_OK || floatVal != FLOAT_VAL
+            || Rb_Prefs_contains(prefs, STRING_KEY) || Rb_Prefs_getNumEntries(prefs) != NUM_TRANSACTION_KEYS + 2){
+        RBLE("Journaled state invalid");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    // Concurrent preferences publish the commit as one snapshot
+    Rb_PrefsConfig config;
+    Rb_Prefs_getDefaultConfig(&config);
+    config.concurrency = eRB_PREFS_CONCURRENCY_SNAPSHOT;
+
+    prefs = Rb_Prefs_newWithConfig(&config);
+    transaction = Rb_Prefs_beginTransaction(prefs);
+
+    if(Rb_PrefsTransaction_putString(transaction, STRING_KEY, STRING_VAL) != RB_OK
+            || Rb_PrefsTransaction_commit(&transaction) != RB_OK){
+        RBLE("Rb_PrefsTransaction_commit failed");
+        return -1;
+    }
+
+    char buffer[32];
+
+    if(Rb_Prefs_copyString(prefs, STRING_KEY, buffer, sizeof(buffer)) < 0 || strcmp(buffer, STRING_VAL) != 0){
+        RBLE("Committed value not published");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    system("rm " TEST_FILE_PATH);
+
+    return testPrefsFailedCommit();
+}
+
+int testPrefsFailedCommit() {
+    int32_t i;
+    int32_t rc = 0;
+    char key[64];
+    uint32_t generation;
+    uint32_t committedGeneration;
+    pthread_t thread;
+
+    system("rm -f " TEST_FILE_PATH " " TEST_FILE_PATH ".journal");
+
+    // Journal records can't be written past half of the transaction
+    Rb_PrefsBackend backend;
+    memset(&backend, 0x00, sizeof(Rb_PrefsBackend));
+    backend.save = testPrefsNoopSave;
+    backend.load = testPrefsNoopLoad;
+    backend.append = testPrefsFailingAppend;
+    backend.replay = testPrefsNoopLoad;
+
+    Rb_PrefsConfig config;
+    Rb_Prefs_getDefaultConfig(&config);
+    config.backend = &backend;
+    config.concurrency = eRB_PREFS_CONCURRENCY_SNAPSHOT;
+
+    Rb_PrefsHandle prefs = Rb_Prefs_newWithConfig(&config);
+
+    if(!prefs || Rb_Prefs_openJournal(prefs, TEST_FILE_PATH, 1 << 20) != RB_OK){
+        RBLE("Rb_Prefs_openJournal failed");
+        return -1;
+    }
+
+    Rb_PrefsTransactionHandle transaction = Rb_Prefs_beginTransaction(prefs);
+
+    for(i=0; i<NUM_TRANSACTION_KEYS; i++){
+        snprintf(key, sizeof(key), "failed_%d", i);
+
+        if(Rb_PrefsTransaction_putInt32(transaction, key, i) != RB_OK){
+            RBLE("Rb_PrefsTransaction_putInt32 failed");
+            return -1;
+        }
+    }
+
+    Rb_Prefs_getGeneration(prefs, &generation);
+
+    gPrefsAppends = 0;
+    gPrefsReadersDone = 0;
+
+    pthread_create(&thread, NULL, testPrefsCommitReader, prefs);
+
+    if(Rb_PrefsTransaction_commit(&transaction) == RB_OK){
+        RBLE("Rb_PrefsTransaction_commit succeeded");
+        rc = -1;
+    }
+
+    __atomic_store_n(&gPrefsReadersDone, 1, __ATOMIC_SEQ_CST);
+
+    void* vrc;
+    pthread_join(thread, &vrc);
+
+    if(vrc != NULL){
+        RBLE("Partial commit visible");
+        rc = -1;
+    }
+
+    // Changes are applied as a whole, only journaling them failed
+    Rb_Prefs_getGeneration(prefs, &committedGeneration);
+
+    if(rc == 0 && (committedGeneration != generation + 1 || Rb_Prefs_getNumEntries(prefs) != NUM_TRANSACTION_KEYS)){
+        RBLE("Commit not applied as a whole");
+        rc = -1;
+    }
+
+    // Records of the failed commit were cut off, later ones don't follow a torn record
+    gPrefsAppends = 0;
+
+    if(rc == 0 && (Rb_Prefs_putInt32(prefs, "after_failure", 1) != RB_OK
+            || testPrefsFileSize(TEST_FILE_PATH ".journal") != (long)sizeof("after_failure"))){
+        RBLE("Torn journal record kept");
+        rc = -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    system("rm -f " TEST_FILE_PATH " " TEST_FILE_PATH ".journal");
+
+    if(rc != 0){
+        return rc;
+    }
+
+    return testPrefsSaveAsync();
+}
+
+void* testPrefsCommitReader(void* arg) {
+    Rb_PrefsHandle prefs = (Rb_PrefsHandle)arg;
+
+    while(!__atomic_load_n(&gPrefsReadersDone, __ATOMIC_SEQ_CST)){
+        int32_t numEntries = Rb_Prefs_getNumEntries(prefs);
+
+        if(numEntries != 0 && numEntries != NUM_TRANSACTION_KEYS){
+            return (void*)-1;
+        }
+    }
+
+    return NULL;
+}
+
+int32_t testPrefsNoopSave(Rb_PrefsHandle handle, const Rb_IOStream* stream) {
+    RB_UNUSED(handle);
+    RB_UNUSED(stream);
+
+    return RB_OK;
+}
+
+int32_t testPrefsNoopLoad(Rb_PrefsHandle handle, const Rb_IOStream* stream) {
+    RB_UNUSED(handle);
+    RB_UNUSED(stream);
+
+    return RB_OK;
+}
+
+int32_t testPrefsFailingAppend(Rb_PrefsHandle handle, const Rb_IOStream* stream, const char* key) {
+    RB_UNUSED(handle);
+
+    // Failed records are torn, only their first byte is written
+    if(++gPrefsAppends > NUM_TRANSACTION_KEYS / 2){
+        stream->api.write(stream->handle, key, 1);
+        return RB_ERROR;
+    }
+
+    return Rb_IOStream_print(stream, "%s", key);
+}
+
+int testPrefsSaveAsync() {
+    int32_t i;
+    char key[64];
+    int32_t int32Val;
+
+    Rb_PrefsHandle prefs = Rb_Prefs_new(NULL);
+
+    for(i=0; i<NUM_TRANSACTION_KEYS; i++){
+        snprintf(key, sizeof(key), "async_%d", i);
+
+        if(Rb_Prefs_putInt32(prefs, key, i) != RB_OK){
+            RBLE("Rb_Prefs_putInt32 failed");
+            return -1;
+        }
+    }
+
+    gPrefsSaved = 0;
+
+    // Each request sees the entries as they were when it was made, pending ones are merged
+    for(i=0; i<NUM_ASYNC_SAVES; i++){
+        if(Rb_Prefs_remove(prefs, INT32_KEY) != RB_OK || Rb_Prefs_putInt32(prefs, INT32_KEY, i) != RB_OK
+                || Rb_Prefs_saveAsync(prefs, TEST_FILE_PATH, testPrefsSaved, prefs) != RB_OK){
+            RBLE("Rb_Prefs_saveAsync failed");
+            return -1;
+        }
+    }
+
+    // Not part of any request
+    Rb_Prefs_putInt32(prefs, "unsaved", 0);
+
+    if(Rb_Prefs_waitSave(prefs) != RB_OK || __atomic_load_n(&gPrefsSaved, __ATOMIC_SEQ_CST) != NUM_ASYNC_SAVES){
+        RBLE("Rb_Prefs_waitSave failed");
+        return -1;
+    }
+
+    Rb_PrefsHandle loaded = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_loadFile(loaded, TEST_FILE_PATH) != RB_OK || Rb_Prefs_getNumEntries(loaded) != NUM_TRANSACTION_KEYS + 1
+            || Rb_Prefs_getInt32(loaded, INT32_KEY, &int32Val) != RB_OK || int32Val != NUM_ASYNC_SAVES - 1
+            || Rb_Prefs_contains(loaded, "unsaved")){
+        RBLE("Saved state invalid");
+        return -1;
+    }
+
+    // Pending saves are written before the preferences are freed
+    if(Rb_Prefs_saveAsync(prefs, TEST_FILE_PATH, NULL, NULL) != RB_OK){
+        RBLE("Rb_Prefs_saveAsync failed");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    if(Rb_Prefs_loadFile(loaded, TEST_FILE_PATH) != RB_OK || !Rb_Prefs_contains(loaded, "unsaved")){
+        RBLE("Pending save not written");
+        return -1;
+    }
+
+    Rb_Prefs_free(&loaded);
+
+    system("rm " TEST_FILE_PATH);
+
+    return testPrefsLazyBlobs();
+}
+
+void testPrefsSaved(Rb_PrefsHandle handle, int32_t rc, void* userData) {
+    // Waiting from a callback fails instead of deadlocking
+    if(rc == RB_OK && handle == userData && Rb_Prefs_waitSave(handle) != RB_OK){
+        __atomic_add_fetch(&gPrefsSaved, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+int testPrefsLazyBlobs() {
+    uint32_t i;
+    uint8_t* blob = (uint8_t*)malloc(LAZY_BLOB_SIZE);
+    uint8_t range[BLOB_SIZE];
+    uint32_t size;
+    void* data;
+    const void* view;
+    int32_t int32Val;
+    Rb_IOStream stream;
+
+    for(i=0; i<LAZY_BLOB_SIZE; i++){
+        blob[i] = (i * 7) % 0xFF;
+    }
+
+    Rb_PrefsHandle prefs = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_putBlob(prefs, BLOB_KEY, blob, LAZY_BLOB_SIZE) != RB_OK || Rb_Prefs_putBlob(prefs, "small", blob, BLOB_SIZE) != RB_OK
+            || Rb_Prefs_putInt32(prefs, INT32_KEY, INT32_VAL) != RB_OK || Rb_Prefs_saveFile(prefs, TEST_FILE_PATH) != RB_OK){
+        RBLE("Rb_Prefs_saveFile failed");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    Rb_PrefsConfig config;
+    Rb_Prefs_getDefaultConfig(&config);
+    config.lazyBlobSize = BLOB_SIZE * 2;
+
+    prefs = Rb_Prefs_newWithConfig(&config);
+
+    if(Rb_Prefs_loadFile(prefs, TEST_FILE_PATH) != RB_OK || Rb_Prefs_getInt32(prefs, INT32_KEY, &int32Val) != RB_OK
+            || int32Val != INT32_VAL){
+        RBLE("Rb_Prefs_loadFile failed");
+        return -1;
+    }
+
+    // Read from the file on access
+    if(Rb_Prefs_getBlob(prefs, BLOB_KEY, &data, &size) != RB_OK || size != LAZY_BLOB_SIZE || memcmp(data, blob, size) != 0){
+        RBLE("Rb_Prefs_getBlob failed");
+        return -1;
+    }
+
+    free(data);
+
+    // Ranged read
+    if(Rb_Prefs_openBlobStream(prefs, BLOB_KEY, eRB_IO_MODE_READ, &stream) != RB_OK){
+        RBLE("Rb_Prefs_openBlobStream failed");
+        return -1;
+    }
+
+    if(stream.api.seek(stream.handle, LAZY_BLOB_SIZE / 2) != RB_OK
+            || stream.api.read(stream.handle, range, BLOB_SIZE) != BLOB_SIZE
+            || memcmp(range, blob + LAZY_BLOB_SIZE / 2, BLOB_SIZE) != 0
+            || stream.api.tell(stream.handle) != LAZY_BLOB_SIZE / 2 + BLOB_SIZE){
+        RBLE("Blob stream read failed");
+        return -1;
+    }
+
+    // The stream keeps reading the file after the entry is gone, and the file can be rewritten meanwhile
+    if(Rb_Prefs_saveFile(prefs, TEST_FILE_PATH) != RB_OK || Rb_Prefs_remove(prefs, BLOB_KEY) != RB_OK
+            || stream.api.seek(stream.handle, LAZY_BLOB_SIZE - BLOB_SIZE / 2) != RB_OK
+            || stream.api.read(stream.handle, range, BLOB_SIZE) != BLOB_SIZE / 2
+            || memcmp(range, blob + LAZY_BLOB_SIZE - BLOB_SIZE / 2, BLOB_SIZE / 2) != 0
+            || stream.api.close(&stream.handle) != RB_OK){
+        RBLE("Blob stream read failed");
+        return -1;
+    }
+
+    // Written in parts, stored on close
+    if(Rb_Prefs_openBlobStream(prefs, BLOB_KEY, eRB_IO_MODE_WRITE, &stream) != RB_OK){
+        RBLE("Rb_Prefs_openBlobStream failed");
+        return -1;
+    }
+
+    for(i=0; i<LAZY_BLOB_SIZE; i+=LAZY_BLOB_SIZE / 4){
+        if(stream.api.write(stream.handle, blob + i, LAZY_BLOB_SIZE / 4) != LAZY_BLOB_SIZE / 4){
+            RBLE("Blob stream write failed");
+            return -1;
+        }
+    }
+
+    if(Rb_Prefs_contains(prefs, BLOB_KEY) || stream.api.close(&stream.handle) != RB_OK
+            || Rb_Prefs_getBlobView(prefs, BLOB_KEY, &view, &size) != RB_OK || size != LAZY_BLOB_SIZE
+            || memcmp(view, blob, size) != 0){
+        RBLE("Blob stream write failed");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    // The rewritten file has every value
+    prefs = Rb_Prefs_newWithConfig(&config);
+
+    if(Rb_Prefs_loadFile(prefs, TEST_FILE_PATH) != RB_OK || Rb_Prefs_getBlobView(prefs, BLOB_KEY, &view, &size) != RB_OK
+            || size != LAZY_BLOB_SIZE || memcmp(view, blob, size) != 0
+            || Rb_Prefs_copyBlob(prefs, "small", range, sizeof(range)) != BLOB_SIZE || memcmp(range, blob, BLOB_SIZE) != 0){
+        RBLE("Saved blobs invalid");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    // Not available in concurrent mode
+    config.concurrency = eRB_PREFS_CONCURRENCY_SNAPSHOT;
+
+    if(Rb_Prefs_newWithConfig(&config) != NULL){
+        RBLE("Lazy blobs allowed in concurrent mode");
+        return -1;
+    }
+
+    free(blob);
+
+    system("rm " TEST_FILE_PATH);
+
+    return testPrefsArena();
+}
+
+int testPrefsArena() {
+    int32_t i;
+    char key[64];
+    char value[64];
+    char buffer[64];
+    uint8_t blob[BLOB_SIZE];
+    int32_t int32Val;
+    Rb_IOStream stream;
+
+    for(i=0; i<BLOB_SIZE; i++){
+        blob[i] = (i * 5) % 0xFF;
+    }
+
+    Rb_PrefsConfig config;
+    Rb_Prefs_getDefaultConfig(&config);
+    config.arenaChunkSize = ARENA_CHUNK_SIZE;
+
+    Rb_PrefsHandle prefs = Rb_Prefs_newWithConfig(&config);
+    if(!prefs){
+        RBLE("Rb_Prefs_newWithConfig failed");
+        return -1;
+    }
+
+    for(i=0; i<NUM_COMPACT_KEYS; i++){
+        snprintf(key, sizeof(key), "arena_%d", i);
+        snprintf(value, sizeof(value), "value_%d", i);
+
+        if(Rb_Prefs_putString(prefs, key, value) != RB_OK){
+            RBLE("Rb_Prefs_putString failed");
+            return -1;
+        }
+    }
+
+    // Values larger than a chunk, replaced values
+    uint8_t* largeBlob = (uint8_t*)calloc(1, ARENA_CHUNK_SIZE * 2);
+
+    if(Rb_Prefs_putBlob(prefs, BLOB_KEY, largeBlob, ARENA_CHUNK_SIZE * 2) != RB_OK || Rb_Prefs_remove(prefs, "arena_0") != RB_OK
+            || Rb_Prefs_putInt32(prefs, "arena_0", INT32_VAL) != RB_OK){
+        RBLE("Rb_Prefs_put failed");
+        return -1;
+    }
+
+    free(largeBlob);
+
+    Rb_PrefsTransactionHandle transaction = Rb_Prefs_beginTransaction(prefs);
+
+    if(Rb_PrefsTransaction_putString(transaction, "arena_1", STRING_VAL) != RB_OK
+            || Rb_PrefsTransaction_putBlob(transaction, "transaction_blob", blob, BLOB_SIZE) != RB_OK
+            || Rb_PrefsTransaction_commit(&transaction) != RB_OK){
+        RBLE("Rb_PrefsTransaction_commit failed");
+        return -1;
+    }
+
+    if(Rb_Prefs_openBlobStream(prefs, "stream_blob", eRB_IO_MODE_WRITE, &stream) != RB_OK
+            || stream.api.write(stream.handle, blob, BLOB_SIZE) != BLOB_SIZE || stream.api.close(&stream.handle) != RB_OK){
+        RBLE("Blob stream write failed");
+        return -1;
+    }
+
+    if(Rb_Prefs_saveFile(prefs, TEST_FILE_PATH) != RB_OK){
+        RBLE("Rb_Prefs_saveFile failed");
+        return -1;
+    }
+
+    // Loading clears the arena and reserves the file size
+    for(i=0; i<2; i++){
+        if(Rb_Prefs_loadFile(prefs, TEST_FILE_PATH) != RB_OK || Rb_Prefs_getNumEntries(prefs) != NUM_COMPACT_KEYS + 3){
+            RBLE("Rb_Prefs_loadFile failed");
+            return -1;
+        }
+    }
+
+    for(i=2; i<NUM_COMPACT_KEYS; i++){
+        snprintf(key, sizeof(key), "arena_%d", i);
+        snprintf(value, sizeof(value), "value_%d", i);
+
+        if(Rb_Prefs_copyString(prefs, key, buffer, sizeof(buffer)) < 0 || strcmp(buffer, value) != 0){
+            RBLE("Invalid value");
+            return -1;
+        }
+    }
+
+    if(Rb_Prefs_getInt32(prefs, "arena_0", &int32Val) != RB_OK || int32Val != INT32_VAL
+            || Rb_Prefs_copyString(prefs, "arena_1", buffer, sizeof(buffer)) < 0 || strcmp(buffer, STRING_VAL) != 0
+            || Rb_Prefs_copyBlob(prefs, "transaction_blob", buffer, sizeof(buffer)) != BLOB_SIZE
+            || memcmp(buffer, blob, BLOB_SIZE) != 0
+            || Rb_Prefs_copyBlob(prefs, "stream_blob", buffer, sizeof(buffer)) != BLOB_SIZE
+            || memcmp(buffer, blob, BLOB_SIZE) != 0){
+        RBLE("Invalid value");
+        return -1;
+    }
+
+    if(Rb_Prefs_clear(prefs) != RB_OK || Rb_Prefs_getNumEntries(prefs) != 0 || Rb_Prefs_putString(prefs, STRING_KEY, STRING_VAL) != RB_OK){
+        RBLE("Rb_Prefs_clear failed");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    // Not available in concurrent mode
+    config.concurrency = eRB_PREFS_CONCURRENCY_SNAPSHOT;
+
+    if(Rb_Prefs_newWithConfig(&config) != NULL){
+        RBLE("Arena allowed in concurrent mode");
+        return -1;
+    }
+
+    system("rm " TEST_FILE_PATH);
+
+    return testPrefsPrefix();
+}
+
+int testPrefsPrefix() {
+    int32_t i;
+    int32_t j;
+    char key[64];
+    const char* indexKey;
+
+    system("rm -f " TEST_FILE_PATH " " TEST_FILE_PATH ".journal");
+
+    Rb_PrefsHandle prefs = Rb_Prefs_new(NULL);
+    if(!prefs){
+        RBLE("Rb_Prefs_new failed");
+        return -1;
+    }
+
+    // Modules are interleaved, so the insertion order differs from the key order
+    for(i=0; i<NUM_PREFIX_KEYS; i++){
+        for(j=0; j<NUM_PREFIX_MODULES; j++){
+            snprintf(key, sizeof(key), "mod%d.key%d", j, i);
+
+            if(Rb_Prefs_putInt32(prefs, key, i) != RB_OK){
+                RBLE("Rb_Prefs_putInt32 failed");
+                return -1;
+            }
+        }
+    }
+
+    if(testPrefsCountPrefix(prefs, "mod3.") != NUM_PREFIX_KEYS || testPrefsCountPrefix(prefs, "") != NUM_PREFIX_KEYS * NUM_PREFIX_MODULES
+            || testPrefsCountPrefix(prefs, "mod3.key1") != 11 || testPrefsCountPrefix(prefs, "mod9.") != 0){
+        RBLE("Rb_Prefs_forEachPrefix failed");
+        return -1;
+    }
+
+    // Stopped by the callback
+    gPrefsVisited = 0;
+    gPrefsVisitLimit = 5;
+
+    if(Rb_Prefs_forEachPrefix(prefs, "mod3.", testPrefsVisit, (void*)"mod3.") != RB_TRUE || gPrefsVisited != 5){
+        RBLE("Rb_Prefs_forEachPrefix not stopped");
+        return -1;
+    }
+
+    // Sorted keys are kept in sync once built
+    Rb_PrefsTransactionHandle transaction = Rb_Prefs_beginTransaction(prefs);
+
+    if(Rb_Prefs_putInt32(prefs, "mod3.late", INT32_VAL) != RB_OK || Rb_Prefs_remove(prefs, "mod3.key0") != RB_OK
+            || Rb_PrefsTransaction_putInt32(transaction, "mod3.transaction", INT32_VAL) != RB_OK
+            || Rb_PrefsTransaction_remove(transaction, "mod3.key1") != RB_OK || Rb_PrefsTransaction_commit(&transaction) != RB_OK
+            || testPrefsCountPrefix(prefs, "mod3.") != NUM_PREFIX_KEYS){
+        RBLE("Sorted keys out of sync");
+        return -1;
+    }
+
+    // Removed subtree is journaled (opening the journal reloads the saved entries)
+    if(Rb_Prefs_saveFile(prefs, TEST_FILE_PATH) != RB_OK || Rb_Prefs_openJournal(prefs, TEST_FILE_PATH, 1 << 20) != RB_OK){
+        RBLE("Rb_Prefs_openJournal failed");
+        return -1;
+    }
+
+    if(Rb_Prefs_removePrefix(prefs, "mod3.") != NUM_PREFIX_KEYS || Rb_Prefs_removePrefix(prefs, "mod3.") != 0
+            || Rb_Prefs_contains(prefs, "mod3.late") || testPrefsCountPrefix(prefs, "mod3.") != 0
+            || testPrefsCountPrefix(prefs, "mod4.") != NUM_PREFIX_KEYS
+            || Rb_Prefs_getNumEntries(prefs) != NUM_PREFIX_KEYS * (NUM_PREFIX_MODULES - 1)){
+        RBLE("Rb_Prefs_removePrefix failed");
+        return -1;
+    }
+
+    for(i=0; i<Rb_Prefs_getNumEntries(prefs); i++){
+        if(Rb_Prefs_getKey(prefs, i, &indexKey) != RB_OK || strncmp(indexKey, "mod3.", 5) == 0){
+            RBLE("Removed key listed");
+            return -1;
+        }
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    prefs = Rb_Prefs_new(NULL);
+
+    if(Rb_Prefs_openJournal(prefs, TEST_FILE_PATH, 1 << 20) != RB_OK || testPrefsCountPrefix(prefs, "mod3.") != 0
+            || Rb_Prefs_getNumEntries(prefs) != NUM_PREFIX_KEYS * (NUM_PREFIX_MODULES - 1) || Rb_Prefs_closeJournal(prefs) != RB_OK){
+        RBLE("Journal replay failed");
+        return -1;
+    }
+
+    // Mapped files are queried through their sorted table
+    if(Rb_Prefs_setFormat(prefs, eRB_PREFS_FORMAT_INDEXED) != RB_OK || Rb_Prefs_saveFile(prefs, TEST_FILE_PATH) != RB_OK
+            || Rb_Prefs_mapFile(prefs, TEST_FILE_PATH) != RB_OK){
+        RBLE("Rb_Prefs_mapFile failed");
+        return -1;
+    }
+
+    if(testPrefsCountPrefix(prefs, "mod5.") != NUM_PREFIX_KEYS || testPrefsCountPrefix(prefs, "mod3.") != 0
+            || Rb_Prefs_removePrefix(prefs, "mod5.") >= 0){
+        RBLE("Mapped prefix query failed");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    Rb_PrefsConfig config;
+    Rb_Prefs_getDefaultConfig(&config);
+    config.concurrency = eRB_PREFS_CONCURRENCY_SNAPSHOT;
+
+    prefs = Rb_Prefs_newWithConfig(&config);
+
+    if(Rb_Prefs_loadFile(prefs, TEST_FILE_PATH) != RB_OK || Rb_Prefs_removePrefix(prefs, "mod5.") != NUM_PREFIX_KEYS
+            || testPrefsCountPrefix(prefs, "mod") != NUM_PREFIX_KEYS * (NUM_PREFIX_MODULES - 2)
+            || Rb_Prefs_contains(prefs, "mod5.key7")){
+        RBLE("Concurrent prefix query failed");
+        return -1;
+    }
+
+    Rb_Prefs_free(&prefs);
+
+    system("rm -f " TEST_FILE_PATH " " TEST_FILE_PATH ".journal");
+
+    return 0;
+}
+
+int32_t testPrefsCountPrefix(Rb_PrefsHandle prefs, const char* prefix) {
+    gPrefsVisited = 0;
+    gPrefsVisitLimit = -1;
+
+    if(Rb_Prefs_forEachPrefix(prefs, prefix, testPrefsVisit, (void*)prefix) != RB_OK){
+        return -1;
+    }
+
+    return gPrefsVisited;
+}
+
+int32_t testPrefsVisit(Rb_PrefsHandle handle, const char* key, void* userData) {
+    const char* prefix = (const char*)userData;
+
+    // Keys have to match the prefix and come in ascending order
+    if(!Rb_Prefs_contains(handle, key) || strncmp(key, prefix, strlen(prefix)) != 0
+            || (gPrefsVisited > 0 && strcmp(gPrefsLastKey, key) >= 0)){
+        return RB_ERROR;
+    }
+
+    snprintf(gPrefsLastKey, sizeof(gPrefsLastKey), "%s", key);
+
+    return ++gPrefsVisited == gPrefsVisitLimit ? RB_TRUE : RB_OK;
+}
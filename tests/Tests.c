@@ -45,6 +45,7 @@ DECLARE_TEST(Buffer);
 DECLARE_TEST(CBuffer);
 DECLARE_TEST(Concurrency);
 DECLARE_TEST(Array);
+DECLARE_TEST(MemoryStream);
 DECLARE_TEST(MessageBox);
 DECLARE_TEST(List);
 DECLARE_TEST(Prefs);
@@ -67,6 +68,7 @@ ADD_TEST(Buffer)
 ADD_TEST(CBuffer)
 ADD_TEST(Concurrency)
 ADD_TEST(Array)
+ADD_TEST(MemoryStream)
 ADD_TEST(MessageBox)
 ADD_TEST(List)
 ADD_TEST(Prefs)